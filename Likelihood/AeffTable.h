@@ -0,0 +1,109 @@
+/**
+ * @file AeffTable.h
+ * @brief Table of effective area values shared by the exposure
+ * calculations for a given set of response functions.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_AeffTable_h
+#define Likelihood_AeffTable_h
+
+#include <cstddef>
+#include <vector>
+
+namespace irfInterface {
+   class IAeff;
+}
+
+namespace Likelihood {
+
+class ResponseFunctions;
+
+/**
+ * @class AeffTable
+ *
+ * @brief Effective area values tabulated on a fixed grid of event
+ * type, energy and cos(inclination), for a single epoch and without
+ * the IRF phi dependence.
+ *
+ * The livetime cube integrations (BinnedExposure,
+ * BinnedHealpixExposure, MeanPsf) and the DRM calculation evaluate the
+ * effective area on the same fixed grid of inclination angles, namely
+ * the cos(theta) bins of the livetime cube, for a fixed set of
+ * energies.  fill() computes the values at the nodes of that grid
+ * before the calculation, so that each IRF evaluation is done only
+ * once per set of response functions.  Since the nodes are the exact
+ * points that are requested, the exposures are unchanged.
+ *
+ * fill() is the only method that changes the table, and it does
+ * nothing inside a parallel region, so value() reads the table without
+ * locking.  Points that are not on the grid are evaluated with the IRF
+ * given by the caller, so in threaded loops each thread must pass its
+ * own copy (see ResponseClones).
+ */
+
+class AeffTable {
+
+public:
+
+   AeffTable() : m_time(0) {}
+
+   /// Tabulate the effective areas of all of the event types of
+   /// respFuncs at the given energies and cos(theta) values.  Nodes
+   /// that are already in the table are kept; if the epoch differs
+   /// from that of the table, the table is replaced.  The IRF phi
+   /// dependence is turned off while the values are computed.
+   /// This must be called before any threaded loops that use the
+   /// table, and it does nothing if called inside one.
+   /// @param respFuncs The response functions that own this table
+   /// @param energies True photon energies (MeV)
+   /// @param cosThetas Cosines of the inclinations
+   /// @param time MET (s)
+   void fill(const ResponseFunctions & respFuncs,
+             const std::vector<double> & energies,
+             const std::vector<double> & cosThetas,
+             double time) const;
+
+   /// @return Effective area (cm^2)
+   /// @param aeff The IRF component to evaluate if the point is not
+   ///        a node of the table or aeff uses the phi dependence
+   /// @param evtType Event type of aeff
+   /// @param energy True photon energy (MeV)
+   /// @param cosTheta Cosine of the inclination
+   /// @param phi Azimuthal angle (degrees)
+   /// @param time MET (s)
+   double value(irfInterface::IAeff & aeff, int evtType, double energy,
+                double cosTheta, double phi, double time) const;
+
+   /// Remove all entries.  This must be called if the response
+   /// functions change.
+   void clear();
+
+   /// Number of tabulated values
+   size_t size() const {
+      return m_values.size();
+   }
+
+private:
+
+   mutable double m_time;
+
+   /// The grid nodes, each sorted in ascending order
+   mutable std::vector<int> m_evtTypes;
+   mutable std::vector<double> m_energies;
+   mutable std::vector<double> m_cosThetas;
+
+   /// Values indexed by
+   /// (itype*m_energies.size() + ie)*m_cosThetas.size() + ic
+   mutable std::vector<double> m_values;
+
+   /// @return true if the point is a node of the table, with its value
+   bool find(int evtType, double energy, double cosTheta, double time,
+             double & value) const;
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_AeffTable_h
@@ -41,7 +41,8 @@ namespace Likelihood {
 		   double psfEstimatorFtol = 1e-3,
 		   double psfEstimatorPeakTh = 1e-6,
 		   bool verbose = true,
-		   bool use_single_psf = false)
+		   bool use_single_psf = false,
+		   bool use_psf_stamp = false)
       :m_applyPsfCorrections(applyPsfCorrections),
        m_performConvolution(performConvolution),
        m_resample(resample),
@@ -51,7 +52,8 @@ namespace Likelihood {
        m_psfEstimatorFtol(psfEstimatorFtol),
        m_psfEstimatorPeakTh(psfEstimatorPeakTh),
        m_verbose(verbose),
-       m_use_single_psf(use_single_psf){
+       m_use_single_psf(use_single_psf),
+       m_use_psf_stamp(use_psf_stamp){
     }
 
     /* Copy c'tor */
@@ -65,7 +67,8 @@ namespace Likelihood {
        m_psfEstimatorFtol(other.m_psfEstimatorFtol),
        m_psfEstimatorPeakTh(other.m_psfEstimatorPeakTh),
        m_verbose(other.m_verbose),
-       m_use_single_psf(other.m_use_single_psf){
+       m_use_single_psf(other.m_use_single_psf),
+       m_use_psf_stamp(other.m_use_psf_stamp){
     }
 
     /* D'tor, trivial */
@@ -102,6 +105,9 @@ namespace Likelihood {
     inline void set_use_single_psf(bool val) { m_use_single_psf = val; }
     inline bool use_single_psf() const { return m_use_single_psf; }
 
+    inline void set_use_psf_stamp(bool val) { m_use_psf_stamp = val; }
+    inline bool use_psf_stamp() const { return m_use_psf_stamp; }
+
   private:
     
     friend class BinnedLikeConfig;
@@ -116,6 +122,7 @@ namespace Likelihood {
     double m_psfEstimatorPeakTh; //! Peak threshold on adaptive PSF Integration
     bool m_verbose;              //! Turn on verbose output
     bool m_use_single_psf;       //! Use a single PSF for all sources
+    bool m_use_psf_stamp;        //! Only fill the pixels near point sources, from tabulated PSF profiles
 
   };
     
@@ -137,7 +144,11 @@ namespace Likelihood {
 			   bool& use_edisp,
 			   bool& use_linear_quadrature,
 			   bool& save_all_srcmaps,
-			   bool& use_single_psf);
+			   bool& use_single_psf,
+			   bool& use_psf_stamp,
+			   int& num_threads,
+			   bool& use_incremental_model,
+			   int& drm_grid_order);
 
   public:
 
@@ -156,21 +167,31 @@ namespace Likelihood {
 		     bool use_single_fixed_map = true,
 		     bool use_linear_quadrature = false,
 		     bool save_all_srcmaps = false,
-		     bool use_single_psf = false)
+		     bool use_single_psf = false,
+		     int num_threads = 0,
+		     bool use_incremental_model = false,
+		     int drm_grid_order = -1)
       :m_computePointSources(computePointSources),       
        m_psf_integ_config(applyPsfCorrections,performConvolution,resample,resamp_factor,minbinsz,
 			  integ_type,psfEstimatorFtol,psfEstimatorPeakTh,verbose,use_single_psf),
        m_use_edisp(use_edisp),
        m_use_single_fixed_map(use_single_fixed_map),
        m_use_linear_quadrature(use_linear_quadrature),
-       m_save_all_srcmaps(save_all_srcmaps){
+       m_save_all_srcmaps(save_all_srcmaps),
+       m_num_threads(num_threads),
+       m_use_incremental_model(use_incremental_model),
+       m_drm_grid_order(drm_grid_order){
       get_envars(m_psf_integ_config.m_integ_type,
 		    m_psf_integ_config.m_psfEstimatorFtol,
 		    m_psf_integ_config.m_psfEstimatorPeakTh,
 		    m_use_edisp,
 		    m_use_linear_quadrature,
 		    m_save_all_srcmaps,
-		    m_psf_integ_config.m_use_single_psf);
+		    m_psf_integ_config.m_use_single_psf,
+		    m_psf_integ_config.m_use_psf_stamp,
+		    m_num_threads,
+		    m_use_incremental_model,
+		    m_drm_grid_order);
     }
     
     BinnedLikeConfig(const BinnedLikeConfig& other)
@@ -179,7 +200,10 @@ namespace Likelihood {
        m_use_edisp(other.m_use_edisp),
        m_use_single_fixed_map(other.m_use_single_fixed_map),
        m_use_linear_quadrature(other.m_use_linear_quadrature),
-       m_save_all_srcmaps(other.m_save_all_srcmaps){
+       m_save_all_srcmaps(other.m_save_all_srcmaps),
+       m_num_threads(other.m_num_threads),
+       m_use_incremental_model(other.m_use_incremental_model),
+       m_drm_grid_order(other.m_drm_grid_order){
     }
     
     inline PsfIntegConfig& psf_integ_config() { return m_psf_integ_config; }
@@ -190,12 +214,18 @@ namespace Likelihood {
     inline void set_use_single_fixed_map(bool val) {  m_use_single_fixed_map = val; }
     inline void set_use_linear_quadrature(bool val) {  m_use_linear_quadrature = val; }
     inline void set_save_all_srcmaps(bool val) {  m_save_all_srcmaps = val; }
+    inline void set_num_threads(int val) {  m_num_threads = val; }
+    inline void set_use_incremental_model(bool val) {  m_use_incremental_model = val; }
+    inline void set_drm_grid_order(int val) {  m_drm_grid_order = val; }
    
     inline bool computePointSources() const { return m_computePointSources; } 
     inline bool use_edisp() const { return m_use_edisp; }
     inline bool use_single_fixed_map() const { return m_use_single_fixed_map; }
     inline bool use_linear_quadrature() const { return m_use_linear_quadrature; }
     inline bool save_all_srcmaps() const { return m_save_all_srcmaps; }
+    inline int num_threads() const { return m_num_threads; }
+    inline bool use_incremental_model() const { return m_use_incremental_model; }
+    inline int drm_grid_order() const { return m_drm_grid_order; }
 
   private:
     
@@ -205,6 +235,9 @@ namespace Likelihood {
     bool m_use_single_fixed_map;   //! Use a single model for all fixed components
     bool m_use_linear_quadrature;  //! Use linear quadrature for counts integration
     bool m_save_all_srcmaps;       //! Save the source maps for all sources
+    int m_num_threads;             //! Threads for the likelihood loops, 0 -> original serial loops
+    bool m_use_incremental_model;  //! Update the model map only for sources that changed
+    int m_drm_grid_order;          //! HEALPix order of the DrmGrid for energy dispersion, < 0 -> single Drm
      
   };
 
@@ -12,6 +12,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "Likelihood/ExposureCube.h"
@@ -90,8 +91,24 @@ protected:
 
    std::vector<long> m_naxes;
 
+   /// Livetime efficiency factors for each energy, see
+   /// ExposureCube::livetimeFactors
+   std::vector<std::pair<double, double> > m_livetimeFactors;
+
    void computeMap();
 
+   /// Add the exposure for the pixels in row j of the map.
+   /// @param aeffs Aeff functors for each energy and event type,
+   ///        indexed by k*evtTypes.size() + itype
+   void computeRow(int j, const std::vector<astro::SkyDir> & dirs,
+                   const std::vector<bool> & valid,
+                   const std::vector<Aeff *> & aeffs, size_t ntypes);
+
+   /// Sky directions of the pixels in row j.  Pixels for which the
+   /// projection fails are flagged as not valid.
+   void rowDirs(int j, std::vector<astro::SkyDir> & dirs,
+                std::vector<bool> & valid) const;
+
 };
 
 } // namespace Likelihood
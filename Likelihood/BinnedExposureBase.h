@@ -80,6 +80,14 @@ public:
 
    inline bool allSky() const { return m_allSky; }
 
+   /// Number of threads used to compute the map.  Since the map is
+   /// computed in the constructors, this is set from the numthreads
+   /// parameter, if the application has one and it is > 0, or else
+   /// from ParallelUtils::envThreads(); 0 uses the original serial loop.
+   int numThreads() const {
+      return m_numThreads;
+   }
+
 protected:
 
 // Disable copy constructor and copy assignment operator
@@ -113,8 +121,12 @@ protected:
    bool m_allSky;
    bool m_enforce_boundaries;
 
+   int m_numThreads;
+
    void setCosThetaBounds(const st_app::AppParGroup & pars);
 
+   void setNumThreads(const st_app::AppParGroup & pars);
+
    class Aeff : public ExposureCube::Aeff {
    public:
       Aeff(double energy, int evtType, const Observation & observation,
@@ -34,6 +34,7 @@ namespace Likelihood {
 
    class Drm;
    class Drm_Cache;
+   class DrmGrid;
    class SourceMap;
    class WeightMap;
 
@@ -200,6 +201,19 @@ namespace Likelihood {
      void set_edisp_flag(bool use_edisp) {
        m_config.set_use_edisp(use_edisp);
        m_srcMapCache.set_edisp_flag(use_edisp);
+       m_modelWtsCurrent = false;
+     }
+
+     /* Set flag to update the model map incrementally.
+
+	If set, only the sources whose spectral parameters have changed
+	since the last evaluation are added to the summed model, as the
+	change in their contribution.
+     */
+     void set_use_incremental_model(bool use_incremental) {
+       m_config.set_use_incremental_model(use_incremental);
+       m_modelIsCurrent = false;
+       m_modelWtsCurrent = false;
      }
 
      /// Set flag to use a single map for all the fixed sources
@@ -207,6 +221,28 @@ namespace Likelihood {
        m_config.set_use_single_fixed_map(use_sfm);
      }
 
+     /* Set the number of threads used to evaluate the likelihood.
+
+	0 uses the original serial loops, while any positive value splits
+	the filled pixels into fixed size chunks and merges the partial
+	sums in order.  In that case the results do not depend on the
+	number of threads.  The same number of threads is used to 
+	build the source maps.
+     */
+     void set_num_threads(int num_threads) {
+       m_config.set_num_threads(num_threads);
+       m_srcMapCache.set_num_threads(num_threads);
+     }
+
+     /* Set flag to delay building source maps when sources are added.
+
+	The maps are then built when they are first used, or all at
+	once by loadSourceMaps.
+     */
+     void set_delay_srcmap_build(bool delay) {
+       m_srcMapCache.set_delay_srcmap_build(delay);
+     }
+
      /// Directly set the data in the counts map
      void setCountsMap(const std::vector<float> & counts);
 
@@ -345,11 +381,13 @@ namespace Likelihood {
      /* Insert a SourceMap into this cache */
      void insertSourceMap(const std::string & srcName,
 			  SourceMap& srcMap) {
+       m_modelWtsCurrent = false;
        m_srcMapCache.insertSourceMap(srcName,srcMap);
      }
 
      /* Remove SourceMap into from cache */
      SourceMap* removeSourceMap(const std::string & srcName) {
+       m_modelWtsCurrent = false;
        return m_srcMapCache.removeSourceMap(srcName);
      }
 
@@ -557,6 +595,9 @@ namespace Likelihood {
      
      /// Set the dimensions on a tip image
      static void setImageDimensions(tip::Image * image, long * dims);
+
+     /// Build the DrmGrid, if the configuration asks for one
+     void buildDrmGrid();
  
 
    
@@ -566,6 +607,28 @@ namespace Likelihood {
 
      /// Integrates weights over a pixel to get the counts
      double pixelCounts(double emin, double emax, double y1, double y2, double log_ratio) const;
+
+     /* Sum data * log(model) over the filled pixels in the energy range.
+
+	The filled pixels are split into fixed size chunks, which are
+	summed on m_config.num_threads() threads.  The per-chunk sums
+	are then merged in order.
+      */
+     double logModelSum_chunked(const std::vector<float> & data) const;
+
+     /* Add the pixel terms of the derivatives w.r.t. the free parameters.
+
+	The source maps and spectral derivatives of the free sources are
+	resolved once, and the filled pixels are split into fixed size
+	chunks, which are processed on m_config.num_threads() threads.
+	Each chunk keeps one row of partial sums per parameter, and the
+	rows are merged in order into posDerivs and negDerivs.
+      */
+     void addPixelDerivs_chunked(const std::vector<Source *> & free_srcs,
+				 size_t jentry,
+				 const std::vector<float> & data,
+				 std::vector<Kahan_Accumulator> & posDerivs,
+				 std::vector<Kahan_Accumulator> & negDerivs) const;
     
      void computeFixedCountsSpectrum();
    
@@ -584,6 +647,18 @@ namespace Likelihood {
 		       SourceMap * srcMap=0, 
 		       bool subtract=false,
 		       bool latchParams=false) const;
+
+     /* Bring m_modelWts up to date for the current free source parameters.
+
+	If m_modelWts is current, only the free sources whose parameters
+	differ from the ones latched in their SourceMap are updated, by
+	adding the change in their contributions.  Otherwise, or if one
+	of the changed sources uses energy dispersion, m_modelWts is
+	rebuilt from the fixed weights and all the free sources.
+
+	freeSrcNames : The names of the free sources
+      */
+     void updateModelWts(const std::vector<std::string> & freeSrcNames) const;
      
      
      /* ---------------- Data Members --------------------- */
@@ -607,6 +682,9 @@ namespace Likelihood {
      /// Detector response matrix for energy dispersion.  Null pointer -> no energy dispersion
      Drm * m_drm;
 
+     /// Grid of detector response matrices for the point sources.  Null pointer -> use m_drm
+     DrmGrid * m_drmGrid;
+
      /* ---------------- The current model ------------------------ */
 
      /// The set of source maps, keyed by source name
@@ -619,6 +697,19 @@ namespace Likelihood {
      /// Flag that the model is up to data
      mutable bool m_modelIsCurrent;
 
+     /// The summed model weights for fixed and free sources, only used 
+     /// if m_config.use_incremental_model() is set.
+     mutable std::vector<std::pair<double, double> > m_modelWts;
+
+     /// The spectrum values of the free sources that were used to build m_modelWts
+     mutable std::map<std::string, std::vector<double> > m_modelSpecVals;
+
+     /// Flag that m_modelWts is consistent with the source maps and fixed sources
+     mutable bool m_modelWtsCurrent;
+
+     /// Number of incremental updates since m_modelWts was last rebuilt
+     mutable size_t m_nModelWtsUpdates;
+
 
      /* ---------For keeping track of fixed source -------------- */
 
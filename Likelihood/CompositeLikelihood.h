@@ -20,6 +20,7 @@
 #include "optimizers/Statistic.h"
 
 #include "Likelihood/LogLike.h"
+#include "Likelihood/ParallelUtils.h"
 
 namespace Likelihood {
 
@@ -31,7 +32,8 @@ class CompositeLikelihood : public optimizers::Statistic {
 
 public:
 
-   CompositeLikelihood() : optimizers::Statistic() {}
+   CompositeLikelihood() : optimizers::Statistic(),
+                           m_numThreads(ParallelUtils::envThreads()) {}
 
    virtual ~CompositeLikelihood() throw() {}
 
@@ -48,6 +50,20 @@ public:
 
    double NpredValue(const std::string &, bool /* weighted */) const {return 0;}
 
+   /// Number of threads used to evaluate the components in value()
+   /// and getFreeDerivs().  If > 0, the components are evaluated
+   /// concurrently and their results are combined in component
+   /// order, so they do not depend on the number of threads.  0
+   /// evaluates them one after the other.  The default is
+   /// ParallelUtils::envThreads().
+   void setNumThreads(int numThreads) {
+      m_numThreads = numThreads;
+   }
+
+   int numThreads() const {
+      return m_numThreads;
+   }
+
 protected:
 
    double value(const optimizers::Arg&) const {
@@ -73,6 +89,11 @@ private:
    std::string m_normParName;
    std::string m_commonFuncName;
 
+   int m_numThreads;
+
+   /// The components, in the order of m_components
+   void getComponents(std::vector<LogLike *> & components) const;
+
 };
 
 } // namespace Likelihood
@@ -10,6 +10,8 @@
 #ifndef Likelihood_Convolve_h
 #define Likelihood_Convolve_h
 
+#include <map>
+#include <string>
 #include <vector>
 
 namespace Likelihood {
@@ -18,6 +20,68 @@ class Convolve {
 
 public:
 
+   /// Forward transform of a psf image that has been zero-padded to
+   /// a square array of side npad.  The values are the (re, im) pairs
+   /// of the real-to-complex transform, npad x (npad/2 + 1) of them.
+   class PsfSpectrum {
+   public:
+      PsfSpectrum() : npad(0) {}
+      size_t npad;
+      std::vector<double> values;
+   };
+
+   /// Transformed psf images, keyed by a string that describes the
+   /// psf, the energy and the map geometry.  Entries are not added
+   /// once the cache reaches its size limit.  Access is serialized,
+   /// so a cache may be shared by several threads.
+   class SpectrumCache {
+   public:
+      SpectrumCache(size_t maxBytes=s_defaultMaxBytes)
+         : m_maxBytes(maxBytes), m_bytes(0) {}
+
+      /// @return The cached spectrum, or a null pointer
+      const PsfSpectrum * find(const std::string & key) const;
+
+      /// @return The cached spectrum, or a null pointer if the cache
+      ///         is full.
+      const PsfSpectrum * insert(const std::string & key,
+                                 const PsfSpectrum & spectrum);
+
+      void clear();
+
+      size_t size() const {
+         return m_spectra.size();
+      }
+
+   private:
+      static const size_t s_defaultMaxBytes = 512*1024*1024;
+      size_t m_maxBytes;
+      size_t m_bytes;
+      std::map<std::string, PsfSpectrum> m_spectra;
+   };
+
+   /// @return Side of the square array that a signal of nrows x ncols
+   ///         is padded to for convolve2d.
+   static size_t paddedSize(size_t nrows, size_t ncols);
+
+   /// Compute the transform of a psf image, padded to npad x npad.
+   static void psfSpectrum(const std::vector< std::vector<double> > & psf,
+                           size_t npad, PsfSpectrum & spectrum);
+
+   static void psfSpectrum(const std::vector< std::vector<float> > & psf,
+                           size_t npad, PsfSpectrum & spectrum);
+
+   /// Convolve with a psf that has already been transformed.  The
+   /// spectrum must have been computed for
+   /// paddedSize(signal.size(), signal[0].size()).
+   static std::vector< std::vector<double> > 
+   convolve2d(const std::vector< std::vector<double> > & signal,
+              const PsfSpectrum & psf);
+
+   static std::vector< std::vector<float> > 
+   convolve2d(const std::vector< std::vector<float> > & signal,
+              const PsfSpectrum & psf);
+
    static std::vector<double> 
    convolve(const std::vector<double> & signal,
             const std::vector<double> & psf);
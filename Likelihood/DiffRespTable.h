@@ -0,0 +1,155 @@
+/**
+ * @file DiffRespTable.h
+ * @brief Diffuse responses tabulated on a grid of directions, energies,
+ * inclinations and event types, and interpolated to the events.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_DiffRespTable_h
+#define Likelihood_DiffRespTable_h
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace Likelihood {
+
+class DiffuseSource;
+class Event;
+class ResponseFunctions;
+
+/**
+ * @class DiffRespTable
+ *
+ * @brief Diffuse responses of DiffuseSources at the nodes of a grid in
+ * direction (HEALPix, NESTED, equatorial), log-energy, cosine of the
+ * inclination and event type.
+ *
+ * The diffuse response of an event is an integral of the psf times
+ * the spatial distribution of the source, which varies smoothly with
+ * the event direction, energy and inclination.  Here it is computed
+ * with Event::computeResponseGQ at the nodes around each event and
+ * interpolated: bilinearly on the HEALPix grid and in the cosine of
+ * the inclination, and as a power law in energy.  Nodes are computed
+ * when they are first needed, and can be computed on several threads
+ * at once, provided that each thread uses its own response functions.
+ *
+ * If a table file is given, nodes for the same response functions and
+ * grid are read from it, and save() writes all of the nodes back, so
+ * that later runs with the same source model skip the integrals.  The
+ * sources are identified by name, spatial model parameters, and the
+ * name and contents of their map file.
+ */
+
+class DiffRespTable {
+
+public:
+
+   /// @param respFuncs Response functions used for the integrals
+   /// @param order HEALPix order of the direction grid
+   /// @param emin Lowest energy node (MeV)
+   /// @param emax Highest energy node (MeV)
+   /// @param nee Number of energy nodes, logarithmically spaced
+   /// @param ninc Number of inclination nodes, uniformly spaced in
+   ///        the cosine of the inclination from 0 to 1
+   /// @param tableFile File the nodes are read from and saved to.
+   ///        No file is used if this is empty.
+   DiffRespTable(const ResponseFunctions & respFuncs, int order,
+                 double emin, double emax, size_t nee, size_t ninc,
+                 const std::string & tableFile = "");
+
+   /// The interpolated diffuse response of src for an event.
+   double value(DiffuseSource & src, const Event & event);
+
+   /// The interpolated diffuse response of src for an event, with any
+   /// nodes that are missing computed using respFuncs.  In threaded
+   /// loops, each thread passes its own clone of the response
+   /// functions given to the constructor (see ResponseClones).
+   double value(DiffuseSource & src, const Event & event,
+                const ResponseFunctions & respFuncs);
+
+   /// Write all of the nodes to the table file.
+   void save() const;
+
+   int order() const {
+      return m_order;
+   }
+
+   /// Number of nodes for all sources
+   size_t size() const;
+
+   /// Number of nodes that were read from the table file
+   size_t numRead() const {
+      return m_numRead;
+   }
+
+   /// Number of nodes computed since the table was created
+   size_t numComputed() const {
+      return m_numComputed;
+   }
+
+   /// Approximate memory used by the nodes (bytes)
+   size_t memory_size() const;
+
+private:
+
+   const ResponseFunctions & m_respFuncs;
+   int m_order;
+   double m_emin;
+   double m_emax;
+   size_t m_nee;
+   size_t m_ninc;
+   std::string m_tableFile;
+
+   size_t m_npix;
+   double m_dlogE;
+   double m_dcosInc;
+
+   /// Node values for each source, keyed by node index
+   typedef std::map<size_t, double> NodeMap_t;
+   typedef std::map<std::string, NodeMap_t> SourceMap_t;
+   SourceMap_t m_nodes;
+
+   size_t m_numRead;
+   size_t m_numComputed;
+
+   /// Checksums of the map files, keyed by file name
+   mutable std::map<std::string, std::string> m_checksums;
+
+   /// Index of the node for a pixel, energy, inclination and event type
+   size_t nodeIndex(int pix, size_t ie, size_t iinc, int type) const;
+
+   /// The node value, computing it if needed
+   double nodeValue(DiffuseSource & src, const std::string & srcKey,
+                    int pix, size_t ie, size_t iinc, int type,
+                    const ResponseFunctions & respFuncs);
+
+   /// Compute the diffuse response of src at a node.
+   double computeNode(DiffuseSource & src, int pix, size_t ie,
+                      size_t iinc, int type,
+                      const ResponseFunctions & respFuncs) const;
+
+   /// Read the nodes from the table file, if it matches.
+   void readTable();
+
+   /// Values identifying the response functions and the grid
+   void tableKey(std::vector<double> & values, std::string & names) const;
+
+   /// Name, spatial parameters, and map file and its checksum of a
+   /// source, so that nodes are not reused when any of them change
+   std::string sourceKey(const DiffuseSource & src) const;
+
+   /// Checksum of a map file, computed the first time it is needed
+   const std::string & fileChecksum(const std::string & fitsFile) const;
+
+   /// Disable copy and assignment
+   DiffRespTable(const DiffRespTable &);
+   DiffRespTable & operator=(const DiffRespTable &);
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_DiffRespTable_h
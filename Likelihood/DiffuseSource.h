@@ -28,6 +28,7 @@ namespace Likelihood {
    class Event;
    class MapBase;
    class Observation;
+   class ResponseFunctions;
    class WcsMap2;
    class HealpixProjMap;
 
@@ -194,14 +195,22 @@ namespace Likelihood {
      /// @return the diffuse response for a particular event
      double diffuseResponse(const Event & evt) const;
 
+     /// @return the diffuse response for a particular event, computed
+     /// with the given response functions instead of those of the
+     /// Observation (e.g., per-thread clones).
+     double diffuseResponse(const Event & evt,
+                            const ResponseFunctions & respFuncs) const;
+
    protected:
      
      
      /* Version of diffuse response calculation for WCS maps */
-     double diffuseResponse_wcs(const Event & evt, const WcsMap2& wcsmap) const;
+     double diffuseResponse_wcs(const Event & evt, const WcsMap2& wcsmap,
+                                const ResponseFunctions & respFuncs) const;
      
      /* Version of diffuse response calculation for HEALPix maps */
-     double diffuseResponse_healpix(const Event & evt, const HealpixProjMap& healmap) const;
+     double diffuseResponse_healpix(const Event & evt, const HealpixProjMap& healmap,
+                                    const ResponseFunctions & respFuncs) const;
      
      /* Compute the size of this source */
      double computeMapRadius() const;
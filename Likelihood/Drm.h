@@ -12,6 +12,7 @@
 #define Likelihood_Drm_h
 
 #include <deque>
+#include <utility>
 #include <vector>
 
 #include "astro/SkyDir.h"
@@ -19,6 +20,7 @@
 namespace Likelihood {
 
 class Observation;
+class ResponseFunctions;
 class SourceMap;
 class Source;
 
@@ -29,23 +31,72 @@ public:
    Drm(double ra, double dec, const Observation & observation, 
        const std::vector<double> & ebounds, size_t npts=30);
 
+   /// Build from a matrix that has already been computed, e.g., read
+   /// from a file or interpolated between other matrices.  The matrix
+   /// has ebounds.size() + 1 rows (true energies) of ebounds.size() - 1
+   /// columns (measured energies).
+   Drm(double ra, double dec, const Observation & observation, 
+       const std::vector<double> & ebounds,
+       const std::vector< std::vector<double> > & matrix);
+
    void convolve(const std::vector<double> & true_counts,
                  std::vector<double> & meas_counts) const;
 
+   /// Convolve several true counts spectra with the matrix at once.
+   /// The padded spectra are stacked into a matrix and multiplied by
+   /// the DRM in blocks of spectra, so that each row of the DRM is
+   /// reused across a block.  meas_counts[i] is the convolution of
+   /// true_counts[i], and is the same as from the single spectrum
+   /// version.
+   void convolve(const std::vector<const std::vector<double> *> & true_counts,
+                 const std::vector<std::vector<double> *> & meas_counts) const;
+
    const std::vector<double> & row(size_t k) const {
       return m_drm.at(k);
    }
+
+   const std::vector< std::vector<double> > & matrix() const {
+      return m_drm;
+   }
+
+   const astro::SkyDir & dir() const {
+      return m_dir;
+   }
        
   inline const Observation& observation() const { return m_observation; }
 
   double matrix_element(double etrue, double emeas_min, 
 			double emeas_max) const;
 
+  /// Turn off the phi-dependence of the effective areas, saving the
+  /// previous settings.  Only the flags that are on are changed, so
+  /// this can be called once around several Drm calculations that
+  /// run on different threads.
+  static void disablePhiDependence(const ResponseFunctions & resps,
+                                   std::vector<bool> & phideps);
+
+  /// Restore the settings saved by disablePhiDependence.
+  static void restorePhiDependence(const ResponseFunctions & resps,
+                                   const std::vector<bool> & phideps);
+
 
 protected: 
 
   void compute_livetime();
 
+  /// Matrix element, with the phi-dependence already turned off.
+  double compute_element(double etrue, double emeas_min, 
+                         double emeas_max) const;
+
+  /// Fill m_ebounds, adding one bin at each end.
+  void set_ebounds(const std::vector<double> & ebounds);
+
+  /// Extend a true counts spectrum by one bin at each end, by
+  /// extrapolating in log-log space, to match the true energy bins
+  /// of the matrix.
+  void pad_counts(const std::vector<double> & true_counts,
+                  double * counts) const;
+
 private:
 
    astro::SkyDir m_dir;
@@ -85,6 +136,20 @@ public:
 	      SourceMap & sourceMap,
 	      const std::vector<double>& energies);
 
+  /* Update several caches that use the same DRM.  
+
+     The true counts spectra of all the caches that are out of date 
+     are convolved with the DRM in a single matrix-matrix product,
+     rather than one matrix-vector product per cache. 
+
+     caches and sourceMaps must be the same size, caches[i] is 
+     the cache for sourceMaps[i].
+  */
+  static void update(const Drm* drm,
+		     const std::vector<Drm_Cache*>& caches,
+		     const std::vector<SourceMap*>& sourceMaps,
+		     const std::vector<double>& energies);
+
   inline double get_correction(size_t k, int& kref) const {
     kref = m_kref[k];
     return m_xi[k];   
@@ -111,6 +176,16 @@ public:
   size_t memory_size() const;
 
 private:
+
+  /* Compute the true counts spectra.  
+     Returns false if the spectrum, the npreds and the DRM are the 
+     same as for the last update, in which case nothing needs to be done. */
+  bool update_true_counts(const Drm* drm,
+			  SourceMap & sourceMap,
+			  const std::vector<double>& energies);
+
+  /* Compute the correction factors from the true and measured counts */
+  void update_corrections();
   
   std::vector<double> m_true_counts;
   std::vector<double> m_meas_counts;  
@@ -124,6 +199,13 @@ private:
 
   bool m_use_edisp;
 
+  /* The inputs of the last update, used to skip updates that 
+     would not change anything */
+  const Drm* m_drm;
+  std::vector<double> m_specVals;
+  std::vector<double> m_npreds;
+  std::vector<std::pair<double,double> > m_npred_weights;
+
 };
 
 
@@ -0,0 +1,140 @@
+/**
+ * @file DrmGrid.h
+ * @brief Detector response matrices computed on a HEALPix grid of
+ * directions, and interpolated to the source directions.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_DrmGrid_h
+#define Likelihood_DrmGrid_h
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace astro {
+   class SkyDir;
+}
+
+namespace Likelihood {
+
+class Drm;
+class Observation;
+
+/**
+ * @class DrmGrid
+ *
+ * @brief Drm objects at the centers of the pixels of a HEALPix grid
+ * (NESTED, equatorial) that covers a region of the sky.
+ *
+ * A single Drm uses the livetime as a function of inclination at one
+ * direction, usually the ROI center.  For large ROIs the inclination
+ * distribution, and so the energy dispersion, changes across the
+ * ROI.  Here the matrices are computed at the nodes of a coarse
+ * HEALPix grid, and the matrix for a source is interpolated between
+ * the four nearest nodes.  Nodes that are not in the grid are left
+ * out of the interpolation; if none of the four is in the grid, the
+ * nearest node is used.  Order 3 pixels are about 7 deg across.
+ * Source directions are rounded to the centers of the pixels of a
+ * grid 3 orders finer, so that the number of interpolated matrices
+ * is bounded.
+ *
+ * The nodes are computed on several threads, each with its own clones
+ * of the response functions.  If a cache file is given, matrices for
+ * the same livetime cube contents, response functions and energies
+ * are read from it, and any that had to be computed are written back
+ * to it.
+ */
+
+class DrmGrid {
+
+public:
+
+   /// @param center Center of the region covered by the grid
+   /// @param radius Radius of the region (deg)
+   /// @param order HEALPix order of the grid
+   /// @param observation Provides the livetime cube and the IRFs
+   /// @param ebounds Energy bin boundaries of the counts map (MeV)
+   /// @param cacheFile File the matrices are read from and saved to.
+   ///        No file is used if this is empty.
+   /// @param numThreads Threads used for the matrices,
+   ///        resolved with ParallelUtils::numThreads.
+   DrmGrid(const astro::SkyDir & center, double radius, int order,
+           const Observation & observation,
+           const std::vector<double> & ebounds,
+           const std::string & cacheFile = "",
+           int numThreads = 0);
+
+   ~DrmGrid() throw();
+
+   /// The matrix for a direction, interpolated between the nodes.
+   /// The Drm is owned by the grid, and the same object is returned
+   /// for all directions in the same pixel of the finer grid.
+   const Drm * drm(const astro::SkyDir & dir) const;
+
+   int order() const {
+      return m_order;
+   }
+
+   /// Number of nodes in the grid
+   size_t size() const {
+      return m_nodes.size();
+   }
+
+   /// Number of nodes that were read from the cache file
+   size_t numRead() const {
+      return m_numRead;
+   }
+
+   /// Approximate memory used by the matrices (bytes)
+   size_t memory_size() const;
+
+   /// Name of the cache file for a srcmaps file
+   static std::string cacheFileName(const std::string & srcMapsFile);
+
+private:
+
+   int m_order;
+   const Observation & m_observation;
+   std::vector<double> m_ebounds;
+   std::string m_cacheFile;
+
+   /// Checksum of the livetime cube file, used in the cache key
+   std::string m_cubeChecksum;
+
+   /// The matrices at the nodes, keyed by HEALPix pixel number
+   typedef std::map<int, Drm *> NodeMap_t;
+   NodeMap_t m_nodes;
+
+   size_t m_numRead;
+
+   /// Interpolated matrices, keyed by pixel of the finer grid
+   typedef std::map<int, Drm *> DrmMap_t;
+   mutable DrmMap_t m_drms;
+
+   /// HEALPix order of the grid the directions are rounded to
+   int fineOrder() const;
+
+   /// Read the nodes in pixels from the cache file, if it matches.
+   void readCache(const std::vector<int> & pixels);
+
+   /// Write all of the nodes to the cache file.
+   void writeCache() const;
+
+   /// Values identifying the livetime cube contents, IRFs and energies
+   void cacheKey(std::vector<double> & values, std::string & names) const;
+
+   /// The interpolated matrix for a direction
+   Drm * interpolate(const astro::SkyDir & dir) const;
+
+   /// Disable copy and assignment
+   DrmGrid(const DrmGrid &);
+   DrmGrid & operator=(const DrmGrid &);
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_DrmGrid_h
@@ -0,0 +1,188 @@
+/**
+ * @file EventTable.h
+ * @brief Columnar copy of the event data and the source-by-event
+ * response matrix used by the unbinned log-likelihood.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_EventTable_h
+#define Likelihood_EventTable_h
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Likelihood/EventSourceCache.h"
+
+namespace Likelihood {
+
+   class Event;
+   class Source;
+
+/**
+ * @class EventTable
+ *
+ * @brief Structure-of-arrays store for the unbinned log-likelihood.
+ *
+ * The event energies and efficiencies are copied into contiguous
+ * arrays.  For each source, identified by an integer index in the
+ * order of the source map of the SourceModel, the instrument response
+ * to each event is stored in one row of a dense (source x event)
+ * matrix, so that the flux density of source i for event j is
+ *
+ *    spectrum_i(E_j) * response(i, j)
+ *
+ * The spectra are evaluated at the event energies as they are needed,
+ * using a clone of each spectrum function, so that only the responses
+ * are stored and the summed model can be computed concurrently for
+ * disjoint ranges of events.
+ *
+ * Sources for which the flux density does not factor in this way
+ * (i.e., CompositeSources) are evaluated event-by-event through
+ * Source::fluxDensity.
+ *
+ */
+
+class EventTable {
+
+public:
+
+   EventTable();
+
+   ~EventTable() {}
+
+   /// Copy the event data into the columns.
+   void setEvents(const std::vector<Event> & events);
+
+   /// Compute the response rows for a set of sources.
+   /// @param sources The sources, keyed by name
+   /// @param events The events, these must be the same ones passed to
+   ///        setEvents
+   /// @param respCache Cache of the point source responses, shared with
+   ///        LogLike
+   void setSources(const std::map<std::string, Source *> & sources,
+                   const std::vector<Event> & events,
+                   ResponseCache & respCache);
+
+   /// @return true if the set of sources differs from the one used
+   ///         to build the response matrix
+   bool sourcesChanged(const std::map<std::string, Source *> & sources) const;
+
+   /// Remove all the events and sources.
+   void clear();
+
+   /// Compute the summed model, including the efficiency, for the
+   /// events in [first, last).
+   /// @param events The events, these are needed for the sources that
+   ///        do not factor into a spectrum times a response
+   /// @param respCache Response cache for those sources
+   /// @param modelSums Filled with the summed model for each event,
+   ///        must have at least nEvents() entries
+   void computeModelSums(const std::vector<Event> & events,
+                         ResponseCache & respCache,
+                         size_t first, size_t last,
+                         std::vector<double> & modelSums) const {
+      computeFactoredSums(first, last, modelSums);
+      addUnfactoredSums(events, respCache, first, last, modelSums);
+   }
+
+   /// Compute the summed model from the sources that factor into
+   /// spectrum times response.  This only reads the table and clones
+   /// of the spectra, so it may be called concurrently for disjoint
+   /// event ranges.
+   void computeFactoredSums(size_t first, size_t last,
+                            std::vector<double> & modelSums) const;
+
+   /// Add the contributions of the sources that do not factor into
+   /// spectrum times response.  These go through Source::fluxDensity
+   /// and the response cache, so this is not thread-safe.
+   void addUnfactoredSums(const std::vector<Event> & events,
+                          ResponseCache & respCache,
+                          size_t first, size_t last,
+                          std::vector<double> & modelSums) const;
+
+   /// @return true if there are sources that do not factor into
+   ///         spectrum times response
+   bool hasUnfactoredSources() const;
+
+   /// Add the derivatives of log(modelSum) w.r.t. the free spectral
+   /// parameters for the events in [first, last).  The derivatives
+   /// are ordered as in LogLike::getFreeDerivs.
+   /// @param modelSums The summed model for each event
+   /// @param derivs Must have one entry per free spectral parameter
+   void addLogModelDerivs(const std::vector<Event> & events,
+                          ResponseCache & respCache,
+                          size_t first, size_t last,
+                          const std::vector<double> & modelSums,
+                          std::vector<double> & derivs) const {
+      addFactoredLogModelDerivs(first, last, modelSums, derivs);
+      addUnfactoredLogModelDerivs(events, respCache, first, last,
+                                  modelSums, derivs);
+   }
+
+   /// Derivatives for the sources that factor into spectrum times
+   /// response.  The spectrum derivatives are evaluated with clones of
+   /// the spectra, so this may be called concurrently for disjoint
+   /// event ranges, with a separate derivs vector for each.
+   void addFactoredLogModelDerivs(size_t first, size_t last,
+                                  const std::vector<double> & modelSums,
+                                  std::vector<double> & derivs) const;
+
+   /// Derivatives for the other sources.  This is not thread-safe.
+   void addUnfactoredLogModelDerivs(const std::vector<Event> & events,
+                                    ResponseCache & respCache,
+                                    size_t first, size_t last,
+                                    const std::vector<double> & modelSums,
+                                    std::vector<double> & derivs) const;
+
+   size_t nEvents() const {
+      return m_energies.size();
+   }
+
+   size_t nSources() const {
+      return m_sources.size();
+   }
+
+   /// @return The integer index of a source, or -1 if it is not in the table
+   int sourceId(const std::string & srcName) const;
+
+   const std::vector<double> & energies() const {return m_energies;}
+   const std::vector<double> & efficiencies() const {return m_efficiencies;}
+
+   /// The response row for a source, or a null pointer if that source
+   /// is evaluated event-by-event.
+   const double * responses(size_t isrc) const;
+
+   /// Fill densities[j - first] with the spectrum times the response
+   /// of a source that factors, for the events in [first, last).  A
+   /// clone of the spectrum is evaluated, so this may be called
+   /// concurrently.
+   void computeDensities(size_t isrc, size_t first, size_t last,
+                         double * densities) const;
+
+private:
+
+   /// Event columns
+   std::vector<double> m_energies;
+   std::vector<double> m_efficiencies;
+
+   /// The sources, in the order of the rows
+   std::vector<Source *> m_sources;
+   std::vector<std::string> m_srcNames;
+   std::map<std::string, int> m_srcIds;
+
+   /// Flags for the sources that factor into spectrum times response
+   std::vector<bool> m_factored;
+
+   /// (source x event) matrix of responses
+   std::vector<double> m_responses;
+
+   void computeResponses(size_t isrc, const std::vector<Event> & events,
+                         ResponseCache & respCache);
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_EventTable_h
@@ -10,6 +10,7 @@
 #define Likelihood_ExposureCube_h
 
 #include <stdexcept>
+#include <vector>
 
 #include "facilities/Util.h"
 
@@ -22,6 +23,7 @@
 namespace Likelihood {
 
    class Observation;
+   class ResponseFunctions;
 
 /**
  * @class ExposureCube
@@ -37,7 +39,7 @@ public:
                     m_efficiencyFactor(0),
                     m_haveFile(false), m_fileName(""),
                     m_hasPhiDependence(false),
-                    m_tstart(0), m_tstop(0) {}
+                    m_tstart(0), m_tstop(0), m_id(nextId()) {}
 
    ExposureCube(const ExposureCube & other);
 
@@ -56,12 +58,38 @@ public:
       return m_exposure->data()[dir];
    }
 
+   /// Cosines of the inclinations at the centers of the livetime
+   /// bins.  These are the same for all sky directions.
+   void cosThetaBins(std::vector<double> & cosThetas) const;
+
+   /// Tabulate the effective areas of respFuncs at these energies on
+   /// the cos(theta) bins of the cube, at the epoch used for the
+   /// integrations over the cube.  See AeffTable::fill.
+   void fillAeffTable(const ResponseFunctions & respFuncs,
+                      const std::vector<double> & energies) const;
+
+   /// Livetime efficiency factors for the standard and weighted
+   /// exposures at an energy, at the midpoint of the cube.  These are
+   /// (1, 0) if there is no efficiency factor.  The efficiency factor
+   /// object is shared, so the calls to it are serialized.
+   void livetimeFactors(double energy, double & factor1,
+                        double & factor2) const;
+
    void setEfficiencyFactor(const irfInterface::IEfficiencyFactor * eff) {
       if (eff) {
          m_efficiencyFactor = eff->clone();
+         m_id = nextId();
       }
    }
 
+   /// Identifier for the contents of the cube.  Each ExposureCube
+   /// object has its own, which changes when a file is read or the
+   /// efficiency factor is set, so it serves as a key for quantities
+   /// computed from the cube, even for cubes that have no file.
+   unsigned long id() const {
+      return m_id;
+   }
+
    double tstart() const {
       return m_tstart;
    }
@@ -92,11 +120,17 @@ public:
    template<class T>
    double value(const astro::SkyDir & dir, const T & aeff, 
                 double energy) const {
-      double factor1(1), factor2(0);
-      if (m_efficiencyFactor) {
-         double met((m_tstart + m_tstop)/2.);
-         m_efficiencyFactor->getLivetimeFactors(energy, factor1, factor2, met);
-      }
+      double factor1, factor2;
+      livetimeFactors(energy, factor1, factor2);
+      return value(dir, aeff, factor1, factor2);
+   }
+
+   // Same as above, with the livetime factors for the energy from
+   // livetimeFactors(), so that loops over sky directions can compute
+   // them once per energy.
+   template<class T>
+   double value(const astro::SkyDir & dir, const T & aeff, 
+                double factor1, double factor2) const {
       double value1(value(dir, aeff));
       double value2(0);
       double exposure(factor1*value1);
@@ -186,6 +220,10 @@ private:
    double m_tstart;
    double m_tstop;
 
+   unsigned long m_id;
+
+   static unsigned long nextId();
+
    bool phiDependence(const std::string & filename) const;
 
 };
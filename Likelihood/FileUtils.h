@@ -315,6 +315,15 @@ namespace Likelihood {
     void read_parameters_from_table(const std::string& file_name,
 				    const std::string& table_name,
 				    SourceModel& srcModel);
+
+    /* Checksum of the contents of a file, as a hex string.
+
+       This is a 64-bit FNV-1a hash of all of the bytes of the file.
+       It is used to key caches on the contents of their input files
+       rather than on their names or modification times.
+       Returns an empty string if the file cannot be read.
+     */
+    std::string file_checksum(const std::string& filename);
    
 
 
@@ -53,6 +53,8 @@
 // Fermi includes
 #include "astro/SkyDir.h"
 
+#include "Likelihood/FitUtils.h"
+
 
 // forward declarations
 namespace astro {
@@ -93,6 +95,7 @@ namespace Likelihood {
   class PointSource;
   class AppHelpers;
   class CountsMapBase;  
+  class CountsMapHealpix;
   struct Snapshot_Status;
   class Snapshot;
 
@@ -104,28 +107,54 @@ namespace Likelihood {
 
      For small grids this is not to bad of an approximation.
 
+     For WCS maps, the image can also be rendered at nSuper x nSuper 
+     sub-pixel positions of the source.  Together these sample the test 
+     source image on a grid nSuper times finer than the counts map, and 
+     shifts by fractions of a pixel are done by interpolating between them.
+     With nSuper = 1 the image is shifted by a whole number of pixels.
+
+     For HEALPix maps, the image is rotated to the new direction and
+     interpolated between the nearest HEALPix pixels.
+
      FIXME, add details on size of errors expected.
    */
   class TestSourceModelCache {
 
   public:
 
-    /* Build from a BinnedLikelihood and a Source */
+    /* Build from a BinnedLikelihood and a Source 
+
+       nSuper      : Number of sub-pixel source positions per axis (WCS only)
+    */
     TestSourceModelCache(const BinnedLikelihood& logLike,
-			 const PointSource& source);
+			 const PointSource& source,
+			 int nSuper = 1);
 
     /* D'tor, does nothing */
     ~TestSourceModelCache(){};
+
+    /* Keep a copy of the last translated map, for writeTestSourceToFitsImage().
+       This should be off if translateMap() is called from several threads. */
+    inline void setKeepCurrentModel(bool val) { m_keepCurrentModel = val; }
     
+    /* Compute the pixel offsets of the scan directions from the reference pixel.
+       This uses the projection, so it must be called before translateMap() 
+       is called from several threads. */
+    void setScanDirs(const std::vector<astro::SkyDir>& scanDirs);
+
     /* Translate the cached map to a new location 
 
        newRef      : The new direction of the center of the model image
        out_model   : Filled with the values of the new model image
+       scanIdx     : Index of newRef in the directions given to setScanDirs(), 
+                     or -1 to project newRef.  Only the former is safe 
+		     to use from several threads.
 
        returns 0 for success, error code for failure
      */
     int translateMap(const astro::SkyDir& newRef,
-		     std::vector<float>& out_model) const;
+		     std::vector<float>& out_model,
+		     int scanIdx = -1) const;
 
     /* Write the current cached map to a FITS image
        
@@ -148,11 +177,17 @@ namespace Likelihood {
     */ 
     int translateMap_Wcs(double dx, double dy, std::vector<float>& out_model) const;
 
-    /* Translate the map using HEALPix projection by d_theta and d_phi degrees */
-    int translateMap_Healpix(double d_theta, double d_phi, std::vector<float>& out_model) const {
-      // FIXME, implement this
-      return -1;
-    }
+    /* Translate the map using the sub-pixel images by dx and dy pixels,
+       using bilinear interpolation between the nearest sub-pixel images */
+    int translateMap_WcsSubPixel(double dx, double dy, std::vector<float>& out_model) const;
+
+    /* Add weight * an image shifted by a whole number of pixels to out_model */
+    void addShiftedMap(const std::vector<float>& in_model, 
+		       int delta_x, int delta_y, float weight,
+		       std::vector<float>& out_model) const;
+
+    /* Translate the map using HEALPix projection to a new direction */
+    int translateMap_Healpix(const astro::SkyDir& newRef, std::vector<float>& out_model) const;
 
   private:
           
@@ -167,14 +202,36 @@ namespace Likelihood {
     /* The location of the reference pixel in image coordinates */
     std::pair<double,double> m_refPixel;
 
+    /* The offsets (in pixels) of the scan directions from m_refPixel, WCS only */
+    std::vector<std::pair<double,double> > m_scanOffsets;
+
     /* Number of bins in x,y and energy */
     size_t m_nx;
     size_t m_ny;
     size_t m_ne;
 
+    /* Number of sub-pixel positions per axis */
+    int m_nSuper;
+
+    /* The images for the sub-pixel positions, 
+       m_subPixelModels[iy*m_nSuper + ix] has the source at 
+       m_refPixel + (ix, iy)/m_nSuper */
+    std::vector<std::vector<float> > m_subPixelModels;
+
+    /* The counts map, if it is a HEALPix map */
+    const CountsMapHealpix* m_healpixMap;
+
+    /* For HEALPix maps, unit vectors of the reference direction
+       and of the pixel centers, in the coordinate system of the map */
+    std::vector<double> m_refVec;
+    std::vector<double> m_pixelVecs;
+
     /* The current image */
     mutable std::vector<float> m_currentModel;
 
+    /* Do we copy the translated maps to m_currentModel */
+    bool m_keepCurrentModel;
+
   };
 
 
@@ -419,7 +476,8 @@ namespace Likelihood {
     /* shift the test source */
     virtual int shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
 				const astro::SkyDir& newDir,
-				std::vector<float>& targetModel) const = 0;
+				std::vector<float>& targetModel,
+				int scanIdx) const = 0;
 
     /* set the energy bins to use in the analysis */
     virtual void set_klims(size_t kmin, size_t kmax) = 0;
@@ -566,7 +624,8 @@ namespace Likelihood {
     /* shift the test source */
     virtual int shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
 				const astro::SkyDir& newDir,
-				std::vector<float>& targetModel) const;
+				std::vector<float>& targetModel,
+				int scanIdx) const;
 
     /* set the energy bins to use in the analysis */
     virtual void set_klims(size_t kmin, size_t kmax);
@@ -663,7 +722,8 @@ namespace Likelihood {
     /* shift the test source */
     virtual int shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
 				const astro::SkyDir& newDir,
-				std::vector<float>& targetModel) const;
+				std::vector<float>& targetModel,
+				int scanIdx) const;
   
     /* set the energy bins to use in the analysis */
     virtual void set_klims(size_t kmin, size_t kmax);
@@ -752,6 +812,16 @@ namespace Likelihood {
 		 double tol, int maxIter, double initLambda,
 		 bool useReduced, bool useWeights=false, bool useUnitRefVals=false);
 
+    /* Copy c'tor.
+
+       This makes an independent copy of the cached models and of the
+       current fit, so that several copies can fit the test source at
+       different positions at the same time.  The copy shares the
+       ModelWrapper and the counts data with the original.  It does
+       not have a Snapshot of the model, so update() can not be used on it.
+     */
+    FitScanCache(const FitScanCache& other);
+
     /* D'tor */
     ~FitScanCache();
 
@@ -820,9 +890,13 @@ namespace Likelihood {
     /* Update the model of the test source
        This version shift the SourceMap with respect to a precomputed version
        and in much less expensive, but not quite as accurate 
+
+       scanIdx : Index of newDir in the scan directions, 
+                 see TestSourceModelCache::translateMap()
      */
     int shiftTestSource(const std::vector<TestSourceModelCache*>& modelCache,
-			const astro::SkyDir& newDir);
+			const astro::SkyDir& newDir,
+			int scanIdx = -1);
 
     /* Set the cache to add in the test source with a specify normalization value */
     void addTestSourceToCurrent(double initNorm);
@@ -850,6 +924,22 @@ namespace Likelihood {
     /* Fit the currently cached values using Newton's method */
     int fitCurrent(Prior_Version whichPrior=No_Prior, int verbose=0);
 
+    /* Fit the test source normalization in all of the energy bins at once,
+       using FitUtils::fitNorms_newton_batch.
+
+       This only applies if the test source is the only free parameter,
+       without a prior, and damping is off (initLambda = 0).  In that case
+       each bin gives the same result as setEnergyBin() then fitCurrent().
+
+       status   : Filled with the fitCurrent() return code for each energy bin
+       
+       returns false, without fitting, if the current fit does not qualify
+     */
+    bool fitEnergyBins(std::vector<int>& status);
+
+    /* Make the fit of one energy bin from fitEnergyBins() the current fit */
+    void useEnergyBinFit(size_t energyBin);
+
     /* Calculate the log-likelihood for the currently cached values */
     int calculateLoglikeCurrent(double& logLike, Prior_Version whichPrior=No_Prior);
 
@@ -1094,6 +1184,19 @@ namespace Likelihood {
     // this are the overall bin ranges for the current fit
     size_t m_firstBin;
     size_t m_lastBin;
+
+    // scratch space for the fits, reused from one fit to the next
+    FitUtils::NewtonWorkspace m_workspace;
+
+    // results of fitEnergyBins, one per energy bin
+    std::vector<double> m_binNorms;
+    std::vector<double> m_binCovs;
+    std::vector<double> m_binGrads;
+    std::vector<double> m_binEDMs;
+    std::vector<double> m_binLogLikes;
+
+    // scratch space for fitEnergyBins
+    FitUtils::NewtonBatchWorkspace m_batchWorkspace;
     
   };
 
@@ -1252,6 +1355,9 @@ namespace Likelihood {
 		   double initLambda = 0.0,
 		   bool useWeights = false);
 
+    /* The output data from the last scan with a given name (e.g., "ts"), null if there is none */
+    const HistND* scanData(const std::string& name) const;
+
     /* Write the stored data to a FITS file */
     int writeFitsFile(const std::string& fitsFile,
 		      const std::string& creator,
@@ -1383,6 +1489,20 @@ namespace Likelihood {
     inline void set_writeTestImages(bool val) { m_writeTestImages = val; }
     inline void set_useReduced(bool val) { m_useReduced = val; }
 
+    /* Number of sub-pixel positions per axis used for the test source images.
+       This rebuilds the test source images if they have already been made. */
+    void set_testSourceSuperSample(int val);
+    inline int testSourceSuperSample() const { return m_testSourceSuperSample; }
+
+    /* Number of threads used to scan the grid positions.
+       0 means the positions are fit one after another with the FitScanCache.
+       The default is ParallelUtils::envThreads().
+       The parallel scan is only used when all the fitting at each position 
+       is done with Newton's method on shifted test source images,
+       i.e., with ST_scan_level < 2 and remakeTestSource false. */
+    inline void set_num_threads(int val) { m_numThreads = val; }
+    inline int num_threads() const { return m_numThreads; }
+
   protected:
 
     /* This adds the test source to the source model */
@@ -1394,6 +1514,10 @@ namespace Likelihood {
     /* Set the direction of the test source, based on the loop parameters */
     int setTestSourceDir(int ix, int iy);
 
+    /* Get the direction of the test source for a set of loop parameters,
+       without changing the current direction */
+    int getTestSourceDir(int ix, int iy, astro::SkyDir& dir) const;
+
     /* This does the baseline fit
        i.e., the fit without the test source */
     int baselineFit(double tol = 1e-3, int tolType = 0);
@@ -1419,6 +1543,19 @@ namespace Likelihood {
 			  std::vector<std::vector<double> >& norms,
 			  std::vector<std::vector<double> >& logLikes);
 
+    /* Same as above, but using a specific FitScanCache */
+    int sed_binned_newton(FitScanCache& cache,
+			  int nnorm, double normSigma,
+			  double constrainScale,
+			  std::vector<double>& norm_mles,
+			  std::vector<double>& pos_errs,
+			  std::vector<double>& neg_errs,
+			  std::vector<double>& logLike_mles,
+			  std::vector<double>& uls,
+			  std::vector<int>& sed_fit_status,
+			  std::vector<std::vector<double> >& norms,
+			  std::vector<std::vector<double> >& logLikes) const;
+
     /* Build and cache an image of the test source */
     int buildTestModelCache();
     
@@ -1517,6 +1654,12 @@ namespace Likelihood {
     bool m_writeTestImages;
     bool m_useReduced;
 
+    // Number of threads for the grid scan
+    int m_numThreads;
+
+    // Number of sub-pixel positions per axis for the test source images
+    int m_testSourceSuperSample;
+
   };
 
 }
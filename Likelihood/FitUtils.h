@@ -21,7 +21,7 @@
  */
 
 #ifndef Likelihood_FitUtils_h
-#define Likelihood_Fitutils_h
+#define Likelihood_FitUtils_h
 
 #include <vector>
 #include <map>
@@ -93,6 +93,118 @@ namespace Likelihood {
 		  CLHEP::HepVector& s,
 		  CLHEP::HepVector& delta,
 		  double eps = 1E-16);
+
+    /* Scratch space for fitNorms_newton, kept between fits.
+
+       Scanning a TS cube solves thousands of small systems that all
+       have the same number of parameters.  This holds the per-parameter
+       sums, the pointers into the templates and the GSL objects used by
+       svd_solve, so that they are only allocated when the number of 
+       parameters changes, rather than on every iteration.
+
+       A copy does not share anything with the original, it starts empty.
+     */
+    class NewtonWorkspace {
+    public:
+
+      NewtonWorkspace();
+
+      NewtonWorkspace(const NewtonWorkspace& other);
+
+      ~NewtonWorkspace();
+
+      /* Make sure the buffers are sized for npar parameters */
+      void resize(size_t npar);
+
+      inline size_t npar() const { return m_npar; }
+
+      /* Running sums for the gradient (first npar values) and the 
+	 upper triangle of the Hessian (row by row), one per parameter pair */
+      inline std::vector<double>& sums() { return m_sums; }
+
+      /* Pointers to the first bin of each template */
+      inline std::vector<const float*>& templatePtrs() { return m_templatePtrs; }
+
+      /* Copy of the gradient used by getDeltaAndCovarAndEDM, made on first use */
+      CLHEP::HepVector& gradientCopy();
+
+      inline gsl_matrix* U() { return m_U; }
+      inline gsl_matrix* V() { return m_V; }
+      inline gsl_vector* S() { return m_S; }
+      inline gsl_vector* G() { return m_G; }
+      inline gsl_vector* work() { return m_work; }
+      inline gsl_vector* x() { return m_x; }
+
+    private:
+
+      /* Not implemented */
+      NewtonWorkspace& operator=(const NewtonWorkspace& other);
+
+      void free_gsl();
+
+      size_t m_npar;
+      std::vector<double> m_sums;
+      std::vector<const float*> m_templatePtrs;
+      CLHEP::HepVector* m_gradientCopy;
+      gsl_matrix* m_U;
+      gsl_matrix* m_V;
+      gsl_vector* m_S;
+      gsl_vector* m_G;
+      gsl_vector* m_work;
+      gsl_vector* m_x;
+    };
+
+    /* Scratch space for fitNorms_newton_batch, kept between batches.
+
+       The per-problem quantities are stored as structure-of-arrays, one
+       entry per problem in each vector, so that the Newton steps of all
+       of the problems are taken in a single loop.  The models of the 
+       problems are kept back to back in one buffer.
+     */
+    class NewtonBatchWorkspace {
+    public:
+
+      NewtonBatchWorkspace() {}
+
+      /* Start and stop bins of each problem */
+      inline std::vector<size_t>& starts() { return m_starts; }
+      inline std::vector<size_t>& stops() { return m_stops; }
+
+      /* Offset of the model of each problem in model() */
+      inline std::vector<size_t>& offsets() { return m_offsets; }
+
+      /* Models of all the problems */
+      inline std::vector<float>& model() { return m_model; }
+
+      /* Hessian, initial log-likelihood and iteration count of each problem */
+      inline std::vector<double>& hessians() { return m_hessians; }
+      inline std::vector<double>& logLikeInit() { return m_logLikeInit; }
+      inline std::vector<int>& iterations() { return m_iterations; }
+
+      /* Indices of the problems that are still iterating */
+      inline std::vector<size_t>& active() { return m_active; }
+
+    private:
+
+      std::vector<size_t> m_starts;
+      std::vector<size_t> m_stops;
+      std::vector<size_t> m_offsets;
+      std::vector<float> m_model;
+      std::vector<double> m_hessians;
+      std::vector<double> m_logLikeInit;
+      std::vector<int> m_iterations;
+      std::vector<size_t> m_active;
+    };
+
+    /* Same as above, but using the GSL objects in a NewtonWorkspace */
+    int svd_solve(const CLHEP::HepSymMatrix& hessian,
+		  const CLHEP::HepVector& gradient,
+		  CLHEP::HepMatrix& u,
+		  CLHEP::HepMatrix& v,
+		  CLHEP::HepVector& s,
+		  CLHEP::HepVector& delta,
+		  NewtonWorkspace& workspace,
+		  double eps = 1E-16);
     
     gsl_vector * Vector_Hep_to_Gsl(const CLHEP::HepVector& hep);
 
@@ -354,6 +466,23 @@ namespace Likelihood {
 			       size_t lastBin = 0,
 			       int verbose = 0);
 
+    /* Same as above, but all the sums are done in a single pass over the bins,
+       using the buffers in a NewtonWorkspace.  The products and sums are 
+       done in the same order as above, so the results are the same. */
+    void getGradientAndHessian(const std::vector<float>& data,
+			       const CLHEP::HepVector& norms,
+			       const std::vector<const std::vector<float>* >& templates,
+			       const std::vector<float>& fixed,
+			       const FitScanMVPrior* prior,
+			       const std::vector<float>* weights,
+			       std::vector<float>& model,
+			       CLHEP::HepVector& gradient,
+			       CLHEP::HepSymMatrix& hessian,
+			       NewtonWorkspace& workspace,
+			       size_t firstBin = 0,
+			       size_t lastBin = 0,
+			       int verbose = 0);
+
 
     /* Invert the Hessian to get the covariance matrix.
        Use the gradient vector and the covariance matrix to the delta for the next iteration.
@@ -370,6 +499,15 @@ namespace Likelihood {
 			       CLHEP::HepVector& delta,
 			       double& edm);
 
+    /* Same as above, but using the gradient copy in a NewtonWorkspace */
+    int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
+			       const CLHEP::HepVector& gradient,
+			       const CLHEP::HepVector& norms,
+			       CLHEP::HepSymMatrix& covar,
+			       CLHEP::HepVector& delta,
+			       double& edm,
+			       NewtonWorkspace& workspace);
+
     int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
 			       const CLHEP::HepVector& gradient,
 			       const CLHEP::HepVector& norms,
@@ -377,6 +515,16 @@ namespace Likelihood {
 			       CLHEP::HepVector& delta,
 			       double& edm,
 			       double lambda);
+
+    /* Same as above, but using the GSL objects in a NewtonWorkspace */
+    int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
+			       const CLHEP::HepVector& gradient,
+			       const CLHEP::HepVector& norms,
+			       CLHEP::HepSymMatrix& covar,
+			       CLHEP::HepVector& delta,
+			       double& edm,
+			       double lambda,
+			       NewtonWorkspace& workspace);
     
     /* Extract the set of bins that are non-zero into parallel vectors of indices
        this is done to make it faster to iterate over sparse data
@@ -491,7 +639,66 @@ namespace Likelihood {
 			size_t firstBin = 0, 
 			size_t lastBin = 0,
 			int verbose = 0);
-    
+
+    /* Same as above, but using the buffers in a NewtonWorkspace. 
+       This is what the version above calls, with a temporary workspace. */
+    int fitNorms_newton(const std::vector<float>& data,
+			const CLHEP::HepVector& initNorms,
+			const std::vector<const std::vector<float>* >& templates,
+			const std::vector<float>& fixed,
+			const FitScanMVPrior* prior,
+			const std::vector<float>* weights,
+			double tol, int maxIter, double lambda,
+			CLHEP::HepVector& norms,
+			CLHEP::HepSymMatrix& covar,
+			CLHEP::HepVector& gradient,
+			std::vector<float>& model,
+			double& edm,
+			double& logLikeVal,
+			NewtonWorkspace& workspace,
+			size_t firstBin = 0, 
+			size_t lastBin = 0,
+			int verbose = 0);
+
+    /* Fit a batch of single normalizations using Newton's method.
+
+       Problem k fits the normalization of templates[k] on top of fixed[k],
+       over the bins [firstBins[k], lastBins[k]) of the data 
+       (lastBins[k] = 0 -> end), e.g., the test source in each energy bin, 
+       or at each position, of a TS cube with the background held fixed.
+       
+       The problems are iterated in lockstep: each pass computes the model,
+       gradient and Hessian of every problem that has not yet converged in a
+       single pass over its bins, then takes all of their Newton steps in one
+       loop.  Each problem gives the same result, status and iteration count 
+       as fitNorms_newton with one template, no prior and lambda = 0.
+
+       initNorms:     Initial value of each normalization
+       tol, maxIter:  As for fitNorms_newton
+       norms:         Filled with the fit result of each problem
+       covars:        Filled with the variance of each normalization
+       gradients:     Filled with the gradient of each problem
+       edms:          Filled with the estimated distance to minimum of each problem
+       logLikes:      Filled with the log likelihood of each problem
+       status:        Filled with the fitNorms_newton return code of each problem
+       
+       returns the number of problems that failed
+    */
+    int fitNorms_newton_batch(const std::vector<float>& data,
+			      const std::vector<const std::vector<float>* >& templates,
+			      const std::vector<const std::vector<float>* >& fixed,
+			      const std::vector<float>* weights,
+			      const std::vector<size_t>& firstBins,
+			      const std::vector<size_t>& lastBins,
+			      const std::vector<double>& initNorms,
+			      double tol, int maxIter,
+			      std::vector<double>& norms,
+			      std::vector<double>& covars,
+			      std::vector<double>& gradients,
+			      std::vector<double>& edms,
+			      std::vector<double>& logLikes,
+			      std::vector<int>& status,
+			      NewtonBatchWorkspace& workspace);
 
     /* Fit the log of the normalization using Newton's method
        
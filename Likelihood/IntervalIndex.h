@@ -0,0 +1,73 @@
+/**
+ * @file IntervalIndex.h
+ * @brief Time-ordered lookup of the time range cuts and GTIs for
+ * FT2 intervals.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_IntervalIndex_h
+#define Likelihood_IntervalIndex_h
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Likelihood {
+
+/**
+ * @class IntervalIndex
+ *
+ * @brief Sequential form of LikeExposure::acceptInterval.
+ *
+ * The time range cuts are reduced to their intersection, and a sorted
+ * copy of the GTIs is kept along with a cursor to the first GTI that
+ * can overlap the current interval.  For intervals that are visited in
+ * time order, as for the rows of an FT2 file, the cursor only moves
+ * forward, so acceptance is a two-pointer merge of the FT2 intervals
+ * with the GTIs rather than a search for each interval.  If an
+ * interval starts before the previous one, the cursor is rewound, so
+ * the results do not depend on the order.
+ *
+ */
+
+class IntervalIndex {
+
+public:
+
+   typedef std::pair<double, double> Interval_t;
+
+   /// @param timeCuts Time range cuts
+   /// @param gtis Good Time Intervals
+   IntervalIndex(const std::vector<Interval_t> & timeCuts,
+                 const std::vector<Interval_t> & gtis);
+
+   /// Same arguments and return value as LikeExposure::acceptInterval.
+   /// @param start MET start time of interval (seconds)
+   /// @param stop MET stop time of interval (seconds)
+   /// @param fraction Fraction of the interval to use in exposure
+   ///        calculation.  This is a return value.
+   bool accept(double start, double stop, double & fraction);
+
+   /// Reset the GTI cursor to the start of the GTIs.
+   void rewind();
+
+private:
+
+   /// Intersection of the time range cuts
+   Interval_t m_window;
+
+   /// GTIs sorted by start time
+   std::vector<Interval_t> m_gtis;
+
+   /// Index of the first GTI that can overlap the current interval
+   size_t m_cursor;
+
+   /// Start time of the previous (clipped) interval
+   double m_lastStart;
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_IntervalIndex_h
@@ -9,11 +9,17 @@
 #ifndef Likelihood_LikeExposure_h
 #define Likelihood_LikeExposure_h
 
+#include <string>
 #include <utility>
+#include <vector>
 
 #include "tip/tip_types.h"
 #include "map_tools/Exposure.h"
 
+namespace astro {
+   class SkyDir;
+}
+
 namespace tip {
    class Table;
 }
@@ -47,10 +53,40 @@ public:
 
    void load(const tip::Table * tuple, bool verbose=true);
 
+   /// Fill the exposures from an FT2 file.  The columns are read
+   /// through cfitsio in blocks of rows, rather than cell by cell, and
+   /// rows outside of the GTIs are skipped.
+   /// @param scFile FT2 file
+   /// @param sctable Name of the FT2 extension
+   /// @param filter Optional cfitsio row filter expression
+   /// @param verbose Print progress dots
+   void load(const std::string & scFile, const std::string & sctable,
+             const std::string & filter="", bool verbose=true);
+
+   /// Number of threads used by load().  If > 0, the accepted FT2
+   /// intervals are first read into memory, then split into one
+   /// contiguous block per thread.  Each thread fills private partial
+   /// standard and weighted exposures, which are then summed pixel by
+   /// pixel.  The summation order differs from the serial fill, so
+   /// the livetimes agree with it to float rounding.  0 uses the
+   /// serial fill.  The default is ParallelUtils::envThreads().
+   void setNumThreads(int numThreads) {
+      m_numThreads = numThreads;
+   }
+
+   int numThreads() const {
+      return m_numThreads;
+   }
+
    tip::Index_t numIntervals() const {
       return m_numIntervals;
    }
 
+   /// Exposure weighted by the livetime fraction of each interval
+   const map_tools::Exposure & weightedExposure() const {
+      return *m_weightedExposure;
+   }
+
    /// @brief Normally one would re-implement the
    /// map_tools::Exposure::write(...) member function from the base
    /// class, but it is not virtual, so we add this method instead to
@@ -81,8 +117,13 @@ protected:
 
 private:
 
+   double m_skybin;
    double m_costhetabin;
 
+   /// Cosines of the zenith angle cuts, as passed to map_tools::Exposure
+   double m_cosZenMax;
+   double m_cosZenMin;
+
    const std::vector< std::pair<double, double> > & m_timeCuts;
    const std::vector< std::pair<double, double> > & m_gtis;
 
@@ -97,6 +138,25 @@ private:
 
    map_tools::Exposure * m_weightedExposure;
 
+   int m_numThreads;
+
+   /// Fill the standard and weighted exposures for one interval.
+   void fillInterval(const astro::SkyDir & scz, const astro::SkyDir & scx,
+                     const astro::SkyDir & zenith, double deltat,
+                     double weight);
+
+   /// Fill the standard and weighted exposures from intervals that
+   /// have been read into memory, using m_numThreads threads.
+   void fillParallel(const std::vector<astro::SkyDir> & scz,
+                     const std::vector<astro::SkyDir> & scx,
+                     const std::vector<astro::SkyDir> & zenith,
+                     const std::vector<double> & deltats,
+                     const std::vector<double> & weights);
+
+   static void addExposure(const map_tools::Exposure & partial,
+                           map_tools::Exposure & total,
+                           size_t first, size_t last);
+
    static bool overlaps(const std::pair<double, double> & interval1,
                         std::pair<double, double> & interval2);
 
@@ -14,6 +14,7 @@
 #include "Likelihood/Accumulator.h"
 #include "Likelihood/DiffuseSource.h"
 #include "Likelihood/Event.h"
+#include "Likelihood/EventTable.h"
 #include "Likelihood/Npred.h"
 #include "Likelihood/PointSource.h"
 #include "Likelihood/SourceModel.h"
@@ -82,6 +83,38 @@ public:
 
    virtual void unset_ebounds();
 
+   /// Use the columnar EventTable to evaluate the log-likelihood and
+   /// its derivatives.  Note that Event::modelSum() is not updated
+   /// by value() in this case.
+   void setUseEventTable(bool useEventTable) {
+      m_useEventTable = useEventTable;
+   }
+
+   bool useEventTable() const {
+      return m_useEventTable;
+   }
+
+   /// Number of threads for the event loops in value() and
+   /// getFreeDerivs().  If > 0, the EventTable is used and the events
+   /// are split into fixed-size chunks whose partial sums are merged
+   /// in order, so the results do not depend on the number of
+   /// threads.  0 uses the original serial loops.  The default is
+   /// ParallelUtils::envThreads().
+   void setNumThreads(int numThreads) {
+      m_numThreads = numThreads;
+   }
+
+   int numThreads() const {
+      return m_numThreads;
+   }
+
+   /// The summed model for each event, including the efficiency, as
+   /// of the last call to value() or getFreeDerivs() that used the
+   /// EventTable.
+   const std::vector<double> & eventModelSums() const {
+      return m_modelSums;
+   }
+
 protected:
 
    virtual LogLike * clone() const {
@@ -111,6 +144,34 @@ private:
    // Cache for instrument response to each event times source
    mutable ResponseCache m_respCache;
 
+   /// Columnar event data and source-by-event responses
+   mutable EventTable m_eventTable;
+   bool m_useEventTable;
+
+   /// Summed model for each event, filled from m_eventTable
+   mutable std::vector<double> m_modelSums;
+
+   /// Number of threads for the chunked event loops
+   int m_numThreads;
+
+   /// Rebuild m_eventTable if the events or sources have changed.
+   void updateEventTable() const;
+
+   /// log of the summed model for an event, with the same handling
+   /// of non-positive values as logSourceModel
+   double logModelSum(double modelSum) const;
+
+   /// Fill m_modelSums using the chunked event loop.
+   void computeModelSums_chunked(const std::vector<Event> & events,
+                                 std::vector<size_t> & bounds) const;
+
+   /// Sum of log(modelSum) over the events, using the chunked loop.
+   double logModelSum_chunked(const std::vector<Event> & events) const;
+
+   /// Derivatives of the sum of log(modelSum), using the chunked loop.
+   void addLogModelDerivs_chunked(const std::vector<Event> & events,
+                                  std::vector<double> & derivs) const;
+
    double logSourceModel(const Event & event,
                          ResponseCache::EventRef* srcRespCache=0) const;
 
@@ -11,6 +11,7 @@
 
 #include "astro/SkyDir.h"
 
+#include "Likelihood/Convolve.h"
 #include "Likelihood/Observation.h"
 
 namespace Likelihood {
@@ -29,14 +30,14 @@ public:
    MeanPsf(double ra, double dec, const std::vector<double> & energies,
            const Observation & observation) 
       : m_srcDir(ra, dec, astro::SkyDir::EQUATORIAL),
-        m_energies(energies), m_observation(observation) {
-      init();
+        m_energies(energies) {
+      init(observation);
    }
 
    MeanPsf(const astro::SkyDir & srcDir, const std::vector<double> & energies,
            const Observation & observation) 
-      : m_srcDir(srcDir), m_energies(energies), m_observation(observation) {
-      init();
+      : m_srcDir(srcDir), m_energies(energies) {
+      init(observation);
    }
 
    /// @return The value of the psf.
@@ -112,6 +113,16 @@ public:
                  const std::vector<std::pair<double,double> >& dirs,
                  std::vector<double> & image) const;
 
+   /// Approximate memory used by this object (bytes)
+   size_t memory_size() const;
+
+   /// Transformed images of this psf, used by WcsMap2::convolve so
+   /// that diffuse sources that share this psf and the map geometry
+   /// do not recompute them.
+   Convolve::SpectrumCache & spectrumCache() const {
+      return m_spectrumCache;
+   }
+
 
 private:
 
@@ -121,20 +132,22 @@ private:
 
    std::vector<double> m_energies;
 
-   const Observation & m_observation;
-
    std::vector<double> m_psfValues;
    std::vector<double> m_psfPeakValues;
    std::vector< std::vector<double> > m_partialIntegrals;
 
    std::vector<double> m_exposure;
 
-   void init();
+   mutable Convolve::SpectrumCache m_spectrumCache;
+
+   /// The observation is only used while the psf is computed, so
+   /// that the psf may outlive it, e.g., in the PsfCache.
+   void init(const Observation & observation);
 
    void createLogArray(double xmin, double xmax, unsigned int npts,
                        std::vector<double> & xx) const;
 
-   void computeExposure();
+   void computeExposure(const Observation & observation);
 
    void computePartialIntegrals();
 
@@ -54,6 +54,17 @@ public:
       m_meanpsf(0) {
    }
 
+   /// A copy of other that uses respFuncs in place of its response
+   /// functions, e.g., a per-thread clone.  All of the other
+   /// components are shared with other.
+   Observation(const Observation & other, ResponseFunctions * respFuncs) :
+      m_respFuncs(respFuncs), m_scData(other.m_scData),
+      m_roiCuts(other.m_roiCuts), m_expCube(other.m_expCube),
+      m_expMap(other.m_expMap), m_eventCont(other.m_eventCont),
+      m_bexpmap(other.m_bexpmap), m_phased_expmap(other.m_phased_expmap),
+      m_meanpsf(other.m_meanpsf) {
+   }
+
    const ResponseFunctions & respFuncs() const {
       return *m_respFuncs;
    }
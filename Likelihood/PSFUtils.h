@@ -48,6 +48,15 @@ namespace Likelihood {
   class PsfIntegConfig;
 
   namespace PSFUtils {
+
+    /// Fraction of the psf contained in the pixels filled by makePointSourceMap_wcs_stamp
+    const double psfStampContainment = 0.9999;
+
+    /// Radius (in pixels) inside which makePointSourceMap_wcs_stamp uses psfValueEstimate
+    const double psfStampCoreRadius = 3.;
+
+    /// Number of samples per pixel in the tabulated psf profiles
+    const size_t psfProfileSamples = 10;
    
     /* Split at double into the integer and remainder parts, and deal with boundry conditions 
 
@@ -306,6 +315,64 @@ namespace Likelihood {
 			       std::vector<float>& modelmap,
 			       FileUtils::SrcMapType& mapType);
     
+    /* Compute the SourceMap model values for a Point source.  
+       This version is called for WCS-based Counts Maps if use_psf_stamp is set.
+
+       Only the pixels within the psfStampContainment radius of the source
+       are filled.  They are found in a box around the source position in 
+       pixel coordinates, and their angular offsets are computed once for
+       all the energy planes.  Pixels within psfStampCoreRadius pixels of the
+       source use psfValueEstimate, the others are interpolated from a
+       radial profile of the psf tabulated for each energy.
+
+       pointSrc    : The source in question
+       dataMap     : The counts map in question
+       config      : Parameters for PSF integration 
+       meanpsf     : The average PSF across the ROI
+       formatter   : Stream for writting progress messages
+       modelmap    : Filled with the model values
+     
+       return 0 for success, error code otherwise 
+    */
+    int makePointSourceMap_wcs_stamp(const PointSource& pointSrc, 
+				     const CountsMap& dataMap,
+				     const PsfIntegConfig& config,
+				     const MeanPsf& meanpsf,
+				     st_stream::StreamFormatter& formatter,
+				     std::vector<float>& modelmap);
+
+    /* Tabulate the psf as a function of the offset from the source.
+
+       meanpsf     : The psf
+       energies    : Energies at which to tabulate the psf
+       radii       : Largest offset to tabulate, for each energy (degrees)
+       step        : Spacing of the offsets (degrees)
+       profiles    : Filled with the psf values at offsets i*step, for each energy
+    */
+    void makePsfProfiles(const MeanPsf& meanpsf,
+			 const std::vector<double>& energies,
+			 const std::vector<double>& radii,
+			 double step,
+			 std::vector< std::vector<double> >& profiles);
+
+    /* Find the pixels in a counts map within a given radius of a direction.
+
+       dataMap      : The counts map in question
+       dir          : The direction in question
+       srcCoord     : The direction in the pixel coordinates of the map
+       pixelOffsets : The non-cartesian corrections from createOffsetMap
+       radius       : The radius (degrees)
+       indices      : Filled with the indices of the pixels inside the radius
+       offsets      : Filled with the angular separations of those pixels (degrees)
+    */
+    void findStampPixels(const CountsMap& dataMap,
+			 const astro::SkyDir& dir,
+			 const std::pair<double, double>& srcCoord,
+			 const std::vector< std::vector< double > >& pixelOffsets,
+			 double radius,
+			 std::vector<size_t>& indices,
+			 std::vector<double>& offsets);
+    
     /* Compute the SourceMap model values for a Point source.  
        This version is called for HEALPix-based Counts Maps
 
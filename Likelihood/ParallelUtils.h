@@ -0,0 +1,109 @@
+/**
+ * @file ParallelUtils.h
+ * @brief Functions to split loops into chunks and run them on several threads
+ *
+ *  The threading is done with OpenMP.  If the library is compiled
+ *  without OpenMP support all of the loops run serially, but the
+ *  chunking and the order in which partial results are merged are
+ *  the same, so the results do not depend on the number of threads.
+ *
+ *  Number of threads: every class with a threaded code path keeps its
+ *  own count, set with setNumThreads() or set_num_threads(), which
+ *  defaults to envThreads(), i.e., to LIKELIHOOD_NUM_THREADS.  A
+ *  count of 0 selects the original serial code, and a positive count
+ *  the chunked code on numThreads(count) threads.  The applications
+ *  that are not built on such a class resolve their count with
+ *  numThreads(), and those with a numthreads parameter use it in
+ *  place of LIKELIHOOD_NUM_THREADS when it is > 0.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_ParallelUtils_h
+#define Likelihood_ParallelUtils_h
+
+#include <cstddef>
+#include <vector>
+
+namespace Likelihood {
+
+  class LogLike;
+
+  namespace ParallelUtils {
+
+    /// Default number of items per chunk for loops over filled pixels
+    /// or events.  This is fixed so that the partial sums, and hence
+    /// the final results, do not depend on the number of threads.
+    const size_t defaultChunkSize = 16384;
+
+    /// Maximum number of threads available to this process.
+    /// This is always 1 if the library was compiled without OpenMP.
+    int maxThreads();
+
+    /// Wall-clock time in seconds, for timing reports.
+    double wallTime();
+
+    /* Number of threads requested through the LIKELIHOOD_NUM_THREADS
+       environment variable, or 0 if it is not set.  This is the
+       default count of the threaded classes. */
+    int envThreads();
+
+    /* Resolve the number of threads to use.
+
+       requested : Number of threads requested.  If <= 0 the value
+                   of LIKELIHOOD_NUM_THREADS is used, and if that is
+                   not set either, a single thread.
+
+       The returned value is between 1 and maxThreads().
+     */
+    int numThreads(int requested=0);
+
+    /// Index of the calling thread within the enclosing parallel
+    /// region, or 0 outside of one.
+    int threadNum();
+
+    /// Whether the caller is inside an active parallel region.
+    bool inParallel();
+
+    /* Split the range [first, last) into chunks of fixed size.
+
+       first     : Start of the range
+       last      : End of the range
+       chunkSize : Number of items per chunk, the last chunk might be smaller
+       bounds    : Filled with the chunk edges, i.e., chunk i covers
+                   [bounds[i], bounds[i+1]).
+     */
+    void makeChunks(size_t first, size_t last, size_t chunkSize,
+		    std::vector<size_t>& bounds);
+
+    /* Sum a vector of partial sums in order, using Kahan summation.
+
+       This is used to merge per-chunk partial sums in a fixed order
+       so that the results are bit-reproducible.
+     */
+    double orderedSum(const std::vector<double>& partials);
+
+    /* Evaluate several log-likelihood components, e.g., those of a
+       SummedLikelihood or a CompositeLikelihood.
+
+       components : The components
+       numThreads : Number of threads.  If <= 0 they are evaluated
+                    one after the other.
+       values     : If not null, filled with value() of each component
+       derivs     : If not null, filled with getFreeDerivs() of each
+                    component
+
+       The results are stored in the order of components, so callers
+       that combine them in that order get the same result for any
+       number of threads.
+     */
+    void evaluateComponents(const std::vector<LogLike*>& components,
+			    int numThreads,
+			    std::vector<double>* values,
+			    std::vector<std::vector<double> >* derivs);
+
+  } // namespace ParallelUtils
+
+} // namespace Likelihood
+
+#endif // Likelihood_ParallelUtils_h
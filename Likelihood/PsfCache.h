@@ -0,0 +1,165 @@
+/**
+ * @file PsfCache.h
+ * @brief Singleton class that holds the MeanPsf objects for point
+ * sources, so that sources at nearby positions share them.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_PsfCache_h
+#define Likelihood_PsfCache_h
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace astro {
+   class SkyDir;
+}
+
+namespace st_stream {
+   class StreamFormatter;
+}
+
+namespace Likelihood {
+
+class MeanPsf;
+class Observation;
+
+/**
+ * @class PsfCache
+ *
+ * @brief MeanPsf objects keyed by direction, energies, response
+ * functions and livetime cube.
+ *
+ * Computing a MeanPsf means integrating the psf over the livetime
+ * cube for each energy and separation, which dominates the time taken
+ * to make the source maps of point sources.  Sources that are close
+ * together have nearly identical psfs.
+ *
+ * If the order is negative (the default), the psfs are keyed by the
+ * exact source direction, so only sources at the same position share
+ * a psf.  Otherwise the directions are quantized to the pixels of a
+ * HEALPix grid (NESTED, equatorial) of that order, and the psf is
+ * computed at the pixel center.  Order 9 pixels are about 0.11 deg
+ * across.  The default order can be set with the
+ * LIKELIHOOD_PSF_CACHE_ORDER environment variable.
+ *
+ * The response functions are identified by their name and event
+ * types, and the livetime cube by ExposureCube::id() and its
+ * livetime efficiency factors at the energies, rather than by the
+ * Observation, so that threads using clones of the response
+ * functions share the psfs.  The psfs do not refer to the
+ * Observation after they are computed.
+ *
+ * Each call to meanPsf() must be matched by a call to release() when
+ * the psf is no longer needed; the psf is deleted when it has been
+ * released by all of its users.  Access is serialized with an OpenMP
+ * critical section, and instance() may be called on any thread.
+ */
+
+class PsfCache {
+
+public:
+
+   /// @return The psf for a direction, computing it if needed.
+   ///         The caller must release() it when done with it.
+   /// @param dir Source direction
+   /// @param energies Energies (MeV) at which the psf is tabulated
+   /// @param observation Provides the livetime cube and the IRFs
+   const MeanPsf & meanPsf(const astro::SkyDir & dir,
+                           const std::vector<double> & energies,
+                           const Observation & observation);
+
+   /// Release a psf returned by meanPsf(), deleting it if it has no
+   /// other users.
+   void release(const MeanPsf * psf);
+
+   /// Set the HEALPix order used to quantize the directions.
+   /// A negative value keys the psfs by the exact direction.  Psfs
+   /// that are already in use are kept until they are released.
+   void setOrder(int order);
+
+   int order() const {
+      return m_order;
+   }
+
+   /// Delete all of the psfs.  Only to be called when none of them
+   /// are in use.
+   void clear();
+
+   /// Number of psfs in the cache
+   size_t size() const {
+      return m_psfs.size();
+   }
+
+   size_t hits() const {
+      return m_hits;
+   }
+
+   size_t misses() const {
+      return m_misses;
+   }
+
+   /// Approximate memory used by the psfs (bytes)
+   size_t memory_size() const;
+
+   /// Write the number of psfs, the hit rate and the memory used.
+   void report(st_stream::StreamFormatter & formatter) const;
+
+   static PsfCache * instance();
+
+   static void delete_instance() {
+      delete s_instance;
+      s_instance = 0;
+   }
+
+protected:
+
+   PsfCache();
+
+   ~PsfCache() throw();
+
+private:
+
+   class Key {
+   public:
+      std::string respName;
+      std::vector<unsigned int> evtTypes;
+      unsigned long expCubeId;
+      std::vector<double> energies;
+      std::vector<double> livetimeFactors;
+      double ra;
+      double dec;
+      bool operator<(const Key & rhs) const;
+   };
+
+   class Entry {
+   public:
+      Entry() : psf(0), users(0) {}
+      MeanPsf * psf;
+      size_t users;
+   };
+
+   typedef std::map<Key, Entry> PsfMap_t;
+   PsfMap_t m_psfs;
+
+   /// The entry for each psf, for release()
+   std::map<const MeanPsf *, PsfMap_t::iterator> m_entries;
+
+   int m_order;
+
+   size_t m_hits;
+   size_t m_misses;
+
+   static PsfCache * s_instance;
+
+   /// Direction at which the psf for dir is computed.
+   void quantize(const astro::SkyDir & dir, double & ra, double & dec) const;
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_PsfCache_h
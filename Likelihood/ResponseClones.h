@@ -0,0 +1,72 @@
+/**
+ * @file ResponseClones.h
+ * @brief Per-thread copies of the response functions for threaded loops.
+ *
+ * $Header$
+ */
+
+#ifndef Likelihood_ResponseClones_h
+#define Likelihood_ResponseClones_h
+
+#include <vector>
+
+namespace Likelihood {
+
+class Observation;
+class ResponseFunctions;
+
+/**
+ * @class ResponseClones
+ *
+ * @brief Clones of a set of response functions, and Observations that
+ * use them, one for each thread of a parallel region.
+ *
+ * The irfInterface classes keep internal caches and are not safe to
+ * evaluate on several threads at once.  The clones are made in the
+ * constructor, which must therefore be called outside of the parallel
+ * region.  Inside the region, each thread gets its own copy from
+ * respFuncs() or observation(); thread 0 uses the originals, since
+ * nothing else touches them while the region runs.
+ */
+
+class ResponseClones {
+
+public:
+
+   /// @param respFuncs The response functions to clone
+   /// @param nthreads Number of threads in the parallel region
+   ResponseClones(const ResponseFunctions & respFuncs, int nthreads);
+
+   /// @param observation The Observation to copy.  Its response
+   ///        functions are cloned; the other components are shared.
+   /// @param nthreads Number of threads in the parallel region
+   ResponseClones(const Observation & observation, int nthreads);
+
+   ~ResponseClones();
+
+   /// Response functions for the calling thread
+   const ResponseFunctions & respFuncs() const;
+
+   /// Observation for the calling thread.  This is only available if
+   /// the clones were made from an Observation.
+   const Observation & observation() const;
+
+private:
+
+   const ResponseFunctions & m_respFuncs;
+   const Observation * m_observation;
+
+   std::vector<ResponseFunctions *> m_clones;
+   std::vector<Observation *> m_observations;
+
+   void makeClones(int nthreads);
+
+   /// Disable copy and assignment
+   ResponseClones(const ResponseClones &);
+   ResponseClones & operator=(const ResponseClones &);
+
+};
+
+} // namespace Likelihood
+
+#endif // Likelihood_ResponseClones_h
@@ -13,6 +13,8 @@
 
 #include "irfInterface/Irfs.h"
 
+#include "Likelihood/AeffTable.h"
+
 namespace astro {
    class SkyDir;
 }
@@ -37,6 +39,12 @@ public:
 
    ~ResponseFunctions();
 
+   /// A copy with its own clones of the irfInterface::Irfs objects.
+   /// The IRF classes cache values internally and so cannot be
+   /// evaluated on several threads at once; each thread uses its own
+   /// clone instead.  The caller owns the returned object.
+   ResponseFunctions * clone() const;
+
    /// Return the total instrument response 
    /// (= effective area*PSF*energy dispersion).
    /// @param energy True photon energy (MeV).
@@ -67,11 +75,13 @@ public:
    void setRespPtrs(std::map<unsigned int, irfInterface::Irfs *> 
                     &respPtrs) {
       m_respPtrs = respPtrs;
+      m_aeffTable.clear();
    }
 
    void addRespPtr(unsigned int key,
                    irfInterface::Irfs *respPtr) {
       m_respPtrs[key] = respPtr;
+      m_aeffTable.clear();
    }
 
    void deleteRespPtr(unsigned int key) {
@@ -79,6 +89,13 @@ public:
          delete m_respPtrs[key];
          m_respPtrs[key] = 0;
       }
+      m_aeffTable.clear();
+   }
+
+   /// Effective area values on the livetime cube inclination grid,
+   /// shared by the exposure and DRM calculations.
+   const AeffTable & aeffTable() const {
+      return m_aeffTable;
    }
 
    irfInterface::Irfs * respPtr(unsigned int eventType) const;
@@ -149,6 +166,8 @@ private:
 
    std::string m_respName;
 
+   AeffTable m_aeffTable;
+
 };
 
 } // namespace Likelihood
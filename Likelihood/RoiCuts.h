@@ -112,6 +112,11 @@ public:
    /// Apply these cuts to an Event
    bool accept(const Event &) const;
 
+   /// Apply these cuts to the FT1 values of an event, so that
+   /// rejected rows do not need an Event object.
+   bool accept(const astro::SkyDir & dir, double energy, double time,
+               double muZenith) const;
+
    /// Write DSS keywords to a FITS header
    void writeDssKeywords(tip::Header & header) const;
 
@@ -157,6 +157,11 @@ public:
    /* Update the DRM cache in this SourceMap */
    const Drm_Cache* update_drm_cache(const Drm* drm, bool force = false);
 
+   /* Update the DRM caches of several SourceMaps that use the same DRM.
+      The DRM is applied to all the spectra that have changed at once. */
+   static void update_drm_caches(const Drm* drm, 
+				 const std::vector<SourceMap*>& srcMaps);
+
    /* Extract a vector of spectral normalization values from a Source object
       and latch it in this class.
       
@@ -337,8 +342,9 @@ private:
    /// Object holding data about the observation
    const Observation & m_observation;
 
-   /// PSF for this particular source ( NULL for diffuse sources ) 
-   MeanPsf* m_meanPsf; 
+   /// PSF for this particular source ( NULL for diffuse sources ), owned by the
+   /// PsfCache and released when the source map is deleted or remade
+   const MeanPsf* m_meanPsf; 
 
    /// For Progress messages
    st_stream::StreamFormatter * m_formatter;
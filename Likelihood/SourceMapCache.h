@@ -27,6 +27,7 @@ namespace Likelihood {
    class CountsMapBase;
    class Drm;
    class Drm_Cache;
+   class DrmGrid;
    class SourceMap;
    class WeightMap;
 
@@ -63,6 +64,23 @@ namespace Likelihood {
 				     bool use_edisp_val,
 				     bool subtract);
 
+     /* Add the change in weights for a source onto a vector.
+	This is used to update the summed model when only the
+	spectrum of a source has changed.  It does not handle energy
+	dispersion, as the correction factors depend on the spectrum.
+
+	modelWts   : The vector being added to.
+	srcMap     : The SourceMap for the source in question
+	npix       : Number of pixel in the map, used for indexing
+	filledPixels : Vector with the indices of the filled pixels,
+	deltaSpec  : Change in the spectrum values at the energy bin edges
+     */
+     static void addSourceDeltaWts_static(std::vector<std::pair<double, double> > & modelWts,
+					  const SourceMap& srcMap,
+					  size_t npix,
+					  const std::vector<unsigned int>& filledPixels,
+					  const std::vector<double>& deltaSpec);
+
    public:
      
      /* Regular c'tor 
@@ -116,6 +134,20 @@ namespace Likelihood {
        m_config.set_use_edisp(use_edisp);
      }
 
+     /// Set the number of threads used to build source maps
+     void set_num_threads(int num_threads) {
+       m_config.set_num_threads(num_threads);
+     }
+
+     /* Set flag to delay building source maps.
+
+	If set, loadSourceMap does not build the SourceMap for a source,
+	it is built when it is first used or by buildSourceMaps.
+     */
+     void set_delay_srcmap_build(bool delay) {
+       m_delaySrcMapBuild = delay;
+     }
+
 
      /* ---------------- Methods Used by SourceModel ---------- */
      
@@ -148,6 +180,14 @@ namespace Likelihood {
      */
      double NpredValue(const Source& src, SourceMap & srcMap, size_t kmin, size_t kmax, bool weighted=false) const;
 
+     /* Bring the energy dispersion corrections of several sources up to date.
+
+	The DRM is applied to the spectra of all the sources that have 
+	changed in a single matrix product.  Later calls to NpredValue 
+	then find the corrections already current.
+     */
+     void updateCorrectionFactors(const std::vector<const Source*>& srcs) const;
+
      
      /* --------------- Functions for dealing with source maps -------------- */
      
@@ -190,6 +230,20 @@ namespace Likelihood {
      void loadSourceMaps(const std::vector<const Source*>& srcs,
 			 bool recreate=false, bool saveMaps=false);
      
+     /* Instantiate or retrieve the SourceMaps for a list of sources.
+
+	Maps that are in the source maps file, and those of diffuse
+	and composite sources, are made serially.  The point sources
+	are computed using num_threads threads (from the configuration),
+	each with its own clones of the response functions.  The
+	SourceMaps are only added to the internal map once they have
+	all been built.
+
+	recreate  : If true new source maps will be generated for all components.  
+     */
+     void buildSourceMaps(const std::vector<const Source*>& srcs,
+			  bool recreate=false);
+     
      /* Instantiate or retrieve a SourceMap for a single sources and
 	add it to the internal map of SourceMap objects.  
 
@@ -285,6 +339,15 @@ namespace Likelihood {
      /* Return true if we use energy dispersion for a particular source */
      bool use_edisp(const Source* src = 0) const;
 
+     /* Use a grid of detector response matrices for the point sources.
+	The grid is owned by the caller, and must outlive this object. */
+     void setDrmGrid(const DrmGrid* drmGrid) { m_drmGrid = drmGrid; }
+
+     /* The detector response matrix for a source.  
+	This is interpolated from the DrmGrid for point sources if there is a grid,
+	and the single matrix otherwise. */
+     const Drm* drm(const Source& src) const;
+
 
    protected:
      
@@ -358,10 +421,16 @@ namespace Likelihood {
      /// Detector response matrix for energy dispersion.  Null pointer -> no energy dispersion
      const Drm * m_drm;
 
+     /// Grid of detector response matrices for point sources.  Null pointer -> use m_drm
+     const DrmGrid * m_drmGrid;
+
      /* ------------- configuration parameters -------------------- */
      std::string m_srcMapsFile;   //! Where the SourceMaps are stored
      BinnedLikeConfig m_config;   //! All of the options
 
+     /// Do not build SourceMaps in loadSourceMap
+     bool m_delaySrcMapBuild;
+
 };
 
 }
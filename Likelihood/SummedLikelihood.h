@@ -15,11 +15,13 @@
 #include <map>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "optimizers/Statistic.h"
 
 #include "Likelihood/LogLike.h"
+#include "Likelihood/ParallelUtils.h"
 #include "Likelihood/TiedParameter.h"
 
 namespace Likelihood {
@@ -32,7 +34,8 @@ class SummedLikelihood : public optimizers::Statistic {
 
 public:
 
-   SummedLikelihood() : optimizers::Statistic(), m_masterComponent(0) {}
+   SummedLikelihood() : optimizers::Statistic(), m_masterComponent(0),
+                        m_numThreads(ParallelUtils::envThreads()) {}
 
    virtual ~SummedLikelihood() throw();
 
@@ -58,6 +61,20 @@ public:
 
    void syncParams();
 
+   /// Number of threads used to evaluate the components in value()
+   /// and getFreeDerivs().  If > 0, the components are evaluated
+   /// concurrently and their results are added in component order,
+   /// so the sums do not depend on the number of threads.  0
+   /// evaluates them one after the other.  The default is
+   /// ParallelUtils::envThreads().
+   void setNumThreads(int numThreads) {
+      m_numThreads = numThreads;
+   }
+
+   int numThreads() const {
+      return m_numThreads;
+   }
+
    double NpredValue(const std::string & srcname, bool weighted = false) const;
 
    /// Member functions to support tying of parameters.
@@ -104,6 +121,19 @@ private:
 
    LogLike * m_masterComponent;
 
+   int m_numThreads;
+
+   /// Free and tied flags of the parameters for which m_freeIndex was
+   /// computed
+   mutable std::vector<bool> m_freeFlags;
+
+   /// (Minos index, index in the LogLike::getFreeDerivs vector) of
+   /// each free parameter
+   mutable std::vector<std::pair<int, size_t> > m_freeIndex;
+
+   /// Update m_freeIndex if the free or tied parameters have changed.
+   void updateFreeIndex() const;
+
 };
 
 } // namespace Likelihood
@@ -0,0 +1,145 @@
+/**
+ * @file AeffTable.cxx
+ * @brief Table of effective area values shared by the exposure
+ * calculations for a given set of response functions.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+
+#include "irfInterface/IAeff.h"
+#include "irfInterface/Irfs.h"
+
+#include "Likelihood/AeffTable.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/ResponseFunctions.h"
+
+namespace {
+/// Index of x in the sorted vector xx, or -1 if it is not there.
+   template <typename T>
+   int nodeIndex(const std::vector<T> & xx, T x) {
+      typename std::vector<T>::const_iterator it
+         = std::lower_bound(xx.begin(), xx.end(), x);
+      if (it == xx.end() || *it != x) {
+         return -1;
+      }
+      return it - xx.begin();
+   }
+
+/// Sorted union of two sorted vectors
+   template <typename T>
+   std::vector<T> merge(const std::vector<T> & xx, std::vector<T> yy) {
+      std::sort(yy.begin(), yy.end());
+      std::vector<T> result;
+      std::set_union(xx.begin(), xx.end(), yy.begin(), yy.end(),
+                     std::back_inserter(result));
+      return result;
+   }
+}
+
+namespace Likelihood {
+
+void AeffTable::fill(const ResponseFunctions & respFuncs,
+                     const std::vector<double> & energies,
+                     const std::vector<double> & cosThetas,
+                     double time) const {
+   if (ParallelUtils::inParallel()) {
+      return;
+   }
+   if (m_values.size() > 0 && time != m_time) {
+      m_evtTypes.clear();
+      m_energies.clear();
+      m_cosThetas.clear();
+      m_values.clear();
+   }
+   std::map<int, irfInterface::IAeff *> aeffs;
+   std::vector<int> evtTypes;
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
+      resp(respFuncs.begin());
+   for ( ; resp != respFuncs.end(); ++resp) {
+      if (resp->second) {
+         aeffs[resp->second->irfID()] = resp->second->aeff();
+         evtTypes.push_back(resp->second->irfID());
+      }
+   }
+   std::vector<int> new_evtTypes(::merge(m_evtTypes, evtTypes));
+   std::vector<double> new_energies(::merge(m_energies, energies));
+   std::vector<double> new_cosThetas(::merge(m_cosThetas, cosThetas));
+   if (new_evtTypes == m_evtTypes && new_energies == m_energies
+       && new_cosThetas == m_cosThetas) {
+      return;
+   }
+
+   std::vector<double> new_values;
+   new_values.reserve(new_evtTypes.size()*new_energies.size()
+                      *new_cosThetas.size());
+   for (size_t itype(0); itype < new_evtTypes.size(); itype++) {
+      int evtType(new_evtTypes[itype]);
+      irfInterface::IAeff * aeff(aeffs.count(evtType) ? aeffs[evtType] : 0);
+      bool phiDependence(aeff ? aeff->usePhiDependence() : false);
+      if (aeff) {
+         aeff->setPhiDependence(false);
+      }
+      for (size_t ie(0); ie < new_energies.size(); ie++) {
+         for (size_t ic(0); ic < new_cosThetas.size(); ic++) {
+            double my_value(0);
+            if (!find(evtType, new_energies[ie], new_cosThetas[ic], time,
+                      my_value) && aeff) {
+               double inclination(std::acos(new_cosThetas[ic])*180./M_PI);
+               my_value = aeff->value(new_energies[ie], inclination, 0, time);
+            }
+            new_values.push_back(my_value);
+         }
+      }
+      if (aeff) {
+         aeff->setPhiDependence(phiDependence);
+      }
+   }
+   m_time = time;
+   m_evtTypes.swap(new_evtTypes);
+   m_energies.swap(new_energies);
+   m_cosThetas.swap(new_cosThetas);
+   m_values.swap(new_values);
+}
+
+bool AeffTable::find(int evtType, double energy, double cosTheta,
+                     double time, double & value) const {
+   if (m_values.size() == 0 || time != m_time) {
+      return false;
+   }
+   int itype(::nodeIndex(m_evtTypes, evtType));
+   int ie(::nodeIndex(m_energies, energy));
+   int ic(::nodeIndex(m_cosThetas, cosTheta));
+   if (itype < 0 || ie < 0 || ic < 0) {
+      return false;
+   }
+   value = m_values[(itype*m_energies.size() + ie)*m_cosThetas.size() + ic];
+   return true;
+}
+
+double AeffTable::value(irfInterface::IAeff & aeff, int evtType,
+                        double energy, double cosTheta, double phi,
+                        double time) const {
+   double my_value(0);
+   if (!aeff.usePhiDependence()
+       && find(evtType, energy, cosTheta, time, my_value)) {
+      return my_value;
+   }
+   double inclination = std::acos(cosTheta)*180./M_PI;
+   return aeff.value(energy, inclination, phi, time);
+}
+
+void AeffTable::clear() {
+   m_evtTypes.clear();
+   m_energies.clear();
+   m_cosThetas.clear();
+   m_values.clear();
+   m_time = 0;
+}
+
+} // namespace Likelihood
@@ -17,7 +17,11 @@ namespace Likelihood {
 				    bool& use_edisp,
 				    bool& use_linear_quadrature,
 				    bool& save_all_srcmaps,
-				    bool& use_single_psf) {
+				    bool& use_single_psf,
+				    bool& use_psf_stamp,
+				    int& num_threads,
+				    bool& use_incremental_model,
+				    int& drm_grid_order) {
          
     if(::getenv("USE_ADAPTIVE_PSF_ESTIMATOR")) {
       estimatorMethod = PsfIntegConfig::adaptive;
@@ -49,6 +53,22 @@ namespace Likelihood {
       use_single_psf = true;
     }
 
+    if (::getenv("USE_PSF_STAMP") ) {
+      use_psf_stamp = true;
+    }
+
+    if (::getenv("LIKELIHOOD_NUM_THREADS") ) {
+      num_threads = atoi(::getenv("LIKELIHOOD_NUM_THREADS"));
+    }
+
+    if (::getenv("USE_INCREMENTAL_MODEL") ) {
+      use_incremental_model = true;
+    }
+
+    if (::getenv("LIKELIHOOD_DRM_GRID_ORDER") ) {
+      drm_grid_order = atoi(::getenv("LIKELIHOOD_DRM_GRID_ORDER"));
+    }
+
   }
  
 } // namespace Likelihood
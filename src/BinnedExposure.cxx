@@ -31,6 +31,8 @@
 #include "Likelihood/BinnedExposure.h"
 #include "Likelihood/CountsMap.h"
 #include "Likelihood/Observation.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/ResponseClones.h"
 
 namespace Likelihood {
 
@@ -198,70 +200,167 @@ void BinnedExposure::computeMap() {
                                &m_cdelt[0], m_crota2, m_isGalactic);
 
    m_exposureMap.resize(m_naxes.at(0)*m_naxes.at(1)*m_energies.size(), 0);
-   long iter(0);
    st_stream::StreamFormatter formatter("BinnedExposure", "computeMap", 2);
    formatter.warn() << "Computing binned exposure map";
+   double tstart(ParallelUtils::wallTime());
 
    // Storing Aeff objects for use within loops over sky pixels.
-   std::map<std::pair<unsigned int, int>, Aeff *> aeffs;
+   std::vector<int> evtTypes;
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
+      resp = m_observation->respFuncs().begin();
+   for (; resp != m_observation->respFuncs().end(); ++resp) {
+      evtTypes.push_back(resp->second->irfID());
+   }
+   size_t ntypes(evtTypes.size());
+   std::vector<Aeff *> aeffs;
    for (unsigned int k(0); k < m_energies.size(); k++) {
-      std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
-         resp = m_observation->respFuncs().begin();
-      for (; resp != m_observation->respFuncs().end(); ++resp) {
-         int evtType = resp->second->irfID();
-         aeffs[std::make_pair(k, evtType)] =  
-            new Aeff(m_energies[k], evtType, *m_observation, m_costhmin,
-                     m_costhmax);
+      for (size_t itype(0); itype < ntypes; itype++) {
+         aeffs.push_back(new Aeff(m_energies[k], evtTypes[itype],
+                                  *m_observation, m_costhmin, m_costhmax));
       }
    }
+   // The effective areas are tabulated before any clones are made.
+   m_observation->expCube().fillAeffTable(m_observation->respFuncs(),
+                                          m_energies);
+   // The livetime efficiency factors depend only on the energy, and
+   // the efficiency factor object is shared, so they are computed here
+   // once rather than for each pixel.
+   m_livetimeFactors.resize(m_energies.size());
+   for (size_t k(0); k < m_energies.size(); k++) {
+      m_observation->expCube().livetimeFactors(m_energies[k],
+                                               m_livetimeFactors[k].first,
+                                               m_livetimeFactors[k].second);
+   }
 
-   long npix(m_naxes[0]*m_naxes[1]);
-   for (int j = 0; j < m_naxes.at(1); j++) {
-      for (int i = 0; i < m_naxes.at(0); i++, iter++) {
-         if (npix > 20 && (iter % (npix/20)) == 0) {
+   int nrows(m_naxes.at(1));
+   int istep(std::max(nrows/20, 1));
+   if (m_numThreads <= 0) {
+      std::vector<astro::SkyDir> dirs;
+      std::vector<bool> valid;
+      for (int j = 0; j < nrows; j++) {
+         if ((j % istep) == 0) {
             formatter.warn() << ".";
          }
-         // std::pair<double, double> coord = m_proj->pix2sph(i + 1, j + 1);
-         // astro::SkyDir dir(coord.first, coord.second, coordsys);
-         astro::SkyDir dir;
-         try {
-            st_facilities::Util::pixel2SkyDir(*m_proj, i + 1, j + 1, dir);
-         } catch (...) {
-            // The astro::SkyProj class throws a SkyProjException
-            // here, but SkyProjException is annoyingly defined in
-            // SkyProj.cxx
-            // http://www-glast.stanford.edu/cgi-bin/viewcvs/astro/src/SkyProj.cxx?revision=1.27&view=markup
-            // so that client code cannot catch it directly. Amazing.
-            continue;
+         rowDirs(j, dirs, valid);
+         computeRow(j, dirs, valid, aeffs, ntypes);
+      }
+   } else {
+// Each row of the map is computed by a single thread, and each thread
+// has its own Aeff functors, built on its own clones of the response
+// functions, since neither the functor caches nor the IRFs are
+// thread-safe.  The values in each pixel are summed in the same order
+// as in the serial loop, so the map is identical.
+      int nthreads = ParallelUtils::numThreads(m_numThreads);
+      ResponseClones clones(*m_observation, nthreads);
+      int rowsDone(0);
+      std::string errorMessage;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+      {
+         const Observation & my_observation(clones.observation());
+         std::vector<Aeff *> my_aeffs;
+         for (unsigned int k(0); k < m_energies.size(); k++) {
+            for (size_t itype(0); itype < ntypes; itype++) {
+               my_aeffs.push_back(new Aeff(m_energies[k], evtTypes[itype],
+                                           my_observation, m_costhmin,
+                                           m_costhmax));
+            }
          }
-                                           
-         for (unsigned int k = 0; k < m_energies.size(); k++) {
-            unsigned int indx = (k*m_naxes.at(1) + j)*m_naxes.at(0) + i;
-            std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
-               resp = m_observation->respFuncs().begin();
-            for (; resp != m_observation->respFuncs().end(); ++resp) {
-               int evtType = resp->second->irfID();
-               // Aeff aeff(m_energies[k], evtType, *m_observation, m_costhmin,
-               //           m_costhmax);
-               Aeff & aeff = *aeffs[std::make_pair(k, evtType)];
-               m_exposureMap.at(indx)
-                  +=m_observation->expCube().value(dir, aeff, m_energies.at(k));
+         std::vector<astro::SkyDir> dirs;
+         std::vector<bool> valid;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+         for (int j = 0; j < nrows; j++) {
+            try {
+// SkyProj is not guaranteed to be thread-safe.
+#ifdef _OPENMP
+#pragma omp critical(BinnedExposure_proj)
+#endif
+               rowDirs(j, dirs, valid);
+               computeRow(j, dirs, valid, my_aeffs, ntypes);
+            } catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(BinnedExposure_error)
+#endif
+               errorMessage = eObj.what();
+            }
+#ifdef _OPENMP
+#pragma omp critical(BinnedExposure_progress)
+#endif
+            {
+               if ((rowsDone % istep) == 0) {
+                  formatter.warn() << ".";
+               }
+               rowsDone++;
             }
          }
+         for (size_t i(0); i < my_aeffs.size(); i++) {
+            delete my_aeffs[i];
+         }
+      }
+      (void)(nthreads);
+      if (errorMessage != "") {
+         for (size_t i(0); i < aeffs.size(); i++) {
+            delete aeffs[i];
+         }
+         throw std::runtime_error(errorMessage);
       }
    }
 
-   // Release memory of Aeff map.
-   for (unsigned int k(0); k < m_energies.size(); k++) {
-      std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
-         resp = m_observation->respFuncs().begin();
-      for (; resp != m_observation->respFuncs().end(); ++resp) {
-         int evtType = resp->second->irfID();
-         delete aeffs[std::make_pair(k, evtType)];
-      }
+   // Release memory of Aeff objects.
+   for (size_t i(0); i < aeffs.size(); i++) {
+      delete aeffs[i];
    }
 
    formatter.warn() << "!" << std::endl;
+   formatter.info() << "Computed " << m_naxes.at(0)*m_naxes.at(1)
+                    << " pixels x " << m_energies.size() << " energies in "
+                    << ParallelUtils::wallTime() - tstart << " s using "
+                    << (m_numThreads > 0 ? 
+                        ParallelUtils::numThreads(m_numThreads) : 1)
+                    << " thread(s)" << std::endl;
+}
+
+void BinnedExposure::rowDirs(int j, std::vector<astro::SkyDir> & dirs,
+                             std::vector<bool> & valid) const {
+   int ncols(m_naxes.at(0));
+   dirs.resize(ncols);
+   valid.assign(ncols, false);
+   for (int i = 0; i < ncols; i++) {
+      try {
+         st_facilities::Util::pixel2SkyDir(*m_proj, i + 1, j + 1, dirs[i]);
+         valid[i] = true;
+      } catch (...) {
+         // The astro::SkyProj class throws a SkyProjException
+         // here, but SkyProjException is annoyingly defined in
+         // SkyProj.cxx
+         // http://www-glast.stanford.edu/cgi-bin/viewcvs/astro/src/SkyProj.cxx?revision=1.27&view=markup
+         // so that client code cannot catch it directly. Amazing.
+      }
+   }
+}
+
+void BinnedExposure::computeRow(int j, const std::vector<astro::SkyDir> & dirs,
+                                const std::vector<bool> & valid,
+                                const std::vector<Aeff *> & aeffs,
+                                size_t ntypes) {
+   for (int i = 0; i < m_naxes.at(0); i++) {
+      if (!valid[i]) {
+         continue;
+      }
+      for (unsigned int k = 0; k < m_energies.size(); k++) {
+         unsigned int indx = (k*m_naxes.at(1) + j)*m_naxes.at(0) + i;
+         for (size_t itype(0); itype < ntypes; itype++) {
+            const Aeff & aeff = *aeffs[k*ntypes + itype];
+            m_exposureMap.at(indx)
+               += m_observation->expCube().value(dirs[i], aeff,
+                                                 m_livetimeFactors[k].first,
+                                                 m_livetimeFactors[k].second);
+         }
+      }
+   }
 }
 
 void BinnedExposure::writeOutput(const std::string & filename) const {
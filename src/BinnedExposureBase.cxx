@@ -31,6 +31,7 @@
 #include "Likelihood/BinnedExposureBase.h"
 #include "Likelihood/CountsMap.h"
 #include "Likelihood/Observation.h"
+#include "Likelihood/ParallelUtils.h"
 
 
 namespace Likelihood {
@@ -58,16 +59,18 @@ BinnedExposureBase::findNearest(const std::vector<double> & xx, double x, double
 
 BinnedExposureBase::BinnedExposureBase() : m_observation(0), m_proj(0), 
 					   m_costhmin(-1), m_costhmax(1),
-					   m_enforce_boundaries(false) {}
+					   m_enforce_boundaries(false),
+					   m_numThreads(ParallelUtils::envThreads()) {}
 
 BinnedExposureBase::BinnedExposureBase(const Observation & observation,
 				       bool useEbounds,
 				       const st_app::AppParGroup * pars)
    : m_observation(&observation), m_proj(0), m_costhmin(-1), m_costhmax(1),
      m_enforce_boundaries(false),
-     m_allSky(false){
+     m_allSky(false), m_numThreads(ParallelUtils::envThreads()) {
    if (pars) {
       setCosThetaBounds(*pars);
+      setNumThreads(*pars);
    }
 }
 
@@ -75,15 +78,18 @@ BinnedExposureBase::BinnedExposureBase(const std::vector<double> & energies,
 				       const Observation & observation,
 				       const st_app::AppParGroup * pars) 
    : m_energies(energies), m_observation(&observation), m_proj(0),
-     m_costhmin(-1), m_costhmax(1),m_enforce_boundaries(false),m_allSky(false)  {
+     m_costhmin(-1), m_costhmax(1),m_enforce_boundaries(false),m_allSky(false),
+     m_numThreads(ParallelUtils::envThreads()) {
    if (pars) {
       setCosThetaBounds(*pars);
+      setNumThreads(*pars);
    } 
 }
 
 BinnedExposureBase::BinnedExposureBase(const std::string & filename) 
    : m_observation(0), m_proj(0), m_costhmin(-1), m_costhmax(1),
-     m_enforce_boundaries(false),m_allSky(false) {
+     m_enforce_boundaries(false),m_allSky(false),
+     m_numThreads(ParallelUtils::envThreads()) {
 
    std::auto_ptr<const tip::Table>
     energies(tip::IFileSvc::instance().readTable(filename, "Energies"));
@@ -114,6 +120,17 @@ void BinnedExposureBase::setCosThetaBounds(const st_app::AppParGroup & pars) {
    }
 }
 
+void BinnedExposureBase::setNumThreads(const st_app::AppParGroup & pars) {
+// Only some of the applications have this parameter.
+   try {
+      int numthreads = pars["numthreads"];
+      if (numthreads > 0) {
+         m_numThreads = numthreads;
+      }
+   } catch (hoops::Hexception &) {
+   }
+}
+
 double BinnedExposureBase::Aeff::value(double cosTheta, double phi) const {
    if (cosTheta < m_costhmin || cosTheta > m_costhmax) {
       return 0;
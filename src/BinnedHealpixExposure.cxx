@@ -155,6 +155,8 @@ void BinnedHealpixExposure::computeHealpixMap(const evtbin::HealpixMap & cmap) {
 		 m_costhmax);
     }
   }
+  m_observation->expCube().fillAeffTable(m_observation->respFuncs(),
+                                         m_energies);
   int npix = m_healpixProj->healpix().Npix();
   for (int i = 0; i < npix; i++ ) {
     if (npix > 20 && (i % (npix/20)) == 0) {
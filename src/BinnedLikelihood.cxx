@@ -28,9 +28,11 @@
 #include "Likelihood/CompositeSource.h"
 #include "Likelihood/FitUtils.h"
 #include "Likelihood/FileUtils.h"
+#include "Likelihood/ParallelUtils.h"
 #include "Likelihood/WeightMap.h"
 
 #include "Likelihood/Drm.h"
+#include "Likelihood/DrmGrid.h"
 #define ST_DLL_EXPORTS
 #include "Likelihood/SourceMap.h"
 #undef ST_DLL_EXPORTS
@@ -62,11 +64,15 @@ BinnedLikelihood::BinnedLikelihood(CountsMapBase & dataMap,
 	     true,false,true,false),
     m_drm(new Drm(m_dataCache.countsMap().refDir().ra(), m_dataCache.countsMap().refDir().dec(), 
 		  observation, m_dataCache.countsMap().energies())),
+    m_drmGrid(0),
     m_srcMapCache(m_dataCache,observation,srcMapsFile,m_config,m_drm),
     m_modelIsCurrent(false),
+    m_modelWtsCurrent(false),
+    m_nModelWtsUpdates(0),
     m_updateFixedWeights(true){
   m_fixedModelWts.resize(m_dataCache.nFilled(), std::make_pair(0, 0));
   m_fixedNpreds.resize(m_dataCache.num_energies(), 0); 
+  buildDrmGrid();
 }
 
 BinnedLikelihood::BinnedLikelihood(CountsMapBase & dataMap,
@@ -93,11 +99,15 @@ BinnedLikelihood::BinnedLikelihood(CountsMapBase & dataMap,
 	     true,false,true,false),
     m_drm(new Drm(m_dataCache.countsMap().refDir().ra(), m_dataCache.countsMap().refDir().dec(), 
 		  observation, m_dataCache.countsMap().energies())),
+    m_drmGrid(0),
     m_srcMapCache(m_dataCache,observation,srcMapsFile,m_config,m_drm),
     m_modelIsCurrent(false),
+    m_modelWtsCurrent(false),
+    m_nModelWtsUpdates(0),
     m_updateFixedWeights(true){    
   m_fixedModelWts.resize(m_dataCache.nFilled(), std::make_pair(0, 0));
   m_fixedNpreds.resize(m_dataCache.num_energies(), 0);
+  buildDrmGrid();
 }
 
 BinnedLikelihood::BinnedLikelihood(CountsMapBase & dataMap,
@@ -112,19 +122,25 @@ BinnedLikelihood::BinnedLikelihood(CountsMapBase & dataMap,
     m_config(config),
     m_drm(new Drm(m_dataCache.countsMap().refDir().ra(), m_dataCache.countsMap().refDir().dec(), 
 		  observation, m_dataCache.countsMap().energies())),
+    m_drmGrid(0),
     m_srcMapCache(m_dataCache,observation,srcMapsFile,m_config,m_drm),
     m_modelIsCurrent(false),
+    m_modelWtsCurrent(false),
+    m_nModelWtsUpdates(0),
     m_updateFixedWeights(true){    
   m_fixedModelWts.resize(m_dataCache.nFilled(), std::make_pair(0, 0));
   m_fixedNpreds.resize(m_dataCache.num_energies(), 0);
+  buildDrmGrid();
 }
 
 BinnedLikelihood::~BinnedLikelihood() throw() {
+  delete m_drmGrid;
   delete m_drm;
 }
 
 
 void BinnedLikelihood::setCountsMap(const std::vector<float> & counts) {
+  m_modelWtsCurrent = false;
   m_dataCache.setCountsMap(counts);
   buildFixedModelWts();
 }
@@ -138,13 +154,17 @@ double BinnedLikelihood::value(optimizers::Arg & dummy) const {
   
   const std::vector<float> & data = m_dataCache.data( m_dataCache.has_weights() );
   
-  for (size_t i(0); i < m_dataCache.nFilled(); i++) {
-    if (m_model.at(i) > 0) {
-      size_t j(m_dataCache.filledPixels()[i]);
-      size_t k(j/num_pixels());
-      if (k >= m_kmin && k <= m_kmax) {
-	double addend = data.at(j)*std::log(m_model[i]);
-	m_accumulator.add(addend);
+  if (m_config.num_threads() > 0) {
+    m_accumulator.add(logModelSum_chunked(data));
+  } else {
+    for (size_t i(0); i < m_dataCache.nFilled(); i++) {
+      if (m_model.at(i) > 0) {
+	size_t j(m_dataCache.filledPixels()[i]);
+	size_t k(j/num_pixels());
+	if (k >= m_kmin && k <= m_kmax) {
+	  double addend = data.at(j)*std::log(m_model[i]);
+	  m_accumulator.add(addend);
+	}
       }
     }
   }
@@ -217,37 +237,41 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
 
   //   timer.start();
-  for (size_t j(jentry); j < m_dataCache.nFilled(); j++) {
-    size_t jmin(m_dataCache.filledPixels()[j]);
-    size_t jmax(jmin + num_pixels());
-    size_t k(jmin/num_pixels());
-    if (k < m_kmin || k > m_kmax-1) {
-      continue;
-    }
-    double emin(m_dataCache.energies().at(k));
-    double emax(m_dataCache.energies().at(k+1));
-    if (m_model.at(j) > 0) {
-      long iparam(0);
+  if (m_config.num_threads() > 0) {
+    addPixelDerivs_chunked(free_srcs, jentry, data, posDerivs, negDerivs);
+  } else {
+    for (size_t j(jentry); j < m_dataCache.nFilled(); j++) {
+      size_t jmin(m_dataCache.filledPixels()[j]);
+      size_t jmax(jmin + num_pixels());
+      size_t k(jmin/num_pixels());
+      if (k < m_kmin || k > m_kmax-1) {
+	continue;
+      }
+      double emin(m_dataCache.energies().at(k));
+      double emax(m_dataCache.energies().at(k+1));
+      if (m_model.at(j) > 0) {
+	long iparam(0);
      
-      for (std::vector<Source *>::const_iterator it(free_srcs.begin());
-	   it != free_srcs.end(); ++it ) {
-	Source * src(*it);
+	for (std::vector<Source *>::const_iterator it(free_srcs.begin());
+	     it != free_srcs.end(); ++it ) {
+	  Source * src(*it);
 	
-	std::string srcName = src->getName();
-	SourceMap & srcMap = sourceMap(srcName);
+	  std::string srcName = src->getName();
+	  SourceMap & srcMap = sourceMap(srcName);
 	
-	const std::vector< std::vector<double> > & specDerivs = srcMap.cached_specDerivs();
-
-	for (size_t i(0); i < specDerivs.size(); i++, iparam++) {
-	  double my_deriv = pixelCounts(emin,emax,
-					srcMap[jmin]*specDerivs[i][k],
-					srcMap[jmax]*specDerivs[i][k+1],
-					m_dataCache.log_energy_ratios()[k]);
-	  double addend(data.at(jmin)/m_model.at(j)*my_deriv);
-	  if (addend > 0) {
-	    posDerivs[iparam].add(addend);
-	  } else {
-	    negDerivs[iparam].add(addend);
+	  const std::vector< std::vector<double> > & specDerivs = srcMap.cached_specDerivs();
+
+	  for (size_t i(0); i < specDerivs.size(); i++, iparam++) {
+	    double my_deriv = pixelCounts(emin,emax,
+					  srcMap[jmin]*specDerivs[i][k],
+					  srcMap[jmax]*specDerivs[i][k+1],
+					  m_dataCache.log_energy_ratios()[k]);
+	    double addend(data.at(jmin)/m_model.at(j)*my_deriv);
+	    if (addend > 0) {
+	      posDerivs[iparam].add(addend);
+	    } else {
+	      negDerivs[iparam].add(addend);
+	    }
 	  }
 	}
       }
@@ -335,6 +359,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
   void BinnedLikelihood::addSource(Source * src, bool fromClone, SourceMap* srcMap) {
     m_bestValueSoFar = -1e38;
+    m_modelWtsCurrent = false;
     SourceModel::addSource(src, fromClone);
     if ( m_config.use_single_fixed_map() && src->fixedSpectrum()) {
       addFixedSource(src->getName());
@@ -349,6 +374,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
   void BinnedLikelihood::addSource(Source * src, BinnedLikeConfig* config, bool fromClone) {
     m_bestValueSoFar = -1e38;
+    m_modelWtsCurrent = false;
     SourceModel::addSource(src, fromClone);
     if ( m_config.use_single_fixed_map() && src->fixedSpectrum()) {
       addFixedSource(src->getName());
@@ -363,6 +389,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
   Source * BinnedLikelihood::deleteSource(const std::string & srcName) {
     m_bestValueSoFar = -1e38;
+    m_modelWtsCurrent = false;
     // Check if this is a fixed source, and if so, remove it from the fixed model.
     std::vector<std::string>::iterator srcIt = 
       std::find(m_fixedSources.begin(), m_fixedSources.end(), srcName);
@@ -422,11 +449,13 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
 
   SourceMap * BinnedLikelihood::createSourceMap(const std::string & srcName) {
+    m_modelWtsCurrent = false;
     Source * src = getSource(srcName);
     return m_srcMapCache.createSourceMap(*src);
   }
 
   void BinnedLikelihood::eraseSourceMap(const std::string & srcName) {
+    m_modelWtsCurrent = false;
     m_srcMapCache.eraseSourceMap(srcName);
   }
 
@@ -440,6 +469,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
   void BinnedLikelihood::loadSourceMaps(const  std::vector<std::string>& srcNames,
 					bool recreate, bool saveMaps) {  
+    m_modelWtsCurrent = false;
     std::vector<const Source*> srcs;
     getSources(srcNames,srcs);
     m_srcMapCache.loadSourceMaps(srcs,recreate,saveMaps);
@@ -448,6 +478,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
   void BinnedLikelihood::loadSourceMap(const std::string & srcName, bool recreate,
 				       bool buildFixedWeights) {
 
+    m_modelWtsCurrent = false;
     const Source& src = source(srcName);
     m_srcMapCache.loadSourceMap(src,recreate);
  
@@ -461,6 +492,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
   void BinnedLikelihood::setSourceMapImage(const std::string & name,
 					   const std::vector<float>& image) {
+    m_modelWtsCurrent = false;
     const Source& src = source(name);
     m_srcMapCache.setSourceMapImage(src,image);
   }
@@ -527,27 +559,48 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
   double BinnedLikelihood::computeModelMap_internal(bool weighted) const {
     double npred(0);
   
-    std::vector<std::pair<double, double> > modelWts;
-    modelWts.resize(m_dataCache.nFilled());
+    std::vector<std::pair<double, double> > localWts;
+    bool incremental = m_config.use_incremental_model();
+    if ( !incremental ) {
+      localWts.resize(m_dataCache.nFilled());
+    }
+    std::vector<std::pair<double, double> > & modelWts = incremental ? m_modelWts : localWts;
   
     if (fixedModelUpdated() && m_updateFixedWeights) {
       const_cast<BinnedLikelihood *>(this)->buildFixedModelWts();
     }
   
-    for (size_t j(0); j < m_fixedModelWts.size(); j++) {
-      modelWts.at(j).first = m_fixedModelWts.at(j).first;
-      modelWts.at(j).second = m_fixedModelWts.at(j).second;
+    if ( !incremental ) {
+      for (size_t j(0); j < m_fixedModelWts.size(); j++) {
+	modelWts.at(j).first = m_fixedModelWts.at(j).first;
+	modelWts.at(j).second = m_fixedModelWts.at(j).second;
+      }
     }
   
     std::vector<std::string> srcNames;
     getSrcNames(srcNames);
+    if ( m_config.use_edisp() ) {
+      // Apply the DRM to all the sources at once, rather than 
+      // one source at a time in NpredValue
+      std::vector<const Source*> srcs;
+      getSources(srcNames,srcs);
+      m_srcMapCache.updateCorrectionFactors(srcs);
+    }
+    std::vector<std::string> freeSrcNames;
     for (size_t i(0); i < srcNames.size(); i++) {
       npred += NpredValue(srcNames[i],weighted);
       if (std::count(m_fixedSources.begin(), m_fixedSources.end(),
 		     srcNames.at(i)) == 0) {
-	addSourceWts(modelWts, srcNames[i]);
+	if ( incremental ) {
+	  freeSrcNames.push_back(srcNames[i]);
+	} else {
+	  addSourceWts(modelWts, srcNames[i]);
+	}
       }
     }
+    if ( incremental ) {
+      updateModelWts(freeSrcNames);
+    }
   
     m_model.clear();
     m_model.resize(m_dataCache.nFilled(), 0);
@@ -567,6 +620,71 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
     return npred;
   }
 
+  void BinnedLikelihood::updateModelWts(const std::vector<std::string> & freeSrcNames) const {
+    // Rebuild from scratch every so often, so that rounding errors
+    // from the incremental updates do not build up.
+    static const size_t maxUpdates(100);
+
+    bool rebuild = !m_modelWtsCurrent || 
+      m_modelWts.size() != m_dataCache.nFilled() ||
+      m_modelSpecVals.size() != freeSrcNames.size() ||
+      m_nModelWtsUpdates >= maxUpdates;
+
+    std::vector<SourceMap *> changed;
+    for (size_t i(0); i < freeSrcNames.size() && !rebuild; i++) {
+      if (m_modelSpecVals.count(freeSrcNames[i]) == 0) {
+	rebuild = true;
+	break;
+      }
+      SourceMap * srcMap = getSourceMap(freeSrcNames[i]);
+      if (srcMap->spectrum_changed()) {
+	if (use_edisp(freeSrcNames[i])) {
+	  // The energy dispersion corrections depend on the spectrum,
+	  // so we can't just add the change.
+	  rebuild = true;
+	  break;
+	}
+	changed.push_back(srcMap);
+      }
+    }
+
+    if (rebuild) {
+      m_modelWts.resize(m_dataCache.nFilled());
+      std::copy(m_fixedModelWts.begin(), m_fixedModelWts.end(), m_modelWts.begin());
+      m_modelSpecVals.clear();
+      for (size_t i(0); i < freeSrcNames.size(); i++) {
+	SourceMap * srcMap = getSourceMap(freeSrcNames[i]);
+	addSourceWts(m_modelWts, freeSrcNames[i], srcMap, false, true);
+	m_modelSpecVals[freeSrcNames[i]] = srcMap->specVals();
+      }
+      m_modelWtsCurrent = true;
+      m_nModelWtsUpdates = 0;
+      return;
+    }
+
+    if (changed.size() == 0) {
+      return;
+    }
+
+    std::vector<double> deltaSpec;
+    for (std::vector<SourceMap *>::const_iterator itr = changed.begin();
+	 itr != changed.end(); itr++ ) {
+      SourceMap * srcMap = *itr;
+      srcMap->setSpectralValues(m_dataCache.energies(), true);
+      const std::vector<double> & newSpec = srcMap->specVals();
+      std::vector<double> & oldSpec = m_modelSpecVals[srcMap->name()];
+      deltaSpec.resize(newSpec.size());
+      for (size_t k(0); k < newSpec.size(); k++) {
+	deltaSpec[k] = newSpec[k] - oldSpec[k];
+      }
+      SourceMapCache::addSourceDeltaWts_static(m_modelWts, *srcMap, num_pixels(),
+					       m_dataCache.filledPixels(), deltaSpec);
+      oldSpec = newSpec;
+    }
+    m_nModelWtsUpdates++;
+  }
+
+
   void BinnedLikelihood::computeModelMap(std::vector<float> & modelMap) const {
     std::vector<std::string> srcNames;
     getSrcNames(srcNames);
@@ -652,6 +770,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
 
 
   void BinnedLikelihood::buildFixedModelWts(bool process_all) {
+    m_modelWtsCurrent = false;
     m_fixedSources.clear();
     m_fixedModelWts.clear();
     m_fixedModelWts.resize(m_dataCache.nFilled(), std::make_pair(0, 0));
@@ -702,6 +821,7 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
       throw std::runtime_error(message.str());
     }
   
+    m_modelWtsCurrent = false;
     m_fixedSources.push_back(srcName);
     const Source& src = *(srcIt->second);
     SourceMap * srcMap = m_srcMapCache.getSourceMap(src);
@@ -746,6 +866,8 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
       throw std::runtime_error(message.str());
     }
   
+    m_modelWtsCurrent = false;
+
     // Generate the SourceMap and include it in the stored maps.
     SourceMap * srcMap = getSourceMap(srcName, false);
     if (srcMap == 0) {
@@ -850,6 +972,21 @@ void BinnedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
   }
 
 
+  void BinnedLikelihood::buildDrmGrid() {
+    if ( m_config.drm_grid_order() < 0 ) {
+      return;
+    }
+    const CountsMapBase& cmap = m_dataCache.countsMap();
+    // Extend the grid past the edge of the map, since the 
+    // interpolation uses the nodes on both sides of each source
+    double pixelSize = std::sqrt(4.*M_PI/(12.*std::pow(4.,m_config.drm_grid_order())))*180./M_PI;
+    m_drmGrid = new DrmGrid(cmap.refDir(), cmap.mapRadius() + pixelSize, 
+			    m_config.drm_grid_order(), observation(), cmap.energies(),
+			    DrmGrid::cacheFileName(m_srcMapsFile), m_config.num_threads());
+    m_srcMapCache.setDrmGrid(m_drmGrid);
+  }
+
+
   void BinnedLikelihood::initialize_composite(CompositeSource& comp) const {
     comp.buildSourceMapCache(m_dataCache,m_srcMapsFile,m_drm);
   }
@@ -895,6 +1032,156 @@ double BinnedLikelihood::pixelCounts(double emin, double emax, double y1, double
 }
 
 
+double BinnedLikelihood::logModelSum_chunked(const std::vector<float> & data) const {
+  std::vector<size_t> bounds;
+  ParallelUtils::makeChunks(0, m_dataCache.nFilled(), 
+			    ParallelUtils::defaultChunkSize, bounds);
+  int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+  std::vector<double> partials(nchunks, 0);
+
+  const std::vector<unsigned int> & filled = m_dataCache.filledPixels();
+  const size_t npix(num_pixels());
+  int nthreads = ParallelUtils::numThreads(m_config.num_threads());
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+  for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+    Kahan_Accumulator accum;
+    for (size_t i(bounds[ichunk]); i < bounds[ichunk+1]; i++) {
+      if (m_model[i] > 0) {
+	size_t j(filled[i]);
+	size_t k(j/npix);
+	if (k >= m_kmin && k <= m_kmax) {
+	  accum.add(data[j]*std::log(m_model[i]));
+	}
+      }
+    }
+    partials[ichunk] = accum.total();
+  }
+  (void)(nthreads);
+  return ParallelUtils::orderedSum(partials);
+}
+
+
+void BinnedLikelihood::addPixelDerivs_chunked(const std::vector<Source *> & free_srcs,
+					      size_t jentry,
+					      const std::vector<float> & data,
+					      std::vector<Kahan_Accumulator> & posDerivs,
+					      std::vector<Kahan_Accumulator> & negDerivs) const {
+  // Resolve the source maps and spectral derivatives once, so that the
+  // pixel loop does not do any name lookups.
+  std::vector<const SourceMap *> srcMaps;
+  std::vector<const std::vector<std::vector<double> > *> srcDerivs;
+  std::vector<size_t> parOffsets;
+  size_t nparams(0);
+  for (std::vector<Source *>::const_iterator it(free_srcs.begin());
+       it != free_srcs.end(); ++it ) {
+    const SourceMap & srcMap = sourceMap((*it)->getName());
+    srcMaps.push_back(&srcMap);
+    srcDerivs.push_back(&srcMap.cached_specDerivs());
+    parOffsets.push_back(nparams);
+    nparams += srcMap.cached_specDerivs().size();
+  }
+  if (nparams == 0) {
+    return;
+  }
+
+  // Both quadrature rules are linear in the weights at the bin edges,
+  // i.e., counts = c1[k]*y1 + c2[k]*y2
+  const std::vector<double> & energies = m_dataCache.energies();
+  std::vector<double> c1(m_dataCache.num_ebins(), 0);
+  std::vector<double> c2(m_dataCache.num_ebins(), 0);
+  for (size_t k(0); k < c1.size(); k++) {
+    c1[k] = pixelCounts(energies[k], energies[k+1], 1., 0., m_dataCache.log_energy_ratios()[k]);
+    c2[k] = pixelCounts(energies[k], energies[k+1], 0., 1., m_dataCache.log_energy_ratios()[k]);
+  }
+
+  std::vector<size_t> bounds;
+  ParallelUtils::makeChunks(jentry, m_dataCache.nFilled(), 
+			    ParallelUtils::defaultChunkSize, bounds);
+  int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+  
+  // One row of partial sums per chunk, one column per parameter
+  std::vector<double> chunkPos(nchunks*nparams, 0);
+  std::vector<double> chunkNeg(nchunks*nparams, 0);
+  
+  const std::vector<unsigned int> & filled = m_dataCache.filledPixels();
+  const size_t npix(num_pixels());
+  int nthreads = ParallelUtils::numThreads(m_config.num_threads());
+
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+  {
+    // Per-thread workspace, reused for every chunk
+    std::vector<size_t> pixels;
+    std::vector<size_t> kvals;
+    std::vector<double> ratios;
+    std::vector<double> a1;
+    std::vector<double> a2;
+    std::vector<Kahan_Accumulator> pos(nparams);
+    std::vector<Kahan_Accumulator> neg(nparams);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      // Select the pixels in this chunk that contribute
+      pixels.clear();
+      kvals.clear();
+      ratios.clear();
+      for (size_t j(bounds[ichunk]); j < bounds[ichunk+1]; j++) {
+	size_t k(filled[j]/npix);
+	if (k < m_kmin || k > m_kmax-1 || !(m_model[j] > 0)) {
+	  continue;
+	}
+	pixels.push_back(filled[j]);
+	kvals.push_back(k);
+	ratios.push_back(data[filled[j]]/m_model[j]);
+      }
+      size_t npts(pixels.size());
+      a1.resize(npts);
+      a2.resize(npts);
+
+      for (size_t isrc(0); isrc < srcMaps.size(); isrc++) {
+	const SourceMap & srcMap = *(srcMaps[isrc]);
+	for (size_t ipt(0); ipt < npts; ipt++) {
+	  a1[ipt] = ratios[ipt]*c1[kvals[ipt]]*srcMap[pixels[ipt]];
+	  a2[ipt] = ratios[ipt]*c2[kvals[ipt]]*srcMap[pixels[ipt] + npix];
+	}
+	const std::vector<std::vector<double> > & specDerivs = *(srcDerivs[isrc]);
+	for (size_t i(0); i < specDerivs.size(); i++) {
+	  const double * dd = &(specDerivs[i][0]);
+	  size_t iparam(parOffsets[isrc] + i);
+	  for (size_t ipt(0); ipt < npts; ipt++) {
+	    double addend = a1[ipt]*dd[kvals[ipt]] + a2[ipt]*dd[kvals[ipt]+1];
+	    if (addend > 0) {
+	      pos[iparam].add(addend);
+	    } else {
+	      neg[iparam].add(addend);
+	    }
+	  }
+	}
+      }
+      for (size_t iparam(0); iparam < nparams; iparam++) {
+	chunkPos[ichunk*nparams + iparam] = pos[iparam].total();
+	chunkNeg[ichunk*nparams + iparam] = neg[iparam].total();
+      }
+    }
+  }
+  (void)(nthreads);
+
+  // Merge the chunks in order
+  for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+    for (size_t iparam(0); iparam < nparams; iparam++) {
+      posDerivs[iparam].add(chunkPos[ichunk*nparams + iparam]);
+      negDerivs[iparam].add(chunkNeg[ichunk*nparams + iparam]);
+    }
+  }
+}
+
+
 void BinnedLikelihood::computeFixedCountsSpectrum() {
   m_fixed_counts_spec.clear();
   for (size_t k(0); k < m_dataCache.num_ebins(); k++) {
@@ -14,6 +14,7 @@
 #include <stdexcept>
 
 #include "Likelihood/CompositeLikelihood.h"
+#include "Likelihood/ParallelUtils.h"
 
 namespace Likelihood {
 
@@ -40,6 +41,20 @@ void CompositeLikelihood::addComponent(const std::string & srcName,
 
 double CompositeLikelihood::value() const {
    double my_value(0);
+   if (m_numThreads > 0) {
+// Each component is the LogLike for a separate ROI, so they can be
+// evaluated at the same time.  The parameters have already been
+// pushed to the components by setFreeParamValues.
+      std::vector<LogLike *> components;
+      getComponents(components);
+      std::vector<double> values;
+      ParallelUtils::evaluateComponents(components, m_numThreads,
+                                        &values, 0);
+      for (size_t i(0); i < values.size(); i++) {
+         my_value += values[i];
+      }
+      return my_value;
+   }
    ComponentConstIterator_t it(m_components.begin());
    for ( ; it != m_components.end(); ++it) {
       my_value += it->first->value();
@@ -47,6 +62,15 @@ double CompositeLikelihood::value() const {
    return my_value;
 }
 
+void CompositeLikelihood::
+getComponents(std::vector<LogLike *> & components) const {
+   components.clear();
+   for (ComponentConstIterator_t it(m_components.begin());
+        it != m_components.end(); ++it) {
+      components.push_back(it->first);
+   }
+}
+
 // void CompositeLikelihood::
 // getIndices(std::vector<std::vector<size_t> > & indices) const {
 //    size_t ncp(m_components.size());
@@ -265,7 +289,14 @@ void CompositeLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
       }
    }
 
-   for ( ; it != m_components.end(); ++it) {
+   std::vector< std::vector<double> > componentDerivs;
+   if (m_numThreads > 0) {
+      std::vector<LogLike *> components;
+      getComponents(components);
+      ParallelUtils::evaluateComponents(components, m_numThreads,
+                                        0, &componentDerivs);
+   }
+   for (size_t icomp(0); it != m_components.end(); ++it, icomp++) {
       std::map<std::string, Source *>::const_iterator src 
          = it->first->sources().begin();
       for ( ; src != it->first->sources().end(); ++src) {
@@ -282,7 +313,11 @@ void CompositeLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
          }
       }
       std::vector<double> my_derivs;
-      it->first->getFreeDerivs(my_derivs);
+      if (m_numThreads > 0) {
+         my_derivs.swap(componentDerivs.at(icomp));
+      } else {
+         it->first->getFreeDerivs(my_derivs);
+      }
       for (size_t i(0); i < my_derivs.size(); i++) {
          freeDerivs.push_back(my_derivs.at(i));
       }
@@ -7,13 +7,20 @@
  * $Header$
  */
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <stdexcept>
 #include <vector>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "fftw/fftw3.h"
 
 #include "Likelihood/Convolve.h"
+#include "Likelihood/ParallelUtils.h"
 
 namespace {
    fftw_complex * 
@@ -30,141 +37,247 @@ namespace {
       return output;
    }
 
-   fftw_complex * 
-   complexArray(const std::vector< std::vector<double> > & input,
-                bool fill=true, size_t nx=0, size_t ny=0) {
-      size_t dx(0), dy(0);
-      if (ny == 0 || ny < input.size()) {
-         ny = input.size();
-      } else {
-         dy = (ny - input.size())/2;
-      }
-      if (nx == 0 || nx < input.at(0).size()) {
-         nx = input.at(0).size();
-      } else {
-         dx = (nx - input.at(0).size())/2;
+   /// Cached real-to-complex and complex-to-real plans for a padded
+   /// array size.  Plans are created with FFTW_ESTIMATE, so the
+   /// results do not depend on timing, and are applied to new arrays
+   /// with the fftw_execute_dft_* functions, which is thread-safe.
+   class PlanCache {
+   public:
+      ~PlanCache() {
+         std::map<Key_t, Plans_t>::iterator it(m_plans.begin());
+         for ( ; it != m_plans.end(); ++it) {
+            fftw_destroy_plan(it->second.first);
+            fftw_destroy_plan(it->second.second);
+         }
       }
-      fftw_complex * output;
-      output = (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*nx*ny);
-
-      if (fill) {
-         for (size_t i = 0; i < nx*ny; i++) {
-            output[i][0] = 0;
-            output[i][1] = 0;
+      typedef std::pair<fftw_plan, fftw_plan> Plans_t;
+      const Plans_t & plans(size_t npad) {
+         int nthreads(1);
+#ifdef LIKELIHOOD_FFTW_THREADS
+#ifdef _OPENMP
+         if (!omp_in_parallel()) {
+            nthreads = Likelihood::ParallelUtils::numThreads(0);
          }
-         for (size_t j = 0; j < input.size(); j++) {
-            for (size_t i = 0; i < input.at(j).size(); i++) {
-               size_t indx = (j + dy)*nx + i + dx;
-               if (indx < nx*ny) {
-                  output[indx][0] = input.at(j).at(i);
+#endif
+#endif
+         Key_t key(npad, nthreads);
+         const Plans_t * result(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_Convolve_plans)
+#endif
+         {
+            std::map<Key_t, Plans_t>::iterator it(m_plans.find(key));
+            if (it == m_plans.end()) {
+#ifdef LIKELIHOOD_FFTW_THREADS
+               static bool initialized(fftw_init_threads() != 0);
+               if (initialized) {
+                  fftw_plan_with_nthreads(nthreads);
                }
+#endif
+               size_t nreal(npad*npad);
+               size_t ncomplex(npad*(npad/2 + 1));
+               double * real = (double *) fftw_malloc(sizeof(double)*nreal);
+               fftw_complex * spec = 
+                  (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*ncomplex);
+               Plans_t plans;
+               plans.first = fftw_plan_dft_r2c_2d(npad, npad, real, spec,
+                                                  FFTW_ESTIMATE);
+               plans.second = fftw_plan_dft_c2r_2d(npad, npad, spec, real,
+                                                   FFTW_ESTIMATE);
+               fftw_free(real);
+               fftw_free(spec);
+               it = m_plans.insert(std::make_pair(key, plans)).first;
             }
+            result = &(it->second);
          }
+         return *result;
       }
-      return output;
+   private:
+      typedef std::pair<size_t, int> Key_t;
+      std::map<Key_t, Plans_t> m_plans;
+   };
+
+   PlanCache & planCache() {
+      static PlanCache cache;
+      return cache;
    }
-   std::vector< std::vector<double> > 
-   subArray(std::vector< std::vector<double> > & input,
-            const std::vector< std::vector<double> > & signal) {
-      size_t dx = (input.size() - signal.size())/2;
-      size_t dy = (input.at(0).size() - signal.at(0).size())/2;
-      std::vector< std::vector<double> > output(signal.size());
-      for (size_t i = 0; i < signal.size(); i++) {
-         output.at(i).resize(signal.at(i).size());
-         for (size_t j = 0; j < signal.at(i).size(); j++) {
-            output.at(i).at(j) = input.at(i + dx).at(j + dy);
+
+   /// Copy an image into the center of a zeroed npad x npad array,
+   /// with the same offsets as the complex arrays used previously.
+   template <typename T>
+   double * paddedArray(const std::vector< std::vector<T> > & input,
+                        size_t npad) {
+      size_t npts(npad*npad);
+      double * output = (double *) fftw_malloc(sizeof(double)*npts);
+      std::fill(output, output + npts, 0.);
+      size_t dy((npad - input.size())/2);
+      size_t dx((npad - input.at(0).size())/2);
+      for (size_t j = 0; j < input.size(); j++) {
+         double * row = output + (j + dy)*npad + dx;
+         for (size_t i = 0; i < input[j].size(); i++) {
+            row[i] = input[j][i];
          }
       }
       return output;
    }
-} // unnamed namespace
-
-namespace Likelihood {
 
-std::vector< std::vector<double> > 
-Convolve::convolve2d(const std::vector< std::vector<double> > & signal,
-                     const std::vector< std::vector<double> > & psf) {
-   if (psf.size() > signal.size()) {
-      throw std::runtime_error("Convolve::convolve2d: Psf size must "
-                               "be smaller than the signal size.");
+   template <typename T>
+   void psfSpectrum(const std::vector< std::vector<T> > & psf,
+                    size_t npad, Likelihood::Convolve::PsfSpectrum & spectrum) {
+      if (psf.size() > npad || psf.at(0).size() > npad) {
+         throw std::runtime_error("Convolve::psfSpectrum: Psf size must "
+                                  "be smaller than the padded size.");
+      }
+      const PlanCache::Plans_t & plans(planCache().plans(npad));
+      size_t ncomplex(npad*(npad/2 + 1));
+      double * in = paddedArray(psf, npad);
+      fftw_complex * out = 
+         (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*ncomplex);
+      fftw_execute_dft_r2c(plans.first, in, out);
+      spectrum.npad = npad;
+      spectrum.values.resize(2*ncomplex);
+      std::copy(&out[0][0], &out[0][0] + 2*ncomplex, spectrum.values.begin());
+      fftw_free(in);
+      fftw_free(out);
    }
 
-   size_t nx = signal.at(0).size();
-   size_t ny = signal.size();
-
-// pad out the signal array so that it is n x n
-   if (nx < ny) {
-      nx = ny;
-   } else if (ny < nx) {
-      ny = nx;
-   }
-   nx*=2;
-   ny*=2;
-   size_t npts = nx*ny;
+   template <typename T>
+   std::vector< std::vector<T> > 
+   convolve2d(const std::vector< std::vector<T> > & signal,
+              const Likelihood::Convolve::PsfSpectrum & psf) {
+      size_t nrows(signal.size());
+      size_t ncols(signal.at(0).size());
+      size_t npad(psf.npad);
+      if (npad != Likelihood::Convolve::paddedSize(nrows, ncols)) {
+         throw std::runtime_error("Convolve::convolve2d: Psf spectrum "
+                                  "does not match the signal size.");
+      }
+      const PlanCache::Plans_t & plans(planCache().plans(npad));
+      size_t npts(npad*npad);
+      size_t ncomplex(npad*(npad/2 + 1));
 
-   fftw_complex * in = ::complexArray(signal, true, nx, ny);
-   fftw_complex * out = ::complexArray(signal, false, nx, ny);
-   fftw_plan splan = fftw_plan_dft_2d(nx, ny, in, out,
-                                      FFTW_FORWARD, FFTW_ESTIMATE);
-   fftw_execute(splan);
-   fftw_destroy_plan(splan);
-   fftw_free(in);
+      double * in = paddedArray(signal, npad);
+      fftw_complex * spec = 
+         (fftw_complex *) fftw_malloc(sizeof(fftw_complex)*ncomplex);
+      fftw_execute_dft_r2c(plans.first, in, spec);
 
-   fftw_complex * ipsf = ::complexArray(psf, true, nx, ny);
-   fftw_complex * opsf = ::complexArray(psf, false, nx, ny);
-   fftw_plan pplan = fftw_plan_dft_2d(nx, ny, ipsf, opsf,
-                                      FFTW_FORWARD, FFTW_ESTIMATE);
-   fftw_execute(pplan);
-   fftw_destroy_plan(pplan);
-   fftw_free(ipsf);
+      const double * pspec = &psf.values[0];
+      for (size_t i = 0; i < ncomplex; i++) {
+         double re(spec[i][0]*pspec[2*i] - spec[i][1]*pspec[2*i + 1]);
+         double im(spec[i][0]*pspec[2*i + 1] + spec[i][1]*pspec[2*i]);
+         spec[i][0] = re;
+         spec[i][1] = im;
+      }
+// The inverse transform overwrites the spectrum, and the padded
+// signal is no longer needed, so it takes the output.
+      fftw_execute_dft_c2r(plans.second, spec, in);
+      fftw_free(spec);
 
-   fftw_complex * iconv = ::complexArray(signal, false, nx, ny);
-   for (size_t i = 0; i < npts; i++) {
-      iconv[i][0] = out[i][0]*opsf[i][0] - out[i][1]*opsf[i][1];
-      iconv[i][1] = out[i][0]*opsf[i][1] + out[i][1]*opsf[i][0];
+// The psf is centered on pixel (npad/2 - 1, npad/2 - 1) of the padded
+// array, so shift by that amount and take the signal-sized region at
+// the center.
+      size_t dy((npad - nrows)/2 + npad/2 - 1);
+      size_t dx((npad - ncols)/2 + npad/2 - 1);
+      std::vector< std::vector<T> > output(nrows, std::vector<T>(ncols));
+      for (size_t j = 0; j < nrows; j++) {
+         const double * row = in + ((j + dy) % npad)*npad;
+         for (size_t i = 0; i < ncols; i++) {
+            output[j][i] = row[(i + dx) % npad]/npts;
+         }
+      }
+      fftw_free(in);
+      return output;
    }
-   fftw_free(out);
-   fftw_free(opsf);
+} // unnamed namespace
 
-   fftw_complex * oconv = ::complexArray(signal, false, nx, ny);
-   fftw_plan cplan = fftw_plan_dft_2d(nx, ny, iconv, oconv,
-                                      FFTW_BACKWARD, FFTW_ESTIMATE);
-   fftw_execute(cplan);
-   fftw_destroy_plan(cplan);
-   fftw_free(iconv);
+namespace Likelihood {
 
-   size_t indx;
-   std::vector< std::vector<double> > output;
-   output.reserve(ny);
-   
-   for (size_t i = ny/2 - 1; i < ny; i++) {
-      std::vector<double> local;
-      for (size_t j = nx/2 - 1; j < nx; j++) {
-         indx = i*nx + j;
-         local.push_back(oconv[indx][0]/npts);
-      }
-      for (size_t j = 0; j < nx/2 - 1; j++) {
-         indx = i*nx + j;
-         local.push_back(oconv[indx][0]/npts);
+const size_t Convolve::SpectrumCache::s_defaultMaxBytes;
+
+const Convolve::PsfSpectrum * 
+Convolve::SpectrumCache::find(const std::string & key) const {
+   const PsfSpectrum * spectrum(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_Convolve_spectra)
+#endif
+   {
+      std::map<std::string, PsfSpectrum>::const_iterator 
+         it(m_spectra.find(key));
+      if (it != m_spectra.end()) {
+         spectrum = &(it->second);
       }
-      output.push_back(local);
    }
-   for (size_t i = 0; i < ny/2 - 1; i++) {
-      std::vector<double> local;
-      for (size_t j = nx/2 - 1; j < nx; j++) {
-         indx = i*nx + j;
-         local.push_back(oconv[indx][0]/npts);
-      }
-      for (size_t j = 0; j < nx/2 - 1; j++) {
-         indx = i*nx + j;
-         local.push_back(oconv[indx][0]/npts);
+   return spectrum;
+}
+
+const Convolve::PsfSpectrum * 
+Convolve::SpectrumCache::insert(const std::string & key,
+                                const PsfSpectrum & spectrum) {
+   const PsfSpectrum * result(0);
+   size_t nbytes(sizeof(double)*spectrum.values.size());
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_Convolve_spectra)
+#endif
+   {
+      std::map<std::string, PsfSpectrum>::iterator it(m_spectra.find(key));
+      if (it != m_spectra.end()) {
+         result = &(it->second);
+      } else if (m_bytes + nbytes <= m_maxBytes) {
+         result = &(m_spectra[key] = spectrum);
+         m_bytes += nbytes;
       }
-      output.push_back(local);
    }
+   return result;
+}
 
-   fftw_free(oconv);
+void Convolve::SpectrumCache::clear() {
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_Convolve_spectra)
+#endif
+   {
+      m_spectra.clear();
+      m_bytes = 0;
+   }
+}
+
+size_t Convolve::paddedSize(size_t nrows, size_t ncols) {
+// Pad out the signal array so that it is n x n, with a border of
+// zeros so that the convolution does not wrap around.
+   return 2*std::max(nrows, ncols);
+}
+
+void Convolve::psfSpectrum(const std::vector< std::vector<double> > & psf,
+                           size_t npad, PsfSpectrum & spectrum) {
+   ::psfSpectrum(psf, npad, spectrum);
+}
+
+void Convolve::psfSpectrum(const std::vector< std::vector<float> > & psf,
+                           size_t npad, PsfSpectrum & spectrum) {
+   ::psfSpectrum(psf, npad, spectrum);
+}
+
+std::vector< std::vector<double> > 
+Convolve::convolve2d(const std::vector< std::vector<double> > & signal,
+                     const PsfSpectrum & psf) {
+   return ::convolve2d(signal, psf);
+}
+
+std::vector< std::vector<float> > 
+Convolve::convolve2d(const std::vector< std::vector<float> > & signal,
+                     const PsfSpectrum & psf) {
+   return ::convolve2d(signal, psf);
+}
 
-   return ::subArray(output, signal);
+std::vector< std::vector<double> > 
+Convolve::convolve2d(const std::vector< std::vector<double> > & signal,
+                     const std::vector< std::vector<double> > & psf) {
+   if (psf.size() > signal.size()) {
+      throw std::runtime_error("Convolve::convolve2d: Psf size must "
+                               "be smaller than the signal size.");
+   }
+   PsfSpectrum spectrum;
+   psfSpectrum(psf, paddedSize(signal.size(), signal.at(0).size()), spectrum);
+   return convolve2d(signal, spectrum);
 }
 
 std::vector<double> 
@@ -242,29 +355,13 @@ Convolve::convolve(const std::vector<float> & signal,
 std::vector< std::vector<float> > 
 Convolve::convolve2d(const std::vector< std::vector<float> > & signal,
                      const std::vector< std::vector<float> > & psf) {
-   std::vector< std::vector<double> > dsignal(signal.size(),
-                                              std::vector<double>(signal[0].size(), 0));
-   std::vector< std::vector<double> > dpsf(psf.size(),
-                                           std::vector<double>(psf[0].size(), 0));
-   for (size_t i(0); i < signal.size(); i++) {
-      for (size_t j(0); j < signal[i].size(); j++) {
-         dsignal[i][j] = signal[i][j];
-      }
-   }
-   for (size_t i(0); i < psf.size(); i++) {
-      for (size_t j(0); j < psf[i].size(); j++) {
-         dpsf[i][j] = psf[i][j];
-      }
-   }
-   std::vector< std::vector<double> > foo(convolve2d(dsignal, dpsf));
-   std::vector< std::vector<float> > my_result(foo.size(),
-                                               std::vector<float>(foo[0].size(), 0));
-   for (size_t i(0); i < foo.size(); i++) {
-      for (size_t j(0); j < foo[i].size(); j++) {
-         my_result[i][j] = foo[i][j];
-      }
+   if (psf.size() > signal.size()) {
+      throw std::runtime_error("Convolve::convolve2d: Psf size must "
+                               "be smaller than the signal size.");
    }
-   return my_result;
+   PsfSpectrum spectrum;
+   psfSpectrum(psf, paddedSize(signal.size(), signal.at(0).size()), spectrum);
+   return convolve2d(signal, spectrum);
 }
 
 
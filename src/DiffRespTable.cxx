@@ -0,0 +1,394 @@
+/**
+ * @file DiffRespTable.cxx
+ * @brief Diffuse responses tabulated on a grid of directions, energies,
+ * inclinations and event types, and interpolated to the events.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+#include "healpix_base.h"
+
+#include "CLHEP/Vector/ThreeVector.h"
+
+#include "astro/SkyDir.h"
+
+#include "optimizers/Function.h"
+
+#include "Likelihood/DiffRespTable.h"
+#include "Likelihood/DiffuseSource.h"
+#include "Likelihood/Event.h"
+#include "Likelihood/FileUtils.h"
+#include "Likelihood/MapBase.h"
+#include "Likelihood/ResponseFunctions.h"
+
+namespace {
+   const char s_magic[8] = {'L', 'K', 'D', 'R', 'S', 'P', '0', '2'};
+
+   template <typename T>
+   void writeValue(std::ofstream & output, const T & value) {
+      output.write(reinterpret_cast<const char *>(&value), sizeof(T));
+   }
+
+   template <typename T>
+   bool readValue(std::ifstream & input, T & value) {
+      input.read(reinterpret_cast<char *>(&value), sizeof(T));
+      return input.good();
+   }
+
+   pointing toPointing(const astro::SkyDir & dir) {
+      return pointing((90. - dir.dec())*M_PI/180., dir.ra()*M_PI/180.);
+   }
+
+   astro::SkyDir toSkyDir(const pointing & ptg) {
+      return astro::SkyDir(ptg.phi*180./M_PI, 90. - ptg.theta*180./M_PI);
+   }
+
+/// Position of x on a uniform grid of npts nodes with spacing dx
+/// starting at zero: the lower node and the fraction of the way to
+/// the next one.  Values off the grid are moved to the nearest end.
+   void gridPosition(double x, double dx, size_t npts,
+                     size_t & indx, double & frac) {
+      double pos(std::max(0., std::min(x/dx, npts - 1.)));
+      indx = std::min(static_cast<size_t>(pos), npts - 2);
+      frac = pos - indx;
+   }
+
+/// Power-law interpolation between two energy nodes, or linear if
+/// either value is not positive.
+   double interpolateEnergy(double y1, double y2, double frac) {
+      if (y1 > 0 && y2 > 0) {
+         return std::exp((1. - frac)*std::log(y1) + frac*std::log(y2));
+      }
+      return (1. - frac)*y1 + frac*y2;
+   }
+}
+
+namespace Likelihood {
+
+DiffRespTable::DiffRespTable(const ResponseFunctions & respFuncs, int order,
+                             double emin, double emax,
+                             size_t nee, size_t ninc,
+                             const std::string & tableFile)
+   : m_respFuncs(respFuncs), m_order(order), m_emin(emin), m_emax(emax),
+     m_nee(nee), m_ninc(ninc), m_tableFile(tableFile),
+     m_numRead(0), m_numComputed(0) {
+   if (m_order < 0) {
+      throw std::runtime_error("DiffRespTable: HEALPix order must be >= 0.");
+   }
+   if (m_nee < 2 || m_ninc < 2 || m_emin <= 0 || m_emax <= m_emin) {
+      throw std::runtime_error("DiffRespTable: need at least two energy "
+                               "and inclination nodes and 0 < emin < emax.");
+   }
+   m_npix = Healpix_Base(m_order, NEST).Npix();
+   m_dlogE = std::log(m_emax/m_emin)/(m_nee - 1.);
+   m_dcosInc = 1./(m_ninc - 1.);
+   if (m_tableFile != "") {
+      readTable();
+   }
+}
+
+double DiffRespTable::value(DiffuseSource & src, const Event & event) {
+   return value(src, event, m_respFuncs);
+}
+
+double DiffRespTable::value(DiffuseSource & src, const Event & event,
+                            const ResponseFunctions & respFuncs) {
+   std::string srcKey(sourceKey(src));
+
+   Healpix_Base hp(m_order, NEST);
+   fix_arr<int, 4> pix;
+   fix_arr<double, 4> wgt;
+   hp.get_interpol(::toPointing(event.getDir()), pix, wgt);
+
+   size_t ie, iinc;
+   double efrac, incfrac;
+   ::gridPosition(std::log(event.getEnergy()/m_emin), m_dlogE, m_nee,
+                  ie, efrac);
+   double cosInc(std::cos(event.getDir().difference(event.zAxis())));
+   ::gridPosition(cosInc, m_dcosInc, m_ninc, iinc, incfrac);
+
+// Only the nodes with non-zero weights are computed.
+   double result(0);
+   for (size_t i(0); i < 4; i++) {
+      for (size_t j(0); j < 2; j++) {
+         double weight(wgt[i]*(j == 0 ? 1. - incfrac : incfrac));
+         if (weight <= 0) {
+            continue;
+         }
+         double y1(0), y2(0);
+         if (efrac < 1) {
+            y1 = nodeValue(src, srcKey, pix[i], ie, iinc + j,
+                           event.getType(), respFuncs);
+         }
+         if (efrac > 0) {
+            y2 = nodeValue(src, srcKey, pix[i], ie + 1, iinc + j,
+                           event.getType(), respFuncs);
+         }
+         result += weight*::interpolateEnergy(y1, y2, efrac);
+      }
+   }
+   return result;
+}
+
+size_t DiffRespTable::nodeIndex(int pix, size_t ie, size_t iinc,
+                                int type) const {
+   return pix + m_npix*(ie + m_nee*(iinc + m_ninc*type));
+}
+
+double DiffRespTable::nodeValue(DiffuseSource & src, const std::string & srcKey,
+                                int pix, size_t ie, size_t iinc, int type,
+                                const ResponseFunctions & respFuncs) {
+   size_t indx(nodeIndex(pix, ie, iinc, type));
+   bool found(false);
+   double result(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DiffRespTable)
+#endif
+   {
+      SourceMap_t::const_iterator srcIt(m_nodes.find(srcKey));
+      if (srcIt != m_nodes.end()) {
+         NodeMap_t::const_iterator it(srcIt->second.find(indx));
+         if (it != srcIt->second.end()) {
+            result = it->second;
+            found = true;
+         }
+      }
+   }
+   if (found) {
+      return result;
+   }
+// Compute the node outside of the critical section, so that several
+// threads can do this at once.  If another thread has added the same
+// node in the meantime, that value is used.
+   double new_value(computeNode(src, pix, ie, iinc, type, respFuncs));
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DiffRespTable)
+#endif
+   {
+      NodeMap_t & nodes(m_nodes[srcKey]);
+      NodeMap_t::const_iterator it(nodes.find(indx));
+      if (it != nodes.end()) {
+         result = it->second;
+      } else {
+         nodes[indx] = new_value;
+         result = new_value;
+         m_numComputed++;
+      }
+   }
+   return result;
+}
+
+double DiffRespTable::computeNode(DiffuseSource & src, int pix, size_t ie,
+                                  size_t iinc, int type,
+                                  const ResponseFunctions & respFuncs) const {
+   Healpix_Base hp(m_order, NEST);
+   astro::SkyDir nodeDir(::toSkyDir(hp.pix2ang(pix)));
+   double energy(m_emin*std::exp(ie*m_dlogE));
+   double inc(std::acos(std::min(1., iinc*m_dcosInc)));
+
+// Put the z-axis at the node inclination from the node direction.
+   CLHEP::Hep3Vector dir(nodeDir.dir());
+   CLHEP::Hep3Vector perp(dir.orthogonal().unit());
+   astro::SkyDir zAxis(std::cos(inc)*dir + std::sin(inc)*perp);
+   astro::SkyDir xAxis(zAxis.dir().orthogonal().unit());
+
+   Event nodeEvent(nodeDir.ra(), nodeDir.dec(), energy, 0, zAxis, xAxis,
+                   1., false, respFuncs.respName(), type);
+   std::vector<DiffuseSource *> srcs(1, &src);
+   nodeEvent.computeResponseGQ(srcs, respFuncs);
+   return nodeEvent.diffuseResponse(energy, src.getName());
+}
+
+size_t DiffRespTable::size() const {
+   size_t retVal(0);
+   for (SourceMap_t::const_iterator it(m_nodes.begin());
+        it != m_nodes.end(); ++it) {
+      retVal += it->second.size();
+   }
+   return retVal;
+}
+
+std::string DiffRespTable::sourceKey(const DiffuseSource & src) const {
+   std::ostringstream key;
+   key << std::setprecision(17) << src.getName();
+   const optimizers::Function * spatialDist(src.spatialDist());
+   if (spatialDist != 0) {
+      std::vector<double> params;
+      spatialDist->getParamValues(params);
+      key << "\n" << spatialDist->genericName();
+      for (size_t i(0); i < params.size(); i++) {
+         key << " " << params[i];
+      }
+   }
+   try {
+      const std::string & fitsFile(src.mapBaseObject()->fitsFile());
+      key << "\n" << fitsFile << "\n" << fileChecksum(fitsFile);
+   } catch (MapBaseException &) {
+      // not a map-based source
+   }
+   return key.str();
+}
+
+const std::string & DiffRespTable::fileChecksum(const std::string & fitsFile) const {
+   const std::string * checksum(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DiffRespTable)
+#endif
+   {
+      std::map<std::string, std::string>::const_iterator
+         it(m_checksums.find(fitsFile));
+      if (it != m_checksums.end()) {
+         checksum = &it->second;
+      }
+   }
+   if (checksum != 0) {
+      return *checksum;
+   }
+   std::string new_checksum(FileUtils::file_checksum(fitsFile));
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DiffRespTable)
+#endif
+   {
+      checksum = &m_checksums.insert(std::make_pair(fitsFile,
+                                                    new_checksum)).first->second;
+   }
+   return *checksum;
+}
+
+void DiffRespTable::tableKey(std::vector<double> & values,
+                             std::string & names) const {
+   names = m_respFuncs.respName();
+   values.clear();
+   values.push_back(m_order);
+   values.push_back(m_emin);
+   values.push_back(m_emax);
+   values.push_back(m_nee);
+   values.push_back(m_ninc);
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator it;
+   for (it = m_respFuncs.begin(); it != m_respFuncs.end(); ++it) {
+      values.push_back(it->first);
+   }
+}
+
+void DiffRespTable::readTable() {
+   std::ifstream input(m_tableFile.c_str(), std::ios::binary);
+   if (!input) {
+      return;
+   }
+   char magic[sizeof(s_magic)];
+   input.read(magic, sizeof(magic));
+   if (!input || std::memcmp(magic, s_magic, sizeof(s_magic)) != 0) {
+      return;
+   }
+   std::vector<double> values;
+   std::string names;
+   tableKey(values, names);
+
+   size_t namelen, nvalues, nsources;
+   if (!::readValue(input, namelen) || namelen != names.size()) {
+      return;
+   }
+   std::string fileNames(namelen, ' ');
+   input.read(&fileNames[0], namelen);
+   if (!input || fileNames != names) {
+      return;
+   }
+   if (!::readValue(input, nvalues) || nvalues != values.size()) {
+      return;
+   }
+   std::vector<double> fileValues(nvalues);
+   input.read(reinterpret_cast<char *>(&fileValues[0]), nvalues*sizeof(double));
+   if (!input || fileValues != values) {
+      return;
+   }
+   if (!::readValue(input, nsources)) {
+      return;
+   }
+   for (size_t i(0); i < nsources; i++) {
+      size_t keylen, nnodes;
+      if (!::readValue(input, keylen)) {
+         return;
+      }
+      std::string srcKey(keylen, ' ');
+      input.read(&srcKey[0], keylen);
+      if (!input || !::readValue(input, nnodes)) {
+         return;
+      }
+      NodeMap_t & nodes(m_nodes[srcKey]);
+      for (size_t j(0); j < nnodes; j++) {
+         size_t indx;
+         double nodeValue;
+         if (!::readValue(input, indx) || !::readValue(input, nodeValue)) {
+            return;
+         }
+         nodes[indx] = nodeValue;
+         m_numRead++;
+      }
+   }
+}
+
+void DiffRespTable::save() const {
+   if (m_tableFile == "") {
+      return;
+   }
+   std::vector<double> values;
+   std::string names;
+   tableKey(values, names);
+
+   std::string tmpfile(m_tableFile + ".tmp");
+   std::ofstream output(tmpfile.c_str(), std::ios::binary);
+   if (!output) {
+      throw std::runtime_error("DiffRespTable::save: cannot open " + tmpfile);
+   }
+   output.write(s_magic, sizeof(s_magic));
+   ::writeValue(output, names.size());
+   output.write(names.data(), names.size());
+   ::writeValue(output, values.size());
+   output.write(reinterpret_cast<const char *>(&values[0]),
+                values.size()*sizeof(double));
+   ::writeValue(output, m_nodes.size());
+   for (SourceMap_t::const_iterator srcIt(m_nodes.begin());
+        srcIt != m_nodes.end(); ++srcIt) {
+      ::writeValue(output, srcIt->first.size());
+      output.write(srcIt->first.data(), srcIt->first.size());
+      ::writeValue(output, srcIt->second.size());
+      for (NodeMap_t::const_iterator it(srcIt->second.begin());
+           it != srcIt->second.end(); ++it) {
+         ::writeValue(output, it->first);
+         ::writeValue(output, it->second);
+      }
+   }
+   output.close();
+   if (!output) {
+      std::remove(tmpfile.c_str());
+      throw std::runtime_error("DiffRespTable::save: error writing " + tmpfile);
+   }
+   if (std::rename(tmpfile.c_str(), m_tableFile.c_str()) != 0) {
+      std::remove(tmpfile.c_str());
+      throw std::runtime_error("DiffRespTable::save: cannot rename "
+                               + tmpfile + " to " + m_tableFile);
+   }
+}
+
+size_t DiffRespTable::memory_size() const {
+   size_t retVal(sizeof(*this));
+   for (SourceMap_t::const_iterator it(m_nodes.begin());
+        it != m_nodes.end(); ++it) {
+      retVal += it->first.capacity()
+         + it->second.size()*(sizeof(size_t) + sizeof(double));
+   }
+   return retVal;
+}
+
+} // namespace Likelihood
@@ -23,6 +23,7 @@
 #include "Likelihood/ProjMap.h"
 #include "Likelihood/WcsMap2.h"
 #include "Likelihood/HealpixProjMap.h"
+#include "Likelihood/ResponseFunctions.h"
 
 namespace Likelihood {
 
@@ -263,13 +264,20 @@ double DiffuseSource::energyFluxDeriv(const std::string & parName,
 
 
 double DiffuseSource::diffuseResponse(const Event& evt) const {
+   return diffuseResponse(evt, m_observation->respFuncs());
+}
+
+double DiffuseSource::diffuseResponse(const Event& evt,
+                                      const ResponseFunctions & respFuncs) const {
    // EAC, switch based on projection type
    const ProjMap* projMap = &(mapBaseObject()->projmap());
    switch ( projMap->getProj()->method() ) {
    case astro::ProjBase::WCS:
-     return diffuseResponse_wcs(evt,static_cast<const WcsMap2&>(*projMap));
+     return diffuseResponse_wcs(evt,static_cast<const WcsMap2&>(*projMap),
+                                respFuncs);
    case astro::ProjBase::HEALPIX:
-     return diffuseResponse_healpix(evt,static_cast<const HealpixProjMap&>(*projMap));
+     return diffuseResponse_healpix(evt,static_cast<const HealpixProjMap&>(*projMap),
+                                    respFuncs);
    default:
      break;
    }
@@ -279,9 +287,9 @@ double DiffuseSource::diffuseResponse(const Event& evt) const {
    return 0.;
 }
 
-double DiffuseSource::diffuseResponse_healpix(const Event& evt, const HealpixProjMap& healmap) const {
+double DiffuseSource::diffuseResponse_healpix(const Event& evt, const HealpixProjMap& healmap,
+                                              const ResponseFunctions & respFuncs) const {
    double trueEnergy(evt.getEnergy());
-   const ResponseFunctions & respFuncs(m_observation->respFuncs());
    const double& solidAngle = healmap.solidAngleHealpix();
    double my_value(0);
    double psf_range(psfRange(evt.getEnergy()));
@@ -301,9 +309,9 @@ double DiffuseSource::diffuseResponse_healpix(const Event& evt, const HealpixPro
    return my_value;
 }
 
-double DiffuseSource::diffuseResponse_wcs(const Event & evt, const WcsMap2& wcsmap) const {
+double DiffuseSource::diffuseResponse_wcs(const Event & evt, const WcsMap2& wcsmap,
+                                          const ResponseFunctions & respFuncs) const {
    double trueEnergy(evt.getEnergy());
-   const ResponseFunctions & respFuncs(m_observation->respFuncs());
    const std::vector< std::vector<float> > & solidAngles(wcsmap.solidAngles());
    double my_value(0);
    for (size_t i(0); i < solidAngles.size(); i++) {
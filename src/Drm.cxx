@@ -43,6 +43,28 @@ namespace Likelihood {
 Drm::Drm(double ra, double dec, const Observation & observation, 
          const std::vector<double> & ebounds, size_t npts) 
   : m_dir(ra, dec), m_observation(observation), m_npts(npts){
+   set_ebounds(ebounds);
+   compute_drm();
+}
+
+Drm::Drm(double ra, double dec, const Observation & observation, 
+         const std::vector<double> & ebounds,
+         const std::vector< std::vector<double> > & matrix)
+  : m_dir(ra, dec), m_observation(observation), m_npts(0), m_drm(matrix) {
+   set_ebounds(ebounds);
+   if (m_drm.size() != m_ebounds.size() - 1) {
+      throw std::runtime_error("Drm: number of rows of the matrix does not "
+                               "match the energy grid.");
+   }
+   for (size_t k(0); k < m_drm.size(); k++) {
+      if (m_drm[k].size() != m_ebounds.size() - 3) {
+         throw std::runtime_error("Drm: number of columns of the matrix "
+                                  "does not match the energy grid.");
+      }
+   }
+}
+
+void Drm::set_ebounds(const std::vector<double> & ebounds) {
    // Prepare the energy bounds array to be used for both true and
    // measured counts bins.
    m_ebounds.resize(ebounds.size());
@@ -54,51 +76,90 @@ Drm::Drm(double ra, double dec, const Observation & observation,
    double de(std::log(m_ebounds[1]/m_ebounds[0]));
    m_ebounds.push_front(std::exp(std::log(m_ebounds[0]) - de));
    m_ebounds.push_back(std::exp(std::log(m_ebounds.back()) + de));
-
-   compute_drm();
 }
 
 void Drm::convolve(const std::vector<double> & true_counts,
                    std::vector<double> & meas_counts) const {
-   if (true_counts.size() != m_ebounds.size() - 3) {
-      throw std::runtime_error("Drm::convolve: Size of true_counts "
-                               "does not equal size of energy grid.");
+   std::vector<const std::vector<double> *> true_counts_list(1, &true_counts);
+   std::vector<std::vector<double> *> meas_counts_list(1, &meas_counts);
+   convolve(true_counts_list, meas_counts_list);
+}
+
+void Drm::convolve(const std::vector<const std::vector<double> *> & true_counts,
+                   const std::vector<std::vector<double> *> & meas_counts) const {
+   if (true_counts.size() != meas_counts.size()) {
+      throw std::runtime_error("Drm::convolve: Number of true_counts and "
+                               "meas_counts spectra do not match.");
+   }
+   size_t nsrc(true_counts.size());
+   size_t nmeas(m_ebounds.size() - 3);
+   size_t ntrue(m_drm.size());
+
+   // Stack the padded spectra into an nsrc x ntrue matrix.
+   std::vector<double> counts(nsrc*ntrue);
+   for (size_t i(0); i < nsrc; i++) {
+      if (true_counts[i]->size() != nmeas) {
+         throw std::runtime_error("Drm::convolve: Size of true_counts "
+                                  "does not equal size of energy grid.");
+      }
+      pad_counts(*true_counts[i], &counts[i*ntrue]);
+   }
+
+   for (size_t i(0); i < nsrc; i++) {
+      meas_counts[i]->assign(nmeas, 0);
+   }
+   if (nmeas == 0) {
+      return;
+   }
+
+   // Multiply by the ntrue x nmeas DRM, a block of spectra at a time.
+   // Each row of the DRM is applied to every spectrum in the block
+   // while it is in cache, rather than the whole DRM being streamed
+   // once per spectrum.  For every output element the sum over the
+   // true energy bins is still done in order, so the result does not
+   // depend on the blocking or on how many spectra are done together.
+   const size_t block_size(16);
+   for (size_t i0(0); i0 < nsrc; i0 += block_size) {
+      size_t i1(std::min(nsrc, i0 + block_size));
+      for (size_t k(0); k < ntrue; k++) {
+         const double * drm_row = &m_drm[k][0];
+         for (size_t i(i0); i < i1; i++) {
+            double value(counts[i*ntrue + k]);
+            double * meas = &(*meas_counts[i])[0];
+            for (size_t kp(0); kp < nmeas; kp++) {
+               meas[kp] += value*drm_row[kp];
+            }
+         }
+      }
    }
-   std::deque<double> counts(true_counts.size());
-   std::copy(true_counts.begin(), true_counts.end(), counts.begin());
-   double value(0);
+}
+
+void Drm::pad_counts(const std::vector<double> & true_counts,
+                     double * counts) const {
+   std::copy(true_counts.begin(), true_counts.end(), counts + 1);
+   size_t ntrue(true_counts.size() + 2);
    double min_counts_value(1e-10);
-   if (counts[0] > min_counts_value && counts[1] > min_counts_value) {
-      value = counts[1]*std::exp(std::log(m_ebounds[0]/m_ebounds[2])/
-                                 std::log(m_ebounds[1]/m_ebounds[2])*
-                                 std::log(counts[0]/counts[1]));
+   if (counts[1] > min_counts_value && counts[2] > min_counts_value) {
+      counts[0] = counts[2]*std::exp(std::log(m_ebounds[0]/m_ebounds[2])/
+                                     std::log(m_ebounds[1]/m_ebounds[2])*
+                                     std::log(counts[1]/counts[2]));
    } else {
-      value = ((m_ebounds[0] - m_ebounds[2])/
-               (m_ebounds[1] - m_ebounds[2])*
-               (counts[0] - counts[1]) + counts[1]);
+      counts[0] = ((m_ebounds[0] - m_ebounds[2])/
+                   (m_ebounds[1] - m_ebounds[2])*
+                   (counts[1] - counts[2]) + counts[2]);
    }
-   counts.push_front(value);
 
    size_t nee(m_ebounds.size() - 1);
-   size_t ncc(counts.size() - 1);
+   size_t ncc(ntrue - 2);
    if (counts[ncc] > 0 && counts[ncc-1] > 0) {
-      value = counts[ncc-1]
+      counts[ncc+1] = counts[ncc-1]
          *std::exp(std::log(m_ebounds[nee]/m_ebounds[nee-2])/
                    std::log(m_ebounds[nee-1]/m_ebounds[nee-2])*
                    std::log(counts[ncc]/counts[ncc-1]));
    } else {
-      value = ((m_ebounds[nee] - m_ebounds[nee-2])/
-               (m_ebounds[nee-1] - m_ebounds[nee-2])*
-               (counts[ncc] - counts[ncc-1]) + counts[ncc-1]);
-   }
-   counts.push_back(value);
-
-   meas_counts.resize(m_ebounds.size() - 3);
-   for (size_t kp(0); kp < meas_counts.size(); kp++) {
-      meas_counts[kp] = 0;
-      for (size_t k(0); k < counts.size(); k++) {
-         meas_counts[kp] += counts[k]*m_drm[k][kp];
-      }
+      counts[ncc+1] = ((m_ebounds[nee] - m_ebounds[nee-2])/
+                       (m_ebounds[nee-1] - m_ebounds[nee-2])*
+                       (counts[ncc] - counts[ncc-1]) + counts[ncc-1]);
    }
 }
 
@@ -110,16 +171,48 @@ void Drm::compute_drm() {
    // in a particular cos theta bin.
    compute_livetime();
 
+   std::vector<double> etrue;
+   for (size_t k(0); k < m_ebounds.size()-1; k++) {
+      etrue.push_back(std::sqrt(m_ebounds[k]*m_ebounds[k+1]));
+   }
+   m_observation.expCube().fillAeffTable(m_observation.respFuncs(), etrue);
+
+   std::vector<bool> phideps;
+   disablePhiDependence(m_observation.respFuncs(), phideps);
    for (size_t k(0); k < m_ebounds.size()-1; k++) {
       std::vector<double> row;
       for (size_t kp(0); kp < m_ebounds.size() - 3; kp++) {
          double emeas_min(m_ebounds[kp+1]);
          double emeas_max(m_ebounds[kp+2]);
-         row.push_back(matrix_element(std::sqrt(m_ebounds[k]*m_ebounds[k+1]),
-                                      emeas_min, emeas_max));
+         row.push_back(compute_element(etrue[k], emeas_min, emeas_max));
       }
       m_drm.push_back(row);
    }
+   restorePhiDependence(m_observation.respFuncs(), phideps);
+}
+
+void Drm::disablePhiDependence(const ResponseFunctions & resps,
+                               std::vector<bool> & phideps) {
+   phideps.clear();
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator it;
+   for (it = resps.begin(); it != resps.end(); ++it) {
+      bool phidep(it->second->aeff()->usePhiDependence());
+      phideps.push_back(phidep);
+      if (phidep) {
+         it->second->aeff()->setPhiDependence(false);
+      }
+   }
+}
+
+void Drm::restorePhiDependence(const ResponseFunctions & resps,
+                               const std::vector<bool> & phideps) {
+   size_t i(0);
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator it;
+   for (it = resps.begin(); it != resps.end() && i < phideps.size(); ++it, i++) {
+      if (phideps[i]) {
+         it->second->aeff()->setPhiDependence(true);
+      }
+   }
 }
 
 
@@ -147,6 +240,16 @@ void Drm::compute_livetime() {
 
 double Drm::
 matrix_element(double etrue, double emeas_min, double emeas_max) const {
+   std::vector<bool> phideps;
+   disablePhiDependence(m_observation.respFuncs(), phideps);
+   double my_disp(compute_element(etrue, emeas_min, emeas_max));
+   restorePhiDependence(m_observation.respFuncs(), phideps);
+   return my_disp;
+}
+
+
+double Drm::
+compute_element(double etrue, double emeas_min, double emeas_max) const {
    const ResponseFunctions & resps(m_observation.respFuncs());
    const ExposureCube & expcube(m_observation.expCube());
    double met((expcube.tstart() + expcube.tstop())/2.);
@@ -159,15 +262,11 @@ matrix_element(double etrue, double emeas_min, double emeas_max) const {
    // Use phi-averged exposure
    double phi(-1);
 
-   // Get the event types (usually just the list of conversion_type's)
-   // and turn off phi-dependence temporarily.
-   std::vector<bool> phideps;
+   // Get the event types (usually just the list of conversion_type's).
    std::vector<int> evtTypes;
    std::map<unsigned int, irfInterface::Irfs *>::const_iterator it;
 
    for (it = resps.begin(); it != resps.end(); ++it) {
-       phideps.push_back(it->second->aeff()->usePhiDependence());
-       it->second->aeff()->setPhiDependence(false);
        evtTypes.push_back(it->second->irfID());
    }
 
@@ -178,7 +277,9 @@ matrix_element(double etrue, double emeas_min, double emeas_max) const {
       double theta = m_theta_vals[j];
       double livetime = m_livetime[j];
       for (size_t i(0); i < evtTypes.size(); i++) {
-         double aeff(resps.aeff(etrue, theta, phi, evtTypes[i], met));
+         double aeff(resps.aeffTable().value(resps.aeff(evtTypes[i]),
+                                             evtTypes[i], etrue,
+                                             m_costheta_vals[j], phi, met));
          double edisp(resps.edisp(evtTypes[i]).integral(emeas_min, emeas_max, 
                                                         etrue, theta, phi,
                                                         met));
@@ -193,12 +294,6 @@ matrix_element(double etrue, double emeas_min, double emeas_max) const {
       my_disp = numerator/denominator;
    }
 
-   // Restore status of phi-dependence.
-   size_t i(0);
-   for (it = resps.begin(); it != resps.end(); ++it, i++) {
-      it->second->aeff()->setPhiDependence(phideps[i]);
-   }
-
    return my_disp;
 }
 
@@ -214,7 +309,8 @@ Drm_Cache::Drm_Cache(const Drm* drm,
    m_meas_counts_wt(energies.size()-1),
    m_xi_wt(energies.size()-1),
    m_kref_wt(energies.size()-1),
-   m_use_edisp(drm!=0){
+   m_use_edisp(drm!=0),
+   m_drm(0){
   update(drm,sourceMap,energies);
 }
 
@@ -227,18 +323,83 @@ Drm_Cache::Drm_Cache(const Drm_Cache& other)
     m_meas_counts_wt(other.m_meas_counts_wt),
     m_xi_wt(other.m_xi_wt),
     m_kref_wt(other.m_kref_wt),
-    m_use_edisp(other.m_use_edisp){
+    m_use_edisp(other.m_use_edisp),
+    m_drm(other.m_drm),
+    m_specVals(other.m_specVals),
+    m_npreds(other.m_npreds),
+    m_npred_weights(other.m_npred_weights){
 }
 
 void Drm_Cache::update(const Drm* drm,
 		       SourceMap & sourceMap,
 		       const std::vector<double>& energies) {
+  if ( !update_true_counts(drm,sourceMap,energies) ) {
+    return;
+  }
+  if ( drm != 0 ) {
+    drm->convolve(m_true_counts, m_meas_counts);
+    drm->convolve(m_true_counts_wt, m_meas_counts_wt);
+  }
+  update_corrections();
+}
+
+void Drm_Cache::update(const Drm* drm,
+		       const std::vector<Drm_Cache*>& caches,
+		       const std::vector<SourceMap*>& sourceMaps,
+		       const std::vector<double>& energies) {
+  if ( caches.size() != sourceMaps.size() ) {
+    throw std::runtime_error("Drm_Cache::update: Number of caches and "
+			     "source maps do not match.");
+  }
+  std::vector<Drm_Cache*> stale;
+  for ( size_t i(0); i < caches.size(); i++ ) {
+    if ( caches[i]->update_true_counts(drm,*sourceMaps[i],energies) ) {
+      stale.push_back(caches[i]);
+    }
+  }
+  if ( stale.size() == 0 ) {
+    return;
+  }
+  if ( drm != 0 ) {
+    // Both the unweighted and weighted spectra go into the same product
+    std::vector<const std::vector<double>*> true_counts;
+    std::vector<std::vector<double>*> meas_counts;
+    true_counts.reserve(2*stale.size());
+    meas_counts.reserve(2*stale.size());
+    for ( std::vector<Drm_Cache*>::iterator itr = stale.begin(); itr != stale.end(); ++itr ) {
+      true_counts.push_back(&(*itr)->m_true_counts);
+      meas_counts.push_back(&(*itr)->m_meas_counts);
+      true_counts.push_back(&(*itr)->m_true_counts_wt);
+      meas_counts.push_back(&(*itr)->m_meas_counts_wt);
+    }
+    drm->convolve(true_counts, meas_counts);
+  }
+  for ( std::vector<Drm_Cache*>::iterator itr = stale.begin(); itr != stale.end(); ++itr ) {
+    (*itr)->update_corrections();
+  }
+}
+
+bool Drm_Cache::update_true_counts(const Drm* drm,
+				   SourceMap & sourceMap,
+				   const std::vector<double>& energies) {
 
   sourceMap.setSpectralValues(energies);  
   const std::vector<double>& npreds = sourceMap.npreds();
   const std::vector<std::pair<double,double> >& npred_weights = sourceMap.npred_weights();
   const std::vector<double>& specVals = sourceMap.specVals();
 
+  // Nothing has changed since the last update
+  if ( drm == m_drm &&
+       specVals == m_specVals && 
+       npreds == m_npreds && 
+       npred_weights == m_npred_weights ) {
+    return false;
+  }
+  m_drm = drm;
+  m_specVals = specVals;
+  m_npreds = npreds;
+  m_npred_weights = npred_weights;
+
   size_t k(0);
   for (k = 0; k < energies.size()-1; k++) {
     double log_energy_ratio = std::log(energies.at(k+1)/energies.at(k));
@@ -253,19 +414,18 @@ void Drm_Cache::update(const Drm* drm,
 							   specVals.at(k+1)*npreds.at(k+1)*npred_weights[k].second,
 							   log_energy_ratio);     
   }
-  if ( drm != 0 ) {
-    m_use_edisp = true;
-    drm->convolve(m_true_counts, m_meas_counts);
-    drm->convolve(m_true_counts_wt, m_meas_counts_wt);
-	
-  } else {
-    m_use_edisp = false;
+  m_use_edisp = drm != 0;
+  if ( !m_use_edisp ) {
     std::copy(m_true_counts.begin(),m_true_counts.end(),m_meas_counts.begin());
     std::copy(m_true_counts_wt.begin(),m_true_counts_wt.end(),m_meas_counts_wt.begin());
   }
+  return true;
+}
+
+void Drm_Cache::update_corrections() {
   int kref(-1);
   int kref_wt(-1);
-  for (k = 0; k < energies.size()-1; k++) {
+  for (size_t k = 0; k < m_true_counts.size(); k++) {
     if ( m_true_counts[k] > 0 ) {
       // Still have counts in this true energy bin, so it can 
       // be used as a reference
@@ -303,7 +463,10 @@ size_t Drm_Cache::memory_size() const {
   retVal += sizeof(double)*m_meas_counts_wt.capacity();
   retVal += sizeof(double)*m_xi_wt.capacity();
   retVal += sizeof(int)*m_kref_wt.capacity();
-
+  retVal += sizeof(double)*m_specVals.capacity();
+  retVal += sizeof(double)*m_npreds.capacity();
+  retVal += sizeof(std::pair<double,double>)*m_npred_weights.capacity();
+  return retVal;
 }
 
 } // namespace Likelihood
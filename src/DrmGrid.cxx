@@ -0,0 +1,380 @@
+/**
+ * @file DrmGrid.cxx
+ * @brief Detector response matrices computed on a HEALPix grid of
+ * directions, and interpolated to the source directions.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+#include "healpix_base.h"
+
+#include "astro/SkyDir.h"
+
+#include "st_stream/StreamFormatter.h"
+
+#include "Likelihood/Drm.h"
+#include "Likelihood/DrmGrid.h"
+#include "Likelihood/ExposureCube.h"
+#include "Likelihood/FileUtils.h"
+#include "Likelihood/Observation.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/ResponseClones.h"
+#include "Likelihood/ResponseFunctions.h"
+
+namespace {
+   const char s_magic[8] = {'L', 'K', 'D', 'R', 'M', 'G', '0', '1'};
+
+   template <typename T>
+   void writeValue(std::ofstream & output, const T & value) {
+      output.write(reinterpret_cast<const char *>(&value), sizeof(T));
+   }
+
+   template <typename T>
+   bool readValue(std::ifstream & input, T & value) {
+      input.read(reinterpret_cast<char *>(&value), sizeof(T));
+      return input.good();
+   }
+
+   pointing toPointing(const astro::SkyDir & dir) {
+      return pointing((90. - dir.dec())*M_PI/180., dir.ra()*M_PI/180.);
+   }
+
+   astro::SkyDir toSkyDir(const pointing & ptg) {
+      return astro::SkyDir(ptg.phi*180./M_PI, 90. - ptg.theta*180./M_PI);
+   }
+}
+
+namespace Likelihood {
+
+DrmGrid::DrmGrid(const astro::SkyDir & center, double radius, int order,
+                 const Observation & observation,
+                 const std::vector<double> & ebounds,
+                 const std::string & cacheFile,
+                 int numThreads)
+   : m_order(order), m_observation(observation), m_ebounds(ebounds),
+     m_cacheFile(cacheFile), m_numRead(0) {
+   if (m_order < 0) {
+      throw std::runtime_error("DrmGrid: HEALPix order must be >= 0.");
+   }
+   double tstart(ParallelUtils::wallTime());
+   Healpix_Base hp(m_order, NEST);
+   std::vector<int> pixels;
+   if (radius >= 180.) {
+      for (int ipix(0); ipix < hp.Npix(); ipix++) {
+         pixels.push_back(ipix);
+      }
+   } else {
+      hp.query_disc_inclusive(::toPointing(center), radius*M_PI/180., pixels);
+   }
+
+   if (m_cacheFile != "") {
+      m_cubeChecksum =
+         FileUtils::file_checksum(m_observation.expCube().fileName());
+      readCache(pixels);
+   }
+
+   std::vector<int> missing;
+   for (size_t i(0); i < pixels.size(); i++) {
+      if (m_nodes.count(pixels[i]) == 0) {
+         missing.push_back(pixels[i]);
+      }
+   }
+   if (missing.empty()) {
+      return;
+   }
+
+   int nthreads(ParallelUtils::numThreads(numThreads));
+   std::vector<Drm *> computed(missing.size(), 0);
+// The first node is computed serially, which also tabulates the
+// effective areas for the energies of the matrices (see AeffTable),
+// before the response functions are cloned for the other threads.
+// Each thread computes its nodes with its own clones, since the IRF
+// objects are not thread-safe, and the matrices are then copied into
+// Drms that use the original Observation.
+   astro::SkyDir firstDir(::toSkyDir(hp.pix2ang(missing[0])));
+   computed[0] = new Drm(firstDir.ra(), firstDir.dec(), m_observation,
+                         m_ebounds);
+   ResponseClones clones(m_observation, nthreads);
+   std::string errorMessage;
+   int nmissing = static_cast<int>(missing.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+#endif
+   for (int i = 1; i < nmissing; i++) {
+      try {
+         astro::SkyDir nodeDir(::toSkyDir(hp.pix2ang(missing[i])));
+         Drm my_drm(nodeDir.ra(), nodeDir.dec(), clones.observation(),
+                    m_ebounds);
+         computed[i] = new Drm(nodeDir.ra(), nodeDir.dec(), m_observation,
+                               m_ebounds, my_drm.matrix());
+      } catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(DrmGrid_error)
+#endif
+         errorMessage = eObj.what();
+      }
+   }
+
+   for (size_t i(0); i < missing.size(); i++) {
+      if (computed[i] != 0) {
+         m_nodes[missing[i]] = computed[i];
+      }
+   }
+   if (errorMessage != "") {
+      throw std::runtime_error("DrmGrid: " + errorMessage);
+   }
+
+   st_stream::StreamFormatter formatter("DrmGrid", "", 2);
+   formatter.info() << "Computed " << missing.size() << " of "
+                    << pixels.size() << " DRM grid nodes in "
+                    << ParallelUtils::wallTime() - tstart << " s using "
+                    << nthreads << " thread(s)" << std::endl;
+
+   if (m_cacheFile != "") {
+      writeCache();
+   }
+}
+
+DrmGrid::~DrmGrid() throw() {
+   for (NodeMap_t::iterator it(m_nodes.begin()); it != m_nodes.end(); ++it) {
+      delete it->second;
+   }
+   for (DrmMap_t::iterator it(m_drms.begin()); it != m_drms.end(); ++it) {
+      delete it->second;
+   }
+}
+
+int DrmGrid::fineOrder() const {
+// Pixels 8 times smaller than the node spacing; 13 is the largest
+// order for Healpix_Base.
+   return std::min(m_order + 3, 13);
+}
+
+std::string DrmGrid::cacheFileName(const std::string & srcMapsFile) {
+   if (srcMapsFile == "" || srcMapsFile == "none") {
+      return "";
+   }
+   return srcMapsFile + ".drm";
+}
+
+const Drm * DrmGrid::drm(const astro::SkyDir & dir) const {
+// The matrices are interpolated to the centers of the pixels of a
+// finer HEALPix grid, so the number of them is bounded however many
+// source positions are tried, e.g., while fitting a position.
+   Healpix_Base fine(fineOrder(), NEST);
+   int key(fine.ang2pix(::toPointing(dir)));
+   const Drm * result(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DrmGrid)
+#endif
+   {
+      DrmMap_t::const_iterator it(m_drms.find(key));
+      if (it != m_drms.end()) {
+         result = it->second;
+      }
+   }
+   if (result != 0) {
+      return result;
+   }
+// Interpolate outside of the critical section.  If another thread
+// has added the same direction in the meantime, that one is used.
+   Drm * new_drm(interpolate(::toSkyDir(fine.pix2ang(key))));
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_DrmGrid)
+#endif
+   {
+      DrmMap_t::const_iterator it(m_drms.find(key));
+      if (it != m_drms.end()) {
+         result = it->second;
+      } else {
+         m_drms[key] = new_drm;
+         result = new_drm;
+      }
+   }
+   if (result != new_drm) {
+      delete new_drm;
+   }
+   return result;
+}
+
+Drm * DrmGrid::interpolate(const astro::SkyDir & dir) const {
+   if (m_nodes.empty()) {
+      throw std::runtime_error("DrmGrid::interpolate: the grid is empty.");
+   }
+   Healpix_Base hp(m_order, NEST);
+   fix_arr<int, 4> pix;
+   fix_arr<double, 4> wgt;
+   hp.get_interpol(::toPointing(dir), pix, wgt);
+
+   std::vector<const Drm *> nodes;
+   std::vector<double> weights;
+   double sumWts(0);
+   for (size_t i(0); i < 4; i++) {
+      NodeMap_t::const_iterator it(m_nodes.find(pix[i]));
+      if (it == m_nodes.end() || wgt[i] <= 0) {
+         continue;
+      }
+      nodes.push_back(it->second);
+      weights.push_back(wgt[i]);
+      sumWts += wgt[i];
+   }
+   if (nodes.empty()) {
+// Outside of the grid, so use the nearest node.
+      double minSep(0);
+      const Drm * nearest(0);
+      for (NodeMap_t::const_iterator it(m_nodes.begin());
+           it != m_nodes.end(); ++it) {
+         double sep(dir.difference(it->second->dir()));
+         if (nearest == 0 || sep < minSep) {
+            minSep = sep;
+            nearest = it->second;
+         }
+      }
+      nodes.push_back(nearest);
+      weights.push_back(1.);
+      sumWts = 1.;
+   }
+
+   std::vector< std::vector<double> > matrix(nodes[0]->matrix());
+   for (size_t k(0); k < matrix.size(); k++) {
+      for (size_t kp(0); kp < matrix[k].size(); kp++) {
+         double value(0);
+         for (size_t i(0); i < nodes.size(); i++) {
+            value += weights[i]*nodes[i]->matrix()[k][kp];
+         }
+         matrix[k][kp] = value/sumWts;
+      }
+   }
+   return new Drm(dir.ra(), dir.dec(), m_observation, m_ebounds, matrix);
+}
+
+void DrmGrid::cacheKey(std::vector<double> & values, std::string & names) const {
+   const ExposureCube & expcube(m_observation.expCube());
+   const ResponseFunctions & resps(m_observation.respFuncs());
+   names = m_cubeChecksum + "\n" + resps.respName();
+   values.clear();
+   values.push_back(m_order);
+   values.push_back(expcube.tstart());
+   values.push_back(expcube.tstop());
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator it;
+   for (it = resps.begin(); it != resps.end(); ++it) {
+      values.push_back(it->first);
+   }
+   values.insert(values.end(), m_ebounds.begin(), m_ebounds.end());
+}
+
+void DrmGrid::readCache(const std::vector<int> & pixels) {
+   std::ifstream input(m_cacheFile.c_str(), std::ios::binary);
+   if (!input) {
+      return;
+   }
+   char magic[sizeof(s_magic)];
+   input.read(magic, sizeof(magic));
+   if (!input || std::memcmp(magic, s_magic, sizeof(s_magic)) != 0) {
+      return;
+   }
+   std::vector<double> values;
+   std::string names;
+   cacheKey(values, names);
+
+   size_t namelen, nvalues, nnodes;
+   if (!::readValue(input, namelen) || namelen != names.size()) {
+      return;
+   }
+   std::string fileNames(namelen, ' ');
+   input.read(&fileNames[0], namelen);
+   if (!input || fileNames != names) {
+      return;
+   }
+   if (!::readValue(input, nvalues) || nvalues != values.size()) {
+      return;
+   }
+   std::vector<double> fileValues(nvalues);
+   input.read(reinterpret_cast<char *>(&fileValues[0]), nvalues*sizeof(double));
+   if (!input || fileValues != values) {
+      return;
+   }
+   if (!::readValue(input, nnodes)) {
+      return;
+   }
+
+   std::set<int> wanted(pixels.begin(), pixels.end());
+   size_t nrows(m_ebounds.size() + 1);
+   size_t ncols(m_ebounds.size() - 1);
+   Healpix_Base hp(m_order, NEST);
+   for (size_t i(0); i < nnodes; i++) {
+      int pix;
+      std::vector< std::vector<double> > matrix(nrows, std::vector<double>(ncols));
+      if (!::readValue(input, pix)) {
+         return;
+      }
+      for (size_t k(0); k < nrows; k++) {
+         input.read(reinterpret_cast<char *>(&matrix[k][0]), ncols*sizeof(double));
+      }
+      if (!input) {
+         return;
+      }
+      if (wanted.count(pix) == 0 || m_nodes.count(pix) != 0) {
+         continue;
+      }
+      astro::SkyDir nodeDir(::toSkyDir(hp.pix2ang(pix)));
+      m_nodes[pix] = new Drm(nodeDir.ra(), nodeDir.dec(), m_observation,
+                             m_ebounds, matrix);
+      m_numRead++;
+   }
+}
+
+void DrmGrid::writeCache() const {
+   std::vector<double> values;
+   std::string names;
+   cacheKey(values, names);
+
+   std::string tmpfile(m_cacheFile + ".tmp");
+   std::ofstream output(tmpfile.c_str(), std::ios::binary);
+   if (!output) {
+      throw std::runtime_error("DrmGrid::writeCache: cannot open " + tmpfile);
+   }
+   output.write(s_magic, sizeof(s_magic));
+   ::writeValue(output, names.size());
+   output.write(names.data(), names.size());
+   ::writeValue(output, values.size());
+   output.write(reinterpret_cast<const char *>(&values[0]),
+                values.size()*sizeof(double));
+   ::writeValue(output, m_nodes.size());
+   for (NodeMap_t::const_iterator it(m_nodes.begin()); it != m_nodes.end(); ++it) {
+      ::writeValue(output, it->first);
+      const std::vector< std::vector<double> > & matrix(it->second->matrix());
+      for (size_t k(0); k < matrix.size(); k++) {
+         output.write(reinterpret_cast<const char *>(&matrix[k][0]),
+                      matrix[k].size()*sizeof(double));
+      }
+   }
+   output.close();
+   if (!output) {
+      std::remove(tmpfile.c_str());
+      throw std::runtime_error("DrmGrid::writeCache: error writing " + tmpfile);
+   }
+   if (std::rename(tmpfile.c_str(), m_cacheFile.c_str()) != 0) {
+      std::remove(tmpfile.c_str());
+      throw std::runtime_error("DrmGrid::writeCache: cannot rename "
+                               + tmpfile + " to " + m_cacheFile);
+   }
+}
+
+size_t DrmGrid::memory_size() const {
+   size_t retVal(sizeof(*this));
+   size_t matrixSize((m_ebounds.size() + 1)*(m_ebounds.size() - 1)*sizeof(double));
+   retVal += (m_nodes.size() + m_drms.size())*(sizeof(Drm) + matrixSize);
+   return retVal;
+}
+
+} // namespace Likelihood
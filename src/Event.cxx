@@ -208,7 +208,7 @@ void Event::computeResponseGQ(std::vector<DiffuseSource *> & srcList,
 	    respValue = fn->diffuseResponse(*this,respFuncs);	
 	 } else if (srcs.at(i)->mapBasedIntegral() || 
 		    (::getenv("MAP_BASED_DIFFRSP") && (mumin != minusone || mumax != one))) {
-	    respValue = srcs.at(i)->diffuseResponse(*this);
+	    respValue = srcs.at(i)->diffuseResponse(*this, respFuncs);
 	 } else if (mumin > mu_psf2s) {
 	    respValue = 
 	      DiffRespIntegrand2::
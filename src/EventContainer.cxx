@@ -9,6 +9,10 @@
 #include <cmath>
 
 #include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "fitsio.h"
 
 #include "facilities/Util.h"
 
@@ -29,6 +33,70 @@
 #include "Likelihood/RoiCuts.h"
 #include "Likelihood/ScData.h"
 
+namespace {
+/// Number of FT1 rows read at a time
+   const size_t s_chunkSize(16384);
+
+/// Throw if status is non-zero, closing fptr first if it is open.
+   void fitsReportError(int status, const std::string & event_file,
+                        fitsfile * fptr=0) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr != 0) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      std::ostringstream message;
+      message << "Likelihood::EventContainer: CFITSIO error " << status
+              << " reading " << event_file;
+      throw std::runtime_error(message.str());
+   }
+
+/// Number of bytes per row of a bit array (X) column.
+   long bitColumnBytes(fitsfile * fptr, int colnum,
+                       const std::string & event_file) {
+      int status(0);
+      int typecode(0);
+      long repeat(0);
+      long width(0);
+      fits_get_coltype(fptr, colnum, &typecode, &repeat, &width, &status);
+      fitsReportError(status, event_file, fptr);
+      if (typecode != TBIT || repeat > 32) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+         throw std::runtime_error("EventContainer::getEvents: "
+                                  "unexpected format for bit array column in "
+                                  + event_file);
+      }
+      return (repeat + 7)/8;
+   }
+
+/// Read nelem rows of a bit array column as nbytes bytes per row.
+   void readBitColumn(fitsfile * fptr, int colnum, long nbytes,
+                      long firstrow, long nelem,
+                      std::vector<unsigned char> & bytes,
+                      const std::string & event_file) {
+      int status(0);
+      unsigned char nulval(0);
+      int anynul(0);
+      fits_read_col(fptr, TBYTE, colnum, firstrow, 1, nelem*nbytes,
+                    &nulval, &bytes[0], &anynul, &status);
+      fitsReportError(status, event_file, fptr);
+   }
+
+/// Value of a bit array, with the last bit as the least significant,
+/// as tip::BitStruct gives it.
+   unsigned long bitValue(const unsigned char * bytes, long nbytes) {
+      unsigned long value(0);
+      for (long k(0); k < nbytes; k++) {
+         value = (value << 8) | bytes[k];
+      }
+      return value;
+   }
+}
+
 namespace Likelihood {
 
 std::vector<std::string> EventContainer::s_FT1_columns;
@@ -81,20 +149,6 @@ void EventContainer::getEvents(std::string event_file,
       evclass_bitarray = false;
    }
 
-   double ra;
-   double dec;
-   double energy;
-   double time;
-   double zenAngle;
-   unsigned long eventClass;
-   int conversionType;
-   unsigned long eventType;
-
-   double respValue;
-
-   tip::Table::Iterator it = events->begin();
-   tip::Table::Record & event = *it;
-
    std::vector<std::string> diffuseNames;
    DiffRespNames diffRespNames;
    bool haveOldDiffRespCols(false);
@@ -108,89 +162,179 @@ void EventContainer::getEvents(std::string event_file,
       get_diffuse_names(events, diffuseNames);
       haveOldDiffRespCols = true;
    }
+   if (m_respFuncs.useEdisp() && !diffuseNames.empty()) {
+      throw std::runtime_error("Attempt to use energy dispersion "
+                               "handling in unbinned analysis.");
+   }
+   std::vector<std::string> diffuseColumns;
+   for (size_t j(0); j < diffuseNames.size(); j++) {
+      if (haveOldDiffRespCols) {
+         diffuseColumns.push_back(diffuseNames[j]);
+      } else {
+         diffuseColumns.push_back(diffRespNames.key(diffuseNames[j]));
+      }
+   }
+   const tip::Table::FieldCont & fields(events->getValidFields());
+   bool haveEventType(std::find(fields.begin(), fields.end(), "event_type")
+                      != fields.end());
+
+   delete events;
+
+// The columns are read with CFITSIO in blocks of rows into contiguous
+// arrays.  The ROI cuts are applied to the column values, so that
+// spacecraft data, efficiencies and Event objects are only looked up
+// or made for the accepted events.
+   int status(0);
+   fitsfile * fptr(0);
+   std::string extname(event_file + "[EVENTS]");
+   fits_open_table(&fptr, extname.c_str(), READONLY, &status);
+   ::fitsReportError(status, event_file);
+
+   long nrows(0);
+   fits_get_num_rows(fptr, &nrows, &status);
+   ::fitsReportError(status, event_file, fptr);
+
+   if (!apply_roi_cut) {
+      m_events.reserve(m_events.size() + nrows);
+   }
+
+   enum {RA_COL, DEC_COL, ENERGY_COL, TIME_COL, ZENITH_ANGLE_COL,
+         EVENT_CLASS_COL, EVENT_TYPE_COL, NUM_COLS};
+   const char * colnames[NUM_COLS] = {"RA", "DEC", "ENERGY", "TIME",
+                                      "ZENITH_ANGLE", "EVENT_CLASS",
+                                      haveEventType ? "EVENT_TYPE"
+                                      : "CONVERSION_TYPE"};
+   int colnums[NUM_COLS];
+   for (int icol(0); icol < NUM_COLS; icol++) {
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(colnames[icol]),
+                      &colnums[icol], &status);
+      ::fitsReportError(status, event_file, fptr);
+   }
+   std::vector<int> respColnums(diffuseColumns.size());
+   for (size_t j(0); j < diffuseColumns.size(); j++) {
+      fits_get_colnum(fptr, CASEINSEN,
+                      const_cast<char *>(diffuseColumns[j].c_str()),
+                      &respColnums[j], &status);
+      ::fitsReportError(status, event_file, fptr);
+   }
+// Bit array columns are read as bytes, packed 8 bits per byte.
+   long classBytes(0);
+   if (evclass_bitarray) {
+      classBytes = ::bitColumnBytes(fptr, colnums[EVENT_CLASS_COL],
+                                    event_file);
+   }
+   long typeBytes(0);
+   if (haveEventType) {
+      typeBytes = ::bitColumnBytes(fptr, colnums[EVENT_TYPE_COL], event_file);
+   }
 
-   for ( ; it != events->end(); ++it, nTotal++) {
-      event["ra"].get(ra);
-      event["dec"].get(dec);
-      event["energy"].get(energy);
-      event["time"].get(time);
-      event["zenith_angle"].get(zenAngle);
-      event["conversion_type"].get(conversionType);
+   long blockSize(std::min(static_cast<long>(s_chunkSize),
+                           std::max(nrows, 1L)));
+   std::vector<double> ra(blockSize);
+   std::vector<double> dec(blockSize);
+   std::vector<double> energy(blockSize);
+   std::vector<double> time(blockSize);
+   std::vector<double> zenAngle(blockSize);
+   std::vector<unsigned long> eventClass(blockSize);
+   std::vector<int> eventType(blockSize);
+   std::vector<unsigned char> bytes(blockSize*std::max(std::max(classBytes,
+                                                                typeBytes),
+                                                       1L));
+   std::vector< std::vector<double> >
+      respValues(diffuseColumns.size(), std::vector<double>(blockSize));
+
+   double dnulval(0);
+   int anynul(0);
+   for (long firstrow(1); firstrow <= nrows; firstrow += blockSize) {
+      long nelem(std::min(blockSize, nrows - firstrow + 1));
+      fits_read_col(fptr, TDOUBLE, colnums[RA_COL], firstrow, 1, nelem,
+                    &dnulval, &ra[0], &anynul, &status);
+      fits_read_col(fptr, TDOUBLE, colnums[DEC_COL], firstrow, 1, nelem,
+                    &dnulval, &dec[0], &anynul, &status);
+      fits_read_col(fptr, TDOUBLE, colnums[ENERGY_COL], firstrow, 1, nelem,
+                    &dnulval, &energy[0], &anynul, &status);
+      fits_read_col(fptr, TDOUBLE, colnums[TIME_COL], firstrow, 1, nelem,
+                    &dnulval, &time[0], &anynul, &status);
+      fits_read_col(fptr, TDOUBLE, colnums[ZENITH_ANGLE_COL], firstrow, 1,
+                    nelem, &dnulval, &zenAngle[0], &anynul, &status);
+      ::fitsReportError(status, event_file, fptr);
       if (evclass_bitarray) {
-         tip::BitStruct event_class;
-         event["event_class"].get(event_class);
-         eventClass = event_class;
+         ::readBitColumn(fptr, colnums[EVENT_CLASS_COL], classBytes,
+                         firstrow, nelem, bytes, event_file);
+         for (long i(0); i < nelem; i++) {
+            eventClass[i] = ::bitValue(&bytes[i*classBytes], classBytes);
+         }
       } else {
-         event["event_class"].get(eventClass);
-      }
-      try {
-         tip::BitStruct event_type;
-         event["event_type"].get(event_type);
-         eventType = event_type;
-         eventType = static_cast<int>(std::log(eventType & event_type_mask)
-                                      /std::log(2));
-      } catch(tip::TipException &) {
-         eventType = conversionType;
+         unsigned long ulnulval(0);
+         fits_read_col(fptr, TULONG, colnums[EVENT_CLASS_COL], firstrow, 1,
+                       nelem, &ulnulval, &eventClass[0], &anynul, &status);
+         ::fitsReportError(status, event_file, fptr);
       }
-      const irfInterface::IEfficiencyFactor * eff_factor =
-         m_respFuncs.respPtr(eventType)->efficiencyFactor();
-
-      double efficiency(1);
-      if (eff_factor) {
-         efficiency = eff_factor->value(energy, m_scData.livetimefrac(time),
-                                        time);
-         if (efficiency < 0) {
-            throw std::runtime_error("EventContainer::getEvents: "
-                                     "efficiency < 0");
+      if (haveEventType) {
+         ::readBitColumn(fptr, colnums[EVENT_TYPE_COL], typeBytes,
+                         firstrow, nelem, bytes, event_file);
+         for (long i(0); i < nelem; i++) {
+            unsigned long evtype(::bitValue(&bytes[i*typeBytes], typeBytes));
+            eventType[i] = static_cast<int>(std::log(evtype & event_type_mask)
+                                            /std::log(2));
          }
+      } else {
+         int inulval(0);
+         fits_read_col(fptr, TINT, colnums[EVENT_TYPE_COL], firstrow, 1,
+                       nelem, &inulval, &eventType[0], &anynul, &status);
+         ::fitsReportError(status, event_file, fptr);
+      }
+      for (size_t j(0); j < diffuseColumns.size(); j++) {
+         fits_read_col(fptr, TDOUBLE, respColnums[j], firstrow, 1, nelem,
+                       &dnulval, &respValues[j][0], &anynul, &status);
+         ::fitsReportError(status, event_file, fptr);
       }
-      Event thisEvent(ra, dec, energy, time, m_scData.zAxis(time),
-                      m_scData.xAxis(time), cos(zenAngle*M_PI/180.), 
-                      m_respFuncs.useEdisp(), m_respFuncs.respName(),
-                      eventType, efficiency);
-      thisEvent.set_classLevel(eventClass);
-      if (!apply_roi_cut || m_roiCuts.accept(thisEvent)) {
-         m_events.push_back(thisEvent);
-         for (std::vector<std::string>::iterator name = diffuseNames.begin();
-              name != diffuseNames.end(); ++name) {
-            std::string srcName = sourceName(*name);
-            std::vector<double> gaussianParams;
-            if (m_respFuncs.useEdisp()) {
-               throw std::runtime_error("Attempt to use energy dispersion "
-                                        "handling in unbinned analysis.");
-               // try {
-               //    event[*name].get(gaussianParams);
-               //    m_events.back().setDiffuseResponse(srcName, gaussianParams);
-               // } catch (tip::TipException & eObj) {
-               //    std::string message(eObj.what());
-               //    if (message.find("FitsColumn::getVector") ==
-               //        std::string::npos) {
-               //       throw;
-               //    }
-               // }
-            } else {
-               std::string colname;
-               if (haveOldDiffRespCols) {
-                  colname = *name;
-               } else {
-                  colname = diffRespNames.key(*name);
-               }
-               event[colname].get(respValue);
-               m_events.back().setDiffuseResponse(*name, respValue);
+      nTotal += nelem;
+
+      for (long i(0); i < nelem; i++) {
+         double muZenith(cos(zenAngle[i]*M_PI/180.));
+         if (apply_roi_cut && 
+             !m_roiCuts.accept(astro::SkyDir(ra[i], dec[i]), energy[i],
+                               time[i], muZenith)) {
+            nReject++;
+            continue;
+         }
+         const irfInterface::IEfficiencyFactor * eff_factor =
+            m_respFuncs.respPtr(eventType[i])->efficiencyFactor();
+
+         double efficiency(1);
+         if (eff_factor) {
+            efficiency = eff_factor->value(energy[i],
+                                           m_scData.livetimefrac(time[i]),
+                                           time[i]);
+            if (efficiency < 0) {
+               int close_status(0);
+               fits_close_file(fptr, &close_status);
+               throw std::runtime_error("EventContainer::getEvents: "
+                                        "efficiency < 0");
             }
          }
-      } else {
-         nReject++;
+         m_events.push_back(Event(ra[i], dec[i], energy[i], time[i],
+                                  m_scData.zAxis(time[i]),
+                                  m_scData.xAxis(time[i]), muZenith,
+                                  m_respFuncs.useEdisp(),
+                                  m_respFuncs.respName(),
+                                  eventType[i], efficiency));
+         m_events.back().set_classLevel(eventClass[i]);
+         for (size_t j(0); j < diffuseNames.size(); j++) {
+            m_events.back().setDiffuseResponse(diffuseNames[j],
+                                               respValues[j][i]);
+         }
       }
    }
+   fits_close_file(fptr, &status);
+   ::fitsReportError(status, event_file);
 
    m_formatter->info(3) << "EventContainer::getEvents:\nOut of " 
                         << nTotal << " events in file "
                         << event_file << ",\n "
                         << nTotal - nReject << " were accepted, and "
                         << nReject << " were rejected.\n" << std::endl;
-
-   delete events;
 }
 
 void EventContainer::computeEventResponses(Source & src, double sr_radius) {
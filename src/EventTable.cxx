@@ -0,0 +1,249 @@
+/**
+ * @file EventTable.cxx
+ * @brief Columnar copy of the event data and the source-by-event
+ * response matrix used by the unbinned log-likelihood.
+ *
+ * $Header$
+ */
+
+#include <memory>
+#include <stdexcept>
+
+#include "optimizers/dArg.h"
+
+#include "Likelihood/DiffuseSource.h"
+#include "Likelihood/Event.h"
+#include "Likelihood/EventTable.h"
+#include "Likelihood/Source.h"
+
+namespace Likelihood {
+
+EventTable::EventTable() {}
+
+void EventTable::setEvents(const std::vector<Event> & events) {
+   clear();
+   size_t nevts(events.size());
+   m_energies.reserve(nevts);
+   m_efficiencies.reserve(nevts);
+   for (size_t j(0); j < nevts; j++) {
+      m_energies.push_back(events[j].getEnergy());
+      m_efficiencies.push_back(events[j].efficiency());
+   }
+}
+
+void EventTable::setSources(const std::map<std::string, Source *> & sources,
+                            const std::vector<Event> & events,
+                            ResponseCache & respCache) {
+   if (events.size() != nEvents()) {
+      throw std::runtime_error("EventTable::setSources: number of events "
+                               "does not match the event columns.");
+   }
+   m_sources.clear();
+   m_srcNames.clear();
+   m_srcIds.clear();
+   std::map<std::string, Source *>::const_iterator srcIt(sources.begin());
+   for ( ; srcIt != sources.end(); ++srcIt) {
+      m_srcIds[srcIt->first] = m_sources.size();
+      m_sources.push_back(srcIt->second);
+      m_srcNames.push_back(srcIt->first);
+   }
+   size_t nsrcs(m_sources.size());
+   m_factored.assign(nsrcs, false);
+   m_responses.assign(nsrcs*nEvents(), 0);
+   for (size_t isrc(0); isrc < nsrcs; isrc++) {
+      computeResponses(isrc, events, respCache);
+   }
+}
+
+bool EventTable::
+sourcesChanged(const std::map<std::string, Source *> & sources) const {
+   if (sources.size() != m_sources.size()) {
+      return true;
+   }
+   std::map<std::string, Source *>::const_iterator srcIt(sources.begin());
+   for (size_t isrc(0); srcIt != sources.end(); ++srcIt, isrc++) {
+      if (srcIt->second != m_sources[isrc] ||
+          srcIt->first != m_srcNames[isrc]) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void EventTable::clear() {
+   m_energies.clear();
+   m_efficiencies.clear();
+   m_sources.clear();
+   m_srcNames.clear();
+   m_srcIds.clear();
+   m_factored.clear();
+   m_responses.clear();
+}
+
+void EventTable::computeFactoredSums(size_t first, size_t last,
+                                     std::vector<double> & modelSums) const {
+   for (size_t j(first); j < last; j++) {
+      modelSums[j] = 0;
+   }
+   std::vector<double> densities(last > first ? last - first : 0);
+   for (size_t isrc(0); isrc < m_sources.size(); isrc++) {
+      if (!m_factored[isrc] || densities.empty()) {
+         continue;
+      }
+      computeDensities(isrc, first, last, &densities[0]);
+      for (size_t j(first); j < last; j++) {
+         modelSums[j] += densities[j - first];
+      }
+   }
+   for (size_t j(first); j < last; j++) {
+      modelSums[j] *= m_efficiencies[j];
+   }
+}
+
+void EventTable::addUnfactoredSums(const std::vector<Event> & events,
+                                   ResponseCache & respCache,
+                                   size_t first, size_t last,
+                                   std::vector<double> & modelSums) const {
+   for (size_t isrc(0); isrc < m_sources.size(); isrc++) {
+      if (m_factored[isrc]) {
+         continue;
+      }
+      for (size_t j(first); j < last; j++) {
+         CachedResponse & cResp(respCache.getCachedValue(j, m_srcNames[isrc]));
+         modelSums[j] += (m_sources[isrc]->fluxDensity(events[j], &cResp)
+                          *m_efficiencies[j]);
+      }
+   }
+}
+
+bool EventTable::hasUnfactoredSources() const {
+   for (size_t isrc(0); isrc < m_factored.size(); isrc++) {
+      if (!m_factored[isrc]) {
+         return true;
+      }
+   }
+   return false;
+}
+
+void EventTable::addFactoredLogModelDerivs(size_t first, size_t last,
+                                           const std::vector<double> & modelSums,
+                                           std::vector<double> & derivs) const {
+   size_t nevts(nEvents());
+   size_t iparam(0);
+   std::vector<std::string> paramNames;
+   for (size_t isrc(0); isrc < m_sources.size(); isrc++) {
+      const Source * src(m_sources[isrc]);
+      src->spectrum().getFreeParamNames(paramNames);
+      if (!m_factored[isrc]) {
+         iparam += paramNames.size();
+         continue;
+      }
+      if (paramNames.empty()) {
+         continue;
+      }
+// Spectrum functions may cache intermediate values, so each call
+// evaluates its own clone.
+      std::auto_ptr<optimizers::Function> spectrum(src->spectrum().clone());
+      const double * resp = &m_responses[isrc*nevts];
+      for (size_t i(0); i < paramNames.size(); i++, iparam++) {
+         double my_deriv(0);
+         for (size_t j(first); j < last; j++) {
+            optimizers::dArg energy_arg(m_energies[j]);
+            my_deriv += (spectrum->derivByParam(energy_arg, paramNames[i])
+                         *resp[j]*m_efficiencies[j]/modelSums[j]);
+         }
+         derivs.at(iparam) += my_deriv;
+      }
+   }
+}
+
+void EventTable::
+addUnfactoredLogModelDerivs(const std::vector<Event> & events,
+                            ResponseCache & respCache,
+                            size_t first, size_t last,
+                            const std::vector<double> & modelSums,
+                            std::vector<double> & derivs) const {
+   size_t iparam(0);
+   std::vector<std::string> paramNames;
+   for (size_t isrc(0); isrc < m_sources.size(); isrc++) {
+      const Source * src(m_sources[isrc]);
+      src->spectrum().getFreeParamNames(paramNames);
+      if (m_factored[isrc]) {
+         iparam += paramNames.size();
+         continue;
+      }
+      for (size_t i(0); i < paramNames.size(); i++, iparam++) {
+         double my_deriv(0);
+         for (size_t j(first); j < last; j++) {
+            CachedResponse & cResp(respCache.getCachedValue(j, m_srcNames[isrc]));
+            my_deriv += (src->fluxDensityDeriv(events[j], paramNames[i], &cResp)
+                         *m_efficiencies[j]/modelSums[j]);
+         }
+         derivs.at(iparam) += my_deriv;
+      }
+   }
+}
+
+int EventTable::sourceId(const std::string & srcName) const {
+   std::map<std::string, int>::const_iterator it(m_srcIds.find(srcName));
+   if (it == m_srcIds.end()) {
+      return -1;
+   }
+   return it->second;
+}
+
+const double * EventTable::responses(size_t isrc) const {
+   if (!m_factored.at(isrc)) {
+      return 0;
+   }
+   return &m_responses[isrc*nEvents()];
+}
+
+void EventTable::computeResponses(size_t isrc,
+                                  const std::vector<Event> & events,
+                                  ResponseCache & respCache) {
+   Source * src(m_sources[isrc]);
+   double * resp = &m_responses[isrc*nEvents()];
+   switch (src->srcType()) {
+   case Source::Point:
+      {
+// Source::fluxDensity fills the cached response, which does not
+// depend on the spectrum.
+         std::vector<CachedResponse> & cached =
+            respCache.getCachedEventValues(m_srcNames[isrc]);
+         for (size_t j(0); j < events.size(); j++) {
+            if (!cached[j].first) {
+               src->fluxDensity(events[j], &cached[j]);
+            }
+            resp[j] = cached[j].second;
+         }
+         m_factored[isrc] = true;
+      }
+      break;
+   case Source::Diffuse:
+      for (size_t j(0); j < events.size(); j++) {
+         resp[j] = events[j].diffuseResponse(events[j].getEnergy(),
+                                             m_srcNames[isrc]);
+      }
+      m_factored[isrc] = true;
+      break;
+   default:
+      m_factored[isrc] = false;
+      break;
+   }
+}
+
+void EventTable::computeDensities(size_t isrc, size_t first, size_t last,
+                                  double * densities) const {
+// Spectrum functions may cache intermediate values, so a clone is
+// evaluated here instead of the source's own spectrum.
+   std::auto_ptr<optimizers::Function> 
+      spectrum(m_sources[isrc]->spectrum().clone());
+   const double * resp = &m_responses[isrc*nEvents()];
+   for (size_t j(first); j < last; j++) {
+      optimizers::dArg energy_arg(m_energies[j]);
+      densities[j - first] = (*spectrum)(energy_arg)*resp[j];
+   }
+}
+
+} // namespace Likelihood
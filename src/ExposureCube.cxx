@@ -24,7 +24,8 @@ ExposureCube::ExposureCube(const ExposureCube & other)
      m_fileName(other.m_fileName), 
      m_hasPhiDependence(other.m_hasPhiDependence),
      m_tstart(other.m_tstart),
-     m_tstop(other.m_tstop) {
+     m_tstop(other.m_tstop),
+     m_id(nextId()) {
    if (other.m_weightedExposure) {
       m_weightedExposure = new map_tools::Exposure(*(other.m_weightedExposure));
    }
@@ -51,6 +52,17 @@ void ExposureCube::readExposureCube(std::string filename) {
    header["TSTART"].get(m_tstart);
    header["TSTOP"].get(m_tstop);
    delete exposure;
+   m_id = nextId();
+}
+
+unsigned long ExposureCube::nextId() {
+   static unsigned long next_id(0);
+   unsigned long id;
+#ifdef _OPENMP
+#pragma omp critical(ExposureCube_id)
+#endif
+   id = ++next_id;
+   return id;
 }
 
 double ExposureCube::livetime(const astro::SkyDir & dir,
@@ -65,6 +77,39 @@ double ExposureCube::livetime(const astro::SkyDir & dir,
    return binner.at(index);
 }
 
+void ExposureCube::cosThetaBins(std::vector<double> & cosThetas) const {
+   cosThetas.clear();
+   const healpix::CosineBinner & binner(m_exposure->data()[astro::SkyDir(0, 0)]);
+   std::vector<float>::const_iterator it(binner.begin());
+   for ( ; it != binner.end_costh(); ++it) {
+      cosThetas.push_back(binner.costheta(it));
+   }
+}
+
+void ExposureCube::fillAeffTable(const ResponseFunctions & respFuncs,
+                                 const std::vector<double> & energies) const {
+   std::vector<double> cosThetas;
+   cosThetaBins(cosThetas);
+   respFuncs.aeffTable().fill(respFuncs, energies, cosThetas,
+                              (m_tstart + m_tstop)/2.);
+}
+
+void ExposureCube::livetimeFactors(double energy, double & factor1,
+                                   double & factor2) const {
+   factor1 = 1;
+   factor2 = 0;
+   if (m_efficiencyFactor == 0) {
+      return;
+   }
+   double met((m_tstart + m_tstop)/2.);
+// The efficiency factor may be called from threaded loops, e.g., when
+// MeanPsfs are built on several threads.
+#ifdef _OPENMP
+#pragma omp critical(ExposureCube_efficiency)
+#endif
+   m_efficiencyFactor->getLivetimeFactors(energy, factor1, factor2, met);
+}
+
 bool ExposureCube::phiDependence(const std::string & filename) const {
    const tip::Table * table 
       = tip::IFileSvc::instance().readTable(filename, "EXPOSURE");
@@ -104,7 +149,6 @@ double ExposureCube::AeffBase::operator()(double cosTheta, double phi) const {
 }
 
 double ExposureCube::Aeff::value(double cosTheta, double phi) const {
-   double inclination = acos(cosTheta)*180./M_PI;
    double epoch((m_observation.expCube().tstart() 
                  + m_observation.expCube().tstop())/2.);
    std::map<unsigned int, irfInterface::Irfs *>::const_iterator respIt 
@@ -112,7 +156,8 @@ double ExposureCube::Aeff::value(double cosTheta, double phi) const {
    for ( ; respIt != m_observation.respFuncs().end(); ++respIt) {
       if (respIt->second->irfID() == m_evtType) {
          irfInterface::IAeff * aeff = respIt->second->aeff();
-         double aeff_val = aeff->value(m_energy, inclination, phi, epoch);
+         double aeff_val = m_observation.respFuncs().aeffTable()
+            .value(*aeff, m_evtType, m_energy, cosTheta, phi, epoch);
          return aeff_val;
       }
    }
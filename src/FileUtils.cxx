@@ -8,6 +8,8 @@
 
 #include <memory>
 #include <cstdio>
+#include <fstream>
+#include <sstream>
 
 #include "Likelihood/FileUtils.h"
 
@@ -556,6 +558,39 @@ namespace Likelihood {
       }      
     }
   
+    std::string file_checksum(const std::string& filename) {
+      std::ifstream input(filename.c_str(), std::ios::binary);
+      if (!input) {
+	return "";
+      }
+      // 64-bit FNV-1a, built from 32-bit halves to stay within C++98.
+      unsigned long hi(0xcbf29ce4UL), lo(0x84222325UL);
+      const unsigned long prime_hi(0x100UL), prime_lo(0x000001b3UL);
+      std::vector<char> buffer(1 << 20);
+      while (input) {
+	input.read(&buffer[0], buffer.size());
+	std::streamsize nread(input.gcount());
+	for (std::streamsize i(0); i < nread; i++) {
+	  lo ^= static_cast<unsigned char>(buffer[i]);
+	  // (hi, lo) *= (prime_hi, prime_lo) modulo 2^64
+	  unsigned long lo_lo((lo & 0xffffUL)*prime_lo);
+	  unsigned long lo_hi((lo >> 16)*prime_lo + (lo_lo >> 16));
+	  unsigned long new_lo(((lo_hi & 0xffffUL) << 16) | (lo_lo & 0xffffUL));
+	  unsigned long new_hi(hi*prime_lo + lo*prime_hi + (lo_hi >> 16));
+	  lo = new_lo & 0xffffffffUL;
+	  hi = new_hi & 0xffffffffUL;
+	}
+      }
+      std::ostringstream checksum;
+      checksum << std::hex;
+      checksum.width(8);
+      checksum.fill('0');
+      checksum << hi;
+      checksum.width(8);
+      checksum << lo;
+      return checksum.str();
+    }
+
   } // namespace FileUtils
  
 } // namespace Likelihood
@@ -12,6 +12,11 @@
 #include <cmath>
 #include <vector>
 #include <memory>
+#include <sstream>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "tip/IFileSvc.h"
 #include "tip/Image.h"
@@ -22,6 +27,8 @@
 #include "astro/SkyProj.h"
 #include "astro/HealpixProj.h"
 
+#include "healpix_base.h"
+
 #include "facilities/commonUtilities.h"
 #include "st_facilities/Util.h"
 
@@ -37,44 +44,135 @@
 #include "Likelihood/Source.h"
 #include "Likelihood/ScanUtils.h"
 #include "Likelihood/BinnedLikelihood.h"
+#include "Likelihood/CountsMapHealpix.h"
+#include "Likelihood/PointSource.h"
 #include "Likelihood/SummedLikelihood.h"
 #include "Likelihood/FitUtils.h"
 #include "Likelihood/SourceMap.h"
 #include "Likelihood/Snapshot.h"
+#include "Likelihood/ParallelUtils.h"
 
 #include "CLHEP/Matrix/Vector.h"
 #include "CLHEP/Matrix/SymMatrix.h"
 
+namespace {
+  /* Unit vector of a direction in the coordinate system of a HEALPix map */
+  void healpixVector(const astro::SkyDir& dir, bool galactic, double* vec) {
+    double lon = astro::degToRad( galactic ? dir.l() : dir.ra() );
+    double lat = astro::degToRad( galactic ? dir.b() : dir.dec() );
+    vec[0] = std::cos(lat)*std::cos(lon);
+    vec[1] = std::cos(lat)*std::sin(lon);
+    vec[2] = std::sin(lat);
+  }
+}
+
 namespace Likelihood {
 
   TestSourceModelCache::TestSourceModelCache(const BinnedLikelihood& logLike,
-					     const PointSource& source)
+					     const PointSource& source,
+					     int nSuper)
     :m_refModel(logLike.countsMap().data().size(),0),
      m_proj(logLike.countsMap().projection()),
-     m_refDir(source.getDir()) {    
+     m_refDir(source.getDir()),
+     m_nSuper(1),
+     m_healpixMap(0),
+     m_keepCurrentModel(true) {    
     // latch the reference direction and the size of the model axes
     m_refPixel = m_refDir.project( m_proj );
+    // Extract the reference image
+    FitUtils::extractModelFromSource(source,logLike,m_refModel,true);
+
+    if ( m_proj.method() == astro::ProjBase::HEALPIX ) {
+      m_healpixMap = dynamic_cast<const CountsMapHealpix*>(&logLike.countsMap());
+      if ( m_healpixMap == 0 ) {
+	throw std::runtime_error("TestSourceModelCache: HEALPix projection without a HEALPix counts map");
+      }
+      m_nx = m_healpixMap->nPixels();
+      m_ny = 1;
+      m_ne = m_refModel.size() / m_nx;
+      // latch the vectors to the reference direction and the pixel centers
+      bool galactic = m_healpixMap->isGalactic();
+      const Healpix_Base& hp = m_healpixMap->healpixProj()->healpix();
+      m_refVec.resize(3);
+      healpixVector(source.getDir(),galactic,&m_refVec[0]);
+      m_pixelVecs.resize(3*m_nx);
+      for ( size_t ipix(0); ipix < m_nx; ipix++ ) {
+	vec3 v = hp.pix2vec(m_healpixMap->localToGlobalIndex(ipix));
+	m_pixelVecs[3*ipix] = v.x;
+	m_pixelVecs[3*ipix+1] = v.y;
+	m_pixelVecs[3*ipix+2] = v.z;
+      }
+      return;
+    }
+
     m_nx = logLike.countsMap().imageDimension(0);
     m_ny = logLike.countsMap().imageDimension(1);    
     m_ne = logLike.countsMap().imageDimension(2);
-    // Extract the reference image
-    FitUtils::extractModelFromSource(source,logLike,m_refModel,true);
+
+    if ( nSuper <= 1 ) {
+      return;
+    }
+    // Render the image with the source at each of the sub-pixel positions.  
+    // The copy has a different name, so that it does not pick up 
+    // the source map of the test source from the BinnedLikelihood
+    m_nSuper = nSuper;
+    m_subPixelModels.resize(m_nSuper*m_nSuper);
+    PointSource* subSrc = static_cast<PointSource*>(source.clone());
+    subSrc->setName(source.getName() + "_subpixel");
+    for ( int iy(0); iy < m_nSuper; iy++ ) {
+      for ( int ix(0); ix < m_nSuper; ix++ ) {
+	std::vector<float>& subModel = m_subPixelModels[iy*m_nSuper + ix];
+	if ( ix == 0 && iy == 0 ) {
+	  subModel = m_refModel;
+	  continue;
+	}
+	astro::SkyDir subDir(m_refPixel.first + double(ix)/m_nSuper,
+			     m_refPixel.second + double(iy)/m_nSuper,
+			     m_proj,false);
+	subSrc->setDir(subDir.ra(),subDir.dec(),false,false);
+	subModel.resize(m_refModel.size(),0.);
+	FitUtils::extractModelFromSource(*subSrc,logLike,subModel,true);
+      }
+    }
+    delete subSrc;
   }
     
-  int TestSourceModelCache::translateMap(const astro::SkyDir& newRef,
-					 std::vector<float>& out_model) const {
+  void TestSourceModelCache::setScanDirs(const std::vector<astro::SkyDir>& scanDirs) {
+    m_scanOffsets.clear();
+    if ( m_healpixMap != 0 ) {
+      return;
+    }
+    m_scanOffsets.reserve(scanDirs.size());
+    for ( std::vector<astro::SkyDir>::const_iterator itr = scanDirs.begin();
+	  itr != scanDirs.end(); itr++ ) {
+      std::pair<double,double> newPix = itr->project( m_proj );
+      m_scanOffsets.push_back(std::make_pair(newPix.first - m_refPixel.first,
+					     newPix.second - m_refPixel.second));
+    }
+  }
     
-    /*
-      if ( m_proj.method() == astro::ProjBase::HEALPIX ) {
-      // FIXME, get these values
-      double d_theta(0.);
-      double d_phi(0.);
-      return translateMap_Healpix(d_theta,d_phi,out_model); 
+  int TestSourceModelCache::translateMap(const astro::SkyDir& newRef,
+					 std::vector<float>& out_model,
+					 int scanIdx) const {
+    if ( m_healpixMap != 0 ) {
+      return translateMap_Healpix(newRef,out_model); 
+    }
+    double dx(0.);
+    double dy(0.);
+    if ( scanIdx >= 0 ) {
+      if ( size_t(scanIdx) >= m_scanOffsets.size() ) {
+	throw std::runtime_error("TestSourceModelCache::translateMap: scan index out of range, call setScanDirs() first.");
       }
-    */
-    std::pair<double,double> newPix = newRef.project( m_proj );
-    double dx = newPix.first - m_refPixel.first;
-    double dy = newPix.second - m_refPixel.second;
+      dx = m_scanOffsets[scanIdx].first;
+      dy = m_scanOffsets[scanIdx].second;
+    } else {
+      std::pair<double,double> newPix = newRef.project( m_proj );
+      dx = newPix.first - m_refPixel.first;
+      dy = newPix.second - m_refPixel.second;
+    }
+    if ( m_nSuper > 1 ) {
+      return translateMap_WcsSubPixel(dx,dy,out_model);
+    }
     return translateMap_Wcs(dx,dy,out_model);
   }
 
@@ -123,6 +221,83 @@ namespace Likelihood {
       std::cout << "Translate WCS: " << delta_x << ' ' << delta_y << std::endl;
     }
     
+    addShiftedMap(m_refModel,delta_x,delta_y,1.,out_model);
+    
+    // copy to the local cache
+    if ( m_keepCurrentModel ) {
+      m_currentModel.resize(out_model.size(),0.);
+      std::copy(out_model.begin(),out_model.end(),m_currentModel.begin());
+    }
+    
+    // This is just a check to make sure that we have preserved the 
+    // normalization
+    if ( true ) {
+      float total_in(0.);
+      float total_out(0.);
+      FitUtils::sumVector(m_refModel.begin(),m_refModel.end(),total_in);
+      FitUtils::sumVector(out_model.begin(),out_model.end(),total_out);
+      if ( false ) {
+	std::cout << "Translate " << dx << ' ' << delta_x << ' '
+		  << dy << ' ' << delta_y << ' '
+		  << total_in << ' ' << total_out << std::endl;
+      }
+    }
+    return 0;
+  }
+  
+ 
+  int TestSourceModelCache::translateMap_WcsSubPixel(double dx, double dy, std::vector<float>& out_model) const {
+
+    FitUtils::setVectorValue(0.,out_model.begin(),out_model.end());    
+
+    // Split the shift into a whole number of pixels and a sub-pixel phase
+    // on each axis, and find the weights of the two neighboring phases
+    int whole[2][2];
+    int phase[2][2];
+    float wts[2][2];
+    double deltas[2] = {dx,dy};
+    for ( int iaxis(0); iaxis < 2; iaxis++ ) {
+      double fine = deltas[iaxis]*m_nSuper;
+      int lo = int(std::floor(fine));
+      double frac = fine - lo;
+      for ( int iside(0); iside < 2; iside++ ) {
+	int fineIdx = lo + iside;
+	int p = fineIdx % m_nSuper;
+	if ( p < 0 ) p += m_nSuper;
+	phase[iaxis][iside] = p;
+	whole[iaxis][iside] = (fineIdx - p) / m_nSuper;
+      }
+      wts[iaxis][0] = 1. - frac;
+      wts[iaxis][1] = frac;
+    }
+
+    for ( int iy(0); iy < 2; iy++ ) {
+      for ( int ix(0); ix < 2; ix++ ) {
+	float weight = wts[0][ix]*wts[1][iy];
+	if ( weight <= 0. ) continue;
+	const std::vector<float>& subModel = m_subPixelModels[phase[1][iy]*m_nSuper + phase[0][ix]];
+	addShiftedMap(subModel,whole[0][ix],whole[1][iy],weight,out_model);
+      }
+    }
+
+    // We don't use 0 to avoid failed matrix inversions 
+    // when the number of observed counts is very small
+    for ( std::vector<float>::iterator itr = out_model.begin(); itr != out_model.end(); itr++ ) {
+      if ( *itr < 1e-9 ) *itr = 1e-9;
+    }
+
+    // copy to the local cache
+    if ( m_keepCurrentModel ) {
+      m_currentModel.resize(out_model.size(),0.);
+      std::copy(out_model.begin(),out_model.end(),m_currentModel.begin());
+    }
+    return 0;
+  }
+
+  void TestSourceModelCache::addShiftedMap(const std::vector<float>& in_model, 
+					   int delta_x, int delta_y, float weight,
+					   std::vector<float>& out_model) const {
+    
     // Compute the start and stop indices for the input vector
     // and the start indices for the output vector
     int start_x_in = delta_x < 0 ? -delta_x : 0;
@@ -132,6 +307,11 @@ namespace Likelihood {
     int start_y_in = delta_y < 0 ? -delta_y : 0;
     int stop_y_in = delta_y < 0 ?  m_ny : m_ny - delta_y;
     int start_y_out = start_y_in + delta_y;
+
+    // Shifted completely off the map
+    if ( stop_x_in <= start_x_in || stop_y_in <= start_y_in ) {
+      return;
+    }
     
     // This is the stride from one energy layer to the next
     int npix = m_nx*m_ny;
@@ -143,39 +323,77 @@ namespace Likelihood {
       size_t row_start_in =  map_offset + (start_y_in * m_nx);
       size_t row_start_out = map_offset + (start_y_out * m_nx);
       // Here we loop over rows
-      for ( size_t iy(start_y_in); iy < stop_y_in; iy++, row_start_in += m_nx, row_start_out += m_nx) {
+      for ( int iy(start_y_in); iy < stop_y_in; iy++, row_start_in += m_nx, row_start_out += m_nx) {
 	// This are the indices of the start and stop pixels in the
 	// input and output maps
 	size_t in_start = row_start_in + start_x_in;
 	size_t in_stop = row_start_in + stop_x_in;
 	size_t out_start = row_start_out + start_x_out; 
-	// copy from input to output
-	std::copy( m_refModel.begin() + in_start,
-		   m_refModel.begin() + in_stop,
-		   out_model.begin() + out_start);
+	if ( weight == 1. ) {
+	  // copy from input to output
+	  std::copy( in_model.begin() + in_start,
+		     in_model.begin() + in_stop,
+		     out_model.begin() + out_start);
+	} else {
+	  for ( size_t i(in_start), j(out_start); i < in_stop; i++, j++ ) {
+	    out_model[j] += weight*in_model[i];
+	  }
+	}
       }
     }
-    
-    // copy to the local cache
-    m_currentModel.resize(out_model.size(),0.);
-    std::copy(out_model.begin(),out_model.end(),m_currentModel.begin());
-    
-    // This is just a check to make sure that we have preserved the 
-    // normalization
-    if ( true ) {
-      float total_in(0.);
-      float total_out(0.);
-      FitUtils::sumVector(m_refModel.begin(),m_refModel.end(),total_in);
-      FitUtils::sumVector(out_model.begin(),out_model.end(),total_out);
-      if ( false ) {
-	std::cout << "Translate " << dx << ' ' << delta_x << ' '
-		  << dy << ' ' << delta_y << ' '
-		  << total_in << ' ' << total_out << std::endl;
+  }
+
+  int TestSourceModelCache::translateMap_Healpix(const astro::SkyDir& newRef, std::vector<float>& out_model) const {
+
+    FitUtils::setVectorValue(1e-9,out_model.begin(),out_model.end());    
+
+    // The rotation that takes the new direction to the reference direction.
+    // Each output pixel takes the value of the reference image at its 
+    // rotated position, interpolated between the nearest HEALPix pixels.
+    double newVec[3];
+    healpixVector(newRef,m_healpixMap->isGalactic(),newVec);
+    const double* refVec = &m_refVec[0];
+    double axis[3] = { newVec[1]*refVec[2] - newVec[2]*refVec[1],
+		       newVec[2]*refVec[0] - newVec[0]*refVec[2],
+		       newVec[0]*refVec[1] - newVec[1]*refVec[0] };
+    double sinAng = std::sqrt(axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2]);
+    double cosAng = newVec[0]*refVec[0] + newVec[1]*refVec[1] + newVec[2]*refVec[2];
+    if ( sinAng > 0. ) {
+      axis[0] /= sinAng; axis[1] /= sinAng; axis[2] /= sinAng;
+    }
+
+    const Healpix_Base& hp = m_healpixMap->healpixProj()->healpix();
+    fix_arr<int,4> pix;
+    fix_arr<double,4> wgt;
+    for ( size_t ipix(0); ipix < m_nx; ipix++ ) {
+      const double* v = &m_pixelVecs[3*ipix];
+      // Rodrigues rotation of the pixel center about axis 
+      double kdotv = axis[0]*v[0] + axis[1]*v[1] + axis[2]*v[2];
+      double kxv[3] = { axis[1]*v[2] - axis[2]*v[1],
+			axis[2]*v[0] - axis[0]*v[2],
+			axis[0]*v[1] - axis[1]*v[0] };
+      vec3 u;
+      u.x = v[0]*cosAng + kxv[0]*sinAng + axis[0]*kdotv*(1. - cosAng);
+      u.y = v[1]*cosAng + kxv[1]*sinAng + axis[1]*kdotv*(1. - cosAng);
+      u.z = v[2]*cosAng + kxv[2]*sinAng + axis[2]*kdotv*(1. - cosAng);
+      hp.get_interpol(pointing(u),pix,wgt);
+      for ( size_t k(0); k < 4; k++ ) {
+	if ( wgt[k] <= 0. ) continue;
+	int inPix = m_healpixMap->globalToLocalIndex(pix[k]);
+	if ( inPix < 0 ) continue;
+	for ( size_t ie(0); ie < m_ne; ie++ ) {
+	  out_model[ie*m_nx + ipix] += wgt[k]*m_refModel[ie*m_nx + inPix];
+	}
       }
     }
+
+    // copy to the local cache
+    if ( m_keepCurrentModel ) {
+      m_currentModel.resize(out_model.size(),0.);
+      std::copy(out_model.begin(),out_model.end(),m_currentModel.begin());
+    }
     return 0;
   }
-  
  
   void FitScanMVPrior::logLikelihood(const CLHEP::HepVector& params, double& logLike) const {
     CLHEP::HepVector delta = params - m_centralVals;
@@ -515,12 +733,13 @@ namespace Likelihood {
 
   int FitScanModelWrapper_Binned::shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
 						  const astro::SkyDir& newDir,
-						  std::vector<float>& targetModel) const {
+						  std::vector<float>& targetModel,
+						  int scanIdx) const {
     if ( modelCaches.size() != 1 ) {
       throw std::runtime_error("FitScanModelWrapper_Binned should only have a single modelCache");
       return -1;
     }
-    modelCaches[0]->translateMap(newDir,targetModel);
+    modelCaches[0]->translateMap(newDir,targetModel,scanIdx);
   }
 
   void FitScanModelWrapper_Binned::set_klims(size_t kmin, size_t kmax) {
@@ -785,7 +1004,8 @@ namespace Likelihood {
   
   int FitScanModelWrapper_Summed::shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
 						  const astro::SkyDir& newDir,
-						  std::vector<float>& targetModel) const {
+						  std::vector<float>& targetModel,
+						  int scanIdx) const {
     if ( modelCaches.size() != m_summedLike.numComponents() ) {
       throw std::runtime_error("FitScanModelWrapper_Summed number of modelCaches should equal number of Likelihood components");
       return -1;
@@ -797,7 +1017,7 @@ namespace Likelihood {
       size_t compSize = m_sizeByComp[i];
       targetModels[i].resize(compSize);
       std::vector<float>* newVect = &(targetModels[i]);
-      modelCaches[i]->translateMap(newDir,*newVect);
+      modelCaches[i]->translateMap(newDir,*newVect,scanIdx);
       targetModelsPtrs.push_back(newVect);
     }
 
@@ -864,6 +1084,82 @@ namespace Likelihood {
 
   }
 
+  FitScanCache::FitScanCache(const FitScanCache& other)
+    :m_modelWrapper(other.m_modelWrapper),
+     m_snapshot(0),
+     m_testSourceName(other.m_testSourceName),
+     m_tol(other.m_tol),
+     m_maxIter(other.m_maxIter),
+     m_initLambda(other.m_initLambda),
+     m_nebins(other.m_nebins),
+     m_npix(other.m_npix),
+     m_data(other.m_data),
+     m_allModels(other.m_allModels),
+     m_templateSourceNames(other.m_templateSourceNames),
+     m_allFixed(other.m_allFixed),
+     m_initModel(other.m_initModel),
+     m_weights(other.m_weights),
+     m_refValues(other.m_refValues),
+     m_targetModel(other.m_targetModel),
+     m_useReduced(other.m_useReduced),
+     m_useWeights(other.m_useWeights),
+     m_useUnitRefVals(other.m_useUnitRefVals),
+     m_dataRed(other.m_dataRed),
+     m_nonZeroBins(other.m_nonZeroBins),
+     m_energyBinStopIdxs(other.m_energyBinStopIdxs),
+     m_allRedModels(other.m_allRedModels),
+     m_allRedFixed(other.m_allRedFixed),
+     m_weightsRed(other.m_weightsRed),
+     m_targetRedModel(other.m_targetRedModel),
+     m_loglike_ref(other.m_loglike_ref),
+     m_currentFreeSources(other.m_currentFreeSources),
+     m_currentFixed(other.m_currentFixed),
+     m_currentRefValues(other.m_currentRefValues),
+     m_currentSourceIndices(other.m_currentSourceIndices),
+     m_currentTestSourceIndex(other.m_currentTestSourceIndex),
+     m_initPars(other.m_initPars),
+     m_currentPars(other.m_currentPars),
+     m_currentCov(other.m_currentCov),
+     m_currentGrad(other.m_currentGrad),
+     m_prior_test(other.m_prior_test ? new FitScanMVPrior(*other.m_prior_test) : 0),
+     m_prior_bkg(other.m_prior_bkg ? new FitScanMVPrior(*other.m_prior_bkg) : 0),
+     m_global_prior_test(other.m_global_prior_test ? new FitScanMVPrior(*other.m_global_prior_test) : 0),
+     m_global_prior_bkg(other.m_global_prior_bkg ? new FitScanMVPrior(*other.m_global_prior_bkg) : 0),
+     m_init_prior_test(other.m_init_prior_test ? new FitScanMVPrior(*other.m_init_prior_test) : 0),
+     m_init_prior_bkg(other.m_init_prior_bkg ? new FitScanMVPrior(*other.m_init_prior_bkg) : 0),
+     m_full_prior_test(other.m_full_prior_test ? new FitScanMVPrior(*other.m_full_prior_test) : 0),
+     m_full_prior_bkg(other.m_full_prior_bkg ? new FitScanMVPrior(*other.m_full_prior_bkg) : 0),
+     m_currentBestModel(other.m_currentBestModel),
+     m_currentLogLike(other.m_currentLogLike),
+     m_currentEDM(other.m_currentEDM),
+     m_firstEnergyBin(other.m_firstEnergyBin),
+     m_lastEnergyBin(other.m_lastEnergyBin),
+     m_firstBin(other.m_firstBin),
+     m_lastBin(other.m_lastBin){
+
+    // The current models point into the other cache, 
+    // so we point them to our own copies instead.
+    for ( std::vector<const std::vector<float>* >::const_iterator itr = other.m_currentModels.begin();
+	  itr != other.m_currentModels.end(); itr++ ) {
+      const std::vector<float>* ptr(0);
+      if ( *itr == &other.m_targetModel ) {
+	ptr = &m_targetModel;
+      } else if ( *itr == &other.m_targetRedModel ) {
+	ptr = &m_targetRedModel;
+      } else {
+	for ( size_t i(0); i < other.m_allModels.size() && ptr == 0; i++ ) {
+	  if ( *itr == &(other.m_allModels[i]) ) ptr = &(m_allModels[i]);
+	}
+	for ( size_t i(0); i < other.m_allRedModels.size() && ptr == 0; i++ ) {
+	  if ( *itr == &(other.m_allRedModels[i]) ) ptr = &(m_allRedModels[i]);
+	}
+      }
+      if ( ptr == 0 ) {
+	throw std::runtime_error("FitScanCache copy c'tor: unknown model in current fit");
+      }
+      m_currentModels.push_back(ptr);
+    }
+  }
  
   FitScanCache::~FitScanCache() {
     cleanup();
@@ -903,6 +1199,9 @@ namespace Likelihood {
 					    std::vector<std::string>& changed_unlatched,
 					    std::vector<std::string>& new_free, 
 					    std::vector<std::string>& new_fixed) const {
+    if ( m_snapshot == 0 ) {
+      throw std::runtime_error("FitScanCache::find_action_needed: this cache does not have a Snapshot of the model");
+    }
     Snapshot_Status latched_status;
     Snapshot_Status unlatched_status;
     m_snapshot->compare_latched(m_modelWrapper.getMasterComponent(),m_templateSourceNames,
@@ -1099,11 +1398,12 @@ namespace Likelihood {
   } 
   
   int FitScanCache::shiftTestSource(const std::vector<TestSourceModelCache*>& modelCaches,
-				    const astro::SkyDir& newDir) {
+				    const astro::SkyDir& newDir,
+				    int scanIdx) {
     // First remove the current version of the source
     removeTestSourceFromCurrent();
     
-    int status = m_modelWrapper.shiftTestSource(modelCaches,newDir,m_targetModel);
+    int status = m_modelWrapper.shiftTestSource(modelCaches,newDir,m_targetModel,scanIdx);
     if ( status != 0 ) {
       // FIXME, do we throw an exception here?
       return status;
@@ -1255,11 +1555,52 @@ namespace Likelihood {
 					   m_currentBestModel,
 					   m_currentEDM,
 					   m_currentLogLike,
+					   m_workspace,
 					   m_firstBin,
 					   m_lastBin,
 					   verbose);
     return status;
   }
+
+  bool FitScanCache::fitEnergyBins(std::vector<int>& status) {
+    if ( m_currentTestSourceIndex != 0 || m_currentModels.size() != 1 || m_initLambda != 0. ) {
+      return false;
+    }
+    const std::vector<float>& data = m_useReduced ? m_dataRed : m_data;
+    std::vector<float>* wts_ptr = m_useWeights ?  ( m_useReduced ? &m_weightsRed : &m_weights ) : 0;
+
+    // Each energy bin is one problem, with the same template and fixed model
+    std::vector<const std::vector<float>* > templates(m_nebins,m_currentModels[0]);
+    std::vector<const std::vector<float>* > fixed(m_nebins,&m_currentFixed);
+    std::vector<size_t> firstBins(m_nebins);
+    std::vector<size_t> lastBins(m_nebins);
+    for ( size_t i(0); i < m_nebins; i++ ) {
+      setEnergyBin(i);
+      firstBins[i] = m_firstBin;
+      lastBins[i] = m_lastBin;
+    }
+    setEnergyBin(-1);
+    std::vector<double> initNorms(m_nebins,m_initPars[0]);
+
+    FitUtils::fitNorms_newton_batch(data,templates,fixed,wts_ptr,
+				    firstBins,lastBins,initNorms,
+				    m_tol,m_maxIter,
+				    m_binNorms,m_binCovs,m_binGrads,
+				    m_binEDMs,m_binLogLikes,status,
+				    m_batchWorkspace);
+    return true;
+  }
+
+  void FitScanCache::useEnergyBinFit(size_t energyBin) {
+    setEnergyBin(energyBin);
+    m_currentPars[0] = m_binNorms[energyBin];
+    m_currentCov[0][0] = m_binCovs[energyBin];
+    m_currentGrad[0] = m_binGrads[energyBin];
+    m_currentEDM = m_binEDMs[energyBin];
+    m_currentLogLike = m_binLogLikes[energyBin];
+    FitUtils::sumModel(m_currentPars,m_currentModels,m_currentFixed,m_currentBestModel,
+		       m_firstBin,m_lastBin);
+  }
   
   
   /* Calculate the log-likelihood for the currently cached values */
@@ -1370,6 +1711,7 @@ namespace Likelihood {
 					       pars_temp,covs_temp,grad_temp,
 					       model_temp,
 					       edm_temp,logLikes[is],
+					       m_workspace,
 					       m_firstBin,m_lastBin);
 	if ( status ) {	    
 	  std::cout << "Failed profile fit on energy bin " << is << ".  Status: " << status << std::endl;
@@ -1712,7 +2054,9 @@ namespace Likelihood {
      m_verbose_bb(0),
      m_verbose_scan(0),
      m_writeTestImages(false),
-     m_useReduced(true){
+     m_useReduced(true),
+     m_numThreads(ParallelUtils::envThreads()),
+     m_testSourceSuperSample(1){
         
     // Build the energy binned from the energies in the BinnedLikelihood
     m_energy_binner = buildEnergyBinner(m_modelWrapper->energies());  
@@ -1743,7 +2087,9 @@ namespace Likelihood {
      m_verbose_bb(0),
      m_verbose_scan(0),
      m_writeTestImages(false),
-     m_useReduced(true){
+     m_useReduced(true),
+     m_numThreads(ParallelUtils::envThreads()),
+     m_testSourceSuperSample(1){
         
     // Build the energy binned from the energies in the BinnedLikelihood
     m_energy_binner = buildEnergyBinner(m_modelWrapper->energies());  
@@ -1782,7 +2128,9 @@ namespace Likelihood {
      m_verbose_bb(0),
      m_verbose_scan(0),
      m_writeTestImages(false),
-     m_useReduced(true){
+     m_useReduced(true),
+     m_numThreads(ParallelUtils::envThreads()),
+     m_testSourceSuperSample(1){
    
     
     // Build the energy binned from the energies in the BinnedLikelihood
@@ -1820,7 +2168,9 @@ namespace Likelihood {
      m_verbose_bb(0),
      m_verbose_scan(0),
      m_writeTestImages(false),
-     m_useReduced(true){
+     m_useReduced(true),
+     m_numThreads(ParallelUtils::envThreads()),
+     m_testSourceSuperSample(1){
    
     // Build the energy binned from the energies in the BinnedLikelihood
     m_energy_binner = buildEnergyBinner(m_modelWrapper->energies());
@@ -2077,43 +2427,88 @@ namespace Likelihood {
     int nfailed_scan_newton_bins(0);
 
     // We store the output by pixel, so these are useful
-    long ipix(0);
     int npix = doTSMap ? nPixels() : 1;
     int ipix_print = std::max(npix / 20,1);
 
+    // The positions can be fit on several threads, each with its own copy of the FitScanCache,
+    // as long as nothing at a position touches the SourceModel.
+    // Each position fills different bins in the output histograms, so that does not need locking.
+    const bool parallelScan = doTSMap && m_numThreads > 0 &&
+      ! ( broadband_st || sed_st || remakeTestSource || writeTestImages() );
+    int nthreads = parallelScan ? ParallelUtils::numThreads(m_numThreads) : 1;
+
+    // Compute the test source directions up front, 
+    // the projections should not be used from several threads at once
+    std::vector<astro::SkyDir> testDirs;
+    if ( doTSMap ) {
+      for ( long iy(0); iy < nybins; iy++ ) {      
+	for ( long ix(0); ix < nxbins; ix++ ) {
+	  astro::SkyDir aDir;
+	  status = getTestSourceDir(ix,iy,aDir);
+	  if ( status != 0 ) {
+	    throw std::runtime_error("Failed to set test source direction.");
+	    return -1;
+	  }
+	  testDirs.push_back(aDir);
+	}
+      }
+    }
+
+    std::vector<FitScanCache*> caches(1,m_cache);
+    for ( int ithread(1); ithread < nthreads; ithread++ ) {
+      caches.push_back(new FitScanCache(*m_cache));
+    }
+    // The pixel offsets of the test source images are also computed up front
+    for ( size_t iComp(0); iComp < m_testSourceCaches.size(); iComp++ ) {
+      m_testSourceCaches[iComp]->setKeepCurrentModel(writeTestImages());
+      if ( doTSMap ) {
+	m_testSourceCaches[iComp]->setScanDirs(testDirs);
+      }
+    }
+
     if ( doTSMap ) {
       std::cout << "Performing TS Grid Scan" << std::flush;
     } else {
       std::cout << "Performing SED Scan" << std::flush;
     }
- 
-    // Note the loop order, outer loop is on Y, this matches HistND structure
-    for ( long iy(0); iy < nybins; iy++ ) {      
-      for ( long ix(0); ix < nxbins; ix++, ipix++ ) {
+
+    double tstart = ParallelUtils::wallTime();
+    std::string errorMessage;
+    // Note the pixel ordering, Y is the slow index, this matches HistND structure
+    long nscan = nxbins*nybins;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads) \
+  reduction(+:nfailed_bb,nfailed_bb_newton,nfailed_scan_newton,nfailed_scan_newton_bins)
+#endif
+    for ( long ipix = 0; ipix < nscan; ipix++ ) {
+      long ix = ipix % nxbins;
+      long iy = ipix / nxbins;
+      int ithread(0);
+#ifdef _OPENMP
+      ithread = omp_get_thread_num();
+#endif
+      FitScanCache* cache = caches[ithread];
+      try {
 	
 	// Set the test source direction from the grid
-	if ( doTSMap ) {
-	  status = setTestSourceDir(ix,iy);
-	  if ( status != 0 ) {
-	    throw std::runtime_error("Failed to set test source direction.");
-	    return -1;
-	  }
+	if ( doTSMap && nthreads == 1 ) {
+	  m_testSourceDir() = testDirs[ipix]();
 	}
+	const astro::SkyDir& testDir = doTSMap ? testDirs[ipix] : m_testSourceDir;
 
 	// Add the test source to the SourceModel if needed.
 	// This also recomputes the test source image	
 	if ( broadband_st || remakeTestSource ) {
-	  status = addTestSourceToModel();
-	  if ( status != 0 ) {
+	  int add_status = addTestSourceToModel();
+	  if ( add_status != 0 ) {
 	    throw std::runtime_error("Failed to add test source to model.");
-	    return -1;
 	  }	  
 	}
 	
 	// Do the broadband fit with the ScienceTools, if requested
 	if ( broadband_st ) {
-	  status = fitTestSourceBroadband(tol,tolType);
-	  if ( status != 0 ) {
+	  int bb_status = fitTestSourceBroadband(tol,tolType);
+	  if ( bb_status != 0 ) {
 	    // count the number of failed fits
 	    nfailed_bb++;
 	  }
@@ -2127,15 +2522,15 @@ namespace Likelihood {
 	}
 
 	// This resets the cache to the null fit 
-	m_cache->refactorModel(freeSources,parScales,false);
+	cache->refactorModel(freeSources,parScales,false);
 
 	// Add the current test source to the null fit
 	if ( remakeTestSource ) {
 	  // This version uses the SourceMap recomputed by the SourceModel
-	  m_cache->setTestSource(*m_testSource);
+	  cache->setTestSource(*m_testSource);
 	} else {
 	  // This version just shifts the image by some number of pixels
-	  m_cache->shiftTestSource(m_testSourceCaches,m_testSourceDir);
+	  cache->shiftTestSource(m_testSourceCaches,testDir,doTSMap ? int(ipix) : -1);
 	  if ( writeTestImages() ) {
 	    char buffer[255];
 	    static const std::string testImages("TestImages.fits");
@@ -2147,30 +2542,30 @@ namespace Likelihood {
 	}
 	
 	// Set the cache to do a broadband fit
-	m_cache->setEnergyBin(-1);	
-	status = m_cache->fitCurrent(FitScanCache::Global_Prior,verbose_bb());
-	if ( status != 0 ) {
+	cache->setEnergyBin(-1);	
+	int fit_status = cache->fitCurrent(FitScanCache::Global_Prior,verbose_bb());
+	if ( fit_status != 0 ) {
 	  // Refit with verbose
 	  if ( redoFailedVerbose ) {
-	    status = m_cache->fitCurrent(FitScanCache::Global_Prior,4);
+	    fit_status = cache->fitCurrent(FitScanCache::Global_Prior,4);
 	  }
 
-	  ts_map_ok->setBinDirect(ipix,status);
+	  ts_map_ok->setBinDirect(ipix,fit_status);
 	  int idx_sed_err = ipix;
 	  for ( int iE_err(0); iE_err < nEBins(); iE_err++, idx_sed_err += npix ) {
-	    ts_cube_ok->setBinDirect(idx_sed_err,double(status));
+	    ts_cube_ok->setBinDirect(idx_sed_err,double(fit_status));
 	  }
 	  nfailed_bb_newton++;
 	  continue;
 	}
 	
 	// get the TS value and copy to the output histogram
-	double tsval_newton = 2*(m_cache->currentLogLike() - loglike_null);
-	double normVal = m_cache->currentPars()[m_cache->testSourceIndex()];
+	double tsval_newton = 2*(cache->currentLogLike() - loglike_null);
+	double normVal = cache->currentPars()[cache->testSourceIndex()];
 	double posErr(0.);
 	double negErr(0.);
 	
-	m_cache->signalUncertainty_quad(0.5,posErr,negErr);
+	cache->signalUncertainty_quad(0.5,posErr,negErr);
 	double symErr = FitUtils::symmetricError(posErr,negErr);
 
 	if ( ts_map ) ts_map->setBinDirect(ipix,tsval_newton);
@@ -2210,15 +2605,15 @@ namespace Likelihood {
 					    logLikes_st);
 	}
 
-	status = sed_binned_newton(nNorm,normSigma,covScale,
-				   norm_mles,pos_errs,neg_errs,
-				   logLike_mles,uls,
-				   sed_fit_status,
-				   norms,logLikes);
-	if ( status != 0 ) {
+	int sed_status = sed_binned_newton(*cache,nNorm,normSigma,covScale,
+					   norm_mles,pos_errs,neg_errs,
+					   logLike_mles,uls,
+					   sed_fit_status,
+					   norms,logLikes);
+	if ( sed_status != 0 ) {
 	  nfailed_scan_newton++;
-	  if ( status > 0 ) {
-	    nfailed_scan_newton_bins += status;
+	  if ( sed_status > 0 ) {
+	    nfailed_scan_newton_bins += sed_status;
 	  }
 	}
 	if ( ipix % ipix_print == 0 ) {
@@ -2270,12 +2665,29 @@ namespace Likelihood {
 	if ( broadband_st || remakeTestSource ) {
 	  removeTestSourceFromModel();
 	}
-	m_cache->removeTestSourceFromCurrent();
+	cache->removeTestSourceFromCurrent();
+      } catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(FitScanner_error)
+#endif
+	errorMessage = eObj.what();
       }
     }
 
     std::cout << "!" << std::endl;
 
+    for ( size_t ithread(1); ithread < caches.size(); ithread++ ) {
+      delete caches[ithread];
+    }
+    if ( errorMessage != "" ) {
+      throw std::runtime_error("FitScanner::run_tscube: " + errorMessage);
+    }
+    if ( nthreads > 1 ) {
+      std::cout << "Scanned " << nscan << " positions in " 
+		<< ParallelUtils::wallTime() - tstart << " s using "
+		<< nthreads << " threads" << std::endl;
+    }
+
     // Warn about failed fits
     if ( nfailed_bb > 0 ) {
       std::cout << "There were " << nfailed_bb << " failed broadband fits with the standard fitter." << std::endl;
@@ -2296,6 +2708,17 @@ namespace Likelihood {
   }
 
 
+  const HistND* FitScanner::scanData(const std::string& name) const {
+    for ( std::vector< std::pair< std::string,std::pair<HistND*,std::string> > >::const_iterator itr = m_scanData.begin();
+	  itr != m_scanData.end(); itr++ ) {
+      if ( itr->first == name ) {
+	return itr->second.first;
+      }
+    }
+    return 0;
+  }
+
+
   /* Write the stored data to a FITS file */
   int FitScanner::writeFitsFile(const std::string& fitsFile,
 				const std::string& creator,
@@ -2618,6 +3041,11 @@ namespace Likelihood {
 
   /* Set the direction of the test source, based on the loop parameters */
   int FitScanner::setTestSourceDir(int ix, int iy) {
+    return getTestSourceDir(ix,iy,m_testSourceDir);
+  }
+
+  /* Get the direction of the test source for a set of loop parameters */
+  int FitScanner::getTestSourceDir(int ix, int iy, astro::SkyDir& dir) const {
     // No projection means we are not looping over direction
     if ( m_proj == 0 ) { 
       if ( ix != 0 ||
@@ -2636,11 +3064,11 @@ namespace Likelihood {
     */
 
     if ( m_dir2_binner != 0 ) {
-      m_testSourceDir() = astro::SkyDir(ix+1,iy+1,*m_proj,false)();   
+      dir() = astro::SkyDir(ix+1,iy+1,*m_proj,false)();   
     } else {
       const evtbin::HealpixBinner* hxp_binner = static_cast<const evtbin::HealpixBinner*>(m_dir1_binner);
       int pixNum  = hxp_binner->pixelIndices()[ix];
-      m_testSourceDir() = astro::SkyDir(pixNum,0,*m_proj,false)();   
+      dir() = astro::SkyDir(pixNum,0,*m_proj,false)();   
     }
     return 0;
   }
@@ -2695,60 +3123,86 @@ namespace Likelihood {
 				    std::vector<std::vector<double> >& norms,
 				    std::vector<std::vector<double> >& logLikes) {
 
-
-    static const bool redoFailedVerbose(false);
-
-    const double errorLevel = 0.5*normSigma*normSigma;
-
     // We can't do the fitting without a FitScanCache
     if ( m_cache == 0 ) {
       std::cerr << "FitScanner::sed_binned_newton no Cache" << std::endl;
       return -1;
     }
+    return sed_binned_newton(*m_cache,nnorm,normSigma,constrainScale,
+			     norm_mles,pos_errs,neg_errs,logLike_mles,uls,
+			     sed_fit_status,norms,logLikes);
+  }
+
+  int FitScanner::sed_binned_newton(FitScanCache& cache,
+				    int nnorm, double normSigma, 
+				    double constrainScale,
+				    std::vector<double>& norm_mles,
+				    std::vector<double>& pos_errs,
+				    std::vector<double>& neg_errs,
+				    std::vector<double>& logLike_mles,
+				    std::vector<double>& uls,
+				    std::vector<int>& sed_fit_status,
+				    std::vector<std::vector<double> >& norms,
+				    std::vector<std::vector<double> >& logLikes) const {
+
+    static const bool redoFailedVerbose(false);
+
+    const double errorLevel = 0.5*normSigma*normSigma;
 
     // first we fix everything except the signal component to their current values 
     std::vector<float> par_scales;
-    m_cache->getParScales(par_scales);
+    cache.getParScales(par_scales);
     bool usePrior(false);
 
     if ( constrainScale < 0 ) {
-      std::vector<bool> freeSources(m_cache->nBkgModel(),false);
-      m_cache->refactorModel(freeSources,par_scales,true);
+      std::vector<bool> freeSources(cache.nBkgModel(),false);
+      cache.refactorModel(freeSources,par_scales,true);
     } else {
       usePrior = true;
-      std::vector<bool> constrainPars(m_cache->nBkgModel(),true);
-      m_cache->buildPriorsFromCurrent(constrainPars,constrainScale);
+      std::vector<bool> constrainPars(cache.nBkgModel(),true);
+      cache.buildPriorsFromCurrent(constrainPars,constrainScale);
     }
     
     // Latch the index of the test source
-    int test_idx = m_cache->testSourceIndex();
+    int test_idx = cache.testSourceIndex();
 
     // Allocate the output vectors
-    norm_mles.resize(m_cache->nebins());
-    logLike_mles.resize(m_cache->nebins());
-    pos_errs.resize(m_cache->nebins());
-    neg_errs.resize(m_cache->nebins());
-    norms.resize(m_cache->nebins());    
-    logLikes.resize(m_cache->nebins());
-    uls.resize(m_cache->nebins());
-    sed_fit_status.resize(m_cache->nebins());
+    norm_mles.resize(cache.nebins());
+    logLike_mles.resize(cache.nebins());
+    pos_errs.resize(cache.nebins());
+    neg_errs.resize(cache.nebins());
+    norms.resize(cache.nebins());    
+    logLikes.resize(cache.nebins());
+    uls.resize(cache.nebins());
+    sed_fit_status.resize(cache.nebins());
 
     // This is to keep track of failed fits.
     // Usually they just have to do with problem
     // with the matrix inversion, so we might not want to crash
     int nfailed(0);
 
+    // With the background fixed, only the test source normalization is fit,
+    // so all of the energy bins can be fit at once
+    std::vector<int> batch_status;
+    bool batched = !usePrior && verbose_scan() == 0 && cache.fitEnergyBins(batch_status);
+
     // Loop on the energy bins
-    for ( size_t i(0); i < m_cache->nebins(); i++ ) {
-      m_cache->setEnergyBin(i);
-      int status = m_cache->fitCurrent(usePrior ? FitScanCache::Local_Prior : FitScanCache::No_Prior,
-				       verbose_scan());
+    for ( size_t i(0); i < cache.nebins(); i++ ) {
+      int status(0);
+      if ( batched ) {
+	cache.useEnergyBinFit(i);
+	status = batch_status[i];
+      } else {
+	cache.setEnergyBin(i);
+	status = cache.fitCurrent(usePrior ? FitScanCache::Local_Prior : FitScanCache::No_Prior,
+				  verbose_scan());
+      }
       sed_fit_status[i] = status;
       if ( status ) {
 	// if the fit failed, fill the output vectors, and move on.
 	// for debugging, redo failed fits with verbose on
 	if ( redoFailedVerbose ) {
-	  m_cache->fitCurrent(usePrior ? FitScanCache::Local_Prior : FitScanCache::No_Prior, 4);
+	  cache.fitCurrent(usePrior ? FitScanCache::Local_Prior : FitScanCache::No_Prior, 4);
 	}
 	nfailed++;
 	logLike_mles[i] = 0.;
@@ -2761,16 +3215,16 @@ namespace Likelihood {
 	continue;
       }
       // latch the information for the output vectors
-      logLike_mles[i] = m_cache->currentLogLike();
-      norm_mles[i] = m_cache->currentPars()[test_idx];
-      m_cache->signalUncertainty_quad(0.5,pos_errs[i],neg_errs[i]);
+      logLike_mles[i] = cache.currentLogLike();
+      norm_mles[i] = cache.currentPars()[test_idx];
+      cache.signalUncertainty_quad(0.5,pos_errs[i],neg_errs[i]);
       double negLim(0.);
       double posLim(0.);
       // estimate the upper limit
-      m_cache->signalUncertainty_quad(1.36,uls[i],negLim);
+      cache.signalUncertainty_quad(1.36,uls[i],negLim);
       // now estimate the scan range
-      m_cache->signalUncertainty_quad(errorLevel,posLim,negLim); 
-      m_cache->scanNormalization(nnorm,1.0,posLim,negLim,norms[i],logLikes[i]);
+      cache.signalUncertainty_quad(errorLevel,posLim,negLim); 
+      cache.scanNormalization(nnorm,1.0,posLim,negLim,norms[i],logLikes[i]);
       if ( false ) {
 	std::cout << "Done scan " << i << ' ' << norm_mles[i] 
 		  << ' ' << norms[i].back() << ' ' << ( logLikes[i].back() - logLike_mles[i] ) << std::endl;
@@ -2778,7 +3232,7 @@ namespace Likelihood {
     }
 
     // Reset the cache to do broadband fitting
-    m_cache->setEnergyBin(-1);
+    cache.setEnergyBin(-1);
     return nfailed;
   } 
 
@@ -2811,7 +3265,8 @@ namespace Likelihood {
       ptrSrc->setDir(m_testSourceDir.ra(), m_testSourceDir.dec(),
 		     false, false);
       // Build the cache with the new test source
-      m_testSourceCaches[iComp] = new TestSourceModelCache(*binnedLike,*ptrSrc);
+      m_testSourceCaches[iComp] = new TestSourceModelCache(*binnedLike,*ptrSrc,
+							      m_testSourceSuperSample);
     }
 
     // latch the specturm in the model wrapper
@@ -2820,6 +3275,18 @@ namespace Likelihood {
     return 0;
   }
 
+  void FitScanner::set_testSourceSuperSample(int val) {
+    if ( val < 1 ) {
+      throw std::runtime_error("FitScanner::set_testSourceSuperSample: value must be at least 1.");
+    }
+    if ( val == m_testSourceSuperSample ) return;
+    m_testSourceSuperSample = val;
+    // Rebuild the images if we already have them
+    if ( m_testSourceCaches.size() > 0 && m_testSourceCaches[0] != 0 ) {
+      buildTestModelCache();
+    }
+  }
+
   /* Build an n-dimensional histogram based on the loop parameters */
   HistND* FitScanner::buildHist(const std::string& name, 
 				bool do_pix,
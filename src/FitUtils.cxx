@@ -116,6 +116,103 @@ namespace Likelihood {
       return 0;
     }
     
+    NewtonWorkspace::NewtonWorkspace()
+      :m_npar(0),m_gradientCopy(0),
+       m_U(0),m_V(0),m_S(0),m_G(0),m_work(0),m_x(0){
+    }
+
+    NewtonWorkspace::NewtonWorkspace(const NewtonWorkspace& /* other */)
+      :m_npar(0),m_gradientCopy(0),
+       m_U(0),m_V(0),m_S(0),m_G(0),m_work(0),m_x(0){
+    }
+
+    NewtonWorkspace::~NewtonWorkspace() {
+      free_gsl();
+      delete m_gradientCopy;
+    }
+
+    CLHEP::HepVector& NewtonWorkspace::gradientCopy() {
+      if ( m_gradientCopy == 0 ) {
+	m_gradientCopy = new CLHEP::HepVector();
+      }
+      return *m_gradientCopy;
+    }
+
+    void NewtonWorkspace::resize(size_t npar) {
+      if ( npar == m_npar ) return;
+      free_gsl();
+      m_npar = npar;
+      m_sums.resize(npar + (npar*(npar+1))/2);
+      m_templatePtrs.resize(npar);
+      if ( npar == 0 ) return;
+      m_U = gsl_matrix_alloc(npar,npar);
+      m_V = gsl_matrix_alloc(npar,npar);
+      m_S = gsl_vector_alloc(npar);
+      m_G = gsl_vector_alloc(npar);
+      m_work = gsl_vector_alloc(npar);
+      m_x = gsl_vector_alloc(npar);
+    }
+
+    void NewtonWorkspace::free_gsl() {
+      if ( m_U ) gsl_matrix_free(m_U);
+      if ( m_V ) gsl_matrix_free(m_V);
+      if ( m_S ) gsl_vector_free(m_S);
+      if ( m_G ) gsl_vector_free(m_G);
+      if ( m_work ) gsl_vector_free(m_work);
+      if ( m_x ) gsl_vector_free(m_x);
+      m_U = m_V = 0;
+      m_S = m_G = m_work = m_x = 0;
+      m_npar = 0;
+    }
+
+    int svd_solve(const CLHEP::HepSymMatrix& hessian,
+		  const CLHEP::HepVector& gradient,
+		  CLHEP::HepMatrix& u,
+		  CLHEP::HepMatrix& v,
+		  CLHEP::HepVector& s,
+		  CLHEP::HepVector& delta,
+		  NewtonWorkspace& workspace,
+		  double eps) {
+
+      const int nrow = hessian.num_row();
+      const int ncol = hessian.num_col();
+
+      delta = CLHEP::HepVector(nrow);
+
+      workspace.resize(nrow);
+      gsl_matrix * U = workspace.U();
+      gsl_vector * G = workspace.G();
+      for ( size_t i(0); i < nrow; i++ ) {
+	for ( size_t j(0); j < ncol; j++ ) {
+	  gsl_matrix_set(U,i,j,hessian[i][j]);
+	}
+	gsl_vector_set(G,i,gradient[i]);
+      }
+      
+      int ierr = gsl_linalg_SV_decomp(U,workspace.V(),workspace.S(),workspace.work());
+      if(ierr) {
+	return ierr;
+      }
+
+      gsl_vector * S = workspace.S();
+      double threshold = 0.5*sqrt(double(nrow+ncol)+1.0)*gsl_vector_get(S,0)*eps;
+      for ( size_t i(0); i < nrow; i++ ) {
+	if( fabs(gsl_vector_get(S,i)) < threshold ) {
+	  gsl_vector_set(S,i,0);
+	}
+      }
+
+      gsl_linalg_SV_solve(U,workspace.V(),S,G,workspace.x());
+
+      Vector_Gsl_to_Hep(workspace.x(),delta);
+
+      Matrix_Gsl_to_Hep(U,u);
+      Matrix_Gsl_to_Hep(workspace.V(),v);
+      Vector_Gsl_to_Hep(S,s);
+
+      return 0;
+    }
+    
     gsl_vector * Vector_Hep_to_Gsl(const CLHEP::HepVector& hep) {
 
       const int nrow = hep.num_row();
@@ -628,12 +725,100 @@ namespace Likelihood {
       return;
     }
 
+    void getGradientAndHessian(const std::vector<float>& data,
+			       const CLHEP::HepVector& norms,
+			       const std::vector<const std::vector<float>* >& templates,
+			       const std::vector<float>& fixed,
+			       const FitScanMVPrior* prior,			       
+			       const std::vector<float>* weights,
+			       std::vector<float>& model,
+			       CLHEP::HepVector& gradient,
+			       CLHEP::HepSymMatrix& hessian,
+			       NewtonWorkspace& workspace,
+			       size_t firstBin,
+			       size_t lastBin,
+			       int verbose) {      
+
+      size_t start = firstBin;
+      size_t stop = lastBin == 0 ? data.size() : lastBin;
+      size_t npar = norms.num_row();
+      
+      sumModel(norms,templates,fixed,model,firstBin,lastBin);
+
+      workspace.resize(npar);
+      std::vector<double>& sums = workspace.sums();
+      std::vector<const float*>& tmpls = workspace.templatePtrs();
+      std::fill(sums.begin(),sums.end(),0.);
+      for ( size_t i(0); i < npar; i++ ) {
+	tmpls[i] = &((*(templates[i]))[0]);
+      }
+      const float* w = weights != 0 ? &((*weights)[0]) : 0;
+
+      // One pass over the bins, 
+      // the gradient terms are in sums[0,npar) and the Hessian terms follow.
+      // The terms are the same, and are added in the same order, 
+      // as in the version above.
+      for ( size_t k(start); k < stop; k++ ) {
+	float d = data[k];
+	float m = model[k];
+	float fdiff(1.);
+	float w2(0.);
+	if ( d > 0 ) {
+	  if ( m <= 0. ) {
+	    throw std::runtime_error("Negative model counts in FitUtils::getGradientAndHessian.");
+	  }
+	  fdiff = ( 1. - ( d / m ) );
+	  w2 = d / ( m * m );
+	}
+	float wfdiff = w ? w[k] * fdiff : fdiff;
+	float ww2 = w ? w[k] * w2 : w2;
+	double* hsum = &sums[npar];
+	for ( size_t i(0); i < npar; i++ ) {
+	  float t_i = tmpls[i][k];
+	  sums[i] += wfdiff * t_i;
+	  float wt_i = ww2 * t_i;
+	  for ( size_t j(i); j < npar; j++, hsum++ ) {
+	    *hsum += wt_i * tmpls[j][k];
+	  }
+	}
+      }
+
+      size_t idx(npar);
+      for ( size_t i(0); i < npar; i++ ) {
+	gradient[i] = float(sums[i]);
+	for ( size_t j(i); j < npar; j++, idx++ ) {
+	  hessian[i][j] = float(sums[idx]);
+	}
+      }
+      
+      // Add in the terms from the prior, if requested
+      if ( prior ) {
+	CLHEP::HepVector gPrior;
+	prior->gradient(norms,gPrior);
+	gradient += gPrior;
+	hessian += prior->hessian();
+      }
+
+      return;
+    }
+
     int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
 			       const CLHEP::HepVector& gradient,
 			       const CLHEP::HepVector& norms,
 			       CLHEP::HepSymMatrix& covar,
 			       CLHEP::HepVector& delta,
 			       double& edm) {      
+      NewtonWorkspace workspace;
+      return getDeltaAndCovarAndEDM(hessian,gradient,norms,covar,delta,edm,workspace);
+    }
+
+    int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
+			       const CLHEP::HepVector& gradient,
+			       const CLHEP::HepVector& norms,
+			       CLHEP::HepSymMatrix& covar,
+			       CLHEP::HepVector& delta,
+			       double& edm,
+			       NewtonWorkspace& workspace) {      
       covar.assign(hessian);
       int ifail(0);
       covar.invert(ifail);
@@ -653,7 +838,8 @@ namespace Likelihood {
       // that are highly anti-correlated with the
       // component that is going negative.
       int retry(0);
-      CLHEP::HepVector g2(gradient);
+      CLHEP::HepVector& g2 = workspace.gradientCopy();
+      g2 = gradient;
       for ( int i(0); i < npar; i++ ) {
 	if ( delta[i] > norms[i] ) {
 	  delta[i] = 0.9999*norms[i];
@@ -685,6 +871,18 @@ namespace Likelihood {
 			       CLHEP::HepVector& delta,
 			       double& edm,
 			       double lambda) {      
+      NewtonWorkspace workspace;
+      return getDeltaAndCovarAndEDM(hessian,gradient,norms,covar,delta,edm,lambda,workspace);
+    }
+
+    int getDeltaAndCovarAndEDM(const CLHEP::HepSymMatrix& hessian,
+			       const CLHEP::HepVector& gradient,
+			       const CLHEP::HepVector& norms,
+			       CLHEP::HepSymMatrix& covar,
+			       CLHEP::HepVector& delta,
+			       double& edm,
+			       double lambda,
+			       NewtonWorkspace& workspace) {      
 
       const int npar = gradient.num_row();
       CLHEP::HepSymMatrix alpha = hessian;
@@ -693,7 +891,7 @@ namespace Likelihood {
 
       CLHEP::HepMatrix u, v;
       CLHEP::HepVector s;
-      int ifail = svd_solve(alpha, gradient, u, v, s, delta);
+      int ifail = svd_solve(alpha, gradient, u, v, s, delta, workspace);
       if(ifail) {
 	return ifail;
       }
@@ -713,7 +911,8 @@ namespace Likelihood {
 
       const double lo_bound = 0;
       int retry(0);
-      CLHEP::HepVector g2(gradient);
+      CLHEP::HepVector& g2 = workspace.gradientCopy();
+      g2 = gradient;
       for ( int i(0); i < npar; i++ ) {
 
 	if ( norms[i] - delta[i] < lo_bound ) {
@@ -730,7 +929,7 @@ namespace Likelihood {
 
       if ( retry > 0 ) {
 
-	int ifail = svd_solve(alpha, g2, u, v, s, delta);
+	int ifail = svd_solve(alpha, g2, u, v, s, delta, workspace);
 	if(ifail) {
 	  return ifail;
 	}
@@ -763,6 +962,30 @@ namespace Likelihood {
 			size_t firstBin, 
 			size_t lastBin,
 			int verbose) {
+      NewtonWorkspace workspace;
+      return fitNorms_newton(data,initNorms,templates,fixed,prior,weights,
+			     tol,maxIter,initLambda,
+			     norms,covar,gradient,model,edm,logLikeVal,
+			     workspace,firstBin,lastBin,verbose);
+    }
+
+    int fitNorms_newton(const std::vector<float>& data,
+			const CLHEP::HepVector& initNorms,
+			const std::vector<const std::vector<float>* >& templates,
+			const std::vector<float>& fixed,
+			const FitScanMVPrior* prior,
+			const std::vector<float>* weights,
+			double tol, int maxIter, double initLambda,
+			CLHEP::HepVector& norms,
+			CLHEP::HepSymMatrix& covar,
+			CLHEP::HepVector& gradient,
+			std::vector<float>& model,
+			double& edm,
+			double& logLikeVal,
+			NewtonWorkspace& workspace,
+			size_t firstBin, 
+			size_t lastBin,
+			int verbose) {
 
 
       // copy over the initial parameters
@@ -811,7 +1034,7 @@ namespace Likelihood {
 	norms[npar-1] = 0.;
 	// the gradient can be useful
 	getGradientAndHessian(data,norms,templates,fixed,prior,weights,model,
-			      gradient,hessian,firstBin,lastBin,verbose);
+			      gradient,hessian,workspace,firstBin,lastBin,verbose);
 	covar = CLHEP::HepSymMatrix(npar);
 	// this will skip the loop below
 	edm = 0.;
@@ -824,7 +1047,7 @@ namespace Likelihood {
 	
 	// do the derivative stuff
 	getGradientAndHessian(data,norms,templates,fixed,prior,weights,model,
-			      gradient,hessian,firstBin,lastBin,verbose);
+			      gradient,hessian,workspace,firstBin,lastBin,verbose);
 	if ( verbose > 2 ) {
 	  printMatrix("Hesse: ",hessian);
 	  printVector("Grad: ",gradient);
@@ -841,10 +1064,10 @@ namespace Likelihood {
 
 	if(lambda > 0)
 	  covOk = getDeltaAndCovarAndEDM(hessian,gradient,norms,
-					 covar,delta,edm,lambda);
+					 covar,delta,edm,lambda,workspace);
 	else
 	  covOk = getDeltaAndCovarAndEDM(hessian,gradient,norms,
-					 covar,delta,edm);
+					 covar,delta,edm,workspace);
 
 	if ( verbose > 2 ) {
 	  printMatrix("Cov: ",covar);
@@ -920,9 +1143,9 @@ namespace Likelihood {
 				      firstBin,lastBin,verbose);
       } else {
 	getGradientAndHessian(data,norms,templates,fixed,prior,weights,model,
-			      gradient,hessian,firstBin,lastBin,verbose);
+			      gradient,hessian,workspace,firstBin,lastBin,verbose);
 	getDeltaAndCovarAndEDM(hessian,gradient,norms,
-			       covar,delta,edm,0.0);
+			       covar,delta,edm,0.0,workspace);
       }
 
       // check to see if we reach the max iterations
@@ -964,7 +1187,234 @@ namespace Likelihood {
       return 0;
     }
 
-    
+    /* Fill the model of one problem of a batch, starting from the fixed component,
+       with the normalization applied to the template as in sumModel,
+       and return its log-likelihood */
+    static double batch_log_likelihood(const std::vector<float>& data,
+				       const std::vector<float>& tmpl,
+				       const std::vector<float>& fixed,
+				       const std::vector<float>* weights,
+				       double norm,
+				       size_t start, size_t stop,
+				       std::vector<float>& model,
+				       size_t offset) {
+      float fnorm = norm;
+      std::vector<float>::iterator model_start = model.begin() + offset;
+      std::vector<float>::iterator outItr = model_start;
+      for ( size_t k(start); k < stop; k++, outItr++ ) {
+	*outItr = fixed[k];
+	*outItr += fnorm * tmpl[k];
+      }
+      return weights == 0 ?
+	logLikePoisson(data.begin() + start, data.begin() + stop,
+		       model_start, model_start + (stop - start)) :
+	logLikePoisson(data.begin() + start, data.begin() + stop,
+		       model_start, model_start + (stop - start),
+		       weights->begin() + start, weights->begin() + stop);
+    }
+
+    /* Fill the model of one problem of a batch and get its gradient and Hessian
+       in the same pass over the bins.  The terms are the same as in
+       getGradientAndHessian, and are added in the same order */
+    static void batch_gradient_and_hessian(const std::vector<float>& data,
+					   const std::vector<float>& tmpl,
+					   const std::vector<float>& fixed,
+					   const std::vector<float>* weights,
+					   double norm,
+					   size_t start, size_t stop,
+					   std::vector<float>& model,
+					   size_t offset,
+					   double& gradient,
+					   double& hessian) {
+      float fnorm = norm;
+      const float* d_ptr = &data[0];
+      const float* t_ptr = &tmpl[0];
+      const float* f_ptr = &fixed[0];
+      const float* w = weights != 0 ? &((*weights)[0]) : 0;
+      float* m_ptr = &model[offset] - start;
+      double gsum(0.);
+      double hsum(0.);
+      for ( size_t k(start); k < stop; k++ ) {
+	float m = f_ptr[k];
+	m += fnorm * t_ptr[k];
+	m_ptr[k] = m;
+	float d = d_ptr[k];
+	float fdiff(1.);
+	float w2(0.);
+	if ( d > 0 ) {
+	  if ( m <= 0. ) {
+	    throw std::runtime_error("Negative model counts in FitUtils::getGradientAndHessian.");
+	  }
+	  fdiff = ( 1. - ( d / m ) );
+	  w2 = d / ( m * m );
+	}
+	float wfdiff = w ? w[k] * fdiff : fdiff;
+	float ww2 = w ? w[k] * w2 : w2;
+	float t = t_ptr[k];
+	gsum += wfdiff * t;
+	float wt = ww2 * t;
+	hsum += wt * t;
+      }
+      gradient = float(gsum);
+      hessian = float(hsum);
+    }
+
+    int fitNorms_newton_batch(const std::vector<float>& data,
+			      const std::vector<const std::vector<float>* >& templates,
+			      const std::vector<const std::vector<float>* >& fixed,
+			      const std::vector<float>* weights,
+			      const std::vector<size_t>& firstBins,
+			      const std::vector<size_t>& lastBins,
+			      const std::vector<double>& initNorms,
+			      double tol, int maxIter,
+			      std::vector<double>& norms,
+			      std::vector<double>& covars,
+			      std::vector<double>& gradients,
+			      std::vector<double>& edms,
+			      std::vector<double>& logLikes,
+			      std::vector<int>& status,
+			      NewtonBatchWorkspace& workspace) {
+
+      size_t nprob = initNorms.size();
+      if ( templates.size() != nprob || fixed.size() != nprob ||
+	   firstBins.size() != nprob || lastBins.size() != nprob ) {
+	throw std::runtime_error("Number of templates, fixed models or bin ranges does not match number of problems in FitUtils::fitNorms_newton_batch");
+      }
+
+      norms = initNorms;
+      covars.assign(nprob,0.);
+      gradients.assign(nprob,0.);
+      edms.assign(nprob,0.);
+      logLikes.assign(nprob,0.);
+      status.assign(nprob,0);
+
+      // Lay out the models of the problems back to back
+      std::vector<size_t>& starts = workspace.starts();
+      std::vector<size_t>& stops = workspace.stops();
+      std::vector<size_t>& offsets = workspace.offsets();
+      starts.resize(nprob);
+      stops.resize(nprob);
+      offsets.resize(nprob);
+      size_t nmodel(0);
+      for ( size_t k(0); k < nprob; k++ ) {
+	starts[k] = firstBins[k];
+	stops[k] = lastBins[k] == 0 ? data.size() : lastBins[k];
+	offsets[k] = nmodel;
+	nmodel += stops[k] - starts[k];
+      }
+      std::vector<float>& model = workspace.model();
+      model.resize(nmodel);
+
+      std::vector<double>& hessians = workspace.hessians();
+      std::vector<double>& logLikeInit = workspace.logLikeInit();
+      std::vector<int>& iters = workspace.iterations();
+      std::vector<size_t>& active = workspace.active();
+      hessians.assign(nprob,0.);
+      logLikeInit.resize(nprob);
+      iters.assign(nprob,0);
+      active.clear();
+
+      // Initial log-likelihood, and the same special case for no counts
+      // as fitNorms_newton
+      for ( size_t k(0); k < nprob; k++ ) {
+	logLikes[k] = batch_log_likelihood(data,*(templates[k]),*(fixed[k]),weights,norms[k],
+					   starts[k],stops[k],model,offsets[k]);
+	logLikeInit[k] = logLikes[k];
+	edms[k] = 100*tol;
+	float data_total(0.);
+	sumVector(data.begin() + starts[k],data.begin() + stops[k],data_total);
+	if ( data_total < 1e-9 ) {
+	  norms[k] = 0.;
+	  batch_gradient_and_hessian(data,*(templates[k]),*(fixed[k]),weights,norms[k],
+				     starts[k],stops[k],model,offsets[k],
+				     gradients[k],hessians[k]);
+	  edms[k] = 0.;
+	  logLikeInit[k] = -1.0e99;
+	}
+	if ( iters[k] < maxIter && std::fabs(edms[k]) > tol ) {
+	  active.push_back(k);
+	}
+      }
+
+      // Iterate the problems that have not converged in lockstep
+      while ( ! active.empty() ) {
+	
+	for ( size_t a(0); a < active.size(); a++ ) {
+	  size_t k = active[a];
+	  batch_gradient_and_hessian(data,*(templates[k]),*(fixed[k]),weights,norms[k],
+				     starts[k],stops[k],model,offsets[k],
+				     gradients[k],hessians[k]);
+	}
+
+	// These are the steps from getDeltaAndCovarAndEDM for a single parameter
+	size_t nactive(0);
+	for ( size_t a(0); a < active.size(); a++ ) {
+	  size_t k = active[a];
+	  if ( hessians[k] == 0. ) {
+	    // failed to invert the cov. matrix
+	    covars[k] = 0.;
+	    status[k] = 1;
+	    continue;
+	  }
+	  double covar = 1.0 / hessians[k];
+	  double delta = covar * gradients[k];
+	  double g2 = gradients[k];
+	  bool retry(false);
+	  if ( delta > norms[k] ) {
+	    delta = 0.9999*norms[k];
+	    g2 = 0.;
+	    retry = true;
+	  }
+	  covars[k] = covar;
+	  edms[k] = std::fabs(delta * g2);
+	  if ( retry ) {
+	    delta = covar * g2;
+	    if ( delta > norms[k] ) {
+	      delta = 0.;
+	    }
+	  }
+	  norms[k] -= delta;
+
+	  // catch fits that are diverging
+	  if ( norms[k] > 1e9 ) {
+	    status[k] = -4;
+	    continue;
+	  }
+	  if ( std::fabs(edms[k]) < tol ) {
+	    continue;
+	  }
+	  iters[k]++;
+	  if ( iters[k] < maxIter && std::fabs(edms[k]) > tol ) {
+	    active[nactive++] = k;
+	  }
+	}
+	active.resize(nactive);
+      }
+
+      // Final log-likelihood and the same checks as fitNorms_newton
+      int nfailed(0);
+      for ( size_t k(0); k < nprob; k++ ) {
+	if ( status[k] != 0 ) {
+	  nfailed++;
+	  continue;
+	}
+	logLikes[k] = batch_log_likelihood(data,*(templates[k]),*(fixed[k]),weights,norms[k],
+					   starts[k],stops[k],model,offsets[k]);
+	if ( iters[k] >= maxIter ) {
+	  status[k] = -2;
+	} else if ( logLikes[k] - logLikeInit[k] < -1. ) {
+	  logLikes[k] = logLikeInit[k];
+	  norms[k] = 0.;
+	  edms[k] = 0.;
+	  status[k] = -8;
+	}
+	if ( status[k] != 0 ) {
+	  nfailed++;
+	}
+      }
+      return nfailed;
+    }
+
     int fitLogNorms_newton(const std::vector<float>& data,
 			   const CLHEP::HepVector& initNorms,
 			   const std::vector<const std::vector<float>* >& templates,
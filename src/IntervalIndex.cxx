@@ -0,0 +1,90 @@
+/**
+ * @file IntervalIndex.cxx
+ * @brief Time-ordered lookup of the time range cuts and GTIs for
+ * FT2 intervals.
+ *
+ * $Header$
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "Likelihood/IntervalIndex.h"
+
+namespace {
+   bool compareFirst(const std::pair<double, double> & a,
+                     const std::pair<double, double> & b) {
+      return a.first < b.first;
+   }
+}
+
+namespace Likelihood {
+
+IntervalIndex::IntervalIndex(const std::vector<Interval_t> & timeCuts,
+                             const std::vector<Interval_t> & gtis)
+   : m_window(-std::numeric_limits<double>::max(),
+              std::numeric_limits<double>::max()),
+     m_gtis(gtis), m_cursor(0),
+     m_lastStart(-std::numeric_limits<double>::max()) {
+   for (size_t i(0); i < timeCuts.size(); i++) {
+      m_window.first = std::max(m_window.first, timeCuts[i].first);
+      m_window.second = std::min(m_window.second, timeCuts[i].second);
+   }
+   std::stable_sort(m_gtis.begin(), m_gtis.end(), ::compareFirst);
+}
+
+void IntervalIndex::rewind() {
+   m_cursor = 0;
+   m_lastStart = -std::numeric_limits<double>::max();
+}
+
+bool IntervalIndex::accept(double start, double stop, double & fraction) {
+   if (stop < start) {
+      std::ostringstream message;
+      message << "FT2 files has an interval with START > STOP:\n START = "
+              << std::setprecision(15) << start << "\n STOP = "
+              << stop;
+      throw std::runtime_error(message.str());
+   }
+   fraction = 0;
+   if (start == stop) {
+      return false;
+   }
+
+// Clip the interval to the time range cuts.
+   double tmin(std::max(start, m_window.first));
+   double tmax(std::min(stop, m_window.second));
+   if (!(tmin < tmax)) {
+      return false;
+   }
+   double maxTotal(tmax - tmin);
+
+   if (tmin < m_lastStart) {
+      m_cursor = 0;
+   }
+   m_lastStart = tmin;
+
+// GTIs ending before this interval cannot overlap any later ones.
+   while (m_cursor < m_gtis.size() && m_gtis[m_cursor].second <= tmin) {
+      m_cursor++;
+   }
+
+   double total(0);
+   for (size_t i(m_cursor); i < m_gtis.size() && m_gtis[i].first < tmax; i++) {
+      double gtiStart(std::max(m_gtis[i].first, tmin));
+      double gtiStop(std::min(m_gtis[i].second, tmax));
+      if (gtiStart < gtiStop) {
+         total += gtiStop - gtiStart;
+      }
+   }
+   if (total > maxTotal || m_gtis.size() == 0) {
+      total = maxTotal;
+   }
+   fraction = total/(stop - start);
+   return true;
+}
+
+} // namespace Likelihood
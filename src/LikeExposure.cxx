@@ -27,7 +27,9 @@
 #include "healpix/CosineBinner.h"
 #include "healpix/HealpixArray.h"
 
+#include "Likelihood/IntervalIndex.h"
 #include "Likelihood/LikeExposure.h"
+#include "Likelihood/ParallelUtils.h"
 #include "Likelihood/RoiCuts.h"
 
 namespace {
@@ -39,6 +41,20 @@ namespace {
                       const std::pair<double, double> & b) {
       return a.second < b.second;
    }
+   void fitsCheckStatus(int status, fitsfile * fptr,
+                        const std::string & routine) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr != 0) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      std::ostringstream message;
+      message << routine << ": CFITSIO error " << status;
+      throw std::runtime_error(message.str());
+   }
 }
 
 namespace Likelihood {
@@ -50,12 +66,15 @@ LikeExposure(double skybin, double costhetabin,
              double zenmax, double zenmin)
    : map_tools::Exposure(skybin, costhetabin, std::cos(zenmax*M_PI/180.),
                          false, std::cos(zenmin*M_PI/180.)), 
-     m_costhetabin(costhetabin), m_timeCuts(timeCuts), m_gtis(gtis),
-     m_numIntervals(0), 
+     m_skybin(skybin), m_costhetabin(costhetabin),
+     m_cosZenMax(std::cos(zenmax*M_PI/180.)),
+     m_cosZenMin(std::cos(zenmin*M_PI/180.)),
+     m_timeCuts(timeCuts), m_gtis(gtis), m_numIntervals(0), 
      m_weightedExposure(new map_tools::Exposure(skybin, costhetabin, 
                                                 std::cos(zenmax*M_PI/180.),
                                                 false,
-                                                std::cos(zenmin*M_PI/180.))) {
+                                                std::cos(zenmin*M_PI/180.))),
+     m_numThreads(ParallelUtils::envThreads()) {
    if (!gtis.empty()) {
       for (size_t i = 0; i < gtis.size(); i++) {
          if (i == 0 || gtis.at(i).first < m_tmin) {
@@ -72,10 +91,13 @@ LikeExposure(double skybin, double costhetabin,
 }
 
 LikeExposure::LikeExposure(const LikeExposure & other) 
-   : map_tools::Exposure(other), m_costhetabin(other.m_costhetabin),
+   : map_tools::Exposure(other), m_skybin(other.m_skybin),
+     m_costhetabin(other.m_costhetabin), m_cosZenMax(other.m_cosZenMax),
+     m_cosZenMin(other.m_cosZenMin),
      m_timeCuts(other.m_timeCuts), m_gtis(other.m_gtis), m_tmin(other.m_tmin),
      m_tmax(other.m_tmax), m_numIntervals(other.m_numIntervals), 
-     m_weightedExposure(new map_tools::Exposure(*other.m_weightedExposure)) {
+     m_weightedExposure(new map_tools::Exposure(*other.m_weightedExposure)),
+     m_numThreads(other.m_numThreads) {
 }
 
 void LikeExposure::load(const tip::Table * scData, bool verbose) {
@@ -122,6 +144,23 @@ void LikeExposure::load(const tip::Table * scData, bool verbose) {
       istep = 1;
    }
 
+// The FT2 rows are in time order, so the GTIs are merged with them
+// sequentially.
+   IntervalIndex intervalIndex(m_timeCuts, m_gtis);
+
+// For the parallel fill, the accepted intervals are collected here and
+// the exposures are filled afterwards.
+   bool parallel(m_numThreads > 0);
+   std::vector<astro::SkyDir> scz, scx, zenith;
+   std::vector<double> deltats, weights;
+   if (parallel) {
+      scz.reserve(nrows);
+      scx.reserve(nrows);
+      zenith.reserve(nrows);
+      deltats.reserve(nrows);
+      weights.reserve(nrows);
+   }
+
    for (tip::Index_t irow = 0; it != scData->end() && start < m_tmax;
         ++it, ++irow) {
       if (verbose && (irow % istep) == 0 ) {
@@ -132,7 +171,7 @@ void LikeExposure::load(const tip::Table * scData, bool verbose) {
       row["stop"].get(stop);
       double deltat = livetime;
       double fraction;
-      if (acceptInterval(start, stop, m_timeCuts, m_gtis, fraction)) {
+      if (intervalIndex.accept(start, stop, fraction)) {
          row["ra_scz"].get(ra);
          row["dec_scz"].get(dec);
          row["ra_scx"].get(rax);
@@ -140,29 +179,230 @@ void LikeExposure::load(const tip::Table * scData, bool verbose) {
          row["ra_zenith"].get(ra_zenith);
          row["dec_zenith"].get(dec_zenith);
          double weight(livetime/(stop - start));
-         if (healpix::CosineBinner::nphibins() == 0) {
-            fill(astro::SkyDir(ra, dec), astro::SkyDir(ra_zenith, dec_zenith), 
-                 deltat*fraction);
-            m_weightedExposure->fill(astro::SkyDir(ra, dec),
-                                     astro::SkyDir(ra_zenith, dec_zenith), 
-                                     deltat*fraction*weight);
+         if (parallel) {
+            scz.push_back(astro::SkyDir(ra, dec));
+            scx.push_back(astro::SkyDir(rax, decx));
+            zenith.push_back(astro::SkyDir(ra_zenith, dec_zenith));
+            deltats.push_back(deltat*fraction);
+            weights.push_back(weight);
+         } else {
+            fillInterval(astro::SkyDir(ra, dec), astro::SkyDir(rax, decx),
+                         astro::SkyDir(ra_zenith, dec_zenith),
+                         deltat*fraction, weight);
+         }
+         m_numIntervals++;
+      }
+   }
+   if (parallel) {
+      fillParallel(scz, scx, zenith, deltats, weights);
+   }
+   if (verbose) {
+      formatter.warn() << "!" << std::endl;
+   }
+}
+
+void LikeExposure::load(const std::string & scFile,
+                        const std::string & sctable,
+                        const std::string & filter, bool verbose) {
+   st_stream::StreamFormatter formatter("LikeExposure", "load", 2);
+   std::string routine("LikeExposure::load");
+
+   std::string extname(scFile + "[" + sctable + "]");
+   if (filter != "") {
+      extname += "[" + filter + "]";
+   }
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_table(&fptr, extname.c_str(), READONLY, &status);
+   ::fitsCheckStatus(status, fptr, routine);
+
+   long nrows(0);
+   fits_get_num_rows(fptr, &nrows, &status);
+   ::fitsCheckStatus(status, fptr, routine);
+
+// The columns are read in blocks of rows of the size cfitsio buffers,
+// as in ScData::readData.
+   long blockSize(0);
+   fits_get_rowsize(fptr, &blockSize, &status);
+   ::fitsCheckStatus(status, fptr, routine);
+   blockSize = std::max(blockSize, 1024L);
+   blockSize = std::min(blockSize, std::max(nrows, 1L));
+
+   enum {START_COL, STOP_COL, LIVETIME_COL, RA_SCZ_COL, DEC_SCZ_COL,
+         RA_SCX_COL, DEC_SCX_COL, RA_ZENITH_COL, DEC_ZENITH_COL, NUM_COLS};
+   const char * colnames[NUM_COLS] = {"START", "STOP", "LIVETIME",
+                                      "RA_SCZ", "DEC_SCZ", "RA_SCX", "DEC_SCX",
+                                      "RA_ZENITH", "DEC_ZENITH"};
+   int colnums[NUM_COLS];
+   for (int icol(0); icol < NUM_COLS; icol++) {
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(colnames[icol]),
+                      &colnums[icol], &status);
+      ::fitsCheckStatus(status, fptr, routine);
+   }
+
+   long istep(nrows/20);
+   if (istep == 0) {
+      istep = 1;
+   }
+
+   IntervalIndex intervalIndex(m_timeCuts, m_gtis);
+
+   bool parallel(m_numThreads > 0);
+   std::vector<astro::SkyDir> scz, scx, zenith;
+   std::vector<double> deltats, weights;
+
+   std::vector< std::vector<double> >
+      columns(NUM_COLS, std::vector<double>(blockSize));
+   double nulval(0);
+   int anynul(0);
+   for (long firstrow(1); firstrow <= nrows; firstrow += blockSize) {
+      long nelem(std::min(blockSize, nrows - firstrow + 1));
+      for (int icol(0); icol < NUM_COLS; icol++) {
+         fits_read_col(fptr, TDOUBLE, colnums[icol], firstrow, 1, nelem,
+                       &nulval, &columns[icol][0], &anynul, &status);
+         ::fitsCheckStatus(status, fptr, routine);
+      }
+      for (long i(0); i < nelem; i++) {
+         if (verbose && ((firstrow - 1 + i) % istep) == 0) {
+            formatter.warn() << ".";
+         }
+         double start(columns[START_COL][i]);
+         double stop(columns[STOP_COL][i]);
+         if (stop <= m_tmin || start >= m_tmax) {
+            continue;
+         }
+         double livetime(columns[LIVETIME_COL][i]);
+         double fraction;
+         if (!intervalIndex.accept(start, stop, fraction)) {
+            continue;
+         }
+         astro::SkyDir zAxis(columns[RA_SCZ_COL][i], columns[DEC_SCZ_COL][i]);
+         astro::SkyDir xAxis(columns[RA_SCX_COL][i], columns[DEC_SCX_COL][i]);
+         astro::SkyDir zenithDir(columns[RA_ZENITH_COL][i],
+                                 columns[DEC_ZENITH_COL][i]);
+         double weight(livetime/(stop - start));
+         if (parallel) {
+            scz.push_back(zAxis);
+            scx.push_back(xAxis);
+            zenith.push_back(zenithDir);
+            deltats.push_back(livetime*fraction);
+            weights.push_back(weight);
          } else {
-            fill_zenith(astro::SkyDir(ra, dec), astro::SkyDir(rax, decx),
-                        astro::SkyDir(ra_zenith, dec_zenith), 
-                        deltat*fraction);
-            m_weightedExposure->fill_zenith(astro::SkyDir(ra, dec),
-                                            astro::SkyDir(rax, decx),
-                                            astro::SkyDir(ra_zenith,dec_zenith),
-                                            deltat*fraction*weight);
+            fillInterval(zAxis, xAxis, zenithDir, livetime*fraction, weight);
          }
          m_numIntervals++;
       }
    }
+   fits_close_file(fptr, &status);
+   ::fitsCheckStatus(status, 0, routine);
+
+   if (parallel) {
+      fillParallel(scz, scx, zenith, deltats, weights);
+   }
    if (verbose) {
       formatter.warn() << "!" << std::endl;
    }
 }
 
+void LikeExposure::fillInterval(const astro::SkyDir & scz,
+                                const astro::SkyDir & scx,
+                                const astro::SkyDir & zenith,
+                                double deltat, double weight) {
+   if (healpix::CosineBinner::nphibins() == 0) {
+      fill(scz, zenith, deltat);
+      m_weightedExposure->fill(scz, zenith, deltat*weight);
+   } else {
+      fill_zenith(scz, scx, zenith, deltat);
+      m_weightedExposure->fill_zenith(scz, scx, zenith, deltat*weight);
+   }
+}
+
+void LikeExposure::fillParallel(const std::vector<astro::SkyDir> & scz,
+                                const std::vector<astro::SkyDir> & scx,
+                                const std::vector<astro::SkyDir> & zenith,
+                                const std::vector<double> & deltats,
+                                const std::vector<double> & weights) {
+   size_t nintervals(scz.size());
+   if (nintervals == 0) {
+      return;
+   }
+   int nthreads = ParallelUtils::numThreads(m_numThreads);
+   std::vector<size_t> bounds;
+   ParallelUtils::makeChunks(0, nintervals, (nintervals + nthreads - 1)/nthreads,
+                             bounds);
+   int nparts = static_cast<int>(bounds.size() - 1);
+
+// Private partial standard and weighted exposures for each block of
+// intervals.
+   std::vector<map_tools::Exposure *> partials;
+   std::vector<map_tools::Exposure *> weightedPartials;
+   for (int ipart = 0; ipart < nparts; ipart++) {
+      partials.push_back(new map_tools::Exposure(m_skybin, m_costhetabin,
+                                                 m_cosZenMax, false,
+                                                 m_cosZenMin));
+      weightedPartials.push_back(new map_tools::Exposure(m_skybin,
+                                                         m_costhetabin,
+                                                         m_cosZenMax, false,
+                                                         m_cosZenMin));
+   }
+
+   bool usePhiBins(healpix::CosineBinner::nphibins() != 0);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static, 1) num_threads(nthreads)
+#endif
+   for (int ipart = 0; ipart < nparts; ipart++) {
+      map_tools::Exposure & exposure(*partials[ipart]);
+      map_tools::Exposure & weighted(*weightedPartials[ipart]);
+      for (size_t i(bounds[ipart]); i < bounds[ipart+1]; i++) {
+         if (usePhiBins) {
+            exposure.fill_zenith(scz[i], scx[i], zenith[i], deltats[i]);
+            weighted.fill_zenith(scz[i], scx[i], zenith[i],
+                                 deltats[i]*weights[i]);
+         } else {
+            exposure.fill(scz[i], zenith[i], deltats[i]);
+            weighted.fill(scz[i], zenith[i], deltats[i]*weights[i]);
+         }
+      }
+   }
+
+// Sum the partials into the totals, pixel by pixel and in block order.
+   size_t npix(data().size());
+   std::vector<size_t> pixBounds;
+   ParallelUtils::makeChunks(0, npix, 0, pixBounds);
+   int nchunks = static_cast<int>(pixBounds.size() - 1);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) num_threads(nthreads)
+#endif
+   for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      for (int ipart = 0; ipart < nparts; ipart++) {
+         addExposure(*partials[ipart], *this,
+                     pixBounds[ichunk], pixBounds[ichunk+1]);
+         addExposure(*weightedPartials[ipart], *m_weightedExposure,
+                     pixBounds[ichunk], pixBounds[ichunk+1]);
+      }
+   }
+   (void)(nthreads);
+
+   for (int ipart = 0; ipart < nparts; ipart++) {
+      delete partials[ipart];
+      delete weightedPartials[ipart];
+   }
+}
+
+void LikeExposure::addExposure(const map_tools::Exposure & partial,
+                               map_tools::Exposure & total,
+                               size_t first, size_t last) {
+   const healpix::HealpixArray<healpix::CosineBinner> & src(partial.data());
+   healpix::HealpixArray<healpix::CosineBinner> & dest(total.data());
+   for (size_t ipix(first); ipix < last; ipix++) {
+      const healpix::CosineBinner & srcBins(src[ipix]);
+      healpix::CosineBinner & destBins(dest[ipix]);
+      for (size_t k(0); k < srcBins.size(); k++) {
+         destBins[k] += srcBins[k];
+      }
+   }
+}
+
 void LikeExposure::writeFile(const std::string & outfile) const {
    std::string dataPath(st_facilities::Environment::dataPath("Likelihood"));
    std::string templateFile = 
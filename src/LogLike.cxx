@@ -7,6 +7,7 @@
  */
 
 #include <cmath>
+#include <cstdlib>
 #include <ctime>
 
 #include <algorithm>
@@ -20,6 +21,7 @@
 #include "Likelihood/DiffuseSource.h"
 #include "Likelihood/LogLike.h"
 #include "Likelihood/Npred.h"
+#include "Likelihood/ParallelUtils.h"
 #include "Likelihood/SrcArg.h"
 
 namespace Likelihood {
@@ -27,9 +29,14 @@ namespace Likelihood {
 LogLike::LogLike(const Observation & observation) 
   : SourceModel(observation), m_nevals(0), m_bestValueSoFar(-1e38),
     m_Npred(), m_accumulator(), m_npredValues(),    
-    m_respCache(), m_use_ebounds(false), m_emin(0), m_emax(0) {
+    m_respCache(), m_useEventTable(false),
+    m_numThreads(ParallelUtils::envThreads()),
+    m_use_ebounds(false), m_emin(0), m_emax(0) {
    const std::vector<Event> & events = m_observation.eventCont().events();
    m_respCache.clearAndResize(events.size());
+   if (::getenv("USE_UNBINNED_EVENT_TABLE")) {
+      m_useEventTable = true;
+   }
    deleteAllSources();
 }
 
@@ -49,16 +56,33 @@ double LogLike::value(const optimizers::Arg&) const {
    double logSourceModelSum(0);
    double NpredSum(0);
 // The "data sum"
-   for (size_t j = 0; j < events.size(); j++) {
-      if (m_use_ebounds && 
-          (events[j].getEnergy() < m_emin || events[j].getEnergy() > m_emax)) {
-         continue;
-      }
-      ResponseCache::EventRef rc_ref = m_respCache.getEventRef(j);
-      double addend(logSourceModel(events.at(j), &rc_ref));
+   if (m_numThreads > 0) {
+      double addend = logModelSum_chunked(events);
       my_value += addend;
       m_accumulator.add(addend);
       logSourceModelSum += addend;
+   } else {
+      if (m_useEventTable) {
+         updateEventTable();
+         m_eventTable.computeModelSums(events, m_respCache, 0, events.size(),
+                                       m_modelSums);
+      }
+      for (size_t j = 0; j < events.size(); j++) {
+         if (m_use_ebounds && 
+             (events[j].getEnergy() < m_emin || events[j].getEnergy() > m_emax)) {
+            continue;
+         }
+         double addend;
+         if (m_useEventTable) {
+            addend = logModelSum(m_modelSums[j]);
+         } else {
+            ResponseCache::EventRef rc_ref = m_respCache.getEventRef(j);
+            addend = logSourceModel(events.at(j), &rc_ref);
+         }
+         my_value += addend;
+         m_accumulator.add(addend);
+         logSourceModelSum += addend;
+      }
    }
 //   std::cout << "data sum: " << my_value << std::endl;
 
@@ -145,8 +169,12 @@ double LogLike::logSourceModel(const Event & event,
 //                    << event.modelSum() << std::endl;
 //       }
    // }
-   if (my_value > 0) {
-      return std::log(my_value);
+   return logModelSum(my_value);
+}
+
+double LogLike::logModelSum(double modelSum) const {
+   if (modelSum > 0) {
+      return std::log(modelSum);
    }
    if (::getenv("LOGLIKE_CATCH_NEG_PROB")) {
       throw std::runtime_error("negative probability density for this event.");
@@ -158,6 +186,126 @@ double LogLike::logSourceModel(const Event & event,
    return -1e30;
 }
 
+void LogLike::updateEventTable() const {
+   const std::vector<Event> & events = m_observation.eventCont().events();
+   if (m_eventTable.nEvents() != events.size()) {
+      m_eventTable.setEvents(events);
+      m_eventTable.setSources(m_sources, events, m_respCache);
+   } else if (m_eventTable.sourcesChanged(m_sources)) {
+      m_eventTable.setSources(m_sources, events, m_respCache);
+   }
+   m_modelSums.resize(events.size());
+}
+
+void LogLike::computeModelSums_chunked(const std::vector<Event> & events,
+                                       std::vector<size_t> & bounds) const {
+   updateEventTable();
+   ParallelUtils::makeChunks(0, events.size(),
+                             ParallelUtils::defaultChunkSize, bounds);
+   int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+   int nthreads = ParallelUtils::numThreads(m_numThreads);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+   for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      m_eventTable.computeFactoredSums(bounds[ichunk], bounds[ichunk+1],
+                                       m_modelSums);
+   }
+   (void)(nthreads);
+// Sources that do not factor go through Source::fluxDensity and the
+// response cache, which are not thread-safe.
+   if (m_eventTable.hasUnfactoredSources()) {
+      m_eventTable.addUnfactoredSums(events, m_respCache, 0, events.size(),
+                                     m_modelSums);
+   }
+}
+
+double LogLike::logModelSum_chunked(const std::vector<Event> & events) const {
+   std::vector<size_t> bounds;
+   computeModelSums_chunked(events, bounds);
+   int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+   std::vector<double> partials(nchunks, 0);
+// Chunks with non-positive model sums are redone serially below, since
+// logModelSum may throw and exceptions cannot leave a parallel region.
+   std::vector<char> nonPositive(nchunks, 0);
+   const std::vector<double> & energies(m_eventTable.energies());
+   int nthreads = ParallelUtils::numThreads(m_numThreads);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+   for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      Kahan_Accumulator accum;
+      for (size_t j(bounds[ichunk]); j < bounds[ichunk+1]; j++) {
+         if (m_use_ebounds && (energies[j] < m_emin || energies[j] > m_emax)) {
+            continue;
+         }
+         if (m_modelSums[j] > 0) {
+            accum.add(std::log(m_modelSums[j]));
+         } else {
+            nonPositive[ichunk] = 1;
+         }
+      }
+      partials[ichunk] = accum.total();
+   }
+   (void)(nthreads);
+   for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      if (!nonPositive[ichunk]) {
+         continue;
+      }
+      Kahan_Accumulator accum;
+      for (size_t j(bounds[ichunk]); j < bounds[ichunk+1]; j++) {
+         if (m_use_ebounds && (energies[j] < m_emin || energies[j] > m_emax)) {
+            continue;
+         }
+         accum.add(logModelSum(m_modelSums[j]));
+      }
+      partials[ichunk] = accum.total();
+   }
+   return ParallelUtils::orderedSum(partials);
+}
+
+void LogLike::addLogModelDerivs_chunked(const std::vector<Event> & events,
+                                        std::vector<double> & derivs) const {
+   std::vector<size_t> bounds;
+   computeModelSums_chunked(events, bounds);
+   size_t nparams(derivs.size());
+   int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+// One row of partial derivatives per chunk, merged in chunk order
+// below.
+   std::vector<double> chunkDerivs(nchunks*nparams, 0);
+   int nthreads = ParallelUtils::numThreads(m_numThreads);
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+   {
+      std::vector<double> my_derivs(nparams);
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+      for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+         my_derivs.assign(nparams, 0);
+         m_eventTable.addFactoredLogModelDerivs(bounds[ichunk],
+                                                bounds[ichunk+1],
+                                                m_modelSums, my_derivs);
+         std::copy(my_derivs.begin(), my_derivs.end(),
+                   chunkDerivs.begin() + ichunk*nparams);
+      }
+   }
+   (void)(nthreads);
+   std::vector<double> partials(nchunks);
+   for (size_t i(0); i < nparams; i++) {
+      for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+         partials[ichunk] = chunkDerivs[ichunk*nparams + i];
+      }
+      derivs[i] += ParallelUtils::orderedSum(partials);
+   }
+   if (m_eventTable.hasUnfactoredSources()) {
+      m_eventTable.addUnfactoredLogModelDerivs(events, m_respCache,
+                                               0, events.size(),
+                                               m_modelSums, derivs);
+   }
+}
+
 void LogLike::getLogSourceModelDerivs(const Event & event,
                                       std::vector<double> & derivs,
 				 ResponseCache::EventRef* srcRespCache) const {
@@ -205,12 +353,22 @@ void LogLike::getFreeDerivs(const optimizers::Arg &,
    const std::vector<Event> & events = m_observation.eventCont().events();
 
    std::vector<double> logSrcModelDerivs(getNumFreeParams(), 0);
-   for (size_t j = 0; j < events.size(); j++) {
-      std::vector<double> derivs;
-      ResponseCache::EventRef rc_ref = m_respCache.getEventRef(j);
-      getLogSourceModelDerivs(events[j], derivs, &rc_ref);
-      for (size_t i = 0; i < derivs.size(); i++) {
-         logSrcModelDerivs[i] += derivs[i];
+   if (m_numThreads > 0) {
+      addLogModelDerivs_chunked(events, logSrcModelDerivs);
+   } else if (m_useEventTable) {
+      updateEventTable();
+      m_eventTable.computeModelSums(events, m_respCache, 0, events.size(),
+                                    m_modelSums);
+      m_eventTable.addLogModelDerivs(events, m_respCache, 0, events.size(),
+                                     m_modelSums, logSrcModelDerivs);
+   } else {
+      for (size_t j = 0; j < events.size(); j++) {
+         std::vector<double> derivs;
+         ResponseCache::EventRef rc_ref = m_respCache.getEventRef(j);
+         getLogSourceModelDerivs(events[j], derivs, &rc_ref);
+         for (size_t i = 0; i < derivs.size(); i++) {
+            logSrcModelDerivs[i] += derivs[i];
+         }
       }
    }
 
@@ -291,6 +449,9 @@ void LogLike::addSource(Source * src, bool fromClone, SourceMap* /* srcMap */) {
    SrcArg sArg(src);
    m_npredValues[src->getName()] = m_Npred(sArg);
    m_bestValueSoFar = -1e38;
+// The table rows are matched to the sources by pointer and name, and
+// a new source can reuse the address of a deleted one.
+   m_eventTable.clear();
 }
 
 Source * LogLike::deleteSource(const std::string & srcName) {
@@ -301,6 +462,7 @@ Source * LogLike::deleteSource(const std::string & srcName) {
    m_respCache.deleteSource(srcName);
    m_npredValues.erase(srcName);
    m_bestValueSoFar = -1e38;
+   m_eventTable.clear();
    return SourceModel::deleteSource(srcName);
 }
 
@@ -309,6 +471,7 @@ void LogLike::getEvents(std::string event_file) {
       const_cast<EventContainer &>(m_observation.eventCont());
    eventCont.getEvents(event_file);
    m_respCache.clearAndResize(eventCont.events().size());
+   m_eventTable.clear();
 }
 
 void LogLike::computeEventResponses(double sr_radius) {
@@ -325,6 +488,7 @@ void LogLike::computeEventResponses(double sr_radius) {
       EventContainer & eventCont =
          const_cast<EventContainer &>(m_observation.eventCont());
       eventCont.computeEventResponses(diffuse_srcs, sr_radius);
+      m_eventTable.clear();
    }
 }
 
@@ -26,8 +26,12 @@ namespace Likelihood {
 
 std::vector<double> MeanPsf::s_separations;
 
-void MeanPsf::init() {
-   computeExposure();
+void MeanPsf::init(const Observation & observation) {
+   computeExposure(observation);
+// Several MeanPsfs may be built at once by SourceMapCache::buildSourceMaps.
+#ifdef _OPENMP
+#pragma omp critical(MeanPsf_separations)
+#endif
    if (s_separations.size() == 0) {
       createLogArray(1e-4, 70., 400, s_separations);
    }
@@ -36,12 +40,12 @@ void MeanPsf::init() {
       for (unsigned int j = 0; j < s_separations.size(); j++) {
          double value(0);
          std::map<unsigned int, irfInterface::Irfs *>::const_iterator 
-            resp = m_observation.respFuncs().begin();
-         for (; resp != m_observation.respFuncs().end(); ++resp) {
+            resp = observation.respFuncs().begin();
+         for (; resp != observation.respFuncs().end(); ++resp) {
             int evtType = resp->second->irfID();
-            Psf psf(s_separations[j], m_energies[k], evtType, m_observation);
-            value += m_observation.expCube().value(m_srcDir, psf,
-                                                   m_energies[k]);
+            Psf psf(s_separations[j], m_energies[k], evtType, observation);
+            value += observation.expCube().value(m_srcDir, psf,
+                                                 m_energies[k]);
          }
          if (m_exposure[k] > 0) {
             value /= m_exposure[k];
@@ -59,16 +63,17 @@ void MeanPsf::init() {
    }
 }
 
-void MeanPsf::computeExposure() {
+void MeanPsf::computeExposure(const Observation & observation) {
+   observation.expCube().fillAeffTable(observation.respFuncs(), m_energies);
    m_exposure.reserve(m_energies.size());
    for (size_t k(0); k < m_energies.size(); k++) {
       double value(0);
       std::map<unsigned int, irfInterface::Irfs *>::const_iterator
-         resp = m_observation.respFuncs().begin();
-      for (; resp != m_observation.respFuncs().end(); ++resp) {
+         resp = observation.respFuncs().begin();
+      for (; resp != observation.respFuncs().end(); ++resp) {
          int evtType = resp->second->irfID();
-         ExposureCube::Aeff aeff(m_energies[k], evtType, m_observation);
-         value += m_observation.expCube().value(m_srcDir, aeff, m_energies[k]);
+         ExposureCube::Aeff aeff(m_energies[k], evtType, observation);
+         value += observation.expCube().value(m_srcDir, aeff, m_energies[k]);
       }
       m_exposure.push_back(value);
    }
@@ -301,7 +306,8 @@ double MeanPsf::Psf::value(double cosTheta, double phi) const {
       if (respIt->second->irfID() == m_evtType) {  
          irfInterface::IAeff * aeff = respIt->second->aeff();
          irfInterface::IPsf * psf = respIt->second->psf();
-         double aeffValue = aeff->value(m_energy, inclination, phi, epoch);
+         double aeffValue = m_observation.respFuncs().aeffTable()
+            .value(*aeff, m_evtType, m_energy, cosTheta, phi, epoch);
          double psfValue = psf->value(m_separation, m_energy, inclination, 
                                       phi, epoch);
          double psf_val = aeffValue*psfValue;
@@ -319,6 +325,18 @@ double MeanPsf::Psf::value(double cosTheta, double phi) const {
    return 0;
 }
 
+size_t MeanPsf::memory_size() const {
+   size_t retVal(sizeof(*this));
+   retVal += m_energies.capacity()*sizeof(double);
+   retVal += m_psfValues.capacity()*sizeof(double);
+   retVal += m_psfPeakValues.capacity()*sizeof(double);
+   retVal += m_exposure.capacity()*sizeof(double);
+   for (size_t k(0); k < m_partialIntegrals.size(); k++) {
+      retVal += m_partialIntegrals[k].capacity()*sizeof(double);
+   }
+   return retVal;
+}
+
 double MeanPsf::IntegralFunctor::operator()(double angle) const {
   return m_mean_psf.integral(angle,m_energy);
 }
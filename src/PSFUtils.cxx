@@ -9,6 +9,7 @@
 #include "Likelihood/PSFUtils.h"
 
 #include <algorithm>
+#include <cmath>
 #include <fstream>
 
 #include "astro/SkyProj.h"
@@ -780,6 +781,12 @@ namespace Likelihood {
 			       std::vector<float>& modelmap,
 			       FileUtils::SrcMapType& mapType) {
       
+      if ( config.use_psf_stamp() && config.performConvolution() ) {
+	mapType = FileUtils::WCS;
+	return makePointSourceMap_wcs_stamp(pointSrc, dataMap, config, meanpsf,
+					    formatter, modelmap);
+      }
+
       const std::vector<Pixel> & pixels(dataMap.pixels());
       std::vector<double> energies;
       dataMap.getEnergies(energies);
@@ -911,6 +918,173 @@ namespace Likelihood {
 
     }
     
+    int makePointSourceMap_wcs_stamp(const PointSource& pointSrc, 
+				     const CountsMap& dataMap,
+				     const PsfIntegConfig& config,
+				     const MeanPsf& meanpsf,
+				     st_stream::StreamFormatter& formatter,
+				     std::vector<float>& modelmap) {
+
+      const std::vector<Pixel> & pixels(dataMap.pixels());
+      std::vector<double> energies;
+      dataMap.getEnergies(energies);
+      size_t npix(pixels.size());
+      size_t nee(energies.size());
+      modelmap.assign(nee*npix, 0);
+
+      const astro::SkyDir & dir(pointSrc.getDir());
+      const std::vector<double> & exposure = meanpsf.exposure();
+      double ref_pixel_size = dataMap.pixelSize();
+
+      std::vector< std::vector< double > > pixelOffsets;
+      createOffsetMap(pointSrc,dataMap,pixelOffsets);
+
+      bool galactic(dataMap.isGalactic());
+      double src_lon = galactic ? dir.l() : dir.ra();
+      double src_lat = galactic ? dir.b() : dir.dec();
+      std::pair<double, double> srcCoord(dataMap.projection().sph2pix(src_lon, 
+								       src_lat));
+
+      // The radius of the stamp, and the radial profiles, for each energy
+      std::vector<double> stampRadii(nee);
+      double stampRadius(0);
+      for (size_t k(0); k < nee; k++) {
+	stampRadii[k] = meanpsf.containmentRadius(energies[k], psfStampContainment);
+	stampRadius = std::max(stampRadius, stampRadii[k]);
+      }
+      double step(ref_pixel_size/psfProfileSamples);
+      std::vector< std::vector<double> > profiles;
+      makePsfProfiles(meanpsf, energies, stampRadii, step, profiles);
+
+      std::vector<size_t> stampPixels;
+      std::vector<double> stampOffsets;
+      findStampPixels(dataMap, dir, srcCoord, pixelOffsets, stampRadius,
+		      stampPixels, stampOffsets);
+      size_t nstamp(stampPixels.size());
+
+      // The pixels near the source, where the psf changes within a pixel,
+      // use the same estimator as makePointSourceMap_wcs
+      double coreRadius(psfStampCoreRadius*ref_pixel_size);
+      std::vector<size_t> core;
+      std::vector< std::pair<double, double> > corePixCoords;
+      std::vector<double> solidAngles(nstamp);
+      for (size_t i(0); i < nstamp; i++) {
+	const Pixel & pixel = pixels[stampPixels[i]];
+	solidAngles[i] = pixel.solidAngle();
+	if ( stampOffsets[i] <= coreRadius ) {
+	  double lon = galactic ? pixel.dir().l() : pixel.dir().ra();
+	  double lat = galactic ? pixel.dir().b() : pixel.dir().dec();
+	  core.push_back(i);
+	  corePixCoords.push_back(pixel.proj().sph2pix(lon, lat));
+	}
+      }
+
+      double psfRadius = maxPsfRadius(pointSrc,dataMap);
+      bool apply_map_corrections = config.applyPsfCorrections() &&
+	dataMap.withinBounds(dir, energies.at(nee/2), 4);
+
+      std::vector<double> values(nstamp);
+      for (size_t k(0); k < nee; k++) {
+	if ( config.verbose() && nee >= 20 && (k % (nee/20)) == 0 ) {
+	  formatter.warn() << ".";
+	}
+	const std::vector<double> & profile = profiles[k];
+	size_t nprof(profile.size());
+	for (size_t i(0); i < nstamp; i++) {
+	  double x(stampOffsets[i]/step);
+	  size_t ix(static_cast<size_t>(x));
+	  values[i] = ix + 1 < nprof ? 
+	    profile[ix] + (x - ix)*(profile[ix+1] - profile[ix]) : 0;
+	}
+	for (size_t i(0); i < core.size(); i++) {
+	  values[core[i]] = psfValueEstimate(meanpsf, energies[k], dir, 
+					     pixels[stampPixels[core[i]]], srcCoord,
+					     corePixCoords[i], pixelOffsets,
+					     ref_pixel_size, config);
+	}
+	double mapIntegral(0);
+	float * plane = &modelmap[k*npix];
+	for (size_t i(0); i < nstamp; i++) {
+	  // This is the value without the exposure, which we need for the map integrals
+	  double value(values[i]*solidAngles[i]);
+	  if ( stampOffsets[i] <= psfRadius ) {
+	    mapIntegral += value;
+	  }
+	  values[i] = value;
+	}
+	double factor(exposure.at(k));
+	if ( apply_map_corrections && mapIntegral > 0 ) {
+	  factor *= meanpsf.integral(psfRadius, energies[k])/mapIntegral;
+	}
+	for (size_t i(0); i < nstamp; i++) {
+	  plane[stampPixels[i]] = values[i]*factor;
+	}
+      }
+      return 0;
+    }
+
+    void makePsfProfiles(const MeanPsf& meanpsf,
+			 const std::vector<double>& energies,
+			 const std::vector<double>& radii,
+			 double step,
+			 std::vector< std::vector<double> >& profiles) {
+      profiles.resize(energies.size());
+      for (size_t k(0); k < energies.size(); k++) {
+	size_t nprof(static_cast<size_t>(radii[k]/step) + 2);
+	std::vector<double> & profile = profiles[k];
+	profile.resize(nprof);
+	for (size_t i(0); i < nprof; i++) {
+	  profile[i] = meanpsf(energies[k], i*step);
+	}
+      }
+    }
+
+    void findStampPixels(const CountsMap& dataMap,
+			 const astro::SkyDir& dir,
+			 const std::pair<double, double>& srcCoord,
+			 const std::vector< std::vector< double > >& pixelOffsets,
+			 double radius,
+			 std::vector<size_t>& indices,
+			 std::vector<double>& offsets) {
+      indices.clear();
+      offsets.clear();
+      const std::vector<Pixel> & pixels(dataMap.pixels());
+      long naxis1(dataMap.naxis1());
+      long naxis2(dataMap.naxis2());
+
+      // The angular separations are at least minRatio * the separations 
+      // in pixel coordinates, which bounds the box to search.
+      double minRatio(1);
+      for (size_t ix(0); ix < pixelOffsets.size(); ix++) {
+	for (size_t iy(0); iy < pixelOffsets[ix].size(); iy++) {
+	  minRatio = std::min(minRatio, 1. + pixelOffsets[ix][iy]);
+	}
+      }
+      long xmin(0), xmax(naxis1 - 1);
+      long ymin(0), ymax(naxis2 - 1);
+      // Large maps might wrap around the sky, so search all of them
+      bool useBox = minRatio > 0.1 && dataMap.mapRadius() < 60. &&
+	srcCoord.first == srcCoord.first && srcCoord.second == srcCoord.second;
+      if ( useBox ) {
+	double halfWidth(radius/(dataMap.pixelSize()*minRatio) + 1.);
+	// Pixel coordinates follow the FITS convention, starting from 1
+	xmin = std::max(xmin, static_cast<long>(std::floor(srcCoord.first - 1. - halfWidth)));
+	xmax = std::min(xmax, static_cast<long>(std::ceil(srcCoord.first - 1. + halfWidth)));
+	ymin = std::max(ymin, static_cast<long>(std::floor(srcCoord.second - 1. - halfWidth)));
+	ymax = std::min(ymax, static_cast<long>(std::ceil(srcCoord.second - 1. + halfWidth)));
+      }
+      for (long iy(ymin); iy <= ymax; iy++) {
+	for (long ix(xmin); ix <= xmax; ix++) {
+	  size_t j(iy*naxis1 + ix);
+	  double offset(dir.difference(pixels[j].dir())*180./M_PI);
+	  if ( offset <= radius ) {
+	    indices.push_back(j);
+	    offsets.push_back(offset);
+	  }
+	}
+      }
+    }
+    
     int makePointSourceMap_healpix(const PointSource& pointSrc,
 				   const CountsMapHealpix& dataMap,
 				   const PsfIntegConfig& config,
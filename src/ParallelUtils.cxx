@@ -0,0 +1,139 @@
+/**
+ * @file ParallelUtils.cxx
+ * @brief Functions to split loops into chunks and run them on several threads
+ *
+ * $Header$
+ */
+
+#include <cstdlib>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "Likelihood/Accumulator.h"
+#include "Likelihood/LogLike.h"
+#include "Likelihood/ParallelUtils.h"
+
+namespace Likelihood {
+
+  namespace ParallelUtils {
+
+    int maxThreads() {
+#ifdef _OPENMP
+      return omp_get_max_threads();
+#else
+      return 1;
+#endif
+    }
+
+    double wallTime() {
+#ifdef _OPENMP
+      return omp_get_wtime();
+#else
+      return static_cast<double>(std::time(0));
+#endif
+    }
+
+    int envThreads() {
+      const char * envval = ::getenv("LIKELIHOOD_NUM_THREADS");
+      if (envval == 0) {
+	return 0;
+      }
+      int nthreads = std::atoi(envval);
+      return nthreads > 0 ? nthreads : 0;
+    }
+
+    int numThreads(int requested) {
+      int nthreads = requested > 0 ? requested : envThreads();
+      if (nthreads <= 0) {
+	return 1;
+      }
+      int nmax = maxThreads();
+      return nthreads > nmax ? nmax : nthreads;
+    }
+
+    int threadNum() {
+#ifdef _OPENMP
+      return omp_get_thread_num();
+#else
+      return 0;
+#endif
+    }
+
+    bool inParallel() {
+#ifdef _OPENMP
+      return omp_in_parallel() != 0;
+#else
+      return false;
+#endif
+    }
+
+    void makeChunks(size_t first, size_t last, size_t chunkSize,
+		    std::vector<size_t>& bounds) {
+      bounds.clear();
+      if (chunkSize == 0) {
+	chunkSize = defaultChunkSize;
+      }
+      bounds.push_back(first);
+      for (size_t i(first); last > i && last - i > chunkSize; i += chunkSize) {
+	bounds.push_back(i + chunkSize);
+      }
+      if (last > first) {
+	bounds.push_back(last);
+      }
+    }
+
+    double orderedSum(const std::vector<double>& partials) {
+      Kahan_Accumulator accum;
+      for (std::vector<double>::const_iterator itr = partials.begin();
+	   itr != partials.end(); itr++ ) {
+	accum.add(*itr);
+      }
+      return accum.total();
+    }
+
+    void evaluateComponents(const std::vector<LogLike*>& components,
+			    int numThreads,
+			    std::vector<double>* values,
+			    std::vector<std::vector<double> >* derivs) {
+      int ncomps = static_cast<int>(components.size());
+      if ( values ) {
+	values->assign(ncomps, 0.);
+      }
+      if ( derivs ) {
+	derivs->assign(ncomps, std::vector<double>());
+      }
+      int nthreads = numThreads > 0 ? numThreads : 1;
+      nthreads = nthreads > maxThreads() ? maxThreads() : nthreads;
+      std::string errorMessage;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+#endif
+      for ( int i = 0; i < ncomps; i++ ) {
+	try {
+	  if ( values ) {
+	    (*values)[i] = components[i]->value();
+	  }
+	  if ( derivs ) {
+	    components[i]->getFreeDerivs((*derivs)[i]);
+	  }
+	} catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(ParallelUtils_evaluateComponents)
+#endif
+	  errorMessage = eObj.what();
+	}
+      }
+      (void)(nthreads);
+      if ( errorMessage != "" ) {
+	throw std::runtime_error(errorMessage);
+      }
+    }
+
+  } // namespace ParallelUtils
+
+} // namespace Likelihood
@@ -23,6 +23,7 @@
 
 #include "irfInterface/Irfs.h"
 
+#include "Likelihood/IntervalIndex.h"
 #include "Likelihood/LikeExposure.h"
 #include "Likelihood/Observation.h"
 #include "Likelihood/PointSource.h"
@@ -410,6 +411,12 @@ void PointSource::computeExposure(const astro::SkyDir & srcDir,
       npts = scData.time_index(roiCuts.maxTime()) + 1;
    }
 
+   std::vector< std::pair<double, double> > timeRanges;
+   std::vector< std::pair<double, double> > gtis;
+   roiCuts.getTimeCuts(timeRanges);
+   roiCuts.getGtis(gtis);
+   IntervalIndex intervalIndex(timeRanges, gtis);
+
    for (size_t it = 0; it < npts && it < scData.numIntervals(); it++) {
       if (npts/20 > 0 && ((it % (npts/20)) == 0)) {
          formatter.warn() << ".";
@@ -420,12 +427,7 @@ void PointSource::computeExposure(const astro::SkyDir & srcDir,
       double fraction(0);
       double ltfrac(livetime/(stop - start));
 
-      std::vector< std::pair<double, double> > timeRanges;
-      std::vector< std::pair<double, double> > gtis;
-      roiCuts.getTimeCuts(timeRanges);
-      roiCuts.getGtis(gtis);
-      bool includeInterval = 
-         LikeExposure::acceptInterval(start, stop, timeRanges, gtis, fraction);
+      bool includeInterval = intervalIndex.accept(start, stop, fraction);
 
 // Compute the inclination and check if it's within response matrix
 // cut-off angle
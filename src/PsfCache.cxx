@@ -0,0 +1,217 @@
+/**
+ * @file PsfCache.cxx
+ * @brief Singleton class that holds the MeanPsf objects for point
+ * sources, so that sources at nearby positions share them.
+ *
+ * $Header$
+ */
+
+#include <cmath>
+#include <cstdlib>
+
+#include <utility>
+
+#include "healpix_base.h"
+
+#include "astro/SkyDir.h"
+
+#include "st_stream/StreamFormatter.h"
+
+#include "Likelihood/ExposureCube.h"
+#include "Likelihood/MeanPsf.h"
+#include "Likelihood/Observation.h"
+#include "Likelihood/PsfCache.h"
+
+namespace Likelihood {
+
+PsfCache * PsfCache::s_instance(0);
+
+PsfCache * PsfCache::instance() {
+   PsfCache * retVal;
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_PsfCache_instance)
+#endif
+   {
+      if (s_instance == 0) {
+         s_instance = new PsfCache();
+      }
+      retVal = s_instance;
+   }
+   return retVal;
+}
+
+PsfCache::PsfCache() : m_order(-1), m_hits(0), m_misses(0) {
+   const char * envval = ::getenv("LIKELIHOOD_PSF_CACHE_ORDER");
+   if (envval != 0) {
+      m_order = std::atoi(envval);
+   }
+}
+
+PsfCache::~PsfCache() throw() {
+   try {
+      clear();
+   } catch(...) {
+   }
+}
+
+bool PsfCache::Key::operator<(const Key & rhs) const {
+   if (ra != rhs.ra) {
+      return ra < rhs.ra;
+   }
+   if (dec != rhs.dec) {
+      return dec < rhs.dec;
+   }
+   if (expCubeId != rhs.expCubeId) {
+      return expCubeId < rhs.expCubeId;
+   }
+   if (respName != rhs.respName) {
+      return respName < rhs.respName;
+   }
+   if (evtTypes != rhs.evtTypes) {
+      return evtTypes < rhs.evtTypes;
+   }
+   if (energies != rhs.energies) {
+      return energies < rhs.energies;
+   }
+   return livetimeFactors < rhs.livetimeFactors;
+}
+
+const MeanPsf & PsfCache::meanPsf(const astro::SkyDir & dir,
+                                  const std::vector<double> & energies,
+                                  const Observation & observation) {
+   Key key;
+   key.respName = observation.respFuncs().respName();
+   std::map<unsigned int, irfInterface::Irfs *>::const_iterator
+      resp(observation.respFuncs().begin());
+   for ( ; resp != observation.respFuncs().end(); ++resp) {
+      key.evtTypes.push_back(resp->first);
+   }
+   key.expCubeId = observation.expCube().id();
+   key.energies = energies;
+   for (size_t k(0); k < energies.size(); k++) {
+      double factor1, factor2;
+      observation.expCube().livetimeFactors(energies[k], factor1, factor2);
+      key.livetimeFactors.push_back(factor1);
+      key.livetimeFactors.push_back(factor2);
+   }
+   quantize(dir, key.ra, key.dec);
+   const MeanPsf * psf(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_PsfCache)
+#endif
+   {
+      PsfMap_t::iterator it(m_psfs.find(key));
+      if (it != m_psfs.end()) {
+         psf = it->second.psf;
+         it->second.users++;
+         m_hits++;
+      }
+   }
+   if (psf != 0) {
+      return *psf;
+   }
+// Compute the psf outside of the critical section, so that several
+// threads can do this at once.  If another thread has added the same
+// psf in the meantime, that one is used.
+   MeanPsf * new_psf = new MeanPsf(key.ra, key.dec, energies, observation);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_PsfCache)
+#endif
+   {
+      PsfMap_t::iterator it(m_psfs.find(key));
+      if (it != m_psfs.end()) {
+         psf = it->second.psf;
+         it->second.users++;
+         m_hits++;
+      } else {
+         it = m_psfs.insert(std::make_pair(key, Entry())).first;
+         it->second.psf = new_psf;
+         it->second.users = 1;
+         m_entries[new_psf] = it;
+         psf = new_psf;
+         m_misses++;
+      }
+   }
+   if (psf != new_psf) {
+      delete new_psf;
+   }
+   return *psf;
+}
+
+void PsfCache::quantize(const astro::SkyDir & dir,
+                        double & ra, double & dec) const {
+   if (m_order < 0) {
+      ra = dir.ra();
+      dec = dir.dec();
+      return;
+   }
+   Healpix_Base hp(m_order, NEST);
+   pointing center((90. - dir.dec())*M_PI/180., dir.ra()*M_PI/180.);
+   pointing pixel_center(hp.pix2ang(hp.ang2pix(center)));
+   ra = pixel_center.phi*180./M_PI;
+   dec = 90. - pixel_center.theta*180./M_PI;
+}
+
+void PsfCache::release(const MeanPsf * psf) {
+   if (psf == 0) {
+      return;
+   }
+   MeanPsf * unused(0);
+#ifdef _OPENMP
+#pragma omp critical(Likelihood_PsfCache)
+#endif
+   {
+      std::map<const MeanPsf *, PsfMap_t::iterator>::iterator
+         entry(m_entries.find(psf));
+      if (entry != m_entries.end()) {
+         PsfMap_t::iterator it(entry->second);
+         if (--it->second.users == 0) {
+            unused = it->second.psf;
+            m_psfs.erase(it);
+            m_entries.erase(entry);
+         }
+      }
+   }
+   delete unused;
+}
+
+void PsfCache::setOrder(int order) {
+   m_order = order;
+}
+
+void PsfCache::clear() {
+   PsfMap_t::iterator it(m_psfs.begin());
+   for ( ; it != m_psfs.end(); ++it) {
+      delete it->second.psf;
+   }
+   m_psfs.clear();
+   m_entries.clear();
+   m_hits = 0;
+   m_misses = 0;
+}
+
+size_t PsfCache::memory_size() const {
+   size_t retVal(sizeof(*this));
+   PsfMap_t::const_iterator it(m_psfs.begin());
+   for ( ; it != m_psfs.end(); ++it) {
+      retVal += sizeof(Key) + sizeof(Entry)
+         + it->first.respName.capacity()
+         + it->first.evtTypes.capacity()*sizeof(unsigned int)
+         + it->first.energies.capacity()*sizeof(double)
+         + it->first.livetimeFactors.capacity()*sizeof(double);
+      retVal += it->second.psf->memory_size();
+   }
+   return retVal;
+}
+
+void PsfCache::report(st_stream::StreamFormatter & formatter) const {
+   size_t nrequests(m_hits + m_misses);
+   formatter.info() << "PsfCache: " << size() << " psfs, "
+                    << m_hits << " hits / " << nrequests << " requests";
+   if (nrequests > 0) {
+      formatter.info() << " (" << 100.*m_hits/nrequests << "%)";
+   }
+   formatter.info() << ", " << memory_size()/1024 << " kB" << std::endl;
+}
+
+} // namespace Likelihood
@@ -0,0 +1,74 @@
+/**
+ * @file ResponseClones.cxx
+ * @brief Per-thread copies of the response functions for threaded loops.
+ *
+ * $Header$
+ */
+
+#include <stdexcept>
+
+#include "Likelihood/Observation.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/ResponseClones.h"
+#include "Likelihood/ResponseFunctions.h"
+
+namespace Likelihood {
+
+ResponseClones::ResponseClones(const ResponseFunctions & respFuncs,
+                               int nthreads)
+   : m_respFuncs(respFuncs), m_observation(0) {
+   makeClones(nthreads);
+}
+
+ResponseClones::ResponseClones(const Observation & observation, int nthreads)
+   : m_respFuncs(observation.respFuncs()), m_observation(&observation) {
+   makeClones(nthreads);
+   for (size_t i(0); i < m_clones.size(); i++) {
+      m_observations.push_back(new Observation(observation, m_clones[i]));
+   }
+}
+
+ResponseClones::~ResponseClones() {
+   for (size_t i(0); i < m_observations.size(); i++) {
+      delete m_observations[i];
+   }
+   for (size_t i(0); i < m_clones.size(); i++) {
+      delete m_clones[i];
+   }
+}
+
+void ResponseClones::makeClones(int nthreads) {
+   for (int i(1); i < nthreads; i++) {
+      m_clones.push_back(m_respFuncs.clone());
+   }
+}
+
+const ResponseFunctions & ResponseClones::respFuncs() const {
+   size_t ithread(ParallelUtils::threadNum());
+   if (ithread == 0) {
+      return m_respFuncs;
+   }
+   if (ithread > m_clones.size()) {
+      throw std::runtime_error("ResponseClones::respFuncs: "
+                               "more threads than clones.");
+   }
+   return *m_clones[ithread - 1];
+}
+
+const Observation & ResponseClones::observation() const {
+   if (m_observation == 0) {
+      throw std::runtime_error("ResponseClones::observation: "
+                               "no Observation was given.");
+   }
+   size_t ithread(ParallelUtils::threadNum());
+   if (ithread == 0) {
+      return *m_observation;
+   }
+   if (ithread > m_observations.size()) {
+      throw std::runtime_error("ResponseClones::observation: "
+                               "more threads than clones.");
+   }
+   return *m_observations[ithread - 1];
+}
+
+} // namespace Likelihood
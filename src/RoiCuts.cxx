@@ -227,10 +227,16 @@ void RoiCuts::sortCuts(bool strict) {
 }
 
 bool RoiCuts::accept(const Event &event) const {
+   return accept(event.getDir(), event.getEnergy(), event.getArrTime(),
+                 event.getMuZenith());
+}
+
+bool RoiCuts::accept(const astro::SkyDir & dir, double energy, double time,
+                     double muZenith) const {
    bool acceptEvent(false);
 
    std::map<std::string, double> thisEvent;
-   thisEvent["TIME"] = event.getArrTime();
+   thisEvent["TIME"] = time;
 
    if (m_gtiCuts.size() == 0) {
       acceptEvent = true;
@@ -246,16 +252,16 @@ bool RoiCuts::accept(const Event &event) const {
       acceptEvent = m_timeRangeCuts.at(i)->accept(thisEvent);
    }
 
-   if (event.getEnergy() < m_eMin || event.getEnergy() > m_eMax) { 
+   if (energy < m_eMin || energy > m_eMax) { 
       acceptEvent = false;
    }
 
-   double dist = event.getSeparation(m_roiCone.center())*180./M_PI;
+   double dist = dir.difference(m_roiCone.center())*180./M_PI;
    if (dist > m_roiCone.radius()) {
       acceptEvent = false;
    }
 
-   if (event.getMuZenith() < m_muZenMax) {
+   if (muZenith < m_muZenMax) {
       acceptEvent = false;
    }
 
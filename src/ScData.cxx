@@ -15,10 +15,9 @@
 #include <stdexcept>
 #include <vector>
 
-#include "facilities/Util.h"
+#include "fitsio.h"
 
-#include "tip/IFileSvc.h"
-#include "tip/Table.h"
+#include "facilities/Util.h"
 
 #include "astro/EarthCoordinate.h"
 
@@ -26,6 +25,25 @@
 
 #include "Likelihood/ScData.h"
 
+namespace {
+/// Throw if status is non-zero, closing fptr first if it is open.
+   void fitsReportError(int status, const std::string & scfile,
+                        fitsfile * fptr=0) {
+      if (status == 0) {
+         return;
+      }
+      fits_report_error(stderr, status);
+      if (fptr != 0) {
+         int close_status(0);
+         fits_close_file(fptr, &close_status);
+      }
+      std::ostringstream message;
+      message << "Likelihood::ScData: CFITSIO error " << status
+              << " reading " << scfile;
+      throw std::runtime_error(message.str());
+   }
+}
+
 namespace Likelihood {
 
 void ScData::readData(std::string scfile, double tstart, double tstop,
@@ -35,53 +53,92 @@ void ScData::readData(std::string scfile, double tstart, double tstop,
    tstop += 2*maxIntervalSize;
    facilities::Util::expandEnvVar(&scfile);
 
-   const tip::Table * scData(0);
    std::ostringstream filter;
    filter << std::setprecision(10);
-   filter << "col START;STOP;LIVETIME;RA_SCZ;DEC_SCZ;RA_SCX;DEC_SCX]"
+   filter << scfile << "[" << sctable << "]"
           << "[(START >= " << tstart
-          << ") && (STOP <= " << tstop << ")";
-   scData = tip::IFileSvc::instance().readTable(scfile, sctable, filter.str());
+          << ") && (STOP <= " << tstop << ")]";
    if (clear) {
       clear_arrays();
    }
 
-   double start, stop, livetime;
-   double raSCX, decSCX;
-   double raSCZ, decSCZ;
-   tip::Table::ConstIterator it = scData->begin();
-   tip::ConstTableRecord & scInterval = *it;
-   for (size_t i(0); it != scData->end(); ++it, ++i) {
-      scInterval["start"].get(start);
-      scInterval["stop"].get(stop);
-      if (stop < tstart || start > tstop) {
-         continue;
+// The columns are read in blocks of rows into contiguous arrays,
+// rather than field by field for each row.
+   int status(0);
+   fitsfile * fptr(0);
+   fits_open_table(&fptr, filter.str().c_str(), READONLY, &status);
+   ::fitsReportError(status, scfile);
+
+   long nrows(0);
+   fits_get_num_rows(fptr, &nrows, &status);
+   ::fitsReportError(status, scfile, fptr);
+
+   long blockSize(0);
+   fits_get_rowsize(fptr, &blockSize, &status);
+   ::fitsReportError(status, scfile, fptr);
+   blockSize = std::max(blockSize, 1024L);
+   blockSize = std::min(blockSize, std::max(nrows, 1L));
+
+   enum {START_COL, STOP_COL, LIVETIME_COL, RA_SCX_COL, DEC_SCX_COL,
+         RA_SCZ_COL, DEC_SCZ_COL, NUM_COLS};
+   const char * colnames[NUM_COLS] = {"START", "STOP", "LIVETIME", 
+                                   "RA_SCX", "DEC_SCX", "RA_SCZ", "DEC_SCZ"};
+   int colnums[NUM_COLS];
+   for (int icol(0); icol < NUM_COLS; icol++) {
+      fits_get_colnum(fptr, CASEINSEN, const_cast<char *>(colnames[icol]),
+                      &colnums[icol], &status);
+      ::fitsReportError(status, scfile, fptr);
+   }
+
+   m_start.reserve(m_start.size() + nrows);
+   m_stop.reserve(m_stop.size() + nrows);
+   m_livetime.reserve(m_livetime.size() + nrows);
+   m_xAxis.reserve(m_xAxis.size() + nrows);
+   m_zAxis.reserve(m_zAxis.size() + nrows);
+
+   std::vector< std::vector<double> > 
+      columns(NUM_COLS, std::vector<double>(blockSize));
+   double nulval(0);
+   int anynul(0);
+   for (long firstrow(1); firstrow <= nrows; firstrow += blockSize) {
+      long nelem(std::min(blockSize, nrows - firstrow + 1));
+      for (int icol(0); icol < NUM_COLS; icol++) {
+         fits_read_col(fptr, TDOUBLE, colnums[icol], firstrow, 1, nelem,
+                       &nulval, &columns[icol][0], &anynul, &status);
+         ::fitsReportError(status, scfile, fptr);
       }
-      scInterval["livetime"].get(livetime);
-      scInterval["ra_scx"].get(raSCX);
-      scInterval["dec_scx"].get(decSCX);
-      scInterval["ra_scz"].get(raSCZ);
-      scInterval["dec_scz"].get(decSCZ);
+      for (long i(0); i < nelem; i++) {
+         double start(columns[START_COL][i]);
+         double stop(columns[STOP_COL][i]);
+         if (stop < tstart || start > tstop) {
+            continue;
+         }
 // Ensure that start times are monotonically increasing.
-      if (m_start.size() > 1 && start < m_start.back()) {
-         std::ostringstream message;
-         message << "Likelihood::ScData: "
-                 << "The start times in the spacecraft data are not "
-                 << "monitonically increasing.\n"
-                 << "Previous time: " << m_start.back() << "\n"
-                 << "Current time: " << start << "\n"
-                 << "Current S/C file: " << scfile << "\n"
-                 << "Check the ordering of your S/C files." 
-                 << std::endl;
-         throw std::runtime_error(message.str());
+         if (m_start.size() > 1 && start < m_start.back()) {
+            int close_status(0);
+            fits_close_file(fptr, &close_status);
+            std::ostringstream message;
+            message << "Likelihood::ScData: "
+                    << "The start times in the spacecraft data are not "
+                    << "monitonically increasing.\n"
+                    << "Previous time: " << m_start.back() << "\n"
+                    << "Current time: " << start << "\n"
+                    << "Current S/C file: " << scfile << "\n"
+                    << "Check the ordering of your S/C files." 
+                    << std::endl;
+            throw std::runtime_error(message.str());
+         }
+         m_start.push_back(start);
+         m_stop.push_back(stop);
+         m_livetime.push_back(columns[LIVETIME_COL][i]);
+         m_xAxis.push_back(astro::SkyDir(columns[RA_SCX_COL][i],
+                                         columns[DEC_SCX_COL][i]));
+         m_zAxis.push_back(astro::SkyDir(columns[RA_SCZ_COL][i],
+                                         columns[DEC_SCZ_COL][i]));
       }
-      m_start.push_back(start);
-      m_stop.push_back(stop);
-      m_livetime.push_back(livetime);
-      m_xAxis.push_back(astro::SkyDir(raSCX, decSCX));
-      m_zAxis.push_back(astro::SkyDir(raSCZ, decSCZ));
    }
-   delete scData;
+   fits_close_file(fptr, &status);
+   ::fitsReportError(status, scfile);
 }
 
 void ScData::readData(const std::vector<std::string> & scFiles, 
@@ -42,6 +42,7 @@
 #include "Likelihood/MapBase.h"
 #include "Likelihood/MeanPsf.h"
 #include "Likelihood/PointSource.h"
+#include "Likelihood/PsfCache.h"
 #include "Likelihood/PSFUtils.h"
 #include "Likelihood/Observation.h"
 #include "Likelihood/ResponseFunctions.h"
@@ -156,8 +157,8 @@ SourceMap::SourceMap(const SourceMap& other)
 
 
 SourceMap::~SourceMap() {
+   PsfCache::instance()->release(m_meanPsf);
    delete m_formatter;
-   delete m_meanPsf; 
    delete m_drm_cache;
 }
 
@@ -288,6 +289,28 @@ const Drm_Cache* SourceMap::update_drm_cache(const Drm* drm, bool force) {
   return drm_cache(force || changed);
 }
 
+void SourceMap::update_drm_caches(const Drm* drm, 
+				  const std::vector<SourceMap*>& srcMaps) {
+  std::vector<Drm_Cache*> caches;
+  std::vector<SourceMap*> toUpdate;
+  for ( std::vector<SourceMap*>::const_iterator itr = srcMaps.begin(); 
+	itr != srcMaps.end(); ++itr ) {
+    SourceMap* srcMap = *itr;
+    srcMap->m_drm = drm;
+    if ( srcMap->m_drm_cache == 0 ) {
+      // This builds the cache, using the DRM
+      srcMap->drm_cache();
+      continue;
+    }
+    caches.push_back(srcMap->m_drm_cache);
+    toUpdate.push_back(srcMap);
+  }
+  if ( toUpdate.size() == 0 ) {
+    return;
+  }
+  Drm_Cache::update(drm,caches,toUpdate,toUpdate.front()->m_dataCache->energies());
+}
+
 void SourceMap::setSpectralValues(const std::vector<double>& energies,
 				    bool latch_params ) {
   if ( m_src == 0 ) return;
@@ -569,7 +592,11 @@ int SourceMap::make_model() {
 				      m_psf_config, *m_formatter, m_model, m_mapType);
     break;
   case Source::Point:
-    m_meanPsf = m_psf_config.use_single_psf() ? 0 : PSFUtils::build_psf(*m_src, m_dataCache->countsMap(),m_observation);
+    PsfCache::instance()->release(m_meanPsf);
+    m_meanPsf = 0;
+    m_meanPsf = m_psf_config.use_single_psf() ? 0 : 
+      &PsfCache::instance()->meanPsf(static_cast<const PointSource&>(*m_src).getDir(),
+				     m_dataCache->energies(), m_observation);
     status =  PSFUtils::makePointSourceMap(static_cast<const PointSource&>(*m_src), m_dataCache->countsMap(), 
 					   m_psf_config, m_meanPsf==0 ? m_observation.meanpsf() : *m_meanPsf, 
 					   *m_formatter, m_model, m_mapType);
@@ -22,8 +22,15 @@
 #include "Likelihood/CountsMapBase.h"
 #include "Likelihood/CountsMapHealpix.h"
 #include "Likelihood/Drm.h"
+#include "Likelihood/DrmGrid.h"
+#include "Likelihood/ExposureCube.h"
 #include "Likelihood/FitUtils.h"
 #include "Likelihood/FileUtils.h"
+#include "Likelihood/Observation.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/PointSource.h"
+#include "Likelihood/PsfCache.h"
+#include "Likelihood/ResponseClones.h"
 #include "Likelihood/WeightMap.h"
 
 #define ST_DLL_EXPORTS
@@ -41,16 +48,20 @@ namespace Likelihood {
     : m_dataCache(dataCache),
       m_observation(observation),
       m_drm(drm),
+      m_drmGrid(0),
       m_srcMapsFile(srcMapsFile),
-      m_config(config) {
+      m_config(config),
+      m_delaySrcMapBuild(false) {
   }
 
   SourceMapCache::SourceMapCache(const SourceMapCache& other)
     : m_dataCache(other.m_dataCache),
       m_observation(other.m_observation),
       m_drm(other.m_drm),
+      m_drmGrid(other.m_drmGrid),
       m_srcMapsFile(m_srcMapsFile),
-      m_config(m_config) {
+      m_config(m_config),
+      m_delaySrcMapBuild(other.m_delaySrcMapBuild) {
   }
 
   SourceMapCache::~SourceMapCache() {
@@ -111,7 +122,7 @@ namespace Likelihood {
 
     const std::string& srcName = src.getName();
     SourceMap* srcMap(0);
-    const Drm* the_drm = use_edisp(&src) ? m_drm : 0;
+    const Drm* the_drm = use_edisp(&src) ? drm(src) : 0;
 
     // Check to see if we already have the map
     std::map<std::string, SourceMap *>::iterator itrFind = m_srcMaps.find(srcName);
@@ -149,7 +160,7 @@ namespace Likelihood {
   SourceMap * SourceMapCache::createSourceMap(const Source& src, const BinnedLikeConfig* config) const {
     const BinnedLikeConfig& the_config = config == 0 ? m_config : *config;
     return new SourceMap(src, &m_dataCache, m_observation, the_config.psf_integ_config(), 
-			 m_drm, m_dataCache.weightMap(), the_config.save_all_srcmaps() );
+			 drm(src), m_dataCache.weightMap(), the_config.save_all_srcmaps() );
   }
   
   void SourceMapCache::eraseSourceMap(const std::string & srcName) {
@@ -186,14 +197,13 @@ namespace Likelihood {
  
     std::vector<tip::Extension*> hdus;
 
+    buildSourceMaps(srcs,recreate);
+
     for ( std::vector<const Source*>::const_iterator itr = srcs.begin();
 	  itr != srcs.end(); itr++ ) {
     
       const Source* src = *itr;
       const std::string& name = src->getName();
-      if (m_srcMaps.find(name) == m_srcMaps.end() || recreate) {
-	loadSourceMap(*src,recreate);
-      }
     
       if(saveMaps) {
 	tip::Extension* ptr(0);
@@ -217,6 +227,115 @@ namespace Likelihood {
   }
 
 
+  void SourceMapCache::buildSourceMaps(const std::vector<const Source*>& srcs,
+				       bool recreate) {
+    st_stream::StreamFormatter formatter("SourceMapCache",
+					 "buildSourceMaps", 2);
+    double tstart(ParallelUtils::wallTime());
+
+    // Maps that are read from the file, and those of composite sources,
+    // which have their own SourceMapCache, are made here.  The others are
+    // built below.
+    std::vector<const Source*> pending;
+    for ( std::vector<const Source*>::const_iterator itr = srcs.begin();
+	  itr != srcs.end(); itr++ ) {
+      const Source* src = *itr;
+      const std::string& name = src->getName();
+      if(!(src->getType() == "Diffuse" || m_config.computePointSources() )) {
+	continue;
+      }
+      std::map<std::string, SourceMap *>::iterator mapIt = m_srcMaps.find(name);
+      if ( mapIt != m_srcMaps.end() ) {
+	if ( !recreate ) {
+	  continue;
+	}
+	delete mapIt->second;
+	m_srcMaps.erase(mapIt);
+      }
+      if ( src->srcType() == Source::Composite ) {
+	m_srcMaps[name] = createSourceMap(*src);
+	continue;
+      }
+      if ( !recreate ) {
+	if ( FileUtils::fileHasExtension(m_srcMapsFile, name) ) {
+	  getSourceMap(*src, true);
+	  continue;
+	}
+      }
+      pending.push_back(src);
+    }
+
+    if ( pending.empty() ) {
+      return;
+    }
+
+    int nthreads = m_config.num_threads() > 0 ? 
+      ParallelUtils::numThreads(m_config.num_threads()) : 1;
+    if ( nthreads < 2 ) {
+      for ( size_t i(0); i < pending.size(); i++ ) {
+	m_srcMaps[pending[i]->getName()] = createSourceMap(*pending[i]);
+      }
+    } else {
+      // Only the point sources are built on several threads.  Making a
+      // diffuse map deletes maps from the shared WcsMapLibrary and uses
+      // the shared response functions, so those are built serially.
+      std::vector<const Source*> points;
+      for ( size_t i(0); i < pending.size(); i++ ) {
+	if ( pending[i]->srcType() == Source::Point ) {
+	  points.push_back(pending[i]);
+	} else {
+	  m_srcMaps[pending[i]->getName()] = createSourceMap(*pending[i]);
+	}
+      }
+      // Each thread computes the psf of its source with its own clones of
+      // the response functions.  The PsfCache keys the psfs on the IRFs,
+      // so the SourceMap then finds it there.  The effective area table
+      // is filled first, so that the clones share it, and the PsfCache
+      // is made here rather than by the first thread to use it.
+      const std::vector<double>& energies = m_dataCache.energies();
+      PsfCache & psfCache(*PsfCache::instance());
+      bool single_psf = m_config.psf_integ_config().use_single_psf();
+      m_observation.expCube().fillAeffTable(m_observation.respFuncs(), energies);
+      ResponseClones clones(m_observation, single_psf ? 1 : nthreads);
+      std::vector<SourceMap*> built(points.size(), 0);
+      std::vector<const MeanPsf*> psfs(points.size(), 0);
+      std::string errorMessage;
+      int nbuild = static_cast<int>(points.size());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+#endif
+      for ( int i = 0; i < nbuild; i++ ) {
+	try {
+	  if ( !single_psf ) {
+	    const PointSource& ptSrc = static_cast<const PointSource&>(*points[i]);
+	    psfs[i] = &psfCache.meanPsf(ptSrc.getDir(), energies,
+					clones.observation());
+	  }
+	  built[i] = createSourceMap(*points[i]);
+	} catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(SourceMapCache_error)
+#endif
+	  errorMessage = points[i]->getName() + ": " + eObj.what();
+	}
+      }
+      for ( size_t i(0); i < points.size(); i++ ) {
+	psfCache.release(psfs[i]);
+	if ( built[i] != 0 ) {
+	  m_srcMaps[points[i]->getName()] = built[i];
+	}
+      }
+      if ( errorMessage != "" ) {
+	throw std::runtime_error("SourceMapCache::buildSourceMaps: " + errorMessage);
+      }
+    }
+
+    formatter.info() << "Built " << pending.size() << " source maps in "
+		     << ParallelUtils::wallTime() - tstart << " s using "
+		     << nthreads << " thread(s)" << std::endl;
+  }
+
+
   void SourceMapCache::loadSourceMap(const Source& src, bool recreate, const BinnedLikeConfig* config) {
     
     const std::string& srcName = src.getName();  
@@ -230,6 +349,10 @@ namespace Likelihood {
       m_srcMaps.erase(srcName);
     }
   
+    if( m_delaySrcMapBuild && !recreate ) {
+      return;
+    }
+
     SourceMap * srcMap = 0;
   
     if(recreate) {
@@ -440,6 +563,20 @@ namespace Likelihood {
     }  
   }
 
+  void SourceMapCache::addSourceDeltaWts_static(std::vector<std::pair<double, double> > & modelWts,
+						const SourceMap& srcMap,
+						size_t npix,
+						const std::vector<unsigned int>& filledPixels,
+						const std::vector<double>& deltaSpec) {
+    for (size_t j(0); j < filledPixels.size(); j++) {
+      size_t jmin(filledPixels[j]);
+      size_t jmax(jmin + npix);
+      size_t k(jmin/npix);
+      modelWts[j].first += srcMap[jmin]*deltaSpec[k];
+      modelWts[j].second += srcMap[jmax]*deltaSpec[k+1];
+    }
+  }
+
   tip::Extension* SourceMapCache::replaceSourceMap(const Source & src,
 						   const std::string & fitsFile) const {
     
@@ -503,6 +640,32 @@ namespace Likelihood {
   
   
   
+  void SourceMapCache::updateCorrectionFactors(const std::vector<const Source*>& srcs) const {
+    if ( m_drm == 0 ) {
+      throw std::runtime_error("No DRM object");
+    }
+    // Group the sources by matrix, so that each group is done in one product
+    std::map<const Drm*, std::vector<SourceMap*> > srcMaps;
+    for ( std::vector<const Source*>::const_iterator itr = srcs.begin(); 
+	  itr != srcs.end(); ++itr ) {
+      if ( !use_edisp(*itr) ) continue;
+      SourceMap* srcMap = getSourceMap(**itr,false);
+      srcMaps[drm(**itr)].push_back(srcMap);
+    }
+    for ( std::map<const Drm*, std::vector<SourceMap*> >::const_iterator itr = srcMaps.begin();
+	  itr != srcMaps.end(); ++itr ) {
+      SourceMap::update_drm_caches(itr->first,itr->second);
+    }
+  }
+
+  const Drm* SourceMapCache::drm(const Source& src) const {
+    if ( m_drmGrid != 0 && src.srcType() == Source::Point ) {
+      const PointSource& ptSrc = static_cast<const PointSource&>(src);
+      return m_drmGrid->drm(ptSrc.getDir());
+    }
+    return m_drm;
+  }
+
   void SourceMapCache::updateCorrectionFactors(const Source & src,
 					       SourceMap & sourceMap) const {
     if ( m_drm == 0 ) {
@@ -510,7 +673,7 @@ namespace Likelihood {
     }
     const Drm* the_drm(0);
     if ( use_edisp(&src) ) {
-      the_drm = m_drm;
+      the_drm = drm(src);
     }
     // drm_cache->update(the_drm,sourceMap,m_dataCache.energies());
     sourceMap.update_drm_cache(the_drm, true);
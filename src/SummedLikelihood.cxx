@@ -12,6 +12,7 @@
 #include <sstream>
 #include <stdexcept>
 
+#include "Likelihood/ParallelUtils.h"
 #include "Likelihood/SummedLikelihood.h"
 
 namespace Likelihood {
@@ -35,6 +36,15 @@ void SummedLikelihood::addComponent(LogLike & component) {
 
 double SummedLikelihood::value() const {
    double my_value(0);
+   if (m_numThreads > 0) {
+      std::vector<double> values;
+      ParallelUtils::evaluateComponents(m_components, m_numThreads,
+                                        &values, 0);
+      for (size_t i(0); i < values.size(); i++) {
+         my_value += values[i];
+      }
+      return my_value;
+   }
    ComponentConstIterator_t it(m_components.begin());
    for ( ; it != m_components.end(); ++it) {
       my_value += (*it)->value();
@@ -147,11 +157,54 @@ void SummedLikelihood::fetchParamValues(std::vector<double> & values,
 }
 
 void SummedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
+   updateFreeIndex();
+
+   // Intialize derivs vector with zeros for each free Minos parameter.
+   derivs.resize(m_freeIndex.size(), 0);
+
+   // Loop over log-likeihood components, adding derivative contributions.
+   if (m_numThreads > 0) {
+      std::vector< std::vector<double> > componentDerivs;
+      ParallelUtils::evaluateComponents(m_components, m_numThreads,
+                                        0, &componentDerivs);
+      for (size_t i(0); i < componentDerivs.size(); i++) {
+         for (size_t j(0); j < m_freeIndex.size(); j++) {
+            derivs.at(m_freeIndex[j].first) 
+               += componentDerivs[i].at(m_freeIndex[j].second);
+         }
+      }
+      return;
+   }
+   for (ComponentConstIterator_t it(m_components.begin());
+        it != m_components.end(); ++it) {
+      std::vector<double> freeDerivs;
+      (*it)->getFreeDerivs(freeDerivs);
+      for (size_t j(0); j < m_freeIndex.size(); j++) {
+         derivs.at(m_freeIndex[j].first) += freeDerivs.at(m_freeIndex[j].second);
+      }
+   }
+}
+
+void SummedLikelihood::updateFreeIndex() const {
+   // The index only changes if parameters are freed, fixed or tied,
+   // so it is kept until the free and tied flags change.
+   const std::vector<optimizers::Parameter> & 
+      pars(m_masterComponent->parameters());
+   std::vector<bool> flags;
+   flags.reserve(pars.size() + m_tiedPars.size());
+   for (size_t par_index(0); par_index < pars.size(); par_index++) {
+      flags.push_back(pars[par_index].isFree());
+   }
+   for (size_t i(0); i < m_tiedPars.size(); i++) {
+      flags.push_back(m_tiedPars[i]->isFree());
+   }
+   if (flags == m_freeFlags) {
+      return;
+   }
+
    // Loop over all parameters and use findIndex(par_index) to
    // determine the minos_index values and their order, accounting for
    // the tied parameters.
-   const std::vector<optimizers::Parameter> & 
-      pars(m_masterComponent->parameters());
 
    // The keys in the free_index map are the minos_index values of the
    // free parameters (i.e., excluding tied).  For the map values, the
@@ -169,20 +222,8 @@ void SummedLikelihood::getFreeDerivs(std::vector<double> & derivs) const {
          free_index_value++;
       }
    }
-
-   // Intialize derivs vector with zeros for each free Minos parameter.
-   derivs.resize(free_index.size(), 0);
-
-   // Loop over log-likeihood components, adding derivative contributions.
-   for (ComponentConstIterator_t it(m_components.begin());
-        it != m_components.end(); ++it) {
-      std::vector<double> freeDerivs;
-      (*it)->getFreeDerivs(freeDerivs);
-      for (std::map<int, size_t>::const_iterator index_it(free_index.begin());
-           index_it != free_index.end(); ++index_it) {
-         derivs.at(index_it->first) += freeDerivs.at(index_it->second);
-      }
-   }
+   m_freeIndex.assign(free_index.begin(), free_index.end());
+   m_freeFlags = flags;
 }
 
 void SummedLikelihood::
@@ -198,6 +239,7 @@ tieParameters(const std::vector<size_t> & par_indices) {
       m_tiedIndices.insert(*it);
    }
    m_tiedPars.push_back(tiedPar);
+   m_freeFlags.clear();
 }
 
 void SummedLikelihood::
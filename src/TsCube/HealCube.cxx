@@ -202,6 +202,7 @@ void HealCube::setGrid() {
   bool is_galactic(coordsys == "GAL");
   int nnorm = m_pars["nnorm"];
   std::string testSourceName = m_pars["target"];
+  int subPixel = m_pars["subpix"];
 
   m_refDir() = astro::SkyDir(xref,yref,
 			     (is_galactic ? astro::SkyDir::GALACTIC : astro::SkyDir::EQUATORIAL ) )();   
@@ -213,6 +214,8 @@ void HealCube::setGrid() {
   m_scanner = new FitScanner(*m_logLike,*m_opt,*hpxProj,hpx_region);
   m_proj = hpxProj;
 
+  m_scanner->set_testSourceSuperSample(subPixel);
+
   int status = testSourceName.empty() ? 
     m_scanner->setPowerlawPointTestSource(m_helper->funcFactory()) : 
     m_scanner->setTestSourceByName(testSourceName);
@@ -222,6 +222,7 @@ void TsCube::setGrid() {
   std::string proj_name = m_pars["proj"];
   int nnorm = m_pars["nnorm"];
   std::string testSourceName = m_pars["target"];
+  int subPixel = m_pars["subpix"];
 
   double crpix[] = {nxpix/2. + 0.5, nypix/2. + 0.5};
   double crval[] = {xref, yref};
@@ -233,6 +234,8 @@ void TsCube::setGrid() {
   m_scanner = new FitScanner(*m_logLike,*m_opt,*skyProj,nxpix,nypix);
   m_proj = skyProj;
 
+  m_scanner->set_testSourceSuperSample(subPixel);
+
   int status = testSourceName.empty() ? 
     m_scanner->setPowerlawPointTestSource(m_helper->funcFactory()) : 
     m_scanner->setTestSourceByName(testSourceName);
@@ -10,7 +10,9 @@
 #include <cmath>
 
 #include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 
 #include "st_stream/StreamFormatter.h"
@@ -478,38 +480,57 @@ ProjMap* WcsMap2::convolve(double energy, const MeanPsf & psf,
    // double cdelt_min = std::min(std::abs(m_cdelt1),std::abs(m_cdelt2));
    // npix = std::min(npix,int(std::max(1.0,2.0*psf.containmentRadius(energy,0.995))/cdelt_min));
 
-   ::Image psf_image;
-
    // Ensure the psf array size is odd in each dimension, so that the
    // center pixel corresponds to the center of the PSF.
    if (npix % 2 == 0) {
       npix -= 1;
    }
-   double refpix = static_cast<double>(npix + 1)/2.;  // refpix at center
-   double crpix[] = {refpix, refpix};
-   double crval[] = {getRefDir().ra(), getRefDir().dec()}; // actually arbitrary
-   double cdelt[] = {m_cdelt1, m_cdelt2}; // ensure same resolution as input map
-   astro::SkyProj my_proj(getProj()->projType(), crpix, crval, cdelt);
-
-   psf_image.resize(npix);
-   for (int j(0); j < npix; j++) {
-      psf_image.at(j).resize(npix, 0);
-      for (int i(0); i < npix; i++) {
-         if (my_proj.testpix2sph(i+1, j+1) == 0) {
-	    std::pair<double, double> coord = my_proj.pix2sph(i+1, j+1);
-            astro::SkyDir dir(coord.first, coord.second, 
-                              astro::SkyDir::EQUATORIAL);
-            double theta = getRefDir().difference(dir)*180./M_PI;
-            psf_image[j][i] = psf(energy, theta, 0);
+
+   // The transformed psf image only depends on the energy and the map
+   // geometry, so it is shared by all the sources convolved with this psf.
+   size_t npad(Convolve::paddedSize(m_naxis2, m_naxis1));
+   std::ostringstream key;
+   key << std::setprecision(17) << energy << " " << npix << " " << npad << " "
+       << m_cdelt1 << " " << m_cdelt2 << " " << getProj()->projType() << " "
+       << getRefDir().ra() << " " << getRefDir().dec();
+   const Convolve::PsfSpectrum * spectrum(psf.spectrumCache().find(key.str()));
+   Convolve::PsfSpectrum my_spectrum;
+
+   if (spectrum == 0) {
+      ::Image psf_image;
+
+      double refpix = static_cast<double>(npix + 1)/2.;  // refpix at center
+      double crpix[] = {refpix, refpix};
+      double crval[] = {getRefDir().ra(), getRefDir().dec()}; // actually arbitrary
+      double cdelt[] = {m_cdelt1, m_cdelt2}; // ensure same resolution as input map
+      astro::SkyProj my_proj(getProj()->projType(), crpix, crval, cdelt);
+
+      psf_image.resize(npix);
+      for (int j(0); j < npix; j++) {
+         psf_image.at(j).resize(npix, 0);
+         for (int i(0); i < npix; i++) {
+            if (my_proj.testpix2sph(i+1, j+1) == 0) {
+               std::pair<double, double> coord = my_proj.pix2sph(i+1, j+1);
+               astro::SkyDir dir(coord.first, coord.second, 
+                                 astro::SkyDir::EQUATORIAL);
+               double theta = getRefDir().difference(dir)*180./M_PI;
+               psf_image[j][i] = psf(energy, theta, 0);
+            }
          }
       }
-   }
 
-   psf_image.normalize();
+      psf_image.normalize();
+      check_negative_pixels(psf_image);
+
+      Convolve::psfSpectrum(psf_image, npad, my_spectrum);
+      spectrum = psf.spectrumCache().insert(key.str(), my_spectrum);
+      if (spectrum == 0) {
+         spectrum = &my_spectrum;
+      }
+   }
 
    check_negative_pixels(counts);
-   check_negative_pixels(psf_image);
-   my_image->m_image.push_back(Convolve::convolve2d(counts, psf_image));
+   my_image->m_image.push_back(Convolve::convolve2d(counts, *spectrum));
    return my_image;
 }
 
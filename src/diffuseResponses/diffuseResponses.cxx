@@ -14,6 +14,11 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "healpix_base.h"
 
 #include "facilities/Util.h"
 
@@ -36,11 +41,16 @@
 
 #include "Likelihood/AppHelpers.h"
 #include "Likelihood/DiffRespNames.h"
+#include "Likelihood/DiffRespTable.h"
 #include "Likelihood/DiffuseSource.h"
 #include "Likelihood/Event.h"
 #include "Likelihood/EventContainer.h"
+#include "Likelihood/MapBase.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/ResponseClones.h"
 #include "Likelihood/ScData.h"
 #include "Likelihood/SourceModel.h"
+#include "Likelihood/WcsMap2.h"
 #include "Likelihood/XmlParser.h"
 
 using XERCES_CPP_NAMESPACE_QUALIFIER DOMDocument;
@@ -63,6 +73,22 @@ namespace {
       Event::toLower(name);
       return name;
    }
+
+/// Number of events in each batch of the diffuse response calculation
+   const size_t s_batchSize(64);
+
+/// HEALPix order used to group events by direction.  Order 3 pixels
+/// are about 7 deg across.
+   const int s_batchOrder(3);
+
+/// Sort key for an event: event type, then direction, then energy.
+   typedef std::pair<std::pair<int, int>, double> EventKey_t;
+
+/// Energy nodes per decade of the diffuse response table
+   const double s_tableNodesPerDecade(8);
+
+/// Inclination nodes of the diffuse response table
+   const size_t s_tableIncNodes(9);
 } // anonymous namespace
 
 /**
@@ -86,6 +112,7 @@ public:
          delete m_srcModel;
          delete m_formatter;
          delete m_eventCont;
+         delete m_respTable;
       } catch (std::exception & eObj) {
          std::cerr << eObj.what() << std::endl;
       } catch (...) {
@@ -118,6 +145,8 @@ private:
 
    std::string m_passVer;
 
+   DiffRespTable * m_respTable;
+
    void promptForParameters();
    void testPassVersion(const std::string & evfile);
    void checkColumnVersion(const std::string & evfile) const;
@@ -130,6 +159,10 @@ private:
    void buildSourceModel();
    void readEventData(std::string eventFile);
    void computeEventResponses();
+   void computeEventResponse(Event & event, bool useDummyValue,
+                             const ResponseFunctions & respFuncs);
+   void buildResponseTable();
+   void fillMapCaches() const;
    void writeEventResponses(std::string eventFile);
    void getDiffuseSources();
    void setGaussianParams(const Event & event, const std::string & name,
@@ -150,7 +183,8 @@ diffuseResponses::diffuseResponses()
      m_pars(st_app::StApp::getParGroup("gtdiffrsp")),
      m_eventCont(0),
      m_ndifrsp(0),
-     m_passVer("") {
+     m_passVer(""),
+     m_respTable(0) {
    setVersion(s_cvs_id);
 }
 
@@ -178,6 +212,7 @@ void diffuseResponses::run() {
 
    std::vector<std::string>::const_iterator evtfile;
    buildSourceModel();
+   buildResponseTable();
    m_formatter->warn() << "Working on...\n";
    for (evtfile = eventFiles.begin(); evtfile != eventFiles.end(); ++evtfile) {
       if (evtfile->find(".gz") == evtfile->length() - 3 ||
@@ -357,6 +392,32 @@ void diffuseResponses::buildSourceModel() {
    m_srcModel->readXml(sourceModel, m_helper->funcFactory(), false, false);
 }
 
+void diffuseResponses::buildResponseTable() {
+   int order = m_pars["rsporder"];
+   if (order < 0) {
+      return;
+   }
+   std::string tableFile = m_pars["rsptable"];
+   facilities::Util::expandEnvVar(&tableFile);
+   if (tableFile == "none") {
+      tableFile = "";
+   }
+   std::pair<double, double> energies
+      = m_helper->observation().roiCuts().getEnergyCuts();
+   size_t nee(static_cast<size_t>(std::ceil(s_tableNodesPerDecade
+                                            *std::log10(energies.second
+                                                        /energies.first))) + 1);
+   m_respTable = new DiffRespTable(m_helper->observation().respFuncs(), order,
+                                   energies.first, energies.second,
+                                   std::max(nee, size_t(2)), s_tableIncNodes,
+                                   tableFile);
+   if (m_respTable->numRead() > 0) {
+      m_formatter->info() << "Read " << m_respTable->numRead()
+                          << " diffuse response nodes from " 
+                          << tableFile << std::endl;
+   }
+}
+
 void diffuseResponses::readEventData(std::string eventFile) {
    m_eventCont = new EventContainer(m_helper->observation().respFuncs(),
                                     m_helper->observation().roiCuts(),
@@ -396,32 +457,146 @@ void diffuseResponses::computeEventResponses() {
          applyClassFilter = false;
       }
    }
-   for (int i = 0; it != events.end(); ++it, i++) {
-      int factor(events.size()/20);
-      if (factor == 0) {
-         factor = 1;
+
+// Decide which events get a dummy value, because they are not in the
+// target class.
+   std::vector<bool> useDummyValue(events.size(), false);
+   for (size_t i(0); it != events.end(); ++it, i++) {
+      if (m_passVer == "NONE") {
+         useDummyValue[i] = (applyClassFilter && 
+                             (it->classLevel() < classLevel_targ));
+      } else {
+         // Apply bit-wise "and" to see if this event is part of the
+         // target class.
+         useDummyValue[i] = (applyClassFilter &&
+                             (it->classLevel() & classLevel_targ) == 0);
+      }
+   }
+   if (events.empty()) {
+      m_formatter->warn() << "!" << std::endl;
+      return;
+   }
+
+// Process the events in batches of nearby events of the same type
+// and similar energies.  The events in a batch use the same map
+// regions and IRF parameters, so the map and IRF caches work better,
+// and the batches are distributed across threads.
+   Healpix_Base hp(s_batchOrder, NEST);
+   std::vector< std::pair<EventKey_t, size_t> > order;
+   order.reserve(events.size());
+   for (size_t i(0); i < events.size(); i++) {
+      const astro::SkyDir & dir(events[i].getDir());
+      pointing ptg((90. - dir.dec())*M_PI/180., dir.ra()*M_PI/180.);
+      order.push_back(std::make_pair(std::make_pair(std::make_pair(events[i].getType(),
+                                                                   hp.ang2pix(ptg)),
+                                                    events[i].getEnergy()), i));
+   }
+   std::sort(order.begin(), order.end());
+   std::vector<size_t> bounds;
+   ParallelUtils::makeChunks(0, order.size(), s_batchSize, bounds);
+   int nbatches = static_cast<int>(bounds.size()) - 1;
+
+// Do the first event by itself.  This fills any maps or tables that
+// the sources build on first use before the threads start.
+   const ResponseFunctions & respFuncs(m_helper->observation().respFuncs());
+   size_t first(order[0].second);
+   computeEventResponse(events[first], useDummyValue[first], respFuncs);
+   fillMapCaches();
+
+// The IRF objects are not thread-safe, so each thread uses its own
+// clones of them.
+   int numthreads = m_pars["numthreads"];
+   int nthreads(ParallelUtils::numThreads(numthreads));
+   ResponseClones clones(respFuncs, nthreads);
+   int ndone(0);
+   int ndots(0);
+   std::string errorMessage;
+   double tstart(ParallelUtils::wallTime());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nthreads)
+#endif
+   for (int ibatch = 0; ibatch < nbatches; ibatch++) {
+      try {
+         for (size_t j(bounds[ibatch]); j < bounds[ibatch+1]; j++) {
+            size_t indx(order[j].second);
+            if (indx == first) {
+               continue;
+            }
+            computeEventResponse(events[indx], useDummyValue[indx],
+                                 clones.respFuncs());
+         }
+      } catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(diffuseResponses_error)
+#endif
+         errorMessage = eObj.what();
       }
-      if ((i % factor) == 0) {
-         m_formatter->warn() << ".";
+#ifdef _OPENMP
+#pragma omp critical(diffuseResponses_progress)
+#endif
+      {
+         ndone++;
+         while (ndots < (20*ndone)/nbatches) {
+            m_formatter->warn() << ".";
+            ndots++;
+         }
       }
+   }
+   if (errorMessage != "") {
+      throw std::runtime_error("diffuseResponses::computeEventResponses: "
+                               + errorMessage);
+   }
+   m_formatter->warn() << "!" << std::endl;
+   m_formatter->info(3) << "Computed responses for " << events.size()
+                        << " events in " << ParallelUtils::wallTime() - tstart
+                        << " s using " << nthreads << " thread(s)" 
+                        << std::endl;
+   if (m_respTable != 0) {
+      m_formatter->info(3) << "Diffuse response table: " 
+                           << m_respTable->numComputed() << " nodes computed, "
+                           << m_respTable->size() << " in total" << std::endl;
+      m_respTable->save();
+   }
+}
+
+void diffuseResponses::
+computeEventResponse(Event & event, bool useDummyValue,
+                     const ResponseFunctions & respFuncs) {
+   if (m_respTable == 0) {
 /// @todo Implement an accurate, faster default calculation; use Gaussian
 /// quadrature version for now.
 //       it->computeResponse(m_srcs, m_helper->observation().respFuncs(), 
 //                           m_srRadius);
-      bool useDummyValue(false);
-      if (m_passVer == "NONE") {
-         useDummyValue = (applyClassFilter && 
-                          (it->classLevel() < classLevel_targ));
-      } else {
-         // Apply bit-wise "and" to see if this event is part of the
-         // target class.
-         useDummyValue = (applyClassFilter &&
-                          (it->classLevel() & classLevel_targ) == 0);
+      event.computeResponseGQ(m_srcs, respFuncs, useDummyValue);
+      return;
+   }
+   for (size_t i(0); i < m_srcs.size(); i++) {
+      double respValue(0);
+      if (!useDummyValue) {
+         respValue = m_respTable->value(*m_srcs[i], event, respFuncs);
+      }
+      event.setDiffuseResponse(event.diffuseSrcName(m_srcs[i]->getName()),
+                               respValue);
+   }
+}
+
+void diffuseResponses::fillMapCaches() const {
+// The map-based diffuse responses read the source maps and the WCS
+// pixel solid angles on first use, so load them here rather than
+// inside the threaded loop.
+   for (size_t i(0); i < m_srcs.size(); i++) {
+      const DiffuseSource * src(m_srcs[i]);
+      const MapBase * mapBase(0);
+      try {
+         mapBase = src->mapBaseObject();
+      } catch (MapBaseException &) {
+         continue;
+      }
+      const ProjMap & projmap(mapBase->projmap());
+      if (projmap.getProj()->method() == astro::ProjBase::WCS) {
+         static_cast<const WcsMap2 &>(projmap).solidAngles();
       }
-      it->computeResponseGQ(m_srcs, m_helper->observation().respFuncs(),
-                            useDummyValue);
    }
-   m_formatter->warn() << "!" << std::endl;
 }
 
 void diffuseResponses::writeEventResponses(std::string eventFile) {
@@ -468,18 +643,30 @@ void diffuseResponses::writeEventResponses(std::string eventFile) {
 //                              << "Using existing column." << std::endl;
       }
    }
+// Look up the field names once, and gather each column before writing.
+   std::vector<std::string> fieldNames;
+   for (size_t i(0); i < m_srcNames.size(); i++) {
+      fieldNames.push_back(m_columnNames.key(diffuseSrcName(m_srcNames[i])));
+   }
+   std::vector< std::vector<double> > columns;
+   if (!m_useEdisp) {
+// Assume infinite energy resolution.
+      columns.resize(m_srcNames.size(), std::vector<double>(my_events.size()));
+      for (size_t i(0); i < m_srcNames.size(); i++) {
+         for (size_t j(0); j < my_events.size(); j++) {
+            columns[i][j] = my_events[j].diffuseResponse(1., m_srcNames[i]);
+         }
+      }
+   }
    tip::Table::Iterator it = events->begin();
    tip::Table::Record & row = *it;
    for (int j = 0 ; it != events->end(); j++, ++it) {
-      std::vector<std::string>::iterator name = m_srcNames.begin();
-      for ( ; name != m_srcNames.end(); ++name) {
-         std::string fieldName = m_columnNames.key(diffuseSrcName(*name));
+      for (size_t i(0); i < m_srcNames.size(); i++) {
          if (m_useEdisp) {
-            tip::Table::Vector<double> respParams = row[fieldName];
-            setGaussianParams(my_events[j], *name, respParams);
+            tip::Table::Vector<double> respParams = row[fieldNames[i]];
+            setGaussianParams(my_events[j], m_srcNames[i], respParams);
          } else {
-// Assume infinite energy resolution.
-            row[fieldName].set(my_events[j].diffuseResponse(1., *name));
+            row[fieldNames[i]].set(columns[i][j]);
          }
       }
    }
@@ -24,6 +24,7 @@
 #include "Likelihood/BinnedLikelihood.h"
 #include "Likelihood/CountsMapBase.h"  // EAC: switch to new base class
 #include "Likelihood/ModelMap.h"
+#include "Likelihood/PsfCache.h"
 
 /**
  * @class ModelMap
@@ -122,6 +123,9 @@ void ModelMap::computeModelMap() {
    std::vector<float> ext_model_map;
    m_logLike->computeModelMap(ext_model_map);
 
+   st_stream::StreamFormatter formatter("gtmodel", "computeModelMap", 2);
+   Likelihood::PsfCache::instance()->report(formatter);
+
    Likelihood::ModelMap modelMap(*m_logLike, &ext_model_map);
    
    std::string outfile = m_pars["outfile"];
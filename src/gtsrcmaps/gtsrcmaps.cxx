@@ -24,6 +24,8 @@
 #include "st_facilities/FitsUtil.h"
 #include "st_facilities/Util.h"
 
+#include "st_stream/StreamFormatter.h"
+
 #include "st_app/AppParGroup.h"
 #include "st_app/StApp.h"
 #include "st_app/StAppFactory.h"
@@ -44,6 +46,7 @@
 #include "Likelihood/ExposureCube.h"
 #include "Likelihood/SourceMap.h"
 #include "Likelihood/ProjMap.h"
+#include "Likelihood/PsfCache.h"
 #include "Likelihood/RoiCuts.h"
 #include "Likelihood/WcsMapLibrary.h"
 
@@ -168,6 +171,9 @@ void gtsrcmaps::run() {
 			   perform_convolution, resample, resamp_factor,
 			   minbinsz) ;
    m_binnedLikelihood->set_use_single_fixed_map(false);
+// Build the source maps together after the model is read in, so that
+// they can be computed on several threads.
+   m_binnedLikelihood->set_delay_srcmap_build(true);
 
    std::string srcModelFile = m_pars["srcmdl"];
    bool loadMaps, createAllMaps;
@@ -194,6 +200,7 @@ void gtsrcmaps::run() {
       }
       throw;
    }
+   m_binnedLikelihood->loadSourceMaps();
 
    std::string srcMapsFile = m_pars["outfile"];
 
@@ -215,6 +222,9 @@ void gtsrcmaps::run() {
 
    m_binnedLikelihood->saveSourceMaps(srcMapsFile);
 
+   st_stream::StreamFormatter formatter("gtsrcmaps", "run", 2);
+   PsfCache::instance()->report(formatter);
+
    std::auto_ptr<tip::Image>
       image(tip::IFileSvc::instance().editImage(srcMapsFile, ""));
    my_cuts.addVersionCut("IRF_VERSION", m_helper->irfsName());
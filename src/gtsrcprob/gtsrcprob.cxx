@@ -19,6 +19,7 @@
 #include <map>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 
 #include "facilities/Util.h"
 
@@ -41,6 +42,11 @@
 #include "Likelihood/DiffRespNames.h"
 #include "Likelihood/DiffuseSource.h"
 #include "Likelihood/Event.h"
+#include "Likelihood/EventTable.h"
+#include "Likelihood/ParallelUtils.h"
+#include "Likelihood/PointSource.h"
+#include "Likelihood/ResponseClones.h"
+#include "Likelihood/ResponseFunctions.h"
 #include "Likelihood/ScData.h"
 #include "Likelihood/SourceModel.h"
 
@@ -88,6 +94,13 @@ private:
    void buildSourceModel();
    void readEventData();
    void writeDensities() const;
+   void computeProbabilities(const std::vector<Event> & events,
+                             const ResponseClones & clones, int nthreads,
+                             std::vector< std::vector<double> > & probs) const;
+   void computePointSourceResponses(const std::vector<Event> & events,
+                                    const ResponseClones & clones,
+                                    int nthreads,
+                                    ResponseCache & respCache) const;
    void getSourceList();
    std::string columnName(std::string srcName) const;
 
@@ -98,6 +111,12 @@ st_app::StAppFactory<SourceProbs> myAppFactory("gtsrcprob");
 
 std::string SourceProbs::s_cvs_id("$Name$");
 
+namespace {
+/// Number of events for which the responses, densities and
+/// probabilities are held in memory at a time
+   const size_t s_blockSize(65536);
+}
+
 SourceProbs::SourceProbs() 
    : st_app::StApp(), m_helper(0), m_sourceModel(0), 
      m_formatter(new st_stream::StreamFormatter("gtsrcprob", "", 2)),
@@ -209,32 +228,163 @@ void SourceProbs::writeDensities() const {
       }
    }
 
-// Grab the names of all of the model components for the normalization 
-// calculation.
-   std::vector<std::string> srcNames;
-   m_sourceModel->getSrcNames(srcNames);
-
-// Loop over ft1 events and output file rows.
+// The events are processed in blocks, so that the responses,
+// densities and probabilities only need to be held for one block.
    const std::vector<Event> & 
       events(m_helper->observation().eventCont().events());
-
+   int numthreads = m_pars["numthreads"];
+   int nthreads(ParallelUtils::numThreads(numthreads));
+// The IRF objects are not thread-safe, so each thread uses its own
+// clones of them.
+   ResponseClones clones(m_helper->observation().respFuncs(), nthreads);
+   double tstart(ParallelUtils::wallTime());
+
+   std::vector< std::vector<double> > probs;
    tip::Table::Iterator it = evtable->begin();
    tip::Table::Record & row = *it;
-   for (size_t j(0); it != evtable->end(); j++, ++it) {
-       std::map<std::string, double> densities;
-       double normalization(0);
-       // Loop over all sources in the model to determine the normalization.
-       for (std::vector<std::string>::iterator name(srcNames.begin());
-            name != srcNames.end(); ++name) {
-          const Source & src(m_sourceModel->source(*name));
-          densities[*name] = src.fluxDensity(events.at(j));
-          normalization += densities[*name];
-       }
-       // Loop over items in the desired source list.
-       for (std::vector<std::string>::const_iterator name(m_srclist.begin());
-            name != m_srclist.end(); ++name) {
-          row[*name].set(densities[*name]/normalization);
-       }
+   for (size_t first(0); first < events.size(); first += s_blockSize) {
+      size_t last(std::min(first + s_blockSize, events.size()));
+      std::vector<Event> block(events.begin() + first, events.begin() + last);
+      computeProbabilities(block, clones, nthreads, probs);
+      for (size_t j(0); j < block.size() && it != evtable->end(); j++, ++it) {
+         for (size_t k(0); k < m_srclist.size(); k++) {
+            row[m_srclist[k]].set(probs[k][j]);
+         }
+      }
    }
    delete evtable;
+
+   m_formatter->info(3) << "Computed probabilities for " << events.size()
+                        << " events in " << ParallelUtils::wallTime() - tstart
+                        << " s using " << nthreads << " thread(s)" 
+                        << std::endl;
+}
+
+void SourceProbs::
+computeProbabilities(const std::vector<Event> & events,
+                     const ResponseClones & clones, int nthreads,
+                     std::vector< std::vector<double> > & probs) const {
+   size_t nevts(events.size());
+
+// The responses of each source to each event are stored in an
+// EventTable, so that the flux densities are spectrum times response.
+// The diffuse responses come from the FT1 file, and the point source
+// responses are computed once, on several threads.
+   ResponseCache respCache(nevts);
+   computePointSourceResponses(events, clones, nthreads, respCache);
+   EventTable table;
+   table.setEvents(events);
+   table.setSources(m_sourceModel->sources(), events, respCache);
+
+// Columns for sources that are not in the model are left at zero.
+   size_t nsrcs(table.nSources());
+   std::vector< std::vector<size_t> > columns(nsrcs);
+   for (size_t k(0); k < m_srclist.size(); k++) {
+      int isrc(table.sourceId(m_srclist[k]));
+      if (isrc >= 0) {
+         columns[isrc].push_back(k);
+      }
+   }
+   probs.assign(m_srclist.size(), std::vector<double>(nevts, 0));
+   std::vector<double> normalization(nevts, 0);
+
+   std::vector<size_t> bounds;
+   ParallelUtils::makeChunks(0, nevts, ParallelUtils::defaultChunkSize, bounds);
+   int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+   for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+      size_t first(bounds[ichunk]);
+      std::vector<double> densities(bounds[ichunk+1] - first);
+      for (size_t isrc(0); isrc < nsrcs; isrc++) {
+         if (table.responses(isrc) == 0) {
+            continue;
+         }
+         table.computeDensities(isrc, first, bounds[ichunk+1], &densities[0]);
+         for (size_t j(first); j < bounds[ichunk+1]; j++) {
+            double density(densities[j - first]);
+            normalization[j] += density;
+            for (size_t k(0); k < columns[isrc].size(); k++) {
+               probs[columns[isrc][k]][j] = density;
+            }
+         }
+      }
+   }
+
+// Sources that do not factor into spectrum times response go through
+// Source::fluxDensity and the response cache, which are not
+// thread-safe.
+   const std::map<std::string, Source *> & sources(m_sourceModel->sources());
+   std::map<std::string, Source *>::const_iterator srcIt(sources.begin());
+   for (size_t isrc(0); srcIt != sources.end(); ++srcIt, isrc++) {
+      if (table.responses(isrc) != 0) {
+         continue;
+      }
+      for (size_t j(0); j < nevts; j++) {
+         CachedResponse & cResp(respCache.getCachedValue(j, srcIt->first));
+         double density(srcIt->second->fluxDensity(events[j], &cResp));
+         normalization[j] += density;
+         for (size_t k(0); k < columns[isrc].size(); k++) {
+            probs[columns[isrc][k]][j] = density;
+         }
+      }
+   }
+
+   for (size_t k(0); k < probs.size(); k++) {
+      for (size_t j(0); j < nevts; j++) {
+         probs[k][j] /= normalization[j];
+      }
+   }
+}
+
+void SourceProbs::computePointSourceResponses(const std::vector<Event> & events,
+                                              const ResponseClones & clones,
+                                              int nthreads,
+                                              ResponseCache & respCache) const {
+   const ResponseFunctions & respFuncs(m_helper->observation().respFuncs());
+   if (respFuncs.useEdisp()) {
+// PointSource::fluxDensity reports this case.
+      return;
+   }
+   std::vector<size_t> bounds;
+   ParallelUtils::makeChunks(0, events.size(), ParallelUtils::defaultChunkSize,
+                             bounds);
+   int nchunks = bounds.size() > 1 ? static_cast<int>(bounds.size() - 1) : 0;
+   std::string errorMessage;
+   const std::map<std::string, Source *> & sources(m_sourceModel->sources());
+   std::map<std::string, Source *>::const_iterator srcIt(sources.begin());
+   for ( ; srcIt != sources.end(); ++srcIt) {
+      if (srcIt->second->srcType() != Source::Point) {
+         continue;
+      }
+      const PointSource * src(dynamic_cast<const PointSource *>(srcIt->second));
+      std::vector<CachedResponse> & 
+         cached(respCache.getCachedEventValues(srcIt->first));
+// This is the response that PointSource::fluxDensity caches.
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+      for (int ichunk = 0; ichunk < nchunks; ichunk++) {
+         try {
+            for (size_t j(bounds[ichunk]); j < bounds[ichunk+1]; j++) {
+               const Event & event(events[j]);
+               cached[j].second = clones.respFuncs()
+                  .totalResponse(event.getEnergy(), event.getEnergy(),
+                                 event.zAxis(), event.xAxis(),
+                                 src->getDir(), event.getDir(),
+                                 event.getType(), event.getArrTime());
+               cached[j].first = true;
+            }
+         } catch (std::exception & eObj) {
+#ifdef _OPENMP
+#pragma omp critical(gtsrcprob_error)
+#endif
+            errorMessage = eObj.what();
+         }
+      }
+      if (errorMessage != "") {
+         throw std::runtime_error("gtsrcprob: " + errorMessage);
+      }
+   }
 }
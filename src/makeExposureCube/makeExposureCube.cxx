@@ -217,6 +217,10 @@ void ExposureCube::createDataCube() {
    m_exposure = new Likelihood::LikeExposure(m_pars["binsz"], 
                                              m_pars["dcostheta"],
                                              timeCuts, gtis, zmax, zmin);
+   int numthreads = m_pars["numthreads"];
+   if (numthreads > 0) {
+      m_exposure->setNumThreads(numthreads);
+   }
    std::string scFile = m_pars["scfile"];
    st_facilities::Util::file_ok(scFile);
    std::vector<std::string> scFiles;
@@ -225,18 +229,13 @@ void ExposureCube::createDataCube() {
    for ( ; scIt != scFiles.end(); scIt++) {
       st_facilities::Util::file_ok(*scIt);
       formatter.err() << "Working on file " << *scIt << std::endl;
-      const tip::Table * scData = 
-         tip::IFileSvc::instance().readTable(*scIt, m_pars["sctable"],
-                                             filter.str());
-      formatter.info(4) << "read " << scData->getNumRecords() 
-                        << " rows" << std::endl;
       int chatter = m_pars["chatter"];
       bool print_output(true);
       if (chatter < 2) {
          print_output = false;
       }
-      m_exposure->load(scData, print_output);
-      delete scData;
+      std::string sctable = m_pars["sctable"];
+      m_exposure->load(*scIt, sctable, filter.str(), print_output);
    }
 
    if (m_exposure->numIntervals() == 0) {
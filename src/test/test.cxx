@@ -12,7 +12,9 @@
 
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -24,6 +26,8 @@
 #include <cppunit/extensions/HelperMacros.h>
 
 #include "CLHEP/Random/RandFlat.h"
+#include "CLHEP/Matrix/SymMatrix.h"
+#include "CLHEP/Matrix/Vector.h"
 
 #include "facilities/Util.h"
 #include "facilities/commonUtilities.h"
@@ -31,6 +35,13 @@
 #include "st_facilities/Environment.h"
 #include "st_facilities/Util.h"
 
+#include "healpix_base.h"
+
+#include "healpix/CosineBinner.h"
+#include "healpix/HealpixArray.h"
+
+#include "astro/SkyProj.h"
+
 #include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
@@ -47,28 +58,39 @@
 
 #include "irfInterface/IrfsFactory.h"
 #include "irfInterface/AcceptanceCone.h"
+#include "irfInterface/IAeff.h"
 #include "irfLoader/Loader.h"
 
+#include "Likelihood/AeffTable.h"
 #include "Likelihood/BinnedConfig.h"
 #include "Likelihood/BinnedExposure.h"
 #include "Likelihood/BinnedHealpixExposure.h"
 #include "Likelihood/BinnedLikelihood.h"
+#include "Likelihood/CompositeLikelihood.h"
 #include "Likelihood/CompositeSource.h"
+#include "Likelihood/Convolve.h"
 #include "Likelihood/CountsMap.h"
 #include "Likelihood/CountsMapHealpix.h"
 #include "Likelihood/DiffRespNames.h"
+#include "Likelihood/DiffRespTable.h"
 #include "Likelihood/DiffuseSource.h"
 #include "Likelihood/Drm.h"
+#include "Likelihood/DrmGrid.h"
 #include "Likelihood/Event.h"
 #include "Likelihood/EventContainer.h"
 #include "Likelihood/ExposureMap.h"
+#include "Likelihood/FitScanner.h"
 #include "Likelihood/FitUtils.h"
 #include "Likelihood/FluxBuilder.h"
+#include "Likelihood/HistND.h"
+#include "Likelihood/IntervalIndex.h"
 #include "Likelihood/LikeExposure.h"
+#include "Likelihood/LogLike.h"
 #include "Likelihood/LogNormal.h"
 #include "Likelihood/MeanPsf.h"
 #include "Likelihood/Observation.h"
 #include "Likelihood/PointSource.h"
+#include "Likelihood/PsfCache.h"
 #include "Likelihood/ScaleFactor.h"
 #include "Likelihood/SourceModelBuilder.h"
 #include "Likelihood/ResponseFunctions.h"
@@ -80,6 +102,7 @@
 #include "Likelihood/SourceMap.h"
 #include "Likelihood/SourceModel.h"
 #include "Likelihood/SpatialMap.h"
+#include "Likelihood/SummedLikelihood.h"
 #include "Likelihood/TrapQuad.h"
 #include "Likelihood/WcsMap2.h"
 #include "Likelihood/BandFunction.h"
@@ -122,21 +145,31 @@ class LikelihoodTests : public CppUnit::TestFixture {
    CPPUNIT_TEST(test_SourceFactory);
    CPPUNIT_TEST(test_XmlBuilders);
    CPPUNIT_TEST(test_LikeExposure);
+   CPPUNIT_TEST(test_LikeExposure_threads);
    CPPUNIT_TEST(test_SourceModel);
    CPPUNIT_TEST(test_SourceDerivs);
    CPPUNIT_TEST(test_PointSource);
+   CPPUNIT_TEST(test_LogLike_eventTable);
+   CPPUNIT_TEST(test_LogLike_threads);
    CPPUNIT_TEST(test_DiffuseSource);
    CPPUNIT_TEST(test_CountsMap);
    CPPUNIT_TEST(test_CountsMapHealpix_allsky);
    CPPUNIT_TEST(test_CountsMapHealpix_region);
    CPPUNIT_TEST(test_BinnedLikelihood);
    CPPUNIT_TEST(test_BinnedLikelihood_2);
+   CPPUNIT_TEST(test_BinnedLikelihood_threads);
+   CPPUNIT_TEST(test_BinnedLikelihood_incremental);
+   CPPUNIT_TEST(test_BinnedLikelihood_srcmaps_threads);
+   CPPUNIT_TEST(test_SummedLikelihood_threads);
+   CPPUNIT_TEST(test_CompositeLikelihood_threads);
    CPPUNIT_TEST(test_CompositeSource);
    CPPUNIT_TEST(test_MeanPsf);
+   CPPUNIT_TEST(test_PsfCache);
    CPPUNIT_TEST(test_BinnedExposure);
    CPPUNIT_TEST(test_BinnedExposureHealpix);
    CPPUNIT_TEST(test_SourceMap);
    CPPUNIT_TEST(test_PointSourceMap);
+   CPPUNIT_TEST(test_PointSourceMap_stamp);
    CPPUNIT_TEST(test_PointSourceMap_hpx_allsky);
    CPPUNIT_TEST(test_PointSourceMap_hpx_region);
    CPPUNIT_TEST(test_rescaling);
@@ -147,6 +180,10 @@ class LikelihoodTests : public CppUnit::TestFixture {
    CPPUNIT_TEST(test_Drm);
    CPPUNIT_TEST(test_Source_Npred);
    CPPUNIT_TEST(test_ExposureCube);
+   CPPUNIT_TEST(test_Convolve);
+   CPPUNIT_TEST(test_FitUtils_newton);
+   CPPUNIT_TEST(test_FitScanner_threads);
+   CPPUNIT_TEST(test_TestSourceModelCache);
 
    CPPUNIT_TEST_SUITE_END();
 
@@ -170,21 +207,31 @@ public:
    void test_SourceFactory();
    void test_XmlBuilders();
    void test_LikeExposure();
+   void test_LikeExposure_threads();
    void test_SourceModel();
    void test_SourceDerivs();
    void test_PointSource();
+   void test_LogLike_eventTable();
+   void test_LogLike_threads();
    void test_DiffuseSource();
    void test_CountsMap();
    void test_CountsMapHealpix_allsky();
    void test_CountsMapHealpix_region();
    void test_BinnedLikelihood();
    void test_BinnedLikelihood_2();
+   void test_BinnedLikelihood_threads();
+   void test_BinnedLikelihood_incremental();
+   void test_BinnedLikelihood_srcmaps_threads();
+   void test_SummedLikelihood_threads();
+   void test_CompositeLikelihood_threads();
    void test_CompositeSource();
    void test_MeanPsf();
+   void test_PsfCache();
    void test_BinnedExposure();
    void test_BinnedExposureHealpix();
    void test_SourceMap();
    void test_PointSourceMap();
+   void test_PointSourceMap_stamp();
    void test_PointSourceMap_hpx_allsky();
    void test_PointSourceMap_hpx_region();
    void test_rescaling();
@@ -195,6 +242,10 @@ public:
    void test_Drm();
    void test_Source_Npred();
    void test_ExposureCube();
+   void test_Convolve();
+   void test_FitUtils_newton();
+   void test_FitScanner_threads();
+   void test_TestSourceModelCache();
 
 private:
 
@@ -790,6 +841,75 @@ void LikelihoodTests::test_LikeExposure() {
 
    CPPUNIT_ASSERT(!LikeExposure::acceptInterval(301., 500., timeRangeCuts, 
                                                 gtis, fraction));
+
+// The sequential IntervalIndex must give the same results as
+// acceptInterval, including for intervals that are out of order.
+   gtis.insert(gtis.begin(), std::make_pair(120., 140.));
+   IntervalIndex intervalIndex(timeRangeCuts, gtis);
+   double starts[] = {100., 160., 200., 130., 301.};
+   double stops[] = {200., 260., 290., 250., 500.};
+   for (size_t i(0); i < 5; i++) {
+      double frac0, frac1;
+      bool accept0 = LikeExposure::acceptInterval(starts[i], stops[i],
+                                                  timeRangeCuts, gtis, frac0);
+      bool accept1 = intervalIndex.accept(starts[i], stops[i], frac1);
+      CPPUNIT_ASSERT(accept0 == accept1);
+      if (accept0) {
+         ASSERT_EQUALS(frac0, frac1);
+      }
+   }
+}
+
+void LikelihoodTests::test_LikeExposure_threads() {
+   srcFactoryInstance();
+   std::vector<std::pair<double, double> > timeCuts;
+   m_roiCuts->getTimeCuts(timeCuts);
+   std::vector<std::pair<double, double> > gtis;
+   m_roiCuts->getGtis(gtis);
+   if (gtis.empty()) {
+      gtis = timeCuts;
+   }
+
+// Serial fill through the tip rows
+   LikeExposure exposure0(1., 0.025, timeCuts, gtis);
+   const tip::Table * scData 
+      = tip::IFileSvc::instance().readTable(m_scFile, "SC_DATA");
+   exposure0.load(scData, false);
+   delete scData;
+
+// Serial and threaded fills from the bulk column reads
+   LikeExposure exposure1(1., 0.025, timeCuts, gtis);
+   exposure1.load(m_scFile, "SC_DATA", "", false);
+   LikeExposure exposure4(1., 0.025, timeCuts, gtis);
+   exposure4.setNumThreads(4);
+   exposure4.load(m_scFile, "SC_DATA", "", false);
+   CPPUNIT_ASSERT(exposure1.numIntervals() > 0);
+   CPPUNIT_ASSERT(exposure4.numIntervals() == exposure1.numIntervals());
+
+   const map_tools::Exposure * exposures[] = {&exposure0,
+                                              &exposure0.weightedExposure()};
+   const map_tools::Exposure * bulkExposures[] = {&exposure1,
+                                                  &exposure1.weightedExposure()};
+   const map_tools::Exposure * threadExposures[] = {&exposure4,
+                                                    &exposure4.weightedExposure()};
+   for (size_t k(0); k < 2; k++) {
+      const healpix::HealpixArray<healpix::CosineBinner> & 
+         data0(exposures[k]->data());
+      const healpix::HealpixArray<healpix::CosineBinner> & 
+         data1(bulkExposures[k]->data());
+      const healpix::HealpixArray<healpix::CosineBinner> & 
+         data4(threadExposures[k]->data());
+      CPPUNIT_ASSERT(data1.size() == data0.size());
+      CPPUNIT_ASSERT(data4.size() == data0.size());
+      for (size_t ipix(0); ipix < data0.size(); ipix++) {
+         for (size_t ibin(0); ibin < data0[ipix].size(); ibin++) {
+            double value0(data0[ipix][ibin]);
+            double tol(1e-5*std::max(std::fabs(value0), 1.));
+            CPPUNIT_ASSERT(std::fabs(data1[ipix][ibin] - value0) <= tol);
+            CPPUNIT_ASSERT(std::fabs(data4[ipix][ibin] - value0) <= tol);
+         }
+      }
+   }
 }
 
 void LikelihoodTests::test_SourceModel() {
@@ -1046,6 +1166,113 @@ void LikelihoodTests::test_PointSource() {
    CPPUNIT_ASSERT(chi2 < 20.);
 }
 
+void LikelihoodTests::test_LogLike_eventTable() {
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   std::vector<Event> events;
+   readEventData(dataPath("single_src_events_0000.fits"), m_scFile, events);
+   std::vector<Event> & roiEvents(m_eventCont->events());
+   roiEvents.clear();
+   for (size_t j(0); j < events.size(); j++) {
+      if (m_roiCuts->accept(events[j])) {
+         roiEvents.push_back(events[j]);
+      }
+   }
+   CPPUNIT_ASSERT(roiEvents.size() > 0);
+
+   LogLike like(*m_observation);
+   like.readXml(dataPath("anticenter_model_2.xml"), *m_funcFactory);
+   like.setNumThreads(0);
+
+// Per-event loops
+   like.setUseEventTable(false);
+   double value0 = like.value();
+   std::vector<double> derivs0;
+   like.getFreeDerivs(derivs0);
+   CPPUNIT_ASSERT(derivs0.size() > 0);
+
+// The columnar EventTable must reproduce them.
+   like.setUseEventTable(true);
+   ASSERT_EQUALS(like.value(), value0);
+   std::vector<double> derivs;
+   like.getFreeDerivs(derivs);
+   CPPUNIT_ASSERT(derivs.size() == derivs0.size());
+   for (size_t i(0); i < derivs0.size(); i++) {
+      ASSERT_EQUALS(derivs[i], derivs0[i]);
+   }
+
+// Also after the spectral parameters have changed.
+   std::vector<double> params;
+   like.getFreeParamValues(params);
+   for (size_t i(0); i < params.size(); i++) {
+      params[i] *= 1.1;
+   }
+   like.setFreeParamValues(params);
+   double value1 = like.value();
+   like.getFreeDerivs(derivs);
+   like.setUseEventTable(false);
+   ASSERT_EQUALS(value1, like.value());
+   like.getFreeDerivs(derivs0);
+   for (size_t i(0); i < derivs0.size(); i++) {
+      ASSERT_EQUALS(derivs[i], derivs0[i]);
+   }
+   roiEvents.clear();
+}
+
+void LikelihoodTests::test_LogLike_threads() {
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   std::vector<Event> events;
+   readEventData(dataPath("single_src_events_0000.fits"), m_scFile, events);
+   std::vector<Event> & roiEvents(m_eventCont->events());
+   roiEvents.clear();
+   for (size_t j(0); j < events.size(); j++) {
+      if (m_roiCuts->accept(events[j])) {
+         roiEvents.push_back(events[j]);
+      }
+   }
+
+   LogLike like(*m_observation);
+   like.readXml(dataPath("anticenter_model_2.xml"), *m_funcFactory);
+
+// The default comes from LIKELIHOOD_NUM_THREADS.
+   ::setenv("LIKELIHOOD_NUM_THREADS", "3", 1);
+   LogLike envLike(*m_observation);
+   ::unsetenv("LIKELIHOOD_NUM_THREADS");
+   CPPUNIT_ASSERT(envLike.numThreads() == 3);
+
+// Serial per-event loops for the reference values.
+   like.setNumThreads(0);
+   CPPUNIT_ASSERT(!like.useEventTable());
+   double value0 = like.value();
+   std::vector<double> derivs0;
+   like.getFreeDerivs(derivs0);
+
+// The chunked loops agree with them to rounding, and give identical
+// results for any number of threads.
+   like.setNumThreads(1);
+   double value1 = like.value();
+   std::vector<double> derivs1;
+   like.getFreeDerivs(derivs1);
+   ASSERT_EQUALS(value1, value0);
+   CPPUNIT_ASSERT(derivs1.size() == derivs0.size());
+   for (size_t i(0); i < derivs0.size(); i++) {
+      ASSERT_EQUALS(derivs1[i], derivs0[i]);
+   }
+   for (int nthreads(2); nthreads < 9; nthreads *= 2) {
+      like.setNumThreads(nthreads);
+      CPPUNIT_ASSERT(like.value() == value1);
+      std::vector<double> derivs;
+      like.getFreeDerivs(derivs);
+      for (size_t i(0); i < derivs.size(); i++) {
+         CPPUNIT_ASSERT(derivs[i] == derivs1[i]);
+      }
+   }
+   roiEvents.clear();
+}
+
 void LikelihoodTests::test_DiffuseSource() {
    std::string eventFile = dataPath("galdiffuse_events_0000.fits");
 
@@ -1097,6 +1324,51 @@ void LikelihoodTests::test_DiffuseSource() {
 //   CPPUNIT_ASSERT(chi2 < 6.);
 /// @todo fix this temporary kluge so that we can tag
    CPPUNIT_ASSERT(chi2 < 10.);
+
+// A diffuse response table read back from its file should give the
+// same responses without computing any nodes.
+   SourceFactory * srcFactory = srcFactoryInstance();
+   DiffuseSource * src
+      = dynamic_cast<DiffuseSource *>(srcFactory->create("Galactic Diffuse"));
+   CPPUNIT_ASSERT(src != 0);
+   std::string tableFile("diffrsp_table_test.rsp");
+   std::remove(tableFile.c_str());
+   DiffRespTable table(*m_respFuncs, 2, 30., 3e5, 9, 3, tableFile);
+   double value(table.value(*src, events[0]));
+   CPPUNIT_ASSERT(value > 0);
+   CPPUNIT_ASSERT(table.numComputed() > 0);
+   table.save();
+   DiffRespTable table2(*m_respFuncs, 2, 30., 3e5, 9, 3, tableFile);
+   CPPUNIT_ASSERT(table2.numRead() == table.size());
+   CPPUNIT_ASSERT(table2.value(*src, events[0]) == value);
+   CPPUNIT_ASSERT(table2.numComputed() == 0);
+   std::remove(tableFile.c_str());
+
+// On a fine grid, the interpolated responses agree with the direct
+// integrals.
+   DiffRespTable fineTable(*m_respFuncs, 6, 30., 3e5, 33, 11);
+   std::vector<DiffuseSource *> srcs(1, src);
+   for (size_t j(0); j < std::min(events.size(), size_t(10)); j++) {
+      Event event(events[j]);
+      event.computeResponseGQ(srcs, *m_respFuncs);
+      double direct(event.diffuseResponse(event.getEnergy(), src->getName()));
+      double tabulated(fineTable.value(*src, events[j]));
+      CPPUNIT_ASSERT(std::fabs(tabulated - direct) <= 0.05*std::fabs(direct));
+   }
+
+// Nodes are recomputed once the spatial model parameters change.
+   size_t numComputed(fineTable.numComputed());
+   fineTable.value(*src, events[0]);
+   CPPUNIT_ASSERT(fineTable.numComputed() == numComputed);
+   optimizers::Function * spatialDist 
+      = const_cast<optimizers::Function *>(src->spatialDist());
+   std::vector<double> params;
+   spatialDist->getParamValues(params);
+   params[0] *= 1.5;
+   spatialDist->setParamValues(params);
+   fineTable.value(*src, events[0]);
+   CPPUNIT_ASSERT(fineTable.numComputed() > numComputed);
+   delete src;
 }
 
 
@@ -1461,6 +1733,211 @@ void LikelihoodTests::test_BinnedLikelihood_2() {
    ASSERT_EQUALS(fit_value4, fit_value5);
 }
 
+void LikelihoodTests::test_BinnedLikelihood_threads() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap(singleSrcMap(21));
+
+   BinnedLikelihood like(dataMap, *m_observation);
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+   like.readXml(anticenter_model, *m_funcFactory);
+
+// Original serial loops.
+   like.set_num_threads(0);
+   double value0 = like.value();
+   std::vector<double> derivs0;
+   like.getFreeDerivs(derivs0);
+
+// Chunked loops must give bit-identical results for any number of
+// threads, and agree with the serial loops to rounding.
+   like.set_num_threads(1);
+   double value1 = like.value();
+   std::vector<double> derivs1;
+   like.getFreeDerivs(derivs1);
+   ASSERT_EQUALS(value1, value0);
+   CPPUNIT_ASSERT(derivs1.size() == derivs0.size());
+   for (size_t i(0); i < derivs0.size(); i++) {
+      ASSERT_EQUALS(derivs1[i], derivs0[i]);
+   }
+   for (int nthreads(2); nthreads < 9; nthreads *= 2) {
+      like.set_num_threads(nthreads);
+      CPPUNIT_ASSERT(like.value() == value1);
+      std::vector<double> derivs;
+      like.getFreeDerivs(derivs);
+      for (size_t i(0); i < derivs.size(); i++) {
+         CPPUNIT_ASSERT(derivs[i] == derivs1[i]);
+      }
+   }
+   like.set_num_threads(0);
+}
+
+void LikelihoodTests::test_BinnedLikelihood_srcmaps_threads() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap(singleSrcMap(21));
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+
+   BinnedLikelihood like0(dataMap, *m_observation);
+   like0.readXml(anticenter_model, *m_funcFactory);
+
+// Build all of the source maps at once on several threads.
+   BinnedLikelihood like1(dataMap, *m_observation);
+   like1.set_delay_srcmap_build(true);
+   like1.readXml(anticenter_model, *m_funcFactory);
+   like1.set_num_threads(4);
+   like1.loadSourceMaps();
+
+   std::vector<std::string> srcNames;
+   like0.getSrcNames(srcNames);
+   for (size_t i(0); i < srcNames.size(); i++) {
+      const std::vector<float> & model0 = like0.sourceMap(srcNames[i]).model();
+      const std::vector<float> & model1 = like1.sourceMap(srcNames[i]).model();
+      CPPUNIT_ASSERT(model1.size() == model0.size());
+      for (size_t j(0); j < model0.size(); j++) {
+         CPPUNIT_ASSERT(model1[j] == model0[j]);
+      }
+   }
+   ASSERT_EQUALS(like1.value(), like0.value());
+}
+
+void LikelihoodTests::test_SummedLikelihood_threads() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap1(singleSrcMap(21));
+   CountsMap dataMap2(singleSrcMap(11));
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+
+   BinnedLikelihood like1(dataMap1, *m_observation);
+   like1.readXml(anticenter_model, *m_funcFactory);
+   BinnedLikelihood like2(dataMap2, *m_observation);
+   like2.readXml(anticenter_model, *m_funcFactory);
+
+   SummedLikelihood summedLike;
+   summedLike.addComponent(like1);
+   summedLike.addComponent(like2);
+
+// Serial for the reference values.
+   summedLike.setNumThreads(0);
+   double value0 = summedLike.value();
+   std::vector<double> derivs0;
+   summedLike.getFreeDerivs(derivs0);
+   ASSERT_EQUALS(value0, like1.value() + like2.value());
+
+// The components are added in the same order for any number of
+// threads, so the results are identical.
+   for (int nthreads(1); nthreads < 5; nthreads *= 2) {
+      summedLike.setNumThreads(nthreads);
+      CPPUNIT_ASSERT(summedLike.value() == value0);
+      std::vector<double> derivs;
+      summedLike.getFreeDerivs(derivs);
+      CPPUNIT_ASSERT(derivs.size() == derivs0.size());
+      for (size_t i(0); i < derivs0.size(); i++) {
+         CPPUNIT_ASSERT(derivs[i] == derivs0[i]);
+      }
+   }
+}
+
+void LikelihoodTests::test_CompositeLikelihood_threads() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap1(singleSrcMap(21));
+   CountsMap dataMap2(singleSrcMap(11));
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+
+   BinnedLikelihood like1(dataMap1, *m_observation);
+   like1.readXml(anticenter_model, *m_funcFactory);
+   BinnedLikelihood like2(dataMap2, *m_observation);
+   like2.readXml(anticenter_model, *m_funcFactory);
+
+   CompositeLikelihood compositeLike;
+   compositeLike.addComponent("Crab Pulsar", like1);
+   compositeLike.addComponent("Crab Pulsar", like2);
+
+// Serial for the reference values.
+   compositeLike.setNumThreads(0);
+   double value0 = compositeLike.value();
+   std::vector<double> derivs0;
+   compositeLike.getFreeDerivs(derivs0);
+   ASSERT_EQUALS(value0, like1.value() + like2.value());
+
+// The components are combined in the same order for any number of
+// threads, so the results are identical.
+   for (int nthreads(1); nthreads < 5; nthreads *= 2) {
+      compositeLike.setNumThreads(nthreads);
+      CPPUNIT_ASSERT(compositeLike.value() == value0);
+      std::vector<double> derivs;
+      compositeLike.getFreeDerivs(derivs);
+      CPPUNIT_ASSERT(derivs.size() == derivs0.size());
+      for (size_t i(0); i < derivs0.size(); i++) {
+         CPPUNIT_ASSERT(derivs[i] == derivs0[i]);
+      }
+   }
+}
+
+void LikelihoodTests::test_BinnedLikelihood_incremental() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap(singleSrcMap(21));
+
+   BinnedLikelihood like0(dataMap, *m_observation);
+   BinnedLikelihood like1(dataMap, *m_observation);
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+   like0.readXml(anticenter_model, *m_funcFactory);
+   like1.readXml(anticenter_model, *m_funcFactory);
+   like1.set_use_incremental_model(true);
+
+   ASSERT_EQUALS(like1.value(), like0.value());
+
+// Move the free parameters one at a time, so that each evaluation
+// only updates a single source.
+   std::vector<double> params;
+   like0.getFreeParamValues(params);
+   for (size_t i(0); i < params.size(); i++) {
+      params[i] *= 1.1;
+      like0.setFreeParamValues(params);
+      like1.setFreeParamValues(params);
+      ASSERT_EQUALS(like1.value(), like0.value());
+   }
+
+// Fitting should give the same answer as well.
+   ASSERT_EQUALS(fit(like1), fit(like0));
+}
+
 void LikelihoodTests::test_MeanPsf() {
    std::string exposureCubeFile = 
       dataPath("expcube_1_day.fits");
@@ -1522,6 +1999,33 @@ void LikelihoodTests::test_MeanPsf() {
          CPPUNIT_ASSERT(fabs(my_trap.integral() - 1.) < 0.032);
       }
    }
+
+// The effective areas are tabulated once for the response functions
+// on the energies and cos(theta) bins of the livetime cube, and the
+// tabulated values are the IRF values.
+   const AeffTable & aeffTable(m_respFuncs->aeffTable());
+   std::vector<double> cosThetas;
+   m_expCube->cosThetaBins(cosThetas);
+   CPPUNIT_ASSERT(aeffTable.size() >= energies.size()*cosThetas.size());
+   irfInterface::Irfs * irfs(m_respFuncs->begin()->second);
+   irfInterface::IAeff & aeff(*irfs->aeff());
+   bool phiDependence(aeff.usePhiDependence());
+   aeff.setPhiDependence(false);
+   double epoch((m_expCube->tstart() + m_expCube->tstop())/2.);
+   for (size_t k(0); k < energies.size(); k += 5) {
+      for (size_t j(0); j < cosThetas.size(); j += 7) {
+         double inclination(std::acos(cosThetas[j])*180./M_PI);
+         CPPUNIT_ASSERT(aeffTable.value(aeff, irfs->irfID(), energies[k],
+                                        cosThetas[j], 0, epoch)
+                        == aeff.value(energies[k], inclination, 0, epoch));
+      }
+   }
+// Points off the grid are evaluated directly.
+   double cosTheta(0.9);
+   ASSERT_EQUALS(aeffTable.value(aeff, irfs->irfID(), 1.1e3, cosTheta,
+                                 0, epoch),
+                 aeff.value(1.1e3, std::acos(cosTheta)*180./M_PI, 0, epoch));
+   aeff.setPhiDependence(phiDependence);
 }
 
 void LikelihoodTests::test_BinnedExposureHealpix() {
@@ -1556,6 +2060,84 @@ void LikelihoodTests::test_BinnedExposureHealpix() {
    }
 }
 
+void LikelihoodTests::test_PsfCache() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   std::vector<double> energies;
+   for (size_t k(0); k < 10; k++) {
+      energies.push_back(100.*std::pow(10., 0.3*k));
+   }
+   astro::SkyDir dir0(83.57, 22.01);
+   astro::SkyDir dir1(83.5701, 22.0101);
+
+   PsfCache & cache(*PsfCache::instance());
+   int order(cache.order());
+
+// Exact directions: the psf is the same as a new MeanPsf.
+   cache.setOrder(-1);
+   cache.clear();
+   const MeanPsf & psf0 = cache.meanPsf(dir0, energies, *m_observation);
+   MeanPsf my_psf(dir0.ra(), dir0.dec(), energies, *m_observation);
+   for (size_t k(0); k < energies.size(); k++) {
+      ASSERT_EQUALS(psf0(energies[k], 0.5), my_psf(energies[k], 0.5));
+   }
+   CPPUNIT_ASSERT(&cache.meanPsf(dir0, energies, *m_observation) == &psf0);
+   const MeanPsf & psf_dir1 = cache.meanPsf(dir1, energies, *m_observation);
+   CPPUNIT_ASSERT(&psf_dir1 != &psf0);
+   CPPUNIT_ASSERT(cache.size() == 2);
+   CPPUNIT_ASSERT(cache.hits() == 1);
+
+// An Observation with cloned response functions shares the psf.
+   ResponseFunctions * respFuncs(m_observation->respFuncs().clone());
+   Observation * clone_obs = new Observation(*m_observation, respFuncs);
+   CPPUNIT_ASSERT(&cache.meanPsf(dir0, energies, *clone_obs) == &psf0);
+   delete clone_obs;
+   delete respFuncs;
+   CPPUNIT_ASSERT(cache.hits() == 2);
+
+// A different cube gets its own psf, even if it has the same file
+// name, as does the same cube once it has been read again.
+   ExposureCube expCube2(*m_expCube);
+   Observation obs2(m_respFuncs, m_scData, m_roiCuts, &expCube2);
+   const MeanPsf & psf_cube2 = cache.meanPsf(dir0, energies, obs2);
+   CPPUNIT_ASSERT(&psf_cube2 != &psf0);
+   cache.release(&psf_cube2);
+   m_expCube->readExposureCube(exposureCubeFile);
+   const MeanPsf & psf_reread = cache.meanPsf(dir0, energies, *m_observation);
+   CPPUNIT_ASSERT(&psf_reread != &psf0);
+   cache.release(&psf_reread);
+   CPPUNIT_ASSERT(cache.size() == 2);
+
+// The psfs are deleted when all of their users release them.
+   cache.release(&psf_dir1);
+   CPPUNIT_ASSERT(cache.size() == 1);
+   cache.release(&psf0);
+   cache.release(&psf0);
+   CPPUNIT_ASSERT(cache.size() == 1);
+   cache.release(&psf0);
+   CPPUNIT_ASSERT(cache.size() == 0);
+
+// Quantized directions: nearby sources share the psf.
+   cache.setOrder(9);
+   const MeanPsf & psf1 = cache.meanPsf(dir0, energies, *m_observation);
+   CPPUNIT_ASSERT(&cache.meanPsf(dir1, energies, *m_observation) == &psf1);
+   CPPUNIT_ASSERT(cache.size() == 1);
+   CPPUNIT_ASSERT(cache.memory_size() > 0);
+   cache.release(&psf1);
+   cache.release(&psf1);
+   CPPUNIT_ASSERT(cache.size() == 0);
+
+   cache.setOrder(order);
+   cache.clear();
+}
+
 void LikelihoodTests::test_BinnedExposure() {
    std::string exposureCubeFile = dataPath("expcube_1_day.fits");
    if (!st_facilities::Util::fileExists(exposureCubeFile)) {
@@ -1589,6 +2171,19 @@ void LikelihoodTests::test_BinnedExposure() {
       ASSERT_EQUALS(bexpmap_value,
                     map2(energies[i], ra, dec));
    }
+
+// The multithreaded map must be identical to the serial one.
+   ::setenv("LIKELIHOOD_NUM_THREADS", "4", 1);
+   BinnedExposure map3(energies, *m_observation);
+   ::unsetenv("LIKELIHOOD_NUM_THREADS");
+   CPPUNIT_ASSERT(map3.numThreads() == 4);
+   double decs[] = {-60., 0., 45., 85.};
+   for (unsigned int i = 0; i < npts; i++) {
+      for (size_t j(0); j < 4; j++) {
+         CPPUNIT_ASSERT(binnedExposure(energies[i], ra, decs[j]) ==
+                        map3(energies[i], ra, decs[j]));
+      }
+   }
 }
 
 void LikelihoodTests::test_SourceMap() {
@@ -1681,6 +2276,50 @@ void LikelihoodTests::test_PointSourceMap() {
 }
 
 
+void LikelihoodTests::test_PointSourceMap_stamp() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+   
+   CountsMap dataMap(singleSrcMap(5,80,80,0.1));
+   BinnedCountsCache dataCache(dataMap, *m_observation, 0, "dummy.fits");
+
+   SourceFactory * srcFactory = srcFactoryInstance("", "", "", false);
+   Source * src =  srcFactory->create("Crab Pulsar");
+   const astro::SkyDir & srcDir(dynamic_cast<PointSource *>(src)->getDir());
+
+   PsfIntegConfig psf_config;
+   PsfIntegConfig stamp_config;
+   stamp_config.set_use_psf_stamp(true);
+
+   SourceMap srcMap0(*src, &dataCache, *m_observation, psf_config);
+   SourceMap srcMap1(*src, &dataCache, *m_observation, stamp_config);
+
+   const std::vector<float> & model0 = srcMap0.model();
+   const std::vector<float> & model1 = srcMap1.model();
+   CPPUNIT_ASSERT(model1.size() == model0.size());
+
+   // The stamped map only drops the far tails of the psf, and
+   // interpolates the psf away from the source.
+   const std::vector<Pixel> & pixels(dataMap.pixels());
+   size_t npix(pixels.size());
+   for (size_t k(0); k < model0.size()/npix; k++) {
+      double sum0(0), sum1(0);
+      for (size_t j(0); j < npix; j++) {
+         size_t indx(k*npix + j);
+         sum0 += model0[indx];
+         sum1 += model1[indx];
+         if (pixels[j].dir().difference(srcDir)*180./M_PI < 1.0 &&
+             model0[indx] > 0) {
+            CPPUNIT_ASSERT(fabs((model1[indx] - model0[indx])/model0[indx]) < 1e-2);
+         }
+      }
+      CPPUNIT_ASSERT(fabs((sum1 - sum0)/sum0) < 1e-3);
+   }
+}
+
 void LikelihoodTests::test_PointSourceMap_hpx_allsky() {
    std::string exposureCubeFile = dataPath("expcube_1_day.fits");
    if (!st_facilities::Util::fileExists(exposureCubeFile)) {
@@ -1905,6 +2544,71 @@ void LikelihoodTests::test_Drm() {
    
    std::vector<double> meas_counts;
    drm.convolve(npreds, meas_counts);
+
+// Convolving several spectra at once should give the same answers as
+// doing them one at a time.
+   std::vector<double> npreds2(npreds.size());
+   for (size_t k(0); k < npreds.size(); k++) {
+      npreds2[k] = 2.*npreds[k]*std::pow(cmap.energies()[k]/1e3, -0.5);
+   }
+   std::vector<double> meas_counts2;
+   drm.convolve(npreds2, meas_counts2);
+
+   std::vector<const std::vector<double> *> true_list;
+   true_list.push_back(&npreds);
+   true_list.push_back(&npreds2);
+   std::vector<double> batch1, batch2;
+   std::vector<std::vector<double> *> meas_list;
+   meas_list.push_back(&batch1);
+   meas_list.push_back(&batch2);
+   drm.convolve(true_list, meas_list);
+   CPPUNIT_ASSERT(batch1 == meas_counts);
+   CPPUNIT_ASSERT(batch2 == meas_counts2);
+
+// Also when there are more spectra than fit in one block.
+   size_t nspec(40);
+   std::vector< std::vector<double> > spectra(nspec, npreds);
+   std::vector< std::vector<double> > batch(nspec);
+   true_list.clear();
+   meas_list.clear();
+   for (size_t i(0); i < nspec; i++) {
+      for (size_t k(0); k < npreds.size(); k++) {
+         spectra[i][k] *= std::pow(cmap.energies()[k]/1e3, -0.05*i);
+      }
+      true_list.push_back(&spectra[i]);
+      meas_list.push_back(&batch[i]);
+   }
+   drm.convolve(true_list, meas_list);
+   for (size_t i(0); i < nspec; i++) {
+      std::vector<double> single;
+      drm.convolve(spectra[i], single);
+      CPPUNIT_ASSERT(batch[i] == single);
+   }
+
+// A DrmGrid read back from its cache file should give the same
+// interpolated matrices as the one that computed them.
+   std::string drmGridFile("drm_grid_test.drm");
+   std::remove(drmGridFile.c_str());
+   astro::SkyDir crab(ra, dec);
+   DrmGrid grid(crab, 10., 1, *m_observation, cmap.energies(), drmGridFile);
+   CPPUNIT_ASSERT(grid.size() > 0);
+   CPPUNIT_ASSERT(grid.numRead() == 0);
+   DrmGrid grid2(crab, 10., 1, *m_observation, cmap.energies(), drmGridFile);
+   CPPUNIT_ASSERT(grid2.numRead() == grid.size());
+   CPPUNIT_ASSERT(grid.drm(crab)->matrix() == grid2.drm(crab)->matrix());
+   CPPUNIT_ASSERT(grid.drm(crab) == grid.drm(crab));
+   std::remove(drmGridFile.c_str());
+
+// Nodes computed on several threads, each with its own clones of the
+// response functions, are the same as those computed serially, and
+// nearby directions share an interpolated matrix.
+   DrmGrid serialGrid(crab, 10., 1, *m_observation, cmap.energies(), "", 1);
+   DrmGrid threadedGrid(crab, 10., 1, *m_observation, cmap.energies(), "", 4);
+   CPPUNIT_ASSERT(serialGrid.size() == threadedGrid.size());
+   CPPUNIT_ASSERT(serialGrid.drm(crab)->matrix()
+                  == threadedGrid.drm(crab)->matrix());
+   astro::SkyDir nearCrab(ra + 1e-3, dec);
+   CPPUNIT_ASSERT(serialGrid.drm(nearCrab) == serialGrid.drm(crab));
 //    for (size_t k(0); k < npreds.size(); k++) {
 //       std::cout << cmap.energies()[k] << "  "
 //                 << npreds[k] << "  "
@@ -1983,6 +2687,348 @@ void LikelihoodTests::test_ExposureCube() {
    }
 }
 
+void LikelihoodTests::test_Convolve() {
+// Compare the FFT convolution with a direct sum, for a psf that is
+// centered on its middle pixel.
+   size_t nrows(9), ncols(12), npsf(5);
+   std::vector< std::vector<double> > signal(nrows, std::vector<double>(ncols));
+   std::vector< std::vector<double> > psf(npsf, std::vector<double>(npsf));
+   for (size_t j(0); j < nrows; j++) {
+      for (size_t i(0); i < ncols; i++) {
+         signal[j][i] = 1.5 + std::sin(1.3*j + 0.7*i);
+      }
+   }
+   for (size_t j(0); j < npsf; j++) {
+      for (size_t i(0); i < npsf; i++) {
+         psf[j][i] = 0.1*(j + 1) + 0.05*i*i;
+      }
+   }
+   std::vector< std::vector<double> > 
+      result(Convolve::convolve2d(signal, psf));
+   int half(npsf/2);
+   for (int j(0); j < int(nrows); j++) {
+      for (int i(0); i < int(ncols); i++) {
+         double expected(0);
+         for (int dj(-half); dj <= half; dj++) {
+            for (int di(-half); di <= half; di++) {
+               if (j - dj >= 0 && j - dj < int(nrows) &&
+                   i - di >= 0 && i - di < int(ncols)) {
+                  expected += signal[j - dj][i - di]*psf[half + dj][half + di];
+               }
+            }
+         }
+         ASSERT_EQUALS(result[j][i], expected);
+      }
+   }
+
+// A cached psf spectrum gives the same result.
+   Convolve::SpectrumCache cache;
+   Convolve::PsfSpectrum spectrum;
+   Convolve::psfSpectrum(psf, Convolve::paddedSize(nrows, ncols), spectrum);
+   CPPUNIT_ASSERT(cache.insert("psf", spectrum) != 0);
+   CPPUNIT_ASSERT(cache.find("psf") != 0);
+   CPPUNIT_ASSERT(cache.find("other") == 0);
+   CPPUNIT_ASSERT(Convolve::convolve2d(signal, *cache.find("psf")) == result);
+}
+
+void LikelihoodTests::test_FitUtils_newton() {
+// Fit a flat background and a peaked test source at a few positions,
+// with and without a reused workspace.
+   size_t nbins(64), npos(3);
+   std::vector<float> fixed(nbins, 0.5);
+   std::vector<float> bkg(nbins, 2.);
+   std::vector< std::vector<float> > tests(npos, std::vector<float>(nbins));
+   std::vector<float> data(nbins);
+   for (size_t k(0); k < nbins; k++) {
+      for (size_t ipos(0); ipos < npos; ipos++) {
+         double dx(double(k) - 20. - 10.*ipos);
+         tests[ipos][k] = 5.*std::exp(-dx*dx/8.);
+      }
+      data[k] = std::floor(fixed[k] + 1.2*bkg[k] + 0.8*tests[1][k] 
+                           + std::sin(0.9*k) + 0.5);
+   }
+   std::vector<const std::vector<float>*> bkgTemplates(1, &bkg);
+   std::vector<const std::vector<float>*> testTemplates;
+   for (size_t ipos(0); ipos < npos; ipos++) {
+      testTemplates.push_back(&tests[ipos]);
+   }
+   CLHEP::HepVector initNorms(2);
+   initNorms[0] = 1.;
+   initNorms[1] = 0.1;
+   double tol(1e-3), lambda(0.);
+   int maxIter(30);
+
+// The single pass gradient and Hessian are the same as the original ones.
+   FitUtils::NewtonWorkspace workspace;
+   std::vector<const std::vector<float>*> templates(bkgTemplates);
+   templates.push_back(testTemplates[1]);
+   std::vector<float> model(nbins);
+   CLHEP::HepVector grad(2), grad_ws(2);
+   CLHEP::HepSymMatrix hess(2), hess_ws(2);
+   FitUtils::getGradientAndHessian(data, initNorms, templates, fixed, 0, 0,
+                                   model, grad, hess);
+   FitUtils::getGradientAndHessian(data, initNorms, templates, fixed, 0, 0,
+                                   model, grad_ws, hess_ws, workspace);
+   for (size_t i(0); i < 2; i++) {
+      CPPUNIT_ASSERT(grad[i] == grad_ws[i]);
+      for (size_t j(i); j < 2; j++) {
+         CPPUNIT_ASSERT(hess[i][j] == hess_ws[i][j]);
+      }
+   }
+
+// Fits that reuse one workspace for all of the positions are the same
+// as fits with their own scratch space.
+   std::vector<double> logLikes;
+   for (size_t ipos(0); ipos < npos; ipos++) {
+      templates.back() = testTemplates[ipos];
+      CLHEP::HepVector pars, pars_ws;
+      CLHEP::HepSymMatrix covar, covar_ws;
+      double edm, edm_ws, logLike, logLike_ws;
+      int ok = FitUtils::fitNorms_newton(data, initNorms, templates, fixed,
+                                         0, 0, tol, maxIter, lambda,
+                                         pars, covar, grad, model,
+                                         edm, logLike);
+      int ok_ws = FitUtils::fitNorms_newton(data, initNorms, templates, fixed,
+                                            0, 0, tol, maxIter, lambda,
+                                            pars_ws, covar_ws, grad_ws, model,
+                                            edm_ws, logLike_ws, workspace);
+      CPPUNIT_ASSERT(ok == 0);
+      CPPUNIT_ASSERT(ok_ws == ok);
+      CPPUNIT_ASSERT(logLike_ws == logLike);
+      CPPUNIT_ASSERT(pars_ws[0] == pars[0]);
+      CPPUNIT_ASSERT(pars_ws[1] == pars[1]);
+      logLikes.push_back(logLike);
+   }
+// The position of the injected source fits best.
+   CPPUNIT_ASSERT(logLikes[1] > logLikes[0]);
+   CPPUNIT_ASSERT(logLikes[1] > logLikes[2]);
+
+// Fit the test source normalization alone, with the background fixed,
+// at each position and in two bin ranges, one of which has no counts.
+// The batch gives the same results as the single fits, with and
+// without weights.
+   std::vector<float> bkgFixed(nbins);
+   std::vector<float> weights(nbins);
+   for (size_t k(0); k < nbins; k++) {
+      bkgFixed[k] = fixed[k] + 1.2*bkg[k];
+      weights[k] = 0.5 + 0.5*std::cos(0.1*k);
+   }
+   std::vector<float> sparseData(data);
+   std::fill(sparseData.begin() + 48, sparseData.end(), 0.);
+   size_t ranges[3][2] = {{0, 32}, {32, 0}, {48, 0}};
+   std::vector<const std::vector<float>*> batchTemplates;
+   std::vector<const std::vector<float>*> batchFixed;
+   std::vector<size_t> firstBins, lastBins;
+   std::vector<double> batchInit;
+   for (size_t ipos(0); ipos < npos; ipos++) {
+      for (size_t irange(0); irange < 3; irange++) {
+         batchTemplates.push_back(testTemplates[ipos]);
+         batchFixed.push_back(&bkgFixed);
+         firstBins.push_back(ranges[irange][0]);
+         lastBins.push_back(ranges[irange][1]);
+         batchInit.push_back(0.1);
+      }
+   }
+   FitUtils::NewtonBatchWorkspace batchWorkspace;
+   for (size_t iw(0); iw < 2; iw++) {
+      const std::vector<float> * wts(iw == 0 ? 0 : &weights);
+      std::vector<double> norms, covars, grads, edms, batchLogLikes;
+      std::vector<int> status;
+      int nfailed = FitUtils::fitNorms_newton_batch(sparseData, batchTemplates,
+                                                    batchFixed, wts,
+                                                    firstBins, lastBins,
+                                                    batchInit, tol, maxIter,
+                                                    norms, covars, grads, edms,
+                                                    batchLogLikes, status,
+                                                    batchWorkspace);
+      int nfailed_single(0);
+      for (size_t k(0); k < batchInit.size(); k++) {
+         std::vector<const std::vector<float>*> single(1, batchTemplates[k]);
+         CLHEP::HepVector init(1), pars;
+         init[0] = batchInit[k];
+         CLHEP::HepSymMatrix covar;
+         double edm, logLike;
+         int ok = FitUtils::fitNorms_newton(sparseData, init, single,
+                                            bkgFixed, 0, wts,
+                                            tol, maxIter, lambda,
+                                            pars, covar, grad, model,
+                                            edm, logLike, workspace,
+                                            firstBins[k], lastBins[k]);
+         if (ok != 0) {
+            nfailed_single++;
+         }
+         CPPUNIT_ASSERT(status[k] == ok);
+         CPPUNIT_ASSERT(norms[k] == pars[0]);
+         CPPUNIT_ASSERT(covars[k] == covar[0][0]);
+         CPPUNIT_ASSERT(grads[k] == grad[0]);
+         CPPUNIT_ASSERT(edms[k] == edm);
+         CPPUNIT_ASSERT(batchLogLikes[k] == logLike);
+      }
+      CPPUNIT_ASSERT(nfailed == nfailed_single);
+// The empty range has no signal.
+      CPPUNIT_ASSERT(norms[2] == 0);
+   }
+}
+
+void LikelihoodTests::test_FitScanner_threads() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance();
+   (void)(srcFactory);
+
+   CountsMap dataMap(singleSrcMap(5, 20, 20, 0.25));
+   std::string anticenter_model = dataPath("anticenter_model_2.xml");
+   astro::SkyDir center(83.57, 22.01);
+   int nscan(5);
+   astro::SkyProj * proj = FitScanner::buildSkyProj("CAR", center, 0.25, nscan);
+
+// A TS cube scanned on one thread and on several threads.  The
+// sub-pixel test source images use the precomputed pixel offsets.
+   const char * names[] = {"fit_ts", "fit_norm", "ts", "norm", "loglike"};
+   size_t nnames(sizeof(names)/sizeof(names[0]));
+   std::vector< std::vector<float> > results[2];
+   int num_threads[] = {0, 4};
+   for (size_t irun(0); irun < 2; irun++) {
+      BinnedLikelihood like(dataMap, *m_observation);
+      like.readXml(anticenter_model, *m_funcFactory);
+#ifdef DARWIN_F2C_FAILURE
+      optimizers::NewMinuit my_optimizer(like);
+#else
+      optimizers::Minuit my_optimizer(like);
+#endif
+      FitScanner scanner(like, my_optimizer, *proj, nscan, nscan);
+      scanner.set_testSourceSuperSample(2);
+      scanner.set_num_threads(num_threads[irun]);
+      CPPUNIT_ASSERT(scanner.setPowerlawPointTestSource(*m_funcFactory) == 0);
+      CPPUNIT_ASSERT(scanner.run_tscube(true, true, 5) == 0);
+      for (size_t i(0); i < nnames; i++) {
+         const HistND * hist = scanner.scanData(names[i]);
+         CPPUNIT_ASSERT(hist != 0);
+         results[irun].push_back(hist->data());
+      }
+   }
+   delete proj;
+
+   for (size_t i(0); i < nnames; i++) {
+      CPPUNIT_ASSERT(results[0][i].size() == results[1][i].size());
+      for (size_t j(0); j < results[0][i].size(); j++) {
+         CPPUNIT_ASSERT(std::fabs(results[0][i][j] - results[1][i][j]) 
+                        <= 1e-4*std::max(1.f, std::fabs(results[0][i][j])));
+      }
+   }
+}
+
+namespace {
+   /// Total of each energy plane of a model image
+   std::vector<double> planeTotals(const std::vector<float> & model,
+                                   size_t npix) {
+      std::vector<double> totals(model.size()/npix, 0);
+      for (size_t i(0); i < model.size(); i++) {
+         totals[i/npix] += model[i];
+      }
+      return totals;
+   }
+
+   /// Index of the largest value in an energy plane of a model image
+   size_t peakPixel(const std::vector<float> & model, size_t npix,
+                    size_t iplane) {
+      std::vector<float>::const_iterator plane(model.begin() + iplane*npix);
+      return std::max_element(plane, plane + npix) - plane;
+   }
+}
+
+void LikelihoodTests::test_TestSourceModelCache() {
+   std::string exposureCubeFile = dataPath("expcube_1_day.fits");
+   if (!st_facilities::Util::fileExists(exposureCubeFile)) {
+      generate_exposureHyperCube();
+   }
+   m_expCube->readExposureCube(exposureCubeFile);
+
+   SourceFactory * srcFactory = srcFactoryInstance("", "", "", false);
+   PointSource * src 
+      = dynamic_cast<PointSource *>(srcFactory->create("Crab Pulsar"));
+   CPPUNIT_ASSERT(src != 0);
+
+   CountsMap dataMap(singleSrcMap(11));
+   BinnedLikelihood like(dataMap, *m_observation);
+   const astro::ProjBase & proj(dataMap.projection());
+   size_t npix(dataMap.imageDimension(0)*dataMap.imageDimension(1));
+   std::pair<double, double> refPix(src->getDir().project(proj));
+
+   TestSourceModelCache wholeCache(like, *src, 1);
+   TestSourceModelCache subCache(like, *src, 2);
+   size_t nbins(dataMap.data().size());
+   std::vector<float> whole(nbins), sub(nbins), scanned(nbins);
+
+// A shift by a whole number of pixels uses the reference image with
+// zero sub-pixel offset, so it matches the integer shift.
+   astro::SkyDir shifted(refPix.first + 2., refPix.second - 1., proj, false);
+   wholeCache.translateMap(shifted, whole);
+   subCache.translateMap(shifted, sub);
+   float peak(*std::max_element(whole.begin(), whole.end()));
+   for (size_t i(0); i < nbins; i++) {
+      CPPUNIT_ASSERT(std::fabs(sub[i] - whole[i]) <= 1e-4*peak);
+   }
+
+// The offsets precomputed for the threaded scan give the same image.
+   subCache.setScanDirs(std::vector<astro::SkyDir>(1, shifted));
+   subCache.translateMap(shifted, scanned, 0);
+   CPPUNIT_ASSERT(scanned == sub);
+
+// A half-pixel shift moves the source, but conserves the flux in each
+// energy plane where the psf is contained in the map.
+   astro::SkyDir halfShifted(refPix.first + 0.5, refPix.second, proj, false);
+   subCache.translateMap(halfShifted, sub);
+   wholeCache.translateMap(src->getDir(), whole);
+   std::vector<double> totals(planeTotals(whole, npix));
+   std::vector<double> halfTotals(planeTotals(sub, npix));
+   for (size_t k(0); k < totals.size(); k++) {
+      if (like.energies()[k] >= 1e3) {
+         CPPUNIT_ASSERT(std::fabs(halfTotals[k]/totals[k] - 1.) < 0.01);
+      }
+   }
+   CPPUNIT_ASSERT(sub != whole);
+
+// HEALPix: the image is rotated so that the peak is at the pixel of
+// the new direction, and a zero rotation gives back the reference image.
+   CountsMapHealpix hpxMap(healpixmap_region());
+   BinnedLikelihood hpxLike(hpxMap, *m_observation);
+   TestSourceModelCache hpxCache(hpxLike, *src, 1);
+   size_t nhpx(hpxMap.nPixels());
+   size_t nhpxBins(hpxMap.data().size());
+   size_t lastPlane(nhpxBins/nhpx - 1);
+   std::vector<float> rotated(nhpxBins), unrotated(nhpxBins);
+
+   const Healpix_Base & hp(hpxMap.healpixProj()->healpix());
+   astro::SkyDir offset(src->getDir().ra(), src->getDir().dec() + 1.);
+   double lon(hpxMap.isGalactic() ? offset.l() : offset.ra());
+   double lat(hpxMap.isGalactic() ? offset.b() : offset.dec());
+   int newPix(hp.ang2pix(pointing((90. - lat)*M_PI/180., lon*M_PI/180.)));
+   pointing center(hp.pix2ang(newPix));
+   lon = center.phi*180./M_PI;
+   lat = 90. - center.theta*180./M_PI;
+   astro::SkyDir newDir(lon, lat, hpxMap.isGalactic() ? 
+                        astro::SkyDir::GALACTIC : astro::SkyDir::EQUATORIAL);
+
+   hpxCache.translateMap(newDir, rotated);
+   size_t ipeak(peakPixel(rotated, nhpx, lastPlane));
+   CPPUNIT_ASSERT(hpxMap.localToGlobalIndex(ipeak) == newPix);
+
+   std::vector<float> reference(nhpxBins);
+   FitUtils::extractModelFromSource(*src, hpxLike, reference, true);
+   hpxCache.translateMap(src->getDir(), unrotated);
+   float hpxPeak(*std::max_element(reference.begin(), reference.end()));
+   for (size_t i(0); i < nhpxBins; i++) {
+      CPPUNIT_ASSERT(std::fabs(unrotated[i] - reference[i]) <= 1e-4*hpxPeak);
+   }
+
+   delete src;
+}
+
 void LikelihoodTests::readEventData(const std::string &eventFile,
                                     const std::string &scDataFile,
                                     std::vector<Event> &events) {